@@ -0,0 +1,268 @@
+﻿#ifndef SANAE_NEURALNETWORK_MATRIX_ALLOCATOR
+#define SANAE_NEURALNETWORK_MATRIX_ALLOCATOR
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+/**
+ * @brief 先頭アドレスを Alignment バイト境界に揃えるアロケータ
+ * @tparam T 要素型
+ * @tparam Alignment アライメント(バイト)。2の累乗である必要があります。デフォルトは64(キャッシュライン)。
+ * @tparam Padded trueの場合、Matrixのコンテナとして使用したときに各行(列優先の場合は各列)の先頭も Alignment バイト境界に揃えます。
+ */
+template<typename T, std::size_t Alignment = 64, bool Padded = false>
+struct AlignedAllocator {
+	static_assert(Alignment != 0 && (Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two.");
+	static_assert(Alignment >= alignof(T), "Alignment must not be smaller than alignof(T).");
+
+	using value_type = T;
+	static constexpr std::size_t alignment = Alignment;
+	static constexpr bool padded = Padded;
+
+	template<typename U>
+	struct rebind {
+		using other = AlignedAllocator<U, Alignment, Padded>;
+	};
+
+	AlignedAllocator() noexcept = default;
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment, Padded>&) noexcept {}
+
+	T* allocate(std::size_t n) {
+		if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+			throw std::bad_array_new_length();
+
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+	}
+	void deallocate(T* p, std::size_t) noexcept {
+		::operator delete(p, std::align_val_t(Alignment));
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, Alignment, Padded>&) const noexcept { return true; }
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment, Padded>&) const noexcept { return false; }
+};
+
+/// 先頭アドレスのみを Alignment バイト境界に揃えたstd::vector
+template<typename T, std::size_t Alignment = 64>
+using AlignedVector = std::vector<T, AlignedAllocator<T, Alignment>>;
+
+/// 各行(列優先の場合は各列)の先頭を Alignment バイト境界に揃えるため、リーディングディメンションをパディングするstd::vector
+template<typename T, std::size_t Alignment = 64>
+using PaddedVector = std::vector<T, AlignedAllocator<T, Alignment, true>>;
+
+namespace MatrixMemory {
+	namespace detail {
+		inline std::pmr::memory_resource*& current_slot() noexcept {
+			thread_local std::pmr::memory_resource* resource = nullptr;
+			return resource;
+		}
+	}
+
+	/**
+	 * @brief このスレッドで新しく作る行列が格納領域を確保するメモリリソースを取得します。
+	 * @return Scope で指定したリソース。指定されていない場合は std::pmr::get_default_resource()
+	 */
+	inline std::pmr::memory_resource* current() noexcept {
+		std::pmr::memory_resource* resource = detail::current_slot();
+		return resource ? resource : std::pmr::get_default_resource();
+	}
+
+	/**
+	 * @brief 生存期間中、このスレッドで新しく作る行列の確保先を resource に切り替えます。(入れ子にできます)
+	 * @note 既存の行列の格納領域は作ったときのリソースのまま変わりません。スレッドプールの他のスレッドには影響しません。
+	 */
+	class Scope {
+	private:
+		std::pmr::memory_resource* _previous;
+
+	public:
+		explicit Scope(std::pmr::memory_resource* resource) noexcept : _previous(detail::current_slot()) {
+			detail::current_slot() = resource;
+		}
+		~Scope() { detail::current_slot() = _previous; }
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+}
+
+/**
+ * @brief 構築時にこのスレッドの MatrixMemory::current() を取り込み、そこから確保するアロケータ
+ * @tparam T 要素型
+ * @note std::pmr::polymorphic_allocator と同様に、コピー・ムーブ代入ではリソースを引き継ぎません (代入先のリソースに要素をコピーします)。
+ *       polymorphic_allocator と異なり、コンテナのコピー構築でもコピー元ではなく現在のリソースを使います。
+ */
+template<typename T>
+class MatrixAllocator {
+private:
+	std::pmr::memory_resource* _resource;
+
+public:
+	using value_type = T;
+
+	MatrixAllocator() noexcept : _resource(MatrixMemory::current()) {}
+	MatrixAllocator(std::pmr::memory_resource* resource) noexcept : _resource(resource) {}
+	template<typename U>
+	MatrixAllocator(const MatrixAllocator<U>& other) noexcept : _resource(other.resource()) {}
+
+	T* allocate(std::size_t n) {
+		if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+			throw std::bad_array_new_length();
+
+		return static_cast<T*>(_resource->allocate(n * sizeof(T), alignof(T)));
+	}
+	void deallocate(T* p, std::size_t n) noexcept {
+		_resource->deallocate(p, n * sizeof(T), alignof(T));
+	}
+
+	MatrixAllocator select_on_container_copy_construction() const noexcept { return MatrixAllocator(); }
+	std::pmr::memory_resource* resource() const noexcept { return _resource; }
+
+	template<typename U>
+	bool operator==(const MatrixAllocator<U>& other) const noexcept { return *_resource == *other.resource(); }
+	template<typename U>
+	bool operator!=(const MatrixAllocator<U>& other) const noexcept { return !(*this == other); }
+};
+
+/// Matrix の既定のコンテナ。MatrixMemory::Scope で確保先を切り替えられるstd::vector
+template<typename T>
+using MatrixVector = std::vector<T, MatrixAllocator<T>>;
+
+/**
+ * @brief 確保した領域を reset() でまとめて再利用する単調増加のメモリリソース
+ * @note 解放 (deallocate) は何もしません。reset() の時点で、このリソースから確保した行列はすべて破棄されている必要があります。
+ *       1回の reset() の間に複数のチャンクを使った場合は、次の reset() で合計サイズの1つのチャンクにまとめるため、
+ *       同じ大きさの確保を繰り返す処理 (学習の1ステップなど) は2回目以降、上流のリソースから確保しません。
+ *       スレッドセーフではありません。MatrixMemory::Scope で1つのスレッドから使います。
+ */
+class MatrixArena : public std::pmr::memory_resource {
+private:
+	struct Chunk {
+		std::byte* data;
+		std::size_t size;
+	};
+
+	/// 各確保の先頭を揃える境界 (キャッシュライン)
+	static constexpr std::size_t _block_alignment = 64;
+	static constexpr std::size_t _min_chunk_size = 64 * 1024;
+
+	std::pmr::memory_resource* _upstream;
+	std::vector<Chunk> _chunks;
+	std::size_t _current = 0;   ///< 使用中のチャンク
+	std::size_t _offset = 0;    ///< 使用中のチャンク内の次の確保位置
+	std::size_t _used = 0;      ///< 前回の reset() 以降に確保したバイト数
+	std::size_t _upstream_allocations = 0;
+
+	void _add_chunk(std::size_t size) {
+		std::byte* data = static_cast<std::byte*>(_upstream->allocate(size, _block_alignment));
+		try {
+			_chunks.push_back({ data, size });
+		}
+		catch (...) {
+			_upstream->deallocate(data, size, _block_alignment);
+			throw;
+		}
+		_upstream_allocations++;
+	}
+
+protected:
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+		alignment = std::max(alignment, _block_alignment);
+		bytes = std::max<std::size_t>(bytes, 1);
+
+		while (_current < _chunks.size()) {
+			const Chunk& chunk = _chunks[_current];
+			const std::size_t begin = (_offset + alignment - 1) / alignment * alignment;
+			if (begin <= chunk.size && bytes <= chunk.size - begin) {
+				_offset = begin + bytes;
+				_used += bytes;
+				return chunk.data + begin;
+			}
+
+			// 残りのチャンク (reset() 前に確保したもの) を順に使う
+			_current++;
+			_offset = 0;
+		}
+
+		// 足りない場合は直前のチャンクの2倍以上の大きさで追加する
+		const std::size_t last = _chunks.empty() ? 0 : _chunks.back().size;
+		const std::size_t needed = bytes + alignment;
+		_add_chunk(std::max({ needed, 2 * last, _min_chunk_size }));
+		_current = _chunks.size() - 1;
+		_offset = 0;
+		return do_allocate(bytes, alignment);
+	}
+	void do_deallocate(void*, std::size_t, std::size_t) override {}
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+public:
+	/**
+	 * @param initial_size 最初に確保するチャンクのサイズ(バイト)。0の場合は最初の確保時に確保します。
+	 * @param upstream チャンクを確保する上流のリソース
+	 */
+	explicit MatrixArena(std::size_t initial_size = 0, std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+		: _upstream(upstream)
+	{
+		if (initial_size != 0)
+			_add_chunk(initial_size);
+	}
+	~MatrixArena() override { release(); }
+
+	MatrixArena(const MatrixArena&) = delete;
+	MatrixArena& operator=(const MatrixArena&) = delete;
+
+	/**
+	 * @brief 確保した領域をすべて未使用に戻します。チャンクは上流に返さずに再利用します。
+	 * @note 複数のチャンクを使っていた場合は、合計サイズの1つのチャンクに置き換えます。
+	 */
+	void reset() {
+		if (_chunks.size() > 1) {
+			std::size_t total = 0;
+			for (const Chunk& chunk : _chunks)
+				total += chunk.size;
+
+			release();
+			_add_chunk(total);
+		}
+		_current = 0;
+		_offset = 0;
+		_used = 0;
+	}
+
+	/**
+	 * @brief すべてのチャンクを上流のリソースに返します。
+	 */
+	void release() noexcept {
+		for (const Chunk& chunk : _chunks)
+			_upstream->deallocate(chunk.data, chunk.size, _block_alignment);
+		_chunks.clear();
+		_current = 0;
+		_offset = 0;
+		_used = 0;
+	}
+
+	/// 前回の reset() 以降に確保したバイト数 (アライメントの詰め物を除く)
+	std::size_t used() const noexcept { return _used; }
+	/// 上流から確保済みのバイト数の合計
+	std::size_t capacity() const noexcept {
+		std::size_t total = 0;
+		for (const Chunk& chunk : _chunks)
+			total += chunk.size;
+		return total;
+	}
+	/// 上流のリソースからチャンクを確保した回数の累計
+	std::size_t upstream_allocations() const noexcept { return _upstream_allocations; }
+};
+
+// コンテナのパディング幅(バイト)取得用の型。0の場合はパディングしない
+template<typename T> struct container_padding { static constexpr std::size_t value = 0; };
+template<typename T, std::size_t Alignment>
+struct container_padding<std::vector<T, AlignedAllocator<T, Alignment, true>>> { static constexpr std::size_t value = Alignment; };
+
+#endif // SANAE_NEURALNETWORK_MATRIX_ALLOCATOR
\ No newline at end of file
@@ -0,0 +1,394 @@
+﻿#ifndef SANAE_NEURALNETWORK_MATRIX_BACKEND
+#define SANAE_NEURALNETWORK_MATRIX_BACKEND
+
+#include "blasgemm.h"
+#include "matrix.h"
+#include "nativegemm.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief 行列積・axpy・scal を計算する実装 (プロバイダ) を実行時に選ぶレジストリ
+ *
+ * 要素型ごとに Registry<T> があり、ネイティブの実装 ("native") と、コンパイル時に有効にしたBLAS
+ * ("openblas", "cublas", "clblast") が最初から登録されています。add() で他の実装も登録できます。
+ *
+ * use_blas = true の行列演算は呼び出しごとに次の順序でプロバイダを選びます。
+ *   1. set_provider() で指定された名前
+ *   2. 環境変数 SANAE_BLAS (native, openblas などのプロバイダ名。auto または未設定の場合は指定なし)
+ *   3. コストモデルで見積もった実行時間が最も短いプロバイダ
+ * 指定された名前のプロバイダがその要素型・演算に対応していない場合はコストモデルで選びます。
+ * use_blas = false の場合はレジストリを参照せず、常にネイティブの実装で計算します。
+ *
+ * コストモデルは 呼び出し1回あたりの固定費 + 演算量 / 演算のスループット + 転送量 / 転送のスループット で、
+ * 小さな積ではスレッドの起動やデバイスへの転送の固定費が大きいネイティブ以外の実装を避けます。
+ * 既定の係数はおおよその値です。calibrate() で実行環境で測った値に置き換えられます。
+ *
+ * @note プロバイダの登録・set_provider()・calibrate() は、行列演算を実行していない間に呼び出す必要があります。
+ */
+namespace Backend {
+	/// プロバイダを選ぶ演算の種類
+	enum class Routine { Gemm, Axpy, Scal };
+
+	/**
+	 * @brief 実行時間の見積もり。単位はナノ秒、演算のスループットは GFLOP/s、転送のスループットは GB/s です。
+	 */
+	struct CostModel {
+		double latency_ns = 0;    ///< 呼び出し1回あたりの固定費 (スレッドの起動、デバイスとの同期など)
+		double flops_per_ns = 1;  ///< 演算のスループット
+		double bytes_per_ns = 0;  ///< オペランドの転送のスループット。0の場合は転送の時間を含めない
+
+		double estimate(double flops, double bytes) const noexcept {
+			return latency_ns + flops / flops_per_ns + (bytes_per_ns > 0 ? bytes / bytes_per_ns : 0.0);
+		}
+	};
+
+	/// C = alpha * op(A) * op(B) + beta * C (引数は NativeGemm::MatMul::multiply と同じ)
+	template<typename T>
+	using GemmFunc = void (*)(const T*, const T*, T*, size_t, size_t, size_t, bool, bool, bool, bool, T, T, size_t, size_t, size_t);
+	/// 同じ形状の行列積をまとめて計算する関数 (引数は NativeGemm::BatchedMatMul::multiply と同じ)
+	template<typename T>
+	using BatchedGemmFunc = void (*)(const T*, size_t, const T*, size_t, T*, size_t, size_t, size_t, size_t, size_t, bool, bool, bool, bool, T, T, size_t, size_t, size_t);
+	/// y = alpha * x + y
+	template<typename T>
+	using AxpyFunc = void (*)(size_t n, T alpha, const T* x, T* y);
+	/// x = alpha * x
+	template<typename T>
+	using ScalFunc = void (*)(size_t n, T alpha, T* x);
+
+	/**
+	 * @brief 行列演算の実装
+	 * @note 対応していない演算の関数は nullptr にします。gemm_batched が nullptr の場合は gemm を順に呼び出します。
+	 */
+	template<typename T>
+	struct Provider {
+		std::string name;
+		bool native = false; ///< ネイティブの実装かどうか。選ばれた場合は呼び出し元の実行ポリシーや GemmAlgorithm に従って計算します。
+		GemmFunc<T> gemm = nullptr;
+		BatchedGemmFunc<T> gemm_batched = nullptr;
+		AxpyFunc<T> axpy = nullptr;
+		ScalFunc<T> scal = nullptr;
+		CostModel gemm_cost;   ///< 行列積の見積もり
+		CostModel vector_cost; ///< axpy の見積もり
+		CostModel scal_cost;   ///< scal の見積もり
+
+		bool supports(Routine routine) const noexcept {
+			switch (routine) {
+			case Routine::Gemm: return gemm != nullptr;
+			case Routine::Axpy: return axpy != nullptr;
+			case Routine::Scal: return scal != nullptr;
+			}
+			return false;
+		}
+
+		/**
+		 * @brief 実行時間を見積もります。
+		 * @param m, n, k 行列積の場合は M, N, K。axpy, scal の場合は m が要素数で、n, k は使いません。
+		 */
+		double cost(Routine routine, size_t m, size_t n = 1, size_t k = 1) const noexcept {
+			const double size = static_cast<double>(sizeof(T));
+			if (routine == Routine::Gemm) {
+				const double M = static_cast<double>(m), N = static_cast<double>(n), K = static_cast<double>(k);
+				return gemm_cost.estimate(2 * M * N * K, (M * K + K * N + M * N) * size);
+			}
+			const double count = static_cast<double>(m);
+			return routine == Routine::Axpy
+				? vector_cost.estimate(2 * count, 3 * count * size)
+				: scal_cost.estimate(count, 2 * count * size);
+		}
+	};
+
+	namespace detail {
+		/// 環境変数 SANAE_BLAS で指定されたプロバイダ名 (指定がなければ空)
+		inline std::string initial_provider() {
+			const char* env = std::getenv("SANAE_BLAS");
+			if (env == nullptr || std::string_view(env) == "auto")
+				return {};
+			return env;
+		}
+
+		inline std::string& provider_state() {
+			static std::string state = initial_provider();
+			return state;
+		}
+
+		template<typename T>
+		void native_gemm(const T* A, const T* B, T* C, size_t M, size_t N, size_t K, bool AMajor, bool BMajor, bool TransA, bool TransB, T alpha, T beta, size_t lda, size_t ldb, size_t ldc) {
+			NativeGemm::MatMul<T>::multiply(A, B, C, M, N, K, AMajor, BMajor, TransA, TransB, alpha, beta, lda, ldb, ldc);
+		}
+
+		template<typename T>
+		void native_axpy(size_t n, T alpha, const T* x, T* y) {
+			if constexpr (SimdKernel::vectorizable_v<T>)
+				SimdKernel::axpy(n, alpha, x, y);
+			else
+				for (size_t i = 0; i < n; i++)
+					y[i] += alpha * x[i];
+		}
+
+		template<typename T>
+		void native_scal(size_t n, T alpha, T* x) {
+			if constexpr (SimdKernel::vectorizable_v<T>)
+				SimdKernel::binary_scalar<SimdKernel::Op::Mul>(static_cast<const T*>(x), alpha, x, n);
+			else
+				for (size_t i = 0; i < n; i++)
+					x[i] *= alpha;
+		}
+
+		/**
+		 * @brief 最初から登録するプロバイダ
+		 */
+		template<typename T>
+		std::vector<Provider<T>> builtin_providers() {
+			std::vector<Provider<T>> providers;
+
+			Provider<T> native;
+			native.name = "native";
+			native.native = true;
+			if constexpr (std::is_arithmetic_v<T> || is_float16_v<T>) {
+				native.gemm = &native_gemm<T>;
+				native.gemm_batched = &NativeGemm::BatchedMatMul<T>::multiply;
+			}
+			native.axpy = &native_axpy<T>;
+			native.scal = &native_scal<T>;
+			// 既定の係数は1スレッドで測った値に近いもの (calibrate() で置き換えられる)
+			native.gemm_cost = { 100, 8, 0 };
+			native.vector_cost = { 10, 30, 0 };
+			native.scal_cost = { 10, 30, 0 };
+			providers.push_back(std::move(native));
+
+#if defined(USE_BLAS)
+			if constexpr (can_use_blas<T>::value) {
+				Provider<T> blas;
+				blas.gemm = &BlasGemm::MatMul<T>::multiply;
+				blas.gemm_batched = &BlasGemm::BatchedMatMul<T>::multiply;
+				blas.axpy = &BlasGemm::Add<T>::axpy;
+				blas.scal = &BlasGemm::ScalarMul<T>::scal;
+#if defined(USE_CUBLAS)
+				// 呼び出しごとにデバイスとの間でオペランドを転送する
+				blas.name = "cublas";
+				blas.gemm_cost = { 30000, 4000, 12 };
+				blas.vector_cost = { 30000, 4000, 12 };
+				blas.scal_cost = { 30000, 4000, 12 };
+#elif defined(USE_CLBLAST)
+				blas.name = "clblast";
+				blas.gemm_cost = { 50000, 1000, 12 };
+				blas.vector_cost = { 50000, 1000, 12 };
+				blas.scal_cost = { 50000, 1000, 12 };
+#else
+				// 行列積はネイティブより速く、axpy, scal はネイティブのSIMDカーネルの方が速い
+				blas.name = "openblas";
+				blas.gemm_cost = { 150, 16, 0 };
+				blas.vector_cost = { 20, 25, 0 };
+				blas.scal_cost = { 20, 25, 0 };
+#endif
+				providers.push_back(std::move(blas));
+			}
+#endif
+			return providers;
+		}
+
+		/**
+		 * @brief func() の実行時間の最小値をナノ秒で測ります。
+		 */
+		template<typename Func>
+		double measure_ns(Func&& func, size_t repeat) {
+			double best = std::numeric_limits<double>::infinity();
+			for (size_t i = 0; i < repeat; i++) {
+				const auto begin = std::chrono::steady_clock::now();
+				func();
+				const auto end = std::chrono::steady_clock::now();
+				best = std::min(best, std::chrono::duration<double, std::nano>(end - begin).count());
+			}
+			return best;
+		}
+
+		/**
+		 * @brief 小さい演算と大きい演算の実行時間から固定費とスループットを求めます。
+		 */
+		inline CostModel fit(double small_flops, double small_ns, double large_flops, double large_ns) {
+			CostModel model;
+			model.flops_per_ns = (large_flops - small_flops) / std::max(large_ns - small_ns, 1.0);
+			model.latency_ns = std::max(small_ns - small_flops / model.flops_per_ns, 0.0);
+			model.bytes_per_ns = 0; // 転送の時間は測った時間に含まれる
+			return model;
+		}
+	}
+
+	/**
+	 * @brief 要素型 T のプロバイダのレジストリ
+	 */
+	template<typename T>
+	class Registry {
+	private:
+		std::vector<Provider<T>> _providers;
+
+		Registry() : _providers(detail::builtin_providers<T>()) {}
+
+	public:
+		static Registry& instance() {
+			static Registry registry;
+			return registry;
+		}
+
+		/**
+		 * @brief プロバイダを登録します。同じ名前のプロバイダがある場合は置き換えます。
+		 * @throws std::invalid_argument 名前が空、または "native" を置き換えようとした場合
+		 */
+		void add(Provider<T> provider) {
+			if (provider.name.empty() || provider.name == "auto")
+				throw std::invalid_argument("Provider name must not be empty or \"auto\".");
+			if (provider.name == "native")
+				throw std::invalid_argument("The native provider cannot be replaced.");
+
+			provider.native = false;
+			for (Provider<T>& p : _providers) {
+				if (p.name == provider.name) {
+					p = std::move(provider);
+					return;
+				}
+			}
+			_providers.push_back(std::move(provider));
+		}
+
+		/**
+		 * @brief プロバイダの登録を解除します。
+		 * @return 解除した場合は true、その名前のプロバイダがない場合は false
+		 * @throws std::invalid_argument "native" を解除しようとした場合
+		 */
+		bool remove(std::string_view name) {
+			if (name == "native")
+				throw std::invalid_argument("The native provider cannot be removed.");
+
+			const auto it = std::find_if(_providers.begin(), _providers.end(), [&](const Provider<T>& p) { return p.name == name; });
+			if (it == _providers.end())
+				return false;
+			_providers.erase(it);
+			return true;
+		}
+
+		/**
+		 * @brief 名前でプロバイダを探します。
+		 * @return 見つからない場合は nullptr
+		 */
+		Provider<T>* find(std::string_view name) noexcept {
+			for (Provider<T>& p : _providers)
+				if (p.name == name)
+					return &p;
+			return nullptr;
+		}
+
+		/// 登録されているプロバイダ。先頭は常にネイティブの実装です。
+		const std::vector<Provider<T>>& providers() const noexcept { return _providers; }
+
+		/**
+		 * @brief 演算に使うプロバイダを選びます。
+		 * @param m, n, k Provider::cost と同じです。
+		 * @return 選んだプロバイダ。どのプロバイダも対応していない場合はネイティブの実装を返します。
+		 */
+		const Provider<T>& select(Routine routine, size_t m, size_t n = 1, size_t k = 1) const noexcept {
+			const std::string& forced = detail::provider_state();
+			if (!forced.empty()) {
+				for (const Provider<T>& p : _providers)
+					if (p.name == forced && p.supports(routine))
+						return p;
+			}
+
+			const Provider<T>* best = &_providers.front();
+			double best_cost = std::numeric_limits<double>::infinity();
+			for (const Provider<T>& p : _providers) {
+				if (!p.supports(routine))
+					continue;
+				const double cost = p.cost(routine, m, n, k);
+				if (cost < best_cost) {
+					best = &p;
+					best_cost = cost;
+				}
+			}
+			return *best;
+		}
+
+		/**
+		 * @brief 各プロバイダの行列積と axpy, scal の実行時間を測り、コストモデルの係数を置き換えます。
+		 * @param small, large 行列積を測る正方行列の大きさ。axpy, scal は small^2, large^2 要素で測ります。
+		 * @note 大きい方の演算はネイティブの実装でも数ミリ秒かかります。プログラムの開始時に1回だけ呼び出してください。
+		 */
+		void calibrate(size_t small = 16, size_t large = 256) {
+			if (small == 0 || large <= small)
+				throw std::invalid_argument("Calibration sizes must satisfy 0 < small < large.");
+
+			std::vector<T> a(large * large, T(1)), b(large * large, T(1)), c(large * large, T(0));
+			const double small_gemm = 2.0 * small * small * small, large_gemm = 2.0 * large * large * large;
+			const double small_vec = static_cast<double>(small * small), large_vec = static_cast<double>(large * large);
+
+			for (Provider<T>& p : _providers) {
+				if (p.gemm != nullptr) {
+					auto run = [&](size_t s) {
+						return detail::measure_ns([&] { p.gemm(a.data(), b.data(), c.data(), s, s, s, true, true, false, false, T(1), T(0), 0, 0, 0); }, 5);
+					};
+					p.gemm(a.data(), b.data(), c.data(), small, small, small, true, true, false, false, T(1), T(0), 0, 0, 0); // 初回の初期化を除く
+					p.gemm_cost = detail::fit(small_gemm, run(small), large_gemm, run(large));
+				}
+				if (p.axpy != nullptr) {
+					auto run = [&](size_t n) {
+						return detail::measure_ns([&] { p.axpy(n, T(1), a.data(), c.data()); }, 5);
+					};
+					// axpy の見積もりは 2n FLOP として扱う
+					p.vector_cost = detail::fit(2 * small_vec, run(small * small), 2 * large_vec, run(large * large));
+				}
+				if (p.scal != nullptr) {
+					auto run = [&](size_t n) {
+						return detail::measure_ns([&] { p.scal(n, T(1), c.data()); }, 5);
+					};
+					// scal は読み出しが1本だけなので axpy とは別に測る (見積もりは n FLOP として扱う)
+					p.scal_cost = detail::fit(small_vec, run(small * small), large_vec, run(large * large));
+				}
+			}
+		}
+	};
+
+	/**
+	 * @brief 演算のプロバイダを名前で指定します。
+	 * @param name プロバイダ名。空文字列または "auto" を指定するとコストモデルで選ぶように戻します。
+	 * @note 指定した名前のプロバイダがない要素型や演算では、コストモデルで選びます。
+	 */
+	inline void set_provider(std::string_view name) {
+		detail::provider_state() = (name == "auto") ? std::string() : std::string(name);
+	}
+
+	/**
+	 * @brief set_provider() または環境変数 SANAE_BLAS で指定されているプロバイダ名を返します。指定がなければ "auto" を返します。
+	 */
+	inline std::string_view active_provider() noexcept {
+		const std::string& forced = detail::provider_state();
+		return forced.empty() ? std::string_view("auto") : std::string_view(forced);
+	}
+
+	/**
+	 * @brief use_blas = true の演算で、ネイティブ以外のプロバイダが選ばれた場合にそのプロバイダを返します。
+	 * @tparam enabled false の場合はレジストリを参照せず、常に nullptr を返します。
+	 * @return ネイティブの実装で計算する場合は nullptr
+	 */
+	template<typename T, bool enabled>
+	inline const Provider<T>* external_provider(Routine routine, size_t m, size_t n = 1, size_t k = 1) noexcept {
+		if constexpr (enabled) {
+			const Provider<T>& p = Registry<T>::instance().select(routine, m, n, k);
+			return p.native ? nullptr : &p;
+		}
+		else {
+			return nullptr;
+		}
+	}
+}
+
+#endif
\ No newline at end of file
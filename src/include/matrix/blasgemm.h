@@ -11,7 +11,14 @@
 namespace BlasGemm {
 	template<typename T> 
 	struct MatMul {
-		static void multiply(const T* A, const T* B, T* C, size_t M, size_t N, size_t K, bool rowMajor) {
+		static void multiply(const T* A, const T* B, T* C, size_t M, size_t N, size_t K, bool AMajor, bool BMajor, bool TransA = false, bool TransB = false, T alpha = T(1), T beta = T(0), size_t lda = 0, size_t ldb = 0, size_t ldc = 0) {
+			// BLAS未使用時のプレースホルダ
+			throw std::runtime_error("BLAS not supported for this data type.");
+		}
+	};
+	template<typename T> 
+	struct BatchedMatMul {
+		static void multiply(const T* A, size_t stride_a, const T* B, size_t stride_b, T* C, size_t stride_c, size_t batch, size_t M, size_t N, size_t K, bool AMajor, bool BMajor, bool TransA = false, bool TransB = false, T alpha = T(1), T beta = T(0), size_t lda = 0, size_t ldb = 0, size_t ldc = 0) {
 			// BLAS未使用時のプレースホルダ
 			throw std::runtime_error("BLAS not supported for this data type.");
 		}
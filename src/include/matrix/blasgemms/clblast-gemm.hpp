@@ -15,28 +15,44 @@ namespace BlasGemm {
 		static void multiply(
 			const float* A, const float* B, float* C,
 			size_t M, size_t N, size_t K,
-			bool AMajor, bool BMajor
+			bool AMajor, bool BMajor,
+			bool TransA = false, bool TransB = false,
+			float alpha = 1, float beta = 0,
+			size_t lda_ = 0, size_t ldb_ = 0, size_t ldc_ = 0
 		) {
-			const float alpha = 1.0f;
-			const float beta = 0.0f;
 
 			cl::Context context(CL_DEVICE_TYPE_GPU);
 			cl::CommandQueue queue(context);
 
-			cl::Buffer bufA(context, CL_MEM_READ_ONLY, M * K * sizeof(float));
-			cl::Buffer bufB(context, CL_MEM_READ_ONLY, K * N * sizeof(float));
-			cl::Buffer bufC(context, CL_MEM_READ_WRITE, M * N * sizeof(float));
+			// 指定がなければ格納されている行列の行数・列数からリーディングディメンションを求める
+			size_t lda = lda_ != 0 ? lda_ : (AMajor ? (TransA ? M : K) : (TransA ? K : M));
+			size_t ldb = ldb_ != 0 ? ldb_ : (BMajor ? (TransB ? K : N) : (TransB ? N : K));
+			size_t ldc = ldc_ != 0 ? ldc_ : (AMajor ? N : M);
 
-			queue.enqueueWriteBuffer(bufA, CL_TRUE, 0, M * K * sizeof(float), A);
-			queue.enqueueWriteBuffer(bufB, CL_TRUE, 0, K * N * sizeof(float), B);
+			// 格納されている各行列の外側・内側の次元
+			const size_t outerA = (AMajor != TransA) ? M : K, innerA = (AMajor != TransA) ? K : M;
+			const size_t outerB = (BMajor != TransB) ? K : N, innerB = (BMajor != TransB) ? N : K;
+			const size_t outerC = AMajor ? M : N, innerC = AMajor ? N : M;
 
-			auto layout = AMajor ? clblast::Layout::kRowMajor : clblast::Layout::kColMajor;
-			auto transA = clblast::Transpose::kNo;
-			auto transB = (AMajor == BMajor) ? clblast::Transpose::kNo : clblast::Transpose::kYes;
+			// パディングを含めた格納領域のサイズ (外側の次元 x リーディングディメンション)
+			const size_t sizeA = outerA * lda;
+			const size_t sizeB = outerB * ldb;
+			const size_t sizeC = outerC * ldc;
+
+			cl::Buffer bufA(context, CL_MEM_READ_ONLY, sizeA * sizeof(float));
+			cl::Buffer bufB(context, CL_MEM_READ_ONLY, sizeB * sizeof(float));
+			cl::Buffer bufC(context, CL_MEM_READ_WRITE, sizeC * sizeof(float));
 
-			size_t lda = AMajor ? K : M;
-			size_t ldb = AMajor ? N : K;
-			size_t ldc = AMajor ? N : M;
+			// 転送は各行(列)の要素のみ行い、ビューの外側やパディング領域には触れない
+			queue.enqueueWriteBufferRect(bufA, CL_TRUE, { 0, 0, 0 }, { 0, 0, 0 }, { innerA * sizeof(float), outerA, 1 }, lda * sizeof(float), 0, lda * sizeof(float), 0, A);
+			queue.enqueueWriteBufferRect(bufB, CL_TRUE, { 0, 0, 0 }, { 0, 0, 0 }, { innerB * sizeof(float), outerB, 1 }, ldb * sizeof(float), 0, ldb * sizeof(float), 0, B);
+			// beta が0でない場合は C の元の値が必要になる
+			if (beta != 0)
+				queue.enqueueWriteBufferRect(bufC, CL_TRUE, { 0, 0, 0 }, { 0, 0, 0 }, { innerC * sizeof(float), outerC, 1 }, ldc * sizeof(float), 0, ldc * sizeof(float), 0, C);
+
+			auto layout = AMajor ? clblast::Layout::kRowMajor : clblast::Layout::kColMajor;
+			auto transA = TransA ? clblast::Transpose::kYes : clblast::Transpose::kNo;
+			auto transB = ((AMajor == BMajor) == TransB) ? clblast::Transpose::kYes : clblast::Transpose::kNo;
 
 			auto status = clblast::Gemm<float>(
 				layout, transA, transB,
@@ -53,7 +69,7 @@ namespace BlasGemm {
 				throw std::runtime_error("clblast::Gemm failed.");
 			}
 
-			queue.enqueueReadBuffer(bufC, CL_TRUE, 0, M * N * sizeof(float), C);
+			queue.enqueueReadBufferRect(bufC, CL_TRUE, { 0, 0, 0 }, { 0, 0, 0 }, { innerC * sizeof(float), outerC, 1 }, ldc * sizeof(float), 0, ldc * sizeof(float), 0, C);
 		}
 	};
 	template<>
@@ -61,28 +77,44 @@ namespace BlasGemm {
 		static void multiply(
 			const double* A, const double* B, double* C,
 			size_t M, size_t N, size_t K,
-			bool AMajor, bool BMajor
+			bool AMajor, bool BMajor,
+			bool TransA = false, bool TransB = false,
+			double alpha = 1, double beta = 0,
+			size_t lda_ = 0, size_t ldb_ = 0, size_t ldc_ = 0
 		) {
-			const double alpha = 1.0;
-			const double beta = 0.0;
 
 			cl::Context context(CL_DEVICE_TYPE_GPU);
 			cl::CommandQueue queue(context);
 
-			cl::Buffer bufA(context, CL_MEM_READ_ONLY, M * K * sizeof(double));
-			cl::Buffer bufB(context, CL_MEM_READ_ONLY, K * N * sizeof(double));
-			cl::Buffer bufC(context, CL_MEM_READ_WRITE, M * N * sizeof(double));
+			// 指定がなければ格納されている行列の行数・列数からリーディングディメンションを求める
+			size_t lda = lda_ != 0 ? lda_ : (AMajor ? (TransA ? M : K) : (TransA ? K : M));
+			size_t ldb = ldb_ != 0 ? ldb_ : (BMajor ? (TransB ? K : N) : (TransB ? N : K));
+			size_t ldc = ldc_ != 0 ? ldc_ : (AMajor ? N : M);
 
-			queue.enqueueWriteBuffer(bufA, CL_TRUE, 0, M * K * sizeof(double), A);
-			queue.enqueueWriteBuffer(bufB, CL_TRUE, 0, K * N * sizeof(double), B);
+			// 格納されている各行列の外側・内側の次元
+			const size_t outerA = (AMajor != TransA) ? M : K, innerA = (AMajor != TransA) ? K : M;
+			const size_t outerB = (BMajor != TransB) ? K : N, innerB = (BMajor != TransB) ? N : K;
+			const size_t outerC = AMajor ? M : N, innerC = AMajor ? N : M;
 
-			auto layout = AMajor ? clblast::Layout::kRowMajor : clblast::Layout::kColMajor;
-			auto transA = clblast::Transpose::kNo;
-			auto transB = (AMajor == BMajor) ? clblast::Transpose::kNo : clblast::Transpose::kYes;
+			// パディングを含めた格納領域のサイズ (外側の次元 x リーディングディメンション)
+			const size_t sizeA = outerA * lda;
+			const size_t sizeB = outerB * ldb;
+			const size_t sizeC = outerC * ldc;
+
+			cl::Buffer bufA(context, CL_MEM_READ_ONLY, sizeA * sizeof(double));
+			cl::Buffer bufB(context, CL_MEM_READ_ONLY, sizeB * sizeof(double));
+			cl::Buffer bufC(context, CL_MEM_READ_WRITE, sizeC * sizeof(double));
 
-			size_t lda = AMajor ? K : M;
-			size_t ldb = AMajor ? N : K;
-			size_t ldc = AMajor ? N : M;
+			// 転送は各行(列)の要素のみ行い、ビューの外側やパディング領域には触れない
+			queue.enqueueWriteBufferRect(bufA, CL_TRUE, { 0, 0, 0 }, { 0, 0, 0 }, { innerA * sizeof(double), outerA, 1 }, lda * sizeof(double), 0, lda * sizeof(double), 0, A);
+			queue.enqueueWriteBufferRect(bufB, CL_TRUE, { 0, 0, 0 }, { 0, 0, 0 }, { innerB * sizeof(double), outerB, 1 }, ldb * sizeof(double), 0, ldb * sizeof(double), 0, B);
+			// beta が0でない場合は C の元の値が必要になる
+			if (beta != 0)
+				queue.enqueueWriteBufferRect(bufC, CL_TRUE, { 0, 0, 0 }, { 0, 0, 0 }, { innerC * sizeof(double), outerC, 1 }, ldc * sizeof(double), 0, ldc * sizeof(double), 0, C);
+
+			auto layout = AMajor ? clblast::Layout::kRowMajor : clblast::Layout::kColMajor;
+			auto transA = TransA ? clblast::Transpose::kYes : clblast::Transpose::kNo;
+			auto transB = ((AMajor == BMajor) == TransB) ? clblast::Transpose::kYes : clblast::Transpose::kNo;
 
 			auto status = clblast::Gemm<double>(
 				layout, transA, transB,
@@ -99,7 +131,83 @@ namespace BlasGemm {
 				throw std::runtime_error("clblast::Gemm failed.");
 			}
 
-			queue.enqueueReadBuffer(bufC, CL_TRUE, 0, M * N * sizeof(double), C);
+			queue.enqueueReadBufferRect(bufC, CL_TRUE, { 0, 0, 0 }, { 0, 0, 0 }, { innerC * sizeof(double), outerC, 1 }, ldc * sizeof(double), 0, ldc * sizeof(double), 0, C);
+		}
+	};
+	/**
+	 * @brief 同じ形状の独立した行列積を clblast::GemmStridedBatched でまとめて計算します。(引数は NativeGemm::BatchedMatMul と同じ)
+	 * @note デバイス上では各行列を詰めて並べます。ストライドが0の A, B は1つだけ転送します。
+	 */
+	template<typename T>
+	struct BatchedMatMul {
+		static void multiply(
+			const T* A, size_t stride_a,
+			const T* B, size_t stride_b,
+			T* C, size_t stride_c,
+			size_t batch,
+			size_t M, size_t N, size_t K,
+			bool AMajor, bool BMajor,
+			bool TransA = false, bool TransB = false,
+			T alpha = T(1), T beta = T(0),
+			size_t lda_ = 0, size_t ldb_ = 0, size_t ldc_ = 0
+		) {
+			if (batch == 0 || M == 0 || N == 0)
+				return;
+
+			cl::Context context(CL_DEVICE_TYPE_GPU);
+			cl::CommandQueue queue(context);
+
+			// 指定がなければ格納されている行列の行数・列数からリーディングディメンションを求める
+			size_t lda = lda_ != 0 ? lda_ : (AMajor ? (TransA ? M : K) : (TransA ? K : M));
+			size_t ldb = ldb_ != 0 ? ldb_ : (BMajor ? (TransB ? K : N) : (TransB ? N : K));
+			size_t ldc = ldc_ != 0 ? ldc_ : (AMajor ? N : M);
+
+			// 格納されている各行列の外側・内側の次元
+			const size_t outerA = (AMajor != TransA) ? M : K, innerA = (AMajor != TransA) ? K : M;
+			const size_t outerB = (BMajor != TransB) ? K : N, innerB = (BMajor != TransB) ? N : K;
+			const size_t outerC = AMajor ? M : N, innerC = AMajor ? N : M;
+
+			// デバイス上の1つの行列のサイズと転送する行列の数
+			const size_t sizeA = outerA * lda, countA = stride_a == 0 ? 1 : batch;
+			const size_t sizeB = outerB * ldb, countB = stride_b == 0 ? 1 : batch;
+			const size_t sizeC = outerC * ldc;
+
+			cl::Buffer bufA(context, CL_MEM_READ_ONLY, sizeA * countA * sizeof(T));
+			cl::Buffer bufB(context, CL_MEM_READ_ONLY, sizeB * countB * sizeof(T));
+			cl::Buffer bufC(context, CL_MEM_READ_WRITE, sizeC * batch * sizeof(T));
+
+			// 転送は各行(列)の要素のみ行い、ビューの外側やパディング領域には触れない
+			for (size_t i = 0; i < countA; i++)
+				queue.enqueueWriteBufferRect(bufA, CL_TRUE, { i * sizeA * sizeof(T), 0, 0 }, { 0, 0, 0 }, { innerA * sizeof(T), outerA, 1 }, lda * sizeof(T), 0, lda * sizeof(T), 0, A + i * stride_a);
+			for (size_t i = 0; i < countB; i++)
+				queue.enqueueWriteBufferRect(bufB, CL_TRUE, { i * sizeB * sizeof(T), 0, 0 }, { 0, 0, 0 }, { innerB * sizeof(T), outerB, 1 }, ldb * sizeof(T), 0, ldb * sizeof(T), 0, B + i * stride_b);
+			// beta が0でない場合は C の元の値が必要になる
+			if (beta != 0)
+				for (size_t i = 0; i < batch; i++)
+					queue.enqueueWriteBufferRect(bufC, CL_TRUE, { i * sizeC * sizeof(T), 0, 0 }, { 0, 0, 0 }, { innerC * sizeof(T), outerC, 1 }, ldc * sizeof(T), 0, ldc * sizeof(T), 0, C + i * stride_c);
+
+			auto layout = AMajor ? clblast::Layout::kRowMajor : clblast::Layout::kColMajor;
+			auto transA = TransA ? clblast::Transpose::kYes : clblast::Transpose::kNo;
+			auto transB = ((AMajor == BMajor) == TransB) ? clblast::Transpose::kYes : clblast::Transpose::kNo;
+
+			auto status = clblast::GemmStridedBatched<T>(
+				layout, transA, transB,
+				M, N, K,
+				alpha,
+				bufA(), 0, lda, stride_a == 0 ? 0 : sizeA,
+				bufB(), 0, ldb, stride_b == 0 ? 0 : sizeB,
+				beta,
+				bufC(), 0, ldc, sizeC,
+				batch,
+				&queue()
+			);
+
+			if (status != clblast::StatusCode::kSuccess) {
+				throw std::runtime_error("clblast::GemmStridedBatched failed.");
+			}
+
+			for (size_t i = 0; i < batch; i++)
+				queue.enqueueReadBufferRect(bufC, CL_TRUE, { i * sizeC * sizeof(T), 0, 0 }, { 0, 0, 0 }, { innerC * sizeof(T), outerC, 1 }, ldc * sizeof(T), 0, ldc * sizeof(T), 0, C + i * stride_c);
 		}
 	};
 	template<typename T>
@@ -5,6 +5,8 @@
 
 #include <cublas_v2.h>
 #include <cuda_runtime.h>
+#include <stdexcept>
+#include <type_traits>
 
 namespace BlasGemm {
 	template<typename T>
@@ -15,10 +17,25 @@ namespace BlasGemm {
 		static void multiply(
 			const float* A, const float* B, float* C,
 			size_t M, size_t N, size_t K,
-			bool AMajor, bool BMajor
+			bool AMajor, bool BMajor,
+			bool TransA = false, bool TransB = false,
+			float alpha = 1, float beta = 0,
+			size_t lda_ = 0, size_t ldb_ = 0, size_t ldc_ = 0
 		) {
-			const float alpha = 1.0f;
-			const float beta = 0.0f;
+			// 指定がなければ格納されている行列の行数・列数からリーディングディメンションを求める
+			int lda = static_cast<int>(lda_ != 0 ? lda_ : (AMajor ? (TransA ? M : K) : (TransA ? K : M)));
+			int ldb = static_cast<int>(ldb_ != 0 ? ldb_ : (BMajor ? (TransB ? K : N) : (TransB ? N : K)));
+			int ldc = static_cast<int>(ldc_ != 0 ? ldc_ : (AMajor ? N : M));
+
+			// 格納されている各行列の外側・内側の次元
+			const size_t outerA = (AMajor != TransA) ? M : K, innerA = (AMajor != TransA) ? K : M;
+			const size_t outerB = (BMajor != TransB) ? K : N, innerB = (BMajor != TransB) ? N : K;
+			const size_t outerC = AMajor ? M : N, innerC = AMajor ? N : M;
+
+			// パディングを含めた格納領域のサイズ (外側の次元 x リーディングディメンション)
+			const size_t sizeA = outerA * lda;
+			const size_t sizeB = outerB * ldb;
+			const size_t sizeC = outerC * ldc;
 
 			float* dA = nullptr, * dB = nullptr, * dC = nullptr;
 
@@ -28,49 +45,64 @@ namespace BlasGemm {
 				if (dC) cudaFree(dC);
 				};
 
-			if (cudaMalloc(&dA, M * K * sizeof(float)) != cudaSuccess)
+			if (cudaMalloc(&dA, sizeA * sizeof(float)) != cudaSuccess)
 				throw std::runtime_error("Failed to allocate device memory for A.");
 
-			if (cudaMalloc(&dB, K * N * sizeof(float)) != cudaSuccess) {
+			if (cudaMalloc(&dB, sizeB * sizeof(float)) != cudaSuccess) {
 				cleanup();
 				throw std::runtime_error("Failed to allocate device memory for B.");
 			}
 
-			if (cudaMalloc(&dC, M * N * sizeof(float)) != cudaSuccess) {
+			if (cudaMalloc(&dC, sizeC * sizeof(float)) != cudaSuccess) {
 				cleanup();
 				throw std::runtime_error("Failed to allocate device memory for C.");
 			}
 
-			if (cudaMemcpy(dA, A, M * K * sizeof(float), cudaMemcpyHostToDevice) != cudaSuccess) {
+			// 転送は各行(列)の要素のみ行い、ビューの外側やパディング領域には触れない
+			if (cudaMemcpy2D(dA, lda * sizeof(float), A, lda * sizeof(float), innerA * sizeof(float), outerA, cudaMemcpyHostToDevice) != cudaSuccess) {
 				cleanup();
 				throw std::runtime_error("Failed to copy A to device.");
 			}
 
-			if (cudaMemcpy(dB, B, K * N * sizeof(float), cudaMemcpyHostToDevice) != cudaSuccess) {
+			if (cudaMemcpy2D(dB, ldb * sizeof(float), B, ldb * sizeof(float), innerB * sizeof(float), outerB, cudaMemcpyHostToDevice) != cudaSuccess) {
 				cleanup();
 				throw std::runtime_error("Failed to copy B to device.");
 			}
 
+			// beta が0でない場合は C の元の値が必要になる
+			if (beta != 0 && cudaMemcpy2D(dC, ldc * sizeof(float), C, ldc * sizeof(float), innerC * sizeof(float), outerC, cudaMemcpyHostToDevice) != cudaSuccess) {
+				cleanup();
+				throw std::runtime_error("Failed to copy C to device.");
+			}
+
 			cublasHandle_t handle;
 			cublasCreate(&handle);
 
-			cublasOperation_t transA = AMajor ? CUBLAS_OP_N : CUBLAS_OP_T;
-			cublasOperation_t transB = BMajor ? CUBLAS_OP_N : CUBLAS_OP_T;
-
-			int lda = AMajor ? K : M;
-			int ldb = BMajor ? N : K;
-			int ldc = N;
-
-			cublasStatus_t status = cublasSgemm(
-				handle,
-				transB, transA,   // cuBLAS は列優先なので順序が逆になる
-				N, M, K,
-				&alpha,
-				dB, ldb,
-				dA, lda,
-				&beta,
-				dC, ldc
-			);
+			// cuBLAS は列優先のため、格納レイアウトが計算順と異なる行列は転置として扱う
+			auto op = [AMajor](bool major, bool trans) {
+				return (major == AMajor) != trans ? CUBLAS_OP_N : CUBLAS_OP_T;
+			};
+
+			// C は A と同じレイアウトで計算する。行優先の場合は C^T = op(B)^T * op(A)^T を列優先として計算する
+			cublasStatus_t status = AMajor
+				? cublasSgemm(
+					handle,
+					op(BMajor, TransB), op(AMajor, TransA),   // cuBLAS は列優先なので順序が逆になる
+					N, M, K,
+					&alpha,
+					dB, ldb,
+					dA, lda,
+					&beta,
+					dC, ldc)
+				: cublasSgemm(
+					handle,
+					op(AMajor, TransA), op(BMajor, TransB),
+					M, N, K,
+					&alpha,
+					dA, lda,
+					dB, ldb,
+					&beta,
+					dC, ldc);
 
 			if (status != CUBLAS_STATUS_SUCCESS) {
 				cublasDestroy(handle);
@@ -78,7 +110,7 @@ namespace BlasGemm {
 				throw std::runtime_error("cublasSgemm failed.");
 			}
 
-			if (cudaMemcpy(C, dC, M * N * sizeof(float), cudaMemcpyDeviceToHost) != cudaSuccess) {
+			if (cudaMemcpy2D(C, ldc * sizeof(float), dC, ldc * sizeof(float), innerC * sizeof(float), outerC, cudaMemcpyDeviceToHost) != cudaSuccess) {
 				cublasDestroy(handle);
 				cleanup();
 				throw std::runtime_error("Failed to copy C from device.");
@@ -93,10 +125,25 @@ namespace BlasGemm {
 		static void multiply(
 			const double* A, const double* B, double* C,
 			size_t M, size_t N, size_t K,
-			bool AMajor, bool BMajor
+			bool AMajor, bool BMajor,
+			bool TransA = false, bool TransB = false,
+			double alpha = 1, double beta = 0,
+			size_t lda_ = 0, size_t ldb_ = 0, size_t ldc_ = 0
 		) {
-			const double alpha = 1.0;
-			const double beta = 0.0;
+			// 指定がなければ格納されている行列の行数・列数からリーディングディメンションを求める
+			int lda = static_cast<int>(lda_ != 0 ? lda_ : (AMajor ? (TransA ? M : K) : (TransA ? K : M)));
+			int ldb = static_cast<int>(ldb_ != 0 ? ldb_ : (BMajor ? (TransB ? K : N) : (TransB ? N : K)));
+			int ldc = static_cast<int>(ldc_ != 0 ? ldc_ : (AMajor ? N : M));
+
+			// 格納されている各行列の外側・内側の次元
+			const size_t outerA = (AMajor != TransA) ? M : K, innerA = (AMajor != TransA) ? K : M;
+			const size_t outerB = (BMajor != TransB) ? K : N, innerB = (BMajor != TransB) ? N : K;
+			const size_t outerC = AMajor ? M : N, innerC = AMajor ? N : M;
+
+			// パディングを含めた格納領域のサイズ (外側の次元 x リーディングディメンション)
+			const size_t sizeA = outerA * lda;
+			const size_t sizeB = outerB * ldb;
+			const size_t sizeC = outerC * ldc;
 
 			double* dA = nullptr, * dB = nullptr, * dC = nullptr;
 
@@ -106,49 +153,64 @@ namespace BlasGemm {
 				if (dC) cudaFree(dC);
 				};
 
-			if (cudaMalloc(&dA, M * K * sizeof(double)) != cudaSuccess)
+			if (cudaMalloc(&dA, sizeA * sizeof(double)) != cudaSuccess)
 				throw std::runtime_error("Failed to allocate device memory for A.");
 
-			if (cudaMalloc(&dB, K * N * sizeof(double)) != cudaSuccess) {
+			if (cudaMalloc(&dB, sizeB * sizeof(double)) != cudaSuccess) {
 				cleanup();
 				throw std::runtime_error("Failed to allocate device memory for B.");
 			}
 
-			if (cudaMalloc(&dC, M * N * sizeof(double)) != cudaSuccess) {
+			if (cudaMalloc(&dC, sizeC * sizeof(double)) != cudaSuccess) {
 				cleanup();
 				throw std::runtime_error("Failed to allocate device memory for C.");
 			}
 
-			if (cudaMemcpy(dA, A, M * K * sizeof(double), cudaMemcpyHostToDevice) != cudaSuccess) {
+			// 転送は各行(列)の要素のみ行い、ビューの外側やパディング領域には触れない
+			if (cudaMemcpy2D(dA, lda * sizeof(double), A, lda * sizeof(double), innerA * sizeof(double), outerA, cudaMemcpyHostToDevice) != cudaSuccess) {
 				cleanup();
 				throw std::runtime_error("Failed to copy A to device.");
 			}
 
-			if (cudaMemcpy(dB, B, K * N * sizeof(double), cudaMemcpyHostToDevice) != cudaSuccess) {
+			if (cudaMemcpy2D(dB, ldb * sizeof(double), B, ldb * sizeof(double), innerB * sizeof(double), outerB, cudaMemcpyHostToDevice) != cudaSuccess) {
 				cleanup();
 				throw std::runtime_error("Failed to copy B to device.");
 			}
 
+			// beta が0でない場合は C の元の値が必要になる
+			if (beta != 0 && cudaMemcpy2D(dC, ldc * sizeof(double), C, ldc * sizeof(double), innerC * sizeof(double), outerC, cudaMemcpyHostToDevice) != cudaSuccess) {
+				cleanup();
+				throw std::runtime_error("Failed to copy C to device.");
+			}
+
 			cublasHandle_t handle;
 			cublasCreate(&handle);
 
-			cublasOperation_t transA = AMajor ? CUBLAS_OP_N : CUBLAS_OP_T;
-			cublasOperation_t transB = BMajor ? CUBLAS_OP_N : CUBLAS_OP_T;
-
-			int lda = AMajor ? K : M;
-			int ldb = BMajor ? N : K;
-			int ldc = N;
-
-			cublasStatus_t status = cublasDgemm(
-				handle,
-				transB, transA,   // cuBLAS は列優先なので A/B の順序が逆になる
-				N, M, K,
-				&alpha,
-				dB, ldb,
-				dA, lda,
-				&beta,
-				dC, ldc
-			);
+			// cuBLAS は列優先のため、格納レイアウトが計算順と異なる行列は転置として扱う
+			auto op = [AMajor](bool major, bool trans) {
+				return (major == AMajor) != trans ? CUBLAS_OP_N : CUBLAS_OP_T;
+			};
+
+			// C は A と同じレイアウトで計算する。行優先の場合は C^T = op(B)^T * op(A)^T を列優先として計算する
+			cublasStatus_t status = AMajor
+				? cublasDgemm(
+					handle,
+					op(BMajor, TransB), op(AMajor, TransA),   // cuBLAS は列優先なので A/B の順序が逆になる
+					N, M, K,
+					&alpha,
+					dB, ldb,
+					dA, lda,
+					&beta,
+					dC, ldc)
+				: cublasDgemm(
+					handle,
+					op(AMajor, TransA), op(BMajor, TransB),
+					M, N, K,
+					&alpha,
+					dA, lda,
+					dB, ldb,
+					&beta,
+					dC, ldc);
 
 			if (status != CUBLAS_STATUS_SUCCESS) {
 				cublasDestroy(handle);
@@ -156,7 +218,7 @@ namespace BlasGemm {
 				throw std::runtime_error("cublasDgemm failed.");
 			}
 
-			if (cudaMemcpy(C, dC, M * N * sizeof(double), cudaMemcpyDeviceToHost) != cudaSuccess) {
+			if (cudaMemcpy2D(C, ldc * sizeof(double), dC, ldc * sizeof(double), innerC * sizeof(double), outerC, cudaMemcpyDeviceToHost) != cudaSuccess) {
 				cublasDestroy(handle);
 				cleanup();
 				throw std::runtime_error("Failed to copy C from device.");
@@ -166,6 +228,107 @@ namespace BlasGemm {
 			cleanup();
 		}
 	};
+	/**
+	 * @brief 同じ形状の独立した行列積を cublas?gemmStridedBatched でまとめて計算します。(引数は NativeGemm::BatchedMatMul と同じ)
+	 * @note デバイス上では各行列を詰めて並べます。ストライドが0の A, B は1つだけ転送します。
+	 */
+	template<typename T>
+	struct BatchedMatMul {
+		static void multiply(
+			const T* A, size_t stride_a,
+			const T* B, size_t stride_b,
+			T* C, size_t stride_c,
+			size_t batch,
+			size_t M, size_t N, size_t K,
+			bool AMajor, bool BMajor,
+			bool TransA = false, bool TransB = false,
+			T alpha = T(1), T beta = T(0),
+			size_t lda_ = 0, size_t ldb_ = 0, size_t ldc_ = 0
+		) {
+			static_assert(std::is_same_v<T, float> || std::is_same_v<T, double>, "cuBLAS batched GEMM supports only float and double.");
+			if (batch == 0 || M == 0 || N == 0)
+				return;
+
+			// 指定がなければ格納されている行列の行数・列数からリーディングディメンションを求める
+			int lda = static_cast<int>(lda_ != 0 ? lda_ : (AMajor ? (TransA ? M : K) : (TransA ? K : M)));
+			int ldb = static_cast<int>(ldb_ != 0 ? ldb_ : (BMajor ? (TransB ? K : N) : (TransB ? N : K)));
+			int ldc = static_cast<int>(ldc_ != 0 ? ldc_ : (AMajor ? N : M));
+
+			// 格納されている各行列の外側・内側の次元
+			const size_t outerA = (AMajor != TransA) ? M : K, innerA = (AMajor != TransA) ? K : M;
+			const size_t outerB = (BMajor != TransB) ? K : N, innerB = (BMajor != TransB) ? N : K;
+			const size_t outerC = AMajor ? M : N, innerC = AMajor ? N : M;
+
+			// デバイス上の1つの行列のサイズと転送する行列の数
+			const size_t sizeA = outerA * lda, countA = stride_a == 0 ? 1 : batch;
+			const size_t sizeB = outerB * ldb, countB = stride_b == 0 ? 1 : batch;
+			const size_t sizeC = outerC * ldc;
+
+			T* dA = nullptr, * dB = nullptr, * dC = nullptr;
+			cublasHandle_t handle = nullptr;
+
+			auto cleanup = [&]() {
+				if (handle) cublasDestroy(handle);
+				if (dA) cudaFree(dA);
+				if (dB) cudaFree(dB);
+				if (dC) cudaFree(dC);
+				};
+			auto fail = [&](const char* message) {
+				cleanup();
+				throw std::runtime_error(message);
+				};
+
+			if (cudaMalloc(&dA, sizeA * countA * sizeof(T)) != cudaSuccess)
+				fail("Failed to allocate device memory for A.");
+			if (cudaMalloc(&dB, sizeB * countB * sizeof(T)) != cudaSuccess)
+				fail("Failed to allocate device memory for B.");
+			if (cudaMalloc(&dC, sizeC * batch * sizeof(T)) != cudaSuccess)
+				fail("Failed to allocate device memory for C.");
+
+			// 転送は各行(列)の要素のみ行い、ビューの外側やパディング領域には触れない
+			for (size_t i = 0; i < countA; i++)
+				if (cudaMemcpy2D(dA + i * sizeA, lda * sizeof(T), A + i * stride_a, lda * sizeof(T), innerA * sizeof(T), outerA, cudaMemcpyHostToDevice) != cudaSuccess)
+					fail("Failed to copy A to device.");
+			for (size_t i = 0; i < countB; i++)
+				if (cudaMemcpy2D(dB + i * sizeB, ldb * sizeof(T), B + i * stride_b, ldb * sizeof(T), innerB * sizeof(T), outerB, cudaMemcpyHostToDevice) != cudaSuccess)
+					fail("Failed to copy B to device.");
+			// beta が0でない場合は C の元の値が必要になる
+			if (beta != 0)
+				for (size_t i = 0; i < batch; i++)
+					if (cudaMemcpy2D(dC + i * sizeC, ldc * sizeof(T), C + i * stride_c, ldc * sizeof(T), innerC * sizeof(T), outerC, cudaMemcpyHostToDevice) != cudaSuccess)
+						fail("Failed to copy C to device.");
+
+			cublasCreate(&handle);
+
+			// cuBLAS は列優先のため、格納レイアウトが計算順と異なる行列は転置として扱う
+			auto op = [AMajor](bool major, bool trans) {
+				return (major == AMajor) != trans ? CUBLAS_OP_N : CUBLAS_OP_T;
+			};
+			const long long strideA = stride_a == 0 ? 0 : static_cast<long long>(sizeA);
+			const long long strideB = stride_b == 0 ? 0 : static_cast<long long>(sizeB);
+			const long long strideC = static_cast<long long>(sizeC);
+
+			auto gemm = [&](cublasOperation_t opX, cublasOperation_t opY, size_t m, size_t n, const T* X, int ldx, long long sx, const T* Y, int ldy, long long sy) {
+				if constexpr (std::is_same_v<T, float>)
+					return cublasSgemmStridedBatched(handle, opX, opY, static_cast<int>(m), static_cast<int>(n), static_cast<int>(K), &alpha, X, ldx, sx, Y, ldy, sy, &beta, dC, ldc, strideC, static_cast<int>(batch));
+				else
+					return cublasDgemmStridedBatched(handle, opX, opY, static_cast<int>(m), static_cast<int>(n), static_cast<int>(K), &alpha, X, ldx, sx, Y, ldy, sy, &beta, dC, ldc, strideC, static_cast<int>(batch));
+			};
+
+			// C は A と同じレイアウトで計算する。行優先の場合は C^T = op(B)^T * op(A)^T を列優先として計算する
+			const cublasStatus_t status = AMajor
+				? gemm(op(BMajor, TransB), op(AMajor, TransA), N, M, dB, ldb, strideB, dA, lda, strideA)
+				: gemm(op(AMajor, TransA), op(BMajor, TransB), M, N, dA, lda, strideA, dB, ldb, strideB);
+			if (status != CUBLAS_STATUS_SUCCESS)
+				fail("cublasGemmStridedBatched failed.");
+
+			for (size_t i = 0; i < batch; i++)
+				if (cudaMemcpy2D(C + i * stride_c, ldc * sizeof(T), dC + i * sizeC, ldc * sizeof(T), innerC * sizeof(T), outerC, cudaMemcpyDeviceToHost) != cudaSuccess)
+					fail("Failed to copy C from device.");
+
+			cleanup();
+		}
+	};
 	template<typename T>
 	struct Add {};
 	template<>
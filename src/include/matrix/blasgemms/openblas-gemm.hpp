@@ -2,9 +2,61 @@
 #define SANAE_NEURALNETWORK_OPENBLAS_GEMM
 
 #if defined(USE_OPENBLAS)
+// OpenBLAS の cblas.h はグローバルな bfloat16 (uint16_t) を定義するため、float16.hpp の bfloat16 と衝突しないよう名前を変えて読み込む
+#define bfloat16 openblas_bfloat16
 #include <cblas.h>
+#undef bfloat16
 
 namespace BlasGemm {
+	/**
+	 * @brief 行列とベクトルの積 y = alpha * op(A) * x + beta * y (cblas_?gemv)
+	 * @param RowMajor Aが行優先かどうか
+	 * @param Trans op(A) = A^T とするかどうか
+	 * @param M, N 格納されているAの行数・列数
+	 */
+	template<typename T>
+	struct Gemv {};
+	template<>
+	struct Gemv<float> {
+		static void multiply(bool RowMajor, bool Trans, size_t M, size_t N, float alpha, const float* A, size_t lda, const float* x, size_t incx, float beta, float* y, size_t incy) {
+			cblas_sgemv(RowMajor ? CblasRowMajor : CblasColMajor, Trans ? CblasTrans : CblasNoTrans,
+				M, N, alpha, A, lda, x, incx, beta, y, incy);
+		}
+	};
+	template<>
+	struct Gemv<double> {
+		static void multiply(bool RowMajor, bool Trans, size_t M, size_t N, double alpha, const double* A, size_t lda, const double* x, size_t incx, double beta, double* y, size_t incy) {
+			cblas_dgemv(RowMajor ? CblasRowMajor : CblasColMajor, Trans ? CblasTrans : CblasNoTrans,
+				M, N, alpha, A, lda, x, incx, beta, y, incy);
+		}
+	};
+
+	/**
+	 * @brief M == 1 または N == 1 の行列積を Gemv で計算します。
+	 * @param TransB Aのレイアウトで見たときにBを転置するかどうか (Bのレイアウトの違いを含む)
+	 * @note 他の引数は MatMul::multiply と同じで、リーディングディメンジョンは解決済みのものを渡します。
+	 *       M == 1 の場合は C^T = op(B)^T * op(A)^T として、Bを行列、Aの1行をベクトルとして扱います。
+	 */
+	template<typename T>
+	inline void gemm_as_gemv(
+		const T* A, const T* B, T* C,
+		size_t M, size_t N, size_t K,
+		bool AMajor, bool TransA, bool TransB,
+		T alpha, T beta,
+		size_t lda, size_t ldb, size_t ldc)
+	{
+		if (N == 1) {
+			const size_t incx = (TransB == AMajor) ? 1 : ldb;
+			const size_t incy = AMajor ? ldc : 1;
+			Gemv<T>::multiply(AMajor, TransA, TransA ? K : M, TransA ? M : K, alpha, A, lda, B, incx, beta, C, incy);
+		}
+		else {
+			const size_t incx = (TransA != AMajor) ? 1 : lda;
+			const size_t incy = AMajor ? 1 : ldc;
+			Gemv<T>::multiply(AMajor, !TransB, TransB ? N : K, TransB ? K : N, alpha, B, ldb, A, incx, beta, C, incy);
+		}
+	}
+
 	template<typename T>
 	struct MatMul {};
 	template<>
@@ -12,19 +64,34 @@ namespace BlasGemm {
 		static void multiply(
 			const float* A, const float* B, float* C,
 			size_t M, size_t N, size_t K,
-			bool AMajor, bool BMajor
+			bool AMajor, bool BMajor,
+			bool TransA = false, bool TransB = false,
+			float alpha = 1, float beta = 0,
+			size_t lda_ = 0, size_t ldb_ = 0, size_t ldc_ = 0
 		) {
+			// Cは A と同じレイアウトで計算し、B のレイアウトが異なる場合は転置として扱う
 			CBLAS_ORDER order = AMajor ? CblasRowMajor : CblasColMajor;
-			CBLAS_TRANSPOSE transA = CblasNoTrans;
-			CBLAS_TRANSPOSE transB = AMajor == BMajor ? CblasNoTrans : CblasTrans;
+			CBLAS_TRANSPOSE transA = TransA ? CblasTrans : CblasNoTrans;
+			CBLAS_TRANSPOSE transB = (AMajor == BMajor) == TransB ? CblasTrans : CblasNoTrans;
+
+			// 指定がなければ格納されている行列の行数・列数からリーディングディメンションを求める
+			const size_t lda = lda_ != 0 ? lda_ : (AMajor ? (TransA ? M : K) : (TransA ? K : M));
+			const size_t ldb = ldb_ != 0 ? ldb_ : (BMajor ? (TransB ? K : N) : (TransB ? N : K));
+			const size_t ldc = ldc_ != 0 ? ldc_ : (AMajor ? N : M);
+
+			// 1行または1列の積は行列ベクトル積として計算する (K == 0 では gemv がCをスケーリングしないため除く)
+			if ((M == 1 || N == 1) && K != 0) {
+				gemm_as_gemv<float>(A, B, C, M, N, K, AMajor, TransA, transB == CblasTrans, alpha, beta, lda, ldb, ldc);
+				return;
+			}
 
 			cblas_sgemm(order, transA, transB,
 				M, N, K,
-				1.0,
-				A, AMajor ? K : M,
-				B, AMajor ? N : K,
-				0.0,
-				C, AMajor ? N : M);
+				alpha,
+				A, lda,
+				B, ldb,
+				beta,
+				C, ldc);
 		}
 	};
 	template<>
@@ -32,19 +99,56 @@ namespace BlasGemm {
 		static void multiply(
 			const double* A, const double* B, double* C,
 			size_t M, size_t N, size_t K,
-			bool AMajor, bool BMajor
+			bool AMajor, bool BMajor,
+			bool TransA = false, bool TransB = false,
+			double alpha = 1, double beta = 0,
+			size_t lda_ = 0, size_t ldb_ = 0, size_t ldc_ = 0
 		) {
+			// Cは A と同じレイアウトで計算し、B のレイアウトが異なる場合は転置として扱う
 			CBLAS_ORDER order = AMajor ? CblasRowMajor : CblasColMajor;
-			CBLAS_TRANSPOSE transA = CblasNoTrans;
-			CBLAS_TRANSPOSE transB = AMajor == BMajor ? CblasNoTrans : CblasTrans;
+			CBLAS_TRANSPOSE transA = TransA ? CblasTrans : CblasNoTrans;
+			CBLAS_TRANSPOSE transB = (AMajor == BMajor) == TransB ? CblasTrans : CblasNoTrans;
+
+			// 指定がなければ格納されている行列の行数・列数からリーディングディメンションを求める
+			const size_t lda = lda_ != 0 ? lda_ : (AMajor ? (TransA ? M : K) : (TransA ? K : M));
+			const size_t ldb = ldb_ != 0 ? ldb_ : (BMajor ? (TransB ? K : N) : (TransB ? N : K));
+			const size_t ldc = ldc_ != 0 ? ldc_ : (AMajor ? N : M);
+
+			// 1行または1列の積は行列ベクトル積として計算する (K == 0 では gemv がCをスケーリングしないため除く)
+			if ((M == 1 || N == 1) && K != 0) {
+				gemm_as_gemv<double>(A, B, C, M, N, K, AMajor, TransA, transB == CblasTrans, alpha, beta, lda, ldb, ldc);
+				return;
+			}
 
 			cblas_dgemm(order, transA, transB,
 				M, N, K,
-				1.0,
-				A, AMajor ? K : M,
-				B, AMajor ? N : K,
-				0.0,
-				C, AMajor ? N : M);
+				alpha,
+				A, lda,
+				B, ldb,
+				beta,
+				C, ldc);
+		}
+	};
+
+	/**
+	 * @brief 同じ形状の独立した行列積をまとめて計算します。(引数は NativeGemm::BatchedMatMul と同じ)
+	 * @note CBLAS にはストライド指定のバッチ関数がないため、各積を順に cblas_?gemm で計算します。
+	 */
+	template<typename T>
+	struct BatchedMatMul {
+		static void multiply(
+			const T* A, size_t stride_a,
+			const T* B, size_t stride_b,
+			T* C, size_t stride_c,
+			size_t batch,
+			size_t M, size_t N, size_t K,
+			bool AMajor, bool BMajor,
+			bool TransA = false, bool TransB = false,
+			T alpha = T(1), T beta = T(0),
+			size_t lda = 0, size_t ldb = 0, size_t ldc = 0
+		) {
+			for (size_t i = 0; i < batch; i++)
+				MatMul<T>::multiply(A + i * stride_a, B + i * stride_b, C + i * stride_c, M, N, K, AMajor, BMajor, TransA, TransB, alpha, beta, lda, ldb, ldc);
 		}
 	};
 
@@ -1,13 +1,17 @@
 ﻿#ifndef SANAE_NEURALNETWORK_MATRIX_CALC
 #define SANAE_NEURALNETWORK_MATRIX_CALC
 
+#include "../threadpool/threadpool.h"
 #include "../view/view.h"
+#include "backend.hpp"
 #include "blasgemm.h"
 #include "matrix.h"
+#include "nativegemm.hpp"
+#include "simd.hpp"
+#include "strassen.hpp"
 #include <execution>
 #include <functional>
 #include <stdexcept>
-#include <thread>
 #include <utility>
 #include <vector>
 #include <algorithm>
@@ -15,57 +19,47 @@
 #include <tuple>
 
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
-inline void matrix_mul_nonblas_impl(
-	size_t result_rows,
-	size_t result_cols,
-	const std::vector<View<const T>>& this_rows,
-	const std::vector<View<const T>>& other_cols,
-	Container& result_data)
+template<typename execType, typename SpanFunc>
+inline void Matrix<T, RowMajor, Container>::_for_each_span([[maybe_unused]] execType execPolicy, SpanFunc func) const
+	requires StdExecPolicy<execType>
 {
-	auto task = [&](size_t start, size_t end) {
-		for (size_t index = start; index < end; index++) {
-			size_t row, col;
-			if constexpr (RowMajor) {
-				row = index / result_cols;
-				col = index % result_cols;
-			}
-			else {
-				col = index / result_rows;
-				row = index % result_rows;
-			}
-
-			T value = std::transform_reduce(
-				this_rows[row].begin(), this_rows[row].end(),
-				other_cols[col].begin(),
-				T{},
-				std::plus<T>(),
-				std::multiplies<T>()
-			);
-			if constexpr (RowMajor)
-				result_data[row * result_cols + col] = value;
-			else
-				result_data[col * result_rows + row] = value;
-		}
-	};
-
-	std::vector<std::thread> threads;
-	const size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
-	const size_t total_tasks = result_rows * result_cols;
-	const size_t tasks_per_thread = (total_tasks + max_threads - 1) / max_threads;
-
-	for (size_t t = 0; t < max_threads; t++) {
-		threads.emplace_back([&, t]() {
-			size_t start = t * tasks_per_thread;
-			size_t end = std::min(start + tasks_per_thread, total_tasks);
-			task(start, end);
-		});
-	}
-
-	for (auto& thread : threads) {
-		thread.join();
-	}
+    if constexpr (_padding != 0) {
+        // パディング領域には演算を適用しないよう、行(列)ごとに呼び出す
+        const size_t outer = RowMajor ? this->_rows : this->_cols;
+        const size_t inner = RowMajor ? this->_cols : this->_rows;
+        auto lines = [&](size_t begin, size_t end) {
+            for (size_t line = begin; line < end; line++)
+                func(line * this->_ld, inner);
+        };
+
+        if constexpr (is_parallel_policy_v<execType>)
+            ThreadPool::instance().parallel_for(0, outer, std::max<size_t>(ThreadPool::default_grain / std::max<size_t>(this->_ld, 1), 1), lines);
+        else
+            lines(0, outer);
+    }
+    else if constexpr (is_parallel_policy_v<execType>) {
+        // 並列ポリシーの場合はスレッドプールで分割して実行する
+        ThreadPool::instance().parallel_for(0, this->_storage_size(), ThreadPool::default_grain, [&](size_t begin, size_t end) {
+            func(begin, end - begin);
+        });
+    }
+    else {
+        func(0, this->_storage_size());
+    }
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+inline bool Matrix<T, RowMajor, Container>::_has_zero() const
+{
+    const size_t outer = RowMajor ? this->_rows : this->_cols;
+    const size_t inner = RowMajor ? this->_cols : this->_rows;
+
+    for (size_t line = 0; line < outer; line++) {
+        const T* begin = this->_data.data() + line * this->_ld;
+        if (std::find(begin, begin + inner, T(0)) != begin + inner)
+            return true;
+    }
+    return false;
 }
-
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<typename execType, typename calcType>
 inline void Matrix<T, RowMajor, Container>::_calc(Container& to, const Container& other, execType execPolicy, calcType operation) const
@@ -74,11 +68,18 @@ inline void Matrix<T, RowMajor, Container>::_calc(Container& to, const Container
     if (to.size() != other.size())
         throw std::invalid_argument("Container sizes must agree for calculation.");
 
-    std::transform(execPolicy,
-        to.begin(), to.end(),
-        other.begin(),
-        to.begin(),
-        operation);
+    // 格納領域の共有の解除はスレッドに分割する前に行う
+    T* const dst = to.data();
+    this->_for_each_span(execPolicy, [&](size_t offset, size_t length) {
+        T* out = dst + offset;
+        const T* in = other.data() + offset;
+
+        // 四則演算の関数オブジェクトの場合はSIMDカーネルで計算する
+        if constexpr (SimdKernel::has_binary_v<T, calcType>)
+            SimdKernel::binary<SimdKernel::binary_op_of<calcType>::op>(out, in, out, length);
+        else
+            std::transform(out, out + length, in, out, operation);
+    });
 }
 
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
@@ -86,10 +87,17 @@ template<typename execType, typename calcType>
 inline void Matrix<T, RowMajor, Container>::_calc(Container& to, const T& other, execType execPolicy, calcType operation) const
 	requires StdExecPolicy<execType>
 {
-    std::transform(execPolicy,
-        to.begin(), to.end(),
-        to.begin(),
-        [&](const T& val) { return operation(val, other); });
+    // 格納領域の共有の解除はスレッドに分割する前に行う
+    T* const dst = to.data();
+    this->_for_each_span(execPolicy, [&](size_t offset, size_t length) {
+        T* out = dst + offset;
+
+        // 四則演算の関数オブジェクトの場合はSIMDカーネルで計算する
+        if constexpr (SimdKernel::has_binary_v<T, calcType>)
+            SimdKernel::binary_scalar<SimdKernel::binary_op_of<calcType>::op>(out, other, out, length);
+        else
+            std::transform(out, out + length, out, [&](const T& val) { return operation(val, other); });
+    });
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<bool use_blas, typename execType>
@@ -98,9 +106,9 @@ inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::add(const
 	if (this->_rows != other._rows || this->_cols != other._cols)
 		throw std::invalid_argument("Matrix dimensions must agree for addition.");
 
-	if constexpr (can_use_blas<T>::value && use_blas) {
-		int n = static_cast<int>(this->_rows * this->_cols);
-		BlasGemm::Add<T>::axpy(n, 1.0, other._data.data(), this->_data.data());
+	const size_t n = this->_storage_size();
+	if (const auto* provider = Backend::external_provider<T, use_blas>(Backend::Routine::Axpy, n)) {
+		provider->axpy(n, T(1), other._data.data(), this->_data.data());
 	}
 	else {
 		this->_calc(this->_data, other._data, execPolicy, std::plus<T>());
@@ -109,21 +117,27 @@ inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::add(const
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<bool use_blas, typename execType>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::add_copy(const Matrix& other, execType execPolicy) const requires StdExecPolicy<execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::add_copy(const Matrix& other, execType execPolicy) const& requires StdExecPolicy<execType>
 {
 	if (this->_rows != other._rows || this->_cols != other._cols)
 		throw std::invalid_argument("Matrix dimensions must agree for addition.");
 
 	Container result(this->_data);
 
-	if constexpr (can_use_blas<T>::value && use_blas) {
-		int n = static_cast<int>(this->_rows * this->_cols);
-		BlasGemm::Add<T>::axpy(n, 1.0, other._data.data(), result.data());
+	const size_t n = this->_storage_size();
+	if (const auto* provider = Backend::external_provider<T, use_blas>(Backend::Routine::Axpy, n)) {
+		provider->axpy(n, T(1), other._data.data(), result.data());
 	}
 	else {
 		this->_calc(result, other._data, execPolicy, std::plus<T>());
 	}
-	return Matrix<T, RowMajor, Container>(this->_rows, this->_cols, std::move(result));
+	return Matrix<T, RowMajor, Container>(this->_rows, this->_cols, this->_ld, std::move(result));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<bool use_blas, typename execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::add_copy(const Matrix& other, execType execPolicy) && requires StdExecPolicy<execType>
+{
+	return std::move(this->template add<use_blas>(other, execPolicy));
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<bool use_blas, typename execType>
@@ -132,9 +146,9 @@ inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::sub(const
 	if (this->_rows != other._rows || this->_cols != other._cols)
 		throw std::invalid_argument("Matrix dimensions must agree for subtraction.");
 
-	if constexpr (can_use_blas<T>::value && use_blas) {
-		int n = static_cast<int>(this->_rows * this->_cols);
-		BlasGemm::Sub<T>::axpy(n, 1.0, other._data.data(), this->_data.data());
+	const size_t n = this->_storage_size();
+	if (const auto* provider = Backend::external_provider<T, use_blas>(Backend::Routine::Axpy, n)) {
+		provider->axpy(n, T(-1), other._data.data(), this->_data.data());
 	}
 	else {
 		this->_calc(this->_data, other._data, execPolicy, std::minus<T>());
@@ -144,21 +158,27 @@ inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::sub(const
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<bool use_blas, typename execType>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::sub_copy(const Matrix& other, execType execPolicy) const requires StdExecPolicy<execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::sub_copy(const Matrix& other, execType execPolicy) const& requires StdExecPolicy<execType>
 {
 	if (this->_rows != other._rows || this->_cols != other._cols)
 		throw std::invalid_argument("Matrix dimensions must agree for subtraction.");
 
 	Container result(this->_data);
-	if constexpr (can_use_blas<T>::value && use_blas) {
-		int n = static_cast<int>(this->_rows * this->_cols);
-		BlasGemm::Sub<T>::axpy(n, 1.0, other._data.data(), result.data());
+	const size_t n = this->_storage_size();
+	if (const auto* provider = Backend::external_provider<T, use_blas>(Backend::Routine::Axpy, n)) {
+		provider->axpy(n, T(-1), other._data.data(), result.data());
 	}
 	else {
 		this->_calc(result, other._data, execPolicy, std::minus<T>());
 	}
 
-	return Matrix<T, RowMajor, Container>(this->_rows, this->_cols, std::move(result));
+	return Matrix<T, RowMajor, Container>(this->_rows, this->_cols, this->_ld, std::move(result));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<bool use_blas, typename execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::sub_copy(const Matrix& other, execType execPolicy) && requires StdExecPolicy<execType>
+{
+	return std::move(this->template sub<use_blas>(other, execPolicy));
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<typename execType>
@@ -172,14 +192,20 @@ inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::hadamard_
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<typename execType>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::hadamard_mul_copy(const Matrix& other, execType execPolicy) const requires StdExecPolicy<execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::hadamard_mul_copy(const Matrix& other, execType execPolicy) const& requires StdExecPolicy<execType>
 {
    if (this->_rows != other._rows || this->_cols != other._cols)
        throw std::invalid_argument("Matrix dimensions must agree for Hadamard multiplication.");
 
    Container result(this->_data);
    this->_calc(result, other._data, execPolicy, std::multiplies<T>());
-   return Matrix<T, RowMajor, Container>(this->_rows, this->_cols, std::move(result));
+   return Matrix<T, RowMajor, Container>(this->_rows, this->_cols, this->_ld, std::move(result));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::hadamard_mul_copy(const Matrix& other, execType execPolicy) && requires StdExecPolicy<execType>
+{
+	return std::move(this->hadamard_mul(other, execPolicy));
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<typename execType>
@@ -188,45 +214,44 @@ inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::hadamard_
 	if (this->_rows != other._rows || this->_cols != other._cols)
 		throw std::invalid_argument("Matrix dimensions must agree for Hadamard division.");
 
-	this->_calc(this->_data, other._data, execPolicy, 
-		[](const T& a, const T& b) {
-			if (b == T(0))
-				throw std::invalid_argument("Division by zero in Hadamard division.");
+	// 要素ごとの分岐をなくしてベクトル化できるよう、0の確認は先にまとめて行う
+	if (other._has_zero())
+		throw std::invalid_argument("Division by zero in Hadamard division.");
 
-			return a / b;
-		}
-	);
+	this->_calc(this->_data, other._data, execPolicy, std::divides<T>());
 	return *this;
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<typename execType>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::hadamard_div_copy(const Matrix<T, RowMajor, Container>& other, execType execPolicy) const requires StdExecPolicy<execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::hadamard_div_copy(const Matrix<T, RowMajor, Container>& other, execType execPolicy) const& requires StdExecPolicy<execType>
 {
 	if (this->_rows != other._rows || this->_cols != other._cols)
 		throw std::invalid_argument("Matrix dimensions must agree for Hadamard division.");
 
+	if (other._has_zero())
+		throw std::invalid_argument("Division by zero in Hadamard division.");
+
 	Container result{};
 	if constexpr (requires (Container& c) { c.resize(std::size_t{}); }) {
 		result.resize(this->_data.size());
 	}
 	std::copy(this->_data.begin(), this->_data.end(), result.begin());
-	this->_calc(result, other._data, execPolicy, 
-		[](const T& a, const T& b) {
-			if (b == T(0))
-				throw std::invalid_argument("Division by zero in Hadamard division.");
-
-			return a / b;
-		}
-	);
-	return Matrix<T, RowMajor, Container>(this->_rows, this->_cols, std::move(result));
+	this->_calc(result, other._data, execPolicy, std::divides<T>());
+	return Matrix<T, RowMajor, Container>(this->_rows, this->_cols, this->_ld, std::move(result));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::hadamard_div_copy(const Matrix& other, execType execPolicy) && requires StdExecPolicy<execType>
+{
+	return std::move(this->hadamard_div(other, execPolicy));
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<bool use_blas, typename execType>
 inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::scalar_mul(const T& scalar, execType execPolicy) requires StdExecPolicy<execType>
 {
-	if constexpr (can_use_blas<T>::value && use_blas) {
-		int n = static_cast<int>(this->_rows * this->_cols);
-		BlasGemm::ScalarMul<T>::scal(n, scalar, this->_data.data());
+	const size_t n = this->_storage_size();
+	if (const auto* provider = Backend::external_provider<T, use_blas>(Backend::Routine::Scal, n)) {
+		provider->scal(n, scalar, this->_data.data());
 	}
 	else {
 		this->_calc(this->_data, scalar, execPolicy, std::multiplies<T>());
@@ -235,7 +260,7 @@ inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::scalar_mu
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<bool use_blas, typename execType>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::scalar_mul_copy(const T& scalar, execType execPolicy) const requires StdExecPolicy<execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::scalar_mul_copy(const T& scalar, execType execPolicy) const& requires StdExecPolicy<execType>
 {
 	Container result{};
 	if constexpr (requires (Container& c) { c.resize(std::size_t{}); }) {
@@ -243,14 +268,20 @@ inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::scalar_mul
 	}
 	std::copy(this->_data.begin(), this->_data.end(), result.begin());
 
-	if constexpr (can_use_blas<T>::value && use_blas) {
-		int n = static_cast<int>(this->_rows * this->_cols);
-		BlasGemm::ScalarMul<T>::scal(n, scalar, result.data());
+	const size_t n = this->_storage_size();
+	if (const auto* provider = Backend::external_provider<T, use_blas>(Backend::Routine::Scal, n)) {
+		provider->scal(n, scalar, result.data());
 	}
 	else {
 		this->_calc(result, scalar, execPolicy, std::multiplies<T>());
 	}
-	return Matrix<T, RowMajor, Container>(this->_rows, this->_cols, std::move(result));
+	return Matrix<T, RowMajor, Container>(this->_rows, this->_cols, this->_ld, std::move(result));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<bool use_blas, typename execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::scalar_mul_copy(const T& scalar, execType execPolicy) && requires StdExecPolicy<execType>
+{
+	return std::move(this->template scalar_mul<use_blas>(scalar, execPolicy));
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<typename execType>
@@ -264,7 +295,7 @@ inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::scalar_di
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<typename execType>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::scalar_div_copy(const T& scalar, execType execPolicy) const requires StdExecPolicy<execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::scalar_div_copy(const T& scalar, execType execPolicy) const& requires StdExecPolicy<execType>
 {
 	if (scalar == T(0))
 		throw std::invalid_argument("Division by zero in scalar division.");
@@ -275,211 +306,493 @@ inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::scalar_div
 	}
 	std::copy(this->_data.begin(), this->_data.end(), result.begin());
 	this->_calc(result, scalar, execPolicy, std::divides<T>());
-	return Matrix<T, RowMajor, Container>(this->_rows, this->_cols, std::move(result));
+	return Matrix<T, RowMajor, Container>(this->_rows, this->_cols, this->_ld, std::move(result));
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<typename execType>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::sum_rows(execType execPolicy) const requires StdExecPolicy<execType>{
-	Matrix<T, RowMajor, Container> result(1, this->cols());
-	const size_t cols = this->cols();
-
-	if constexpr (RowMajor){
-		for (size_t j = 0; j < this->cols(); j++) {
-			View<const T> col = this->get_col(j);
-			T sum = std::reduce(col.begin(), col.end(), static_cast<T>(0), std::plus<T>());
-
-			result(0, j) = sum;
-		}
-	}else{
-		for (size_t j = 0; j < this->cols(); j++) {
-			const T* col = this->get_col_ptr(j);
-			T sum = std::reduce(execPolicy ,col, col + cols, static_cast<T>(0), std::plus<T>());
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::scalar_div_copy(const T& scalar, execType execPolicy) && requires StdExecPolicy<execType>
+{
+	return std::move(this->scalar_div(scalar, execPolicy));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<bool use_blas, typename execType>
+inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::axpy(const T& alpha, const Matrix& x, execType execPolicy) requires StdExecPolicy<execType>
+{
+	if (this->_rows != x._rows || this->_cols != x._cols)
+		throw std::invalid_argument("Matrix dimensions must agree for addition.");
 
-			result(0, j) = sum;
-		}
+	const size_t n = this->_storage_size();
+	if (const auto* provider = Backend::external_provider<T, use_blas>(Backend::Routine::Axpy, n)) {
+		provider->axpy(n, alpha, x._data.data(), this->_data.data());
 	}
+	else {
+		T* const dst = this->_data.data(); // 格納領域の共有の解除はスレッドに分割する前に行う
+		this->_for_each_span(execPolicy, [&](size_t offset, size_t length) {
+			T* y = dst + offset;
+			const T* in = x._data.data() + offset;
 
-	return result;
+			if constexpr (SimdKernel::vectorizable_v<T>)
+				SimdKernel::axpy(length, alpha, in, y);
+			else
+				std::transform(in, in + length, y, y, [&](const T& a, const T& b) { return alpha * a + b; });
+		});
+	}
+	return *this;
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<typename execType>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::sum_cols(execType execPolicy) const requires StdExecPolicy<execType>{
-	Matrix<T, RowMajor, Container> result(this->rows(), 1);
-	const size_t rows = this->rows();
-	const size_t cols = this->cols();
+inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::hadamard_fma(const Matrix& a, const Matrix& b, execType execPolicy) requires StdExecPolicy<execType>
+{
+	if (this->_rows != a._rows || this->_cols != a._cols || this->_rows != b._rows || this->_cols != b._cols)
+		throw std::invalid_argument("Matrix dimensions must agree for Hadamard multiplication.");
 
-	if constexpr (RowMajor){
-		for (size_t i = 0; i < this->rows(); i++) {
-			const T* row = this->get_row_ptr(i);
-			T sum = std::reduce(execPolicy, row, row + cols, static_cast<T>(0), std::plus<T>());
+	T* const dst = this->_data.data(); // 格納領域の共有の解除はスレッドに分割する前に行う
+	this->_for_each_span(execPolicy, [&](size_t offset, size_t length) {
+		T* out = dst + offset;
+		const T* pa = a._data.data() + offset;
+		const T* pb = b._data.data() + offset;
 
-			result(i, 0) = sum;
+		if constexpr (SimdKernel::vectorizable_v<T>) {
+			SimdKernel::fma(pa, pb, out, out, length);
 		}
-	}else{
-		for (size_t i = 0; i < this->rows(); i++) {
-			View<const T> row = this->get_row(i);
-			T sum = std::reduce(row.begin(), row.end(), static_cast<T>(0), std::plus<T>());
-
-			result(i, 0) = sum;
+		else {
+			for (size_t i = 0; i < length; i++)
+				out[i] += pa[i] * pb[i];
 		}
+	});
+	return *this;
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<bool AsRow>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::_from_reduction(const MatrixVector<T>& values) {
+	Matrix<T, RowMajor, Container> result(AsRow ? 1 : values.size(), AsRow ? values.size() : 1);
+	for (size_t i = 0; i < values.size(); i++) {
+		if constexpr (AsRow)
+			result(0, i) = values[i];
+		else
+			result(i, 0) = values[i];
 	}
-
 	return result;
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
-template<bool use_blas, bool OtherMajor, typename OtherContainer>
+template<typename execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::sum_rows(execType execPolicy) const requires StdExecPolicy<execType> {
+	return _from_reduction<true>(this->view().sum_rows(execPolicy));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::sum_cols(execType execPolicy) const requires StdExecPolicy<execType> {
+	return _from_reduction<false>(this->view().sum_cols(execPolicy));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::max_rows(execType execPolicy) const requires StdExecPolicy<execType> {
+	return _from_reduction<true>(this->view().max_rows(execPolicy));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::max_cols(execType execPolicy) const requires StdExecPolicy<execType> {
+	return _from_reduction<false>(this->view().max_cols(execPolicy));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::mean_rows(execType execPolicy) const requires StdExecPolicy<execType> && std::floating_point<T> {
+	return _from_reduction<true>(this->view().mean_rows(execPolicy));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::mean_cols(execType execPolicy) const requires StdExecPolicy<execType> && std::floating_point<T> {
+	return _from_reduction<false>(this->view().mean_cols(execPolicy));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::var_rows(execType execPolicy) const requires StdExecPolicy<execType> && std::floating_point<T> {
+	return _from_reduction<true>(this->view().var_rows(execPolicy));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename execType>
+inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::var_cols(execType execPolicy) const requires StdExecPolicy<execType> && std::floating_point<T> {
+	return _from_reduction<false>(this->view().var_cols(execPolicy));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename execType>
+inline std::vector<size_t> Matrix<T, RowMajor, Container>::argmax_rows(execType execPolicy) const requires StdExecPolicy<execType> {
+	return this->view().argmax_rows(execPolicy);
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename execType>
+inline std::vector<size_t> Matrix<T, RowMajor, Container>::argmax_cols(execType execPolicy) const requires StdExecPolicy<execType> {
+	return this->view().argmax_cols(execPolicy);
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<bool use_blas, bool TransThis, bool TransOther, GemmAlgorithm Algorithm, bool OtherMajor, typename OtherContainer>
 inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::matrix_mul(const Matrix<T, OtherMajor, OtherContainer>& other)
 requires (!(RowMajor == false && OtherMajor == true))
 {
-	if (this->cols() != other.rows()) {
-		throw std::invalid_argument("Matrix dimensions must agree for matrix multiplication.");
-	}
-
-	const size_t result_rows = this->rows();
-	const size_t result_cols = other.cols();
+	// op(this) = (TransThis ? this^T : this), op(other) = (TransOther ? other^T : other)
+	const size_t result_rows = TransThis ? this->cols() : this->rows();
+	const size_t result_cols = TransOther ? other.rows() : other.cols();
+	const size_t inner = TransThis ? this->rows() : this->cols();
 
-	Container result_data;
-	if constexpr (is_std_array<Container>::value) {
-		result_data = Container();
-	}else
-	{
-		result_data = Container(result_rows * result_cols);
+	if (inner != (TransOther ? other.cols() : other.rows())) {
+		throw std::invalid_argument("Matrix dimensions must agree for matrix multiplication.");
 	}
 
-	if constexpr (can_use_blas<T>::value && use_blas) {
-		int m = static_cast<int>(result_rows);
-		int n = static_cast<int>(result_cols);
-		int k = static_cast<int>(this->cols());
+	Matrix<T, RowMajor, Container> result(result_rows, result_cols);
 
-		BlasGemm::MatMul<T>::multiply(
+	if (const auto* provider = Backend::external_provider<T, use_blas>(Backend::Routine::Gemm, result_rows, result_cols, inner)) {
+		provider->gemm(
 			this->_data.data(),
 			other.data().data(),
-			result_data.data(),
-			m, n, k,
+			result._data.data(),
+			result_rows, result_cols, inner,
 			RowMajor,
-			OtherMajor
+			OtherMajor,
+			TransThis,
+			TransOther,
+			T(1), T(0),
+			this->_ld, other.ld(), result._ld
 		);
 	}else{
-		std::vector<View<T>> this_rows;
-		std::vector<View<const T>> other_cols;
-
-		this_rows.reserve(result_rows);
-		other_cols.reserve(result_cols);
-
-		for (size_t i = 0; i < result_rows; i++)
-			this_rows.emplace_back(this->get_row(i));
-		for (size_t j = 0; j < result_cols; j++)
-			other_cols.emplace_back(other.get_col(j));
-
-		auto task = [&](size_t start, size_t end) {
-			for (size_t index = start; index < end; index++) {
-				size_t row, col;
-				if constexpr (RowMajor) {
-					row = index / result_cols;
-					col = index % result_cols;
-				}
-				else {
-					col = index / result_rows;
-					row = index % result_rows;
-				}
-				
-				T value = std::transform_reduce(
-					this_rows[row].begin(), this_rows[row].end(),
-					other_cols[col].begin(),
-					T{},
-					std::plus<T>(),
-					std::multiplies<T>()
-				);
-				if constexpr (RowMajor)
-					result_data[row * result_cols + col] = value;
-				else
-					result_data[col * result_rows + row] = value;
-			}
-			};
-
-		std::vector<std::thread> threads;
-		const size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
-		const size_t total_tasks = result_rows * result_cols;
-		const size_t tasks_per_thread = (total_tasks + max_threads - 1) / max_threads;
-
-		for (size_t t = 0; t < max_threads; t++) {
-			threads.emplace_back([&, t]() {
-				size_t start = t * tasks_per_thread;
-				size_t end = std::min(start + tasks_per_thread, total_tasks);
-				task(start, end);
-				});
-		}
-
-		for (auto& thread : threads) {
-			thread.join();
-		}
+		Strassen::gemm<Algorithm>(
+			this->_data.data(),
+			other.data().data(),
+			result._data.data(),
+			result_rows, result_cols, inner,
+			RowMajor,
+			OtherMajor,
+			TransThis,
+			TransOther,
+			this->_ld, other.ld(), result._ld
+		);
 	}
 
-	this->_rows = result_rows;
-	this->_cols = result_cols;
-	this->_data = std::move(result_data);
+	this->_rows = result._rows;
+	this->_cols = result._cols;
+	this->_ld = result._ld;
+	this->_data = std::move(result._data);
 	
 	return *this;
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
-template<bool use_blas, bool OtherMajor, typename OtherContainer>
+template<bool use_blas, bool TransThis, bool TransOther, GemmAlgorithm Algorithm, bool OtherMajor, typename OtherContainer>
 inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::matrix_mul_copy(const Matrix<T, OtherMajor, OtherContainer>& other) const
 requires (!(RowMajor == false && OtherMajor == true))
 {
-	if (this->cols() != other.rows()) {
+	// op(this) = (TransThis ? this^T : this), op(other) = (TransOther ? other^T : other)
+	const size_t result_rows = TransThis ? this->cols() : this->rows();
+	const size_t result_cols = TransOther ? other.rows() : other.cols();
+	const size_t inner = TransThis ? this->rows() : this->cols();
+
+	if (inner != (TransOther ? other.cols() : other.rows())) {
 		throw std::invalid_argument("Matrix dimensions must agree for matrix multiplication.");
 	}
 
-	const size_t result_rows = this->rows();
-	const size_t result_cols = other.cols();
-
-	Container result_data;
 	if constexpr (is_std_array<Container>::value) {
 		const size_t total_elements = result_rows * result_cols;
 		if (total_elements > std::tuple_size_v<Container>) {
 			throw std::invalid_argument("Result matrix size exceeds std::array capacity.");
 		}
-		result_data = Container();
-	}else
-	{
-		result_data = Container(result_rows * result_cols);
 	}
+	Matrix<T, RowMajor, Container> result(result_rows, result_cols);
 
-	if constexpr (can_use_blas<T>::value && use_blas) {
-		int m = static_cast<int>(result_rows);
-		int n = static_cast<int>(result_cols);
-		int k = static_cast<int>(this->cols());
-
-		BlasGemm::MatMul<T>::multiply(
+	if (const auto* provider = Backend::external_provider<T, use_blas>(Backend::Routine::Gemm, result_rows, result_cols, inner)) {
+		provider->gemm(
 			this->_data.data(),
 			other.data().data(),
-			result_data.data(),
-			m, n, k,
+			result._data.data(),
+			result_rows, result_cols, inner,
 			RowMajor,
-			OtherMajor
+			OtherMajor,
+			TransThis,
+			TransOther,
+			T(1), T(0),
+			this->_ld, other.ld(), result._ld
 		);
 	}else{
-		std::vector<View<const T>> this_rows;
-		std::vector<View<const T>> other_cols;
-
-		this_rows.reserve(result_rows);
-		other_cols.reserve(result_cols);
-
-		for (size_t i = 0; i < result_rows; i++)
-			this_rows.emplace_back(this->get_row(i));
-		for (size_t j = 0; j < result_cols; j++)
-			other_cols.emplace_back(other.get_col(j));
-
-		matrix_mul_nonblas_impl<T, RowMajor, Container>(
-			result_rows,
-			result_cols,
-			this_rows,
-			other_cols,
-			result_data
+		Strassen::gemm<Algorithm>(
+			this->_data.data(),
+			other.data().data(),
+			result._data.data(),
+			result_rows, result_cols, inner,
+			RowMajor,
+			OtherMajor,
+			TransThis,
+			TransOther,
+			this->_ld, other.ld(), result._ld
 		);
 	}
 
-	return Matrix<T, RowMajor, Container>(result_rows, result_cols, std::move(result_data));
+	return result;
+}
+
+template<bool use_blas, bool TransA, bool TransB,
+	typename CType, typename AType, typename BType>
+	requires MatrixOperand<CType> && MatrixOperand<AType> && MatrixOperand<BType>
+inline void gemm_into(
+	CType&& C_,
+	const AType& A_,
+	const BType& B_,
+	matrix_operand_value_t<CType> alpha,
+	matrix_operand_value_t<CType> beta)
+{
+	using CTraits = matrix_operand_traits<std::remove_cvref_t<CType>>;
+	using T = typename CTraits::value_type;
+	constexpr bool RowMajor = CTraits::row_major;
+	constexpr bool AMajor = matrix_operand_traits<AType>::row_major;
+	constexpr bool BMajor = matrix_operand_traits<BType>::row_major;
+	static_assert(std::is_same_v<matrix_operand_value_t<AType>, T> && std::is_same_v<matrix_operand_value_t<BType>, T>, "Matrix element types must agree.");
+	static_assert(AMajor == RowMajor, "Output matrix must have the same layout as A.");
+
+	// Matrix の場合も含め、以降はビューとして扱う
+	const MatrixView<T, RowMajor> C = CTraits::mutable_view(C_);
+	const MatrixView<const T, AMajor> A = matrix_operand_traits<AType>::view(A_);
+	const MatrixView<const T, BMajor> B = matrix_operand_traits<BType>::view(B_);
+
+	const size_t M = TransA ? A.cols() : A.rows();
+	const size_t N = TransB ? B.rows() : B.cols();
+	const size_t K = TransA ? A.rows() : A.cols();
+
+	if (K != (TransB ? B.cols() : B.rows()))
+		throw std::invalid_argument("Matrix dimensions must agree for matrix multiplication.");
+	if (C.rows() != M || C.cols() != N)
+		throw std::invalid_argument("Output matrix dimensions must agree for matrix multiplication.");
+	if (C.overlaps(A) || C.overlaps(B))
+		throw std::invalid_argument("Output matrix must not alias an input matrix.");
+
+	if (M == 0 || N == 0)
+		return;
+
+	if (const auto* provider = Backend::external_provider<T, use_blas>(Backend::Routine::Gemm, M, N, K)) {
+		provider->gemm(
+			A.data(),
+			B.data(),
+			C.data(),
+			M, N, K,
+			RowMajor,
+			BMajor,
+			TransA,
+			TransB,
+			alpha,
+			beta,
+			A.ld(),
+			B.ld(),
+			C.ld()
+		);
+	}else{
+		NativeGemm::MatMul<T>::multiply(
+			A.data(),
+			B.data(),
+			C.data(),
+			M, N, K,
+			RowMajor,
+			BMajor,
+			TransA,
+			TransB,
+			alpha,
+			beta,
+			A.ld(),
+			B.ld(),
+			C.ld()
+		);
+	}
+}
+template<bool use_blas, bool TransA, bool TransB,
+	typename CType, typename AType, typename BType>
+	requires MatrixOperand<CType> && MatrixOperand<AType> && MatrixOperand<BType>
+inline void gemm_gathered_into(
+	CType&& C_,
+	const AType& A_,
+	std::span<const size_t> rows,
+	const BType& B_,
+	matrix_operand_value_t<CType> alpha,
+	matrix_operand_value_t<CType> beta)
+{
+	using CTraits = matrix_operand_traits<std::remove_cvref_t<CType>>;
+	using T = typename CTraits::value_type;
+	constexpr bool RowMajor = CTraits::row_major;
+	constexpr bool AMajor = matrix_operand_traits<AType>::row_major;
+	constexpr bool BMajor = matrix_operand_traits<BType>::row_major;
+	static_assert(std::is_same_v<matrix_operand_value_t<AType>, T> && std::is_same_v<matrix_operand_value_t<BType>, T>, "Matrix element types must agree.");
+	static_assert(AMajor == RowMajor, "Output matrix must have the same layout as A.");
+
+	const MatrixView<T, RowMajor> C = CTraits::mutable_view(C_);
+	const MatrixView<const T, AMajor> A = matrix_operand_traits<AType>::view(A_);
+	const MatrixView<const T, BMajor> B = matrix_operand_traits<BType>::view(B_);
+
+	for (size_t row : rows)
+		if (row >= A.rows())
+			throw std::out_of_range("Row index is out of range in gemm_gathered_into");
+
+	const size_t M = TransA ? A.cols() : rows.size();
+	const size_t N = TransB ? B.rows() : B.cols();
+	const size_t K = TransA ? rows.size() : A.cols();
+
+	if (K != (TransB ? B.cols() : B.rows()))
+		throw std::invalid_argument("Matrix dimensions must agree for matrix multiplication.");
+	if (C.rows() != M || C.cols() != N)
+		throw std::invalid_argument("Output matrix dimensions must agree for matrix multiplication.");
+	if (C.overlaps(A) || C.overlaps(B))
+		throw std::invalid_argument("Output matrix must not alias an input matrix.");
+
+	if (M == 0 || N == 0)
+		return;
+
+	if (Backend::external_provider<T, use_blas>(Backend::Routine::Gemm, M, N, K) != nullptr) {
+		// BLASなどは添字で読めないため、選んだ行を連続した領域に集めてから乗算する
+		Matrix<T, AMajor> gathered(rows.size(), A.cols());
+		A.gather_rows_into(rows, gathered.view(), std::execution::par);
+		gemm_into<use_blas, TransA, TransB>(C, gathered, B, alpha, beta);
+	}else{
+		NativeGemm::MatMul<T>::multiply(
+			A.data(),
+			B.data(),
+			C.data(),
+			M, N, K,
+			RowMajor,
+			BMajor,
+			TransA,
+			TransB,
+			alpha,
+			beta,
+			A.ld(),
+			B.ld(),
+			C.ld(),
+			rows.empty() ? nullptr : rows.data()
+		);
+	}
+}
+template<bool use_blas, bool TransA, bool TransB, typename AType, typename BType>
+	requires MatrixOperand<AType> && MatrixOperand<BType>
+inline Matrix<matrix_operand_value_t<AType>, matrix_operand_traits<std::remove_cvref_t<AType>>::row_major> matmul(const AType& A, const BType& B)
+{
+	const auto a = matrix_operand_traits<AType>::view(A);
+	const auto b = matrix_operand_traits<BType>::view(B);
+	const size_t K = TransA ? a.rows() : a.cols();
+	if (K != (TransB ? b.cols() : b.rows()))
+		throw std::invalid_argument("Matrix dimensions must agree for matrix multiplication.");
+
+	Matrix<matrix_operand_value_t<AType>, matrix_operand_traits<std::remove_cvref_t<AType>>::row_major> result(
+		TransA ? a.cols() : a.rows(),
+		TransB ? b.rows() : b.cols());
+	gemm_into<use_blas, TransA, TransB>(result, a, b);
+	return result;
+}
+
+template<bool use_blas, bool TransA, bool TransB,
+	typename CType, typename AType, typename BType>
+	requires MatrixOperand<CType> && MatrixOperand<AType> && MatrixOperand<BType>
+inline void gemm_batched(
+	size_t batch,
+	CType&& C_,
+	const AType& A_,
+	const BType& B_,
+	matrix_operand_value_t<CType> alpha,
+	matrix_operand_value_t<CType> beta)
+{
+	using CTraits = matrix_operand_traits<std::remove_cvref_t<CType>>;
+	using T = typename CTraits::value_type;
+	constexpr bool RowMajor = CTraits::row_major;
+	constexpr bool AMajor = matrix_operand_traits<AType>::row_major;
+	constexpr bool BMajor = matrix_operand_traits<BType>::row_major;
+	static_assert(std::is_same_v<matrix_operand_value_t<AType>, T> && std::is_same_v<matrix_operand_value_t<BType>, T>, "Matrix element types must agree.");
+	static_assert(AMajor == RowMajor, "Output matrix must have the same layout as A.");
+
+	const MatrixView<T, RowMajor> C = CTraits::mutable_view(C_);
+	const MatrixView<const T, AMajor> A = matrix_operand_traits<AType>::view(A_);
+	const MatrixView<const T, BMajor> B = matrix_operand_traits<BType>::view(B_);
+
+	if (batch == 0)
+		return;
+	if (A.rows() % batch != 0 || B.rows() % batch != 0 || C.rows() % batch != 0)
+		throw std::invalid_argument("Row counts must be divisible by the batch size.");
+
+	// 1つの行列の行数と、隣り合う行列の先頭要素の間隔 (行優先なら行数 * ld、列優先なら行数)
+	const size_t rows_a = A.rows() / batch, rows_b = B.rows() / batch, rows_c = C.rows() / batch;
+	const size_t stride_a = AMajor ? rows_a * A.ld() : rows_a;
+	const size_t stride_b = BMajor ? rows_b * B.ld() : rows_b;
+	const size_t stride_c = RowMajor ? rows_c * C.ld() : rows_c;
+
+	const size_t M = TransA ? A.cols() : rows_a;
+	const size_t N = TransB ? rows_b : B.cols();
+	const size_t K = TransA ? rows_a : A.cols();
+
+	if (K != (TransB ? B.cols() : rows_b))
+		throw std::invalid_argument("Matrix dimensions must agree for matrix multiplication.");
+	if (rows_c != M || C.cols() != N)
+		throw std::invalid_argument("Output matrix dimensions must agree for matrix multiplication.");
+	if (C.overlaps(A) || C.overlaps(B))
+		throw std::invalid_argument("Output matrix must not alias an input matrix.");
+
+	if (M == 0 || N == 0)
+		return;
+
+	// まとめて1回呼び出す場合の固定費で見積もるため、K方向に batch 倍した1つの積としてプロバイダを選ぶ
+	if (const auto* provider = Backend::external_provider<T, use_blas>(Backend::Routine::Gemm, M, N, K * batch)) {
+		if (provider->gemm_batched != nullptr) {
+			provider->gemm_batched(
+				A.data(), stride_a,
+				B.data(), stride_b,
+				C.data(), stride_c,
+				batch, M, N, K,
+				RowMajor, BMajor, TransA, TransB,
+				alpha, beta,
+				A.ld(), B.ld(), C.ld());
+		}
+		else {
+			for (size_t i = 0; i < batch; i++)
+				provider->gemm(A.data() + i * stride_a, B.data() + i * stride_b, C.data() + i * stride_c,
+					M, N, K, RowMajor, BMajor, TransA, TransB, alpha, beta, A.ld(), B.ld(), C.ld());
+		}
+	}else{
+		NativeGemm::BatchedMatMul<T>::multiply(
+			A.data(), stride_a,
+			B.data(), stride_b,
+			C.data(), stride_c,
+			batch, M, N, K,
+			RowMajor, BMajor, TransA, TransB,
+			alpha, beta,
+			A.ld(), B.ld(), C.ld());
+	}
+}
+
+template<bool use_blas, bool TransA, bool TransB,
+	typename T, bool RowMajor, typename AType, typename BType>
+	requires MatrixOperand<AType> && MatrixOperand<BType>
+inline void gemm_batched(
+	const std::vector<MatrixView<T, RowMajor>>& C,
+	const std::vector<AType>& A,
+	const std::vector<BType>& B,
+	std::type_identity_t<T> alpha,
+	std::type_identity_t<T> beta)
+{
+	if (A.size() != C.size() || B.size() != C.size())
+		throw std::invalid_argument("Batch sizes must agree.");
+
+	// 形状が異なる場合もあるため、各積の演算量の平均で1つのタスクの積の数を決める
+	size_t work = 0;
+	bool external = false;
+	for (size_t i = 0; i < C.size(); i++) {
+		const auto a = matrix_operand_traits<AType>::view(A[i]);
+		const size_t K = TransA ? a.rows() : a.cols();
+		work += C[i].rows() * C[i].cols() * K;
+		external = external || Backend::external_provider<T, use_blas>(Backend::Routine::Gemm, C[i].rows(), C[i].cols(), K) != nullptr;
+	}
+
+	// ネイティブ以外のプロバイダが選ばれる積がある場合は、各積を順に gemm_into で計算する
+	if (external) {
+		for (size_t i = 0; i < C.size(); i++)
+			gemm_into<use_blas, TransA, TransB>(C[i], A[i], B[i], alpha, beta);
+		return;
+	}
+
+	const size_t average = std::max<size_t>(work / std::max<size_t>(C.size(), 1), 1);
+	const size_t grain = std::max<size_t>(NativeGemm::MatMul<T>::parallel_threshold / average, 1);
+
+	ThreadPool::instance().parallel_for(0, C.size(), grain, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			gemm_into<false, TransA, TransB>(C[i], A[i], B[i], alpha, beta);
+	});
 }
 
 #endif
\ No newline at end of file
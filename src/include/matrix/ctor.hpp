@@ -4,34 +4,70 @@
 #include "matrix.h" 
 #include <algorithm>
 #include <stdexcept>
+#include <utility>
 
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
-inline Matrix<T, RowMajor, Container>::Matrix() : _rows(0), _cols(0), _data()
+inline Matrix<T, RowMajor, Container>::Matrix() : _rows(0), _cols(0), _ld(0), _data()
 {  
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
-inline Matrix<T, RowMajor, Container>::Matrix(size_t rows, size_t cols)
+inline Matrix<T, RowMajor, Container>::Matrix(size_t rows, size_t cols, size_t ld, Container&& storage)
+    : _rows(rows), _cols(cols), _ld(ld), _data(std::move(storage))
+{
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+inline size_t Matrix<T, RowMajor, Container>::_leading_dim(size_t inner)
+{
+    if constexpr (_padding == 0) {
+        return inner;
+    }
+    else {
+        // 行(列)の先頭がアライメント境界に揃うように切り上げる
+        constexpr size_t step = std::max<size_t>(_padding / sizeof(T), 1);
+        size_t ld = (inner + step - 1) / step * step;
+
+        // 格納間隔が4KiBの倍数だと各行(列)の先頭が同じキャッシュセットに載るため、1ブロック分ずらす
+        if (ld != 0 && (ld * sizeof(T)) % 4096 == 0)
+            ld += step;
+
+        return ld;
+    }
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+inline void Matrix<T, RowMajor, Container>::_allocate(size_t rows, size_t cols)
 {
     this->_rows = rows;
     this->_cols = cols;
+    this->_ld = _leading_dim(RowMajor ? cols : rows);
 
     if constexpr (is_std_array<Container>::value) {
         // std::arrayのサイズチェックを追加
-        if (this->_rows * this->_cols > std::tuple_size_v<Container>) {
+        if (this->_storage_size() > std::tuple_size_v<Container>) {
             throw std::invalid_argument("Matrix dimensions do not match std::array size");
         }
         this->_data = Container();
     }
     else {
-        this->_data = Container(this->_rows * this->_cols);
+        this->_data = Container(this->_storage_size());
     }
 }
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+inline size_t Matrix<T, RowMajor, Container>::_storage_size() const noexcept
+{
+    return (RowMajor ? this->_rows : this->_cols) * this->_ld;
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+inline Matrix<T, RowMajor, Container>::Matrix(size_t rows, size_t cols)
+{
+    this->_allocate(rows, cols);
+}
 template<typename T, bool RowMajor, typename Container>
 requires VectorOrArray<Container>
 inline Matrix<T, RowMajor, Container>::Matrix(size_t rows, size_t cols, Container array)
 {
     this->_rows = rows;
     this->_cols = cols;
+    this->_ld = RowMajor ? cols : rows;
 
     const size_t expected = rows * cols;
 
@@ -47,7 +83,18 @@ inline Matrix<T, RowMajor, Container>::Matrix(size_t rows, size_t cols, Containe
             throw std::invalid_argument("Container size does not match matrix dimensions");
         }
         
-        this->_data = std::move(array);
+        if constexpr (_padding == 0) {
+            this->_data = std::move(array);
+        }
+        else {
+            // 詰めて格納されたデータをパディング付きの格納領域にコピーし直す
+            const size_t inner = RowMajor ? cols : rows;
+            this->_allocate(rows, cols);
+
+            const size_t outer = RowMajor ? rows : cols;
+            for (size_t i = 0; i < outer; i++)
+                std::copy(array.begin() + i * inner, array.begin() + (i + 1) * inner, this->_data.begin() + i * this->_ld);
+        }
     }
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
@@ -58,39 +105,25 @@ requires
     std::convertible_to<std::invoke_result_t<InitFunc>, T> &&
     StdExecPolicy<ExecPolicy>
 {
-    this->_rows = rows;
-    this->_cols = cols;
+    this->_allocate(rows, cols);
 
-    if constexpr (is_std_array<Container>::value) {
-        // std::arrayのサイズチェックを追加
-        if (this->_rows * this->_cols > std::tuple_size_v<Container>) {
-            throw std::invalid_argument("Matrix dimensions do not match std::array size");
-        }
-        this->_data = Container();
+    if constexpr (_padding == 0) {
+        std::for_each(execPolicy, _data.begin(), _data.end(),
+                  [&](T& x){ x = func(); });
     }
     else {
-        this->_data = Container(this->_rows * this->_cols);
+        // パディング領域には初期化関数を適用しない
+        const size_t outer = RowMajor ? rows : cols;
+        const size_t inner = RowMajor ? cols : rows;
+        for (size_t i = 0; i < outer; i++)
+            std::for_each(execPolicy, _data.begin() + i * _ld, _data.begin() + i * _ld + inner,
+                      [&](T& x){ x = func(); });
     }
-
-    std::for_each(execPolicy, _data.begin(), _data.end(),
-              [&](T& x){ x = func(); });
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline Matrix<T, RowMajor, Container>::Matrix(const Container2D& data)
 {  
-   this->_rows = data.size();  
-   this->_cols = data.empty() ? 0 : data[0].size();
-
-   if constexpr (is_std_array<Container>::value) {
-       // std::arrayのサイズチェックを追加
-       if (this->_rows * this->_cols > std::tuple_size_v<Container>) {
-           throw std::invalid_argument("Matrix dimensions do not match std::array size");
-       }
-       this->_data = Container();
-   }
-   else {
-       this->_data = Container(this->_rows * this->_cols);
-   }
+   this->_allocate(data.size(), data.empty() ? 0 : data[0].size());
 
    const size_t outer = RowMajor ? _rows : _cols;  
    const size_t inner = RowMajor ? _cols : _rows;
@@ -105,24 +138,13 @@ inline Matrix<T, RowMajor, Container>::Matrix(const Container2D& data)
 
            index++;
        }  
+       index += _ld - inner;
    }  
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline Matrix<T, RowMajor, Container>::Matrix(const InitContainer2D& data)
 {  
-   this->_rows = data.size();  
-   this->_cols = data.size() == 0 ? 0 : data.begin()->size();
-        
-   if constexpr (is_std_array<Container>::value) {
-       // std::arrayのサイズチェックを追加
-       if (this->_rows * this->_cols > std::tuple_size_v<Container>) {
-           throw std::invalid_argument("Matrix dimensions do not match std::array size");
-       }
-       this->_data = Container();
-   }
-   else {
-       this->_data = Container(this->_rows * this->_cols);
-   }
+   this->_allocate(data.size(), data.size() == 0 ? 0 : data.begin()->size());
 
    const size_t outer = RowMajor ? _rows : _cols;  
    const size_t inner = RowMajor ? _cols : _rows;  
@@ -136,7 +158,38 @@ inline Matrix<T, RowMajor, Container>::Matrix(const InitContainer2D& data)
 
            index++;
        }
+       index += _ld - inner;
    }
 }
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename Expr> requires MatrixExpression<Expr>
+inline Matrix<T, RowMajor, Container>::Matrix(const Expr& expr) : Matrix(expr.rows(), expr.cols())
+{
+    this->assign(expr);
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename Expr> requires MatrixExpression<Expr> && (!std::is_reference_v<Expr>) && (!std::is_const_v<Expr>)
+inline Matrix<T, RowMajor, Container>::Matrix(Expr&& expr) : Matrix()
+{
+    // 要素ごとに独立しているため、被演算子の格納領域にそのまま書き込める
+    if (Matrix* storage = expr.template reusable<Matrix>(expr.rows(), expr.cols())) {
+        storage->assign(expr);
+        *this = std::move(*storage);
+    }
+    else {
+        *this = Matrix(std::as_const(expr));
+    }
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+inline Matrix<T, RowMajor, Container>::Matrix(MatrixView<const T, RowMajor> view) : Matrix(view.rows(), view.cols())
+{
+    // ビューの格納間隔と自身のリーディングディメンションは異なるため、行(列)ごとにコピーする
+    const size_t outer = RowMajor ? view.rows() : view.cols();
+    const size_t inner = RowMajor ? view.cols() : view.rows();
+    for (size_t line = 0; line < outer; line++) {
+        const T* src = view.data() + line * view.ld();
+        std::copy(src, src + inner, this->_data.data() + line * this->_ld);
+    }
+}
 
 #endif // SANAE_NEURALNETWORK_MATRIX_CTOR
\ No newline at end of file
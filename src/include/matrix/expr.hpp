@@ -0,0 +1,431 @@
+﻿#ifndef SANAE_NEURALNETWORK_MATRIX_EXPR
+#define SANAE_NEURALNETWORK_MATRIX_EXPR
+
+#include "matrix.h"
+#include <algorithm>
+#include <functional>
+#include <iosfwd>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief 要素ごとの演算を遅延評価する式テンプレート
+ *
+ * 被演算子がすべて行列の場合、operator+ などは評価した行列を返します (auto c = a + b; は行列になります)。
+ * 被演算子に式ノード (MatrixExpr::lazy() や MatrixExpr::map() で作った式) を含む場合は式ノードを返し、
+ * Matrix に代入(または構築)した時点で1回のループでまとめて評価します。
+ * lazy(a) - b * lr のように書けば、式全体で中間バッファを確保しません。
+ * 式ノードは lvalue の行列を参照として保持し、rvalue の行列(一時オブジェクト)は式ノード内にムーブして保持します。
+ * 一時的な式から Matrix を構築する場合は、式が保持している同じ形状の rvalue の行列の格納領域に評価して受け取るため、
+ * std::move(a) + b や a.add_copy(b) - c のような式は新しい格納領域を確保しません。
+ */
+namespace MatrixExpr {
+	// Matrix判定用の型
+	template<typename T> struct is_matrix : std::false_type {};
+	template<typename T, bool RowMajor, typename Container>
+	struct is_matrix<Matrix<T, RowMajor, Container>> : std::true_type {
+		using value_type = T;
+		static constexpr bool row_major = RowMajor;
+		static constexpr bool padded = container_padding<Container>::value != 0;
+	};
+	template<typename T>
+	inline constexpr bool is_matrix_v = is_matrix<std::remove_cvref_t<T>>::value;
+
+	// 式の被演算子(Matrixまたは式ノード)判定用の型
+	template<typename T>
+	concept Operand = is_matrix_v<T> || MatrixExpression<T>;
+
+	/**
+	 * @brief 被演算子の要素型とメモリレイアウトを取得します。
+	 */
+	template<typename T, bool = is_matrix_v<T>>
+	struct operand_traits {
+		using value_type = typename std::remove_cvref_t<T>::value_type;
+		static constexpr bool row_major = std::remove_cvref_t<T>::row_major;
+	};
+	template<typename T>
+	struct operand_traits<T, true> {
+		using value_type = typename is_matrix<std::remove_cvref_t<T>>::value_type;
+		static constexpr bool row_major = is_matrix<std::remove_cvref_t<T>>::row_major;
+	};
+
+	/**
+	 * @brief 式ノードの共通基底(CRTP)
+	 * @tparam Derived 派生した式ノードの型
+	 */
+	template<typename Derived>
+	class Base : public MatrixExprTag {
+	public:
+		/**
+		 * @brief 式を評価して新しい行列を返します。
+		 * @return 評価結果の行列
+		 */
+		auto eval() const& {
+			const Derived& self = static_cast<const Derived&>(*this);
+			return Matrix<typename Derived::value_type, Derived::row_major>(self);
+		}
+		/**
+		 * @brief 式を評価して新しい行列を返します。式が一時的な行列を所有している場合は、その格納領域に評価して返します。
+		 * @return 評価結果の行列
+		 */
+		auto eval() && {
+			Derived& self = static_cast<Derived&>(*this);
+			return Matrix<typename Derived::value_type, Derived::row_major>(std::move(self));
+		}
+	};
+
+	/**
+	 * @brief lvalue の行列を参照する葉ノード
+	 * @tparam Padded 参照する行列がパディング付きの格納領域を持つかどうか
+	 */
+	template<typename T, bool RowMajor, bool Padded = false>
+	class Ref : public Base<Ref<T, RowMajor, Padded>> {
+	private:
+		const T* _data;
+		size_t _rows, _cols, _ld;
+	public:
+		using value_type = T;
+		static constexpr bool row_major = RowMajor;
+		static constexpr bool contiguous = !Padded;
+
+		template<typename Container>
+		explicit Ref(const Matrix<T, RowMajor, Container>& mat)
+			: _data(mat.data().data()), _rows(mat.rows()), _cols(mat.cols()), _ld(mat.ld()) {}
+
+		size_t rows() const noexcept { return this->_rows; }
+		size_t cols() const noexcept { return this->_cols; }
+		T operator[](size_t index) const { return this->_data[index]; }
+		T at(size_t line, size_t index) const { return this->_data[line * this->_ld + index]; }
+
+		/// 参照している行列は再利用できないため、常に nullptr を返します。
+		template<typename M>
+		M* reusable(size_t, size_t) noexcept { return nullptr; }
+	};
+
+	/**
+	 * @brief rvalue の行列を所有する葉ノード
+	 */
+	template<typename M>
+	class Owned : public Base<Owned<M>> {
+	private:
+		M _mat;
+	public:
+		using value_type = typename is_matrix<M>::value_type;
+		static constexpr bool row_major = is_matrix<M>::row_major;
+		static constexpr bool contiguous = !is_matrix<M>::padded;
+
+		explicit Owned(M&& mat) : _mat(std::move(mat)) {}
+
+		size_t rows() const noexcept { return this->_mat.rows(); }
+		size_t cols() const noexcept { return this->_mat.cols(); }
+		value_type operator[](size_t index) const { return this->_mat[index]; }
+		value_type at(size_t line, size_t index) const { return this->_mat.data()[line * this->_mat.ld() + index]; }
+
+		/**
+		 * @brief 所有している行列が型 Target で rows 行 cols 列の場合に、その行列を返します。
+		 * @note 式の各要素は被演算子の同じ位置の要素だけから求まるため、評価結果をこの行列に直接書き込めます。
+		 */
+		template<typename Target>
+		Target* reusable(size_t rows, size_t cols) noexcept {
+			if constexpr (std::is_same_v<Target, M>)
+				return (this->_mat.rows() == rows && this->_mat.cols() == cols) ? &this->_mat : nullptr;
+			else
+				return nullptr;
+		}
+	};
+
+	/**
+	 * @brief 二つの式の要素ごとの演算ノード
+	 * @tparam Op 二項演算の関数オブジェクト
+	 */
+	template<typename Op, typename L, typename R>
+	class Binary : public Base<Binary<Op, L, R>> {
+	private:
+		L _lhs;
+		R _rhs;
+	public:
+		using value_type = typename L::value_type;
+		static constexpr bool row_major = L::row_major;
+		static constexpr bool contiguous = L::contiguous && R::contiguous;
+
+		static_assert(std::is_same_v<value_type, typename R::value_type>, "Matrix element types must agree.");
+		static_assert(L::row_major == R::row_major, "Matrix layouts must agree.");
+
+		Binary(L lhs, R rhs, const char* message) : _lhs(std::move(lhs)), _rhs(std::move(rhs)) {
+			if (this->_lhs.rows() != this->_rhs.rows() || this->_lhs.cols() != this->_rhs.cols())
+				throw std::invalid_argument(message);
+		}
+
+		size_t rows() const noexcept { return this->_lhs.rows(); }
+		size_t cols() const noexcept { return this->_lhs.cols(); }
+		value_type operator[](size_t index) const {
+			return static_cast<value_type>(Op{}(this->_lhs[index], this->_rhs[index]));
+		}
+		value_type at(size_t line, size_t index) const {
+			return static_cast<value_type>(Op{}(this->_lhs.at(line, index), this->_rhs.at(line, index)));
+		}
+
+		template<typename M>
+		M* reusable(size_t rows, size_t cols) noexcept {
+			M* mat = this->_lhs.template reusable<M>(rows, cols);
+			return mat ? mat : this->_rhs.template reusable<M>(rows, cols);
+		}
+	};
+
+	/**
+	 * @brief 式とスカラーの要素ごとの演算ノード
+	 * @tparam Op 二項演算の関数オブジェクト
+	 */
+	template<typename Op, typename E>
+	class Scalar : public Base<Scalar<Op, E>> {
+	private:
+		E _expr;
+		typename E::value_type _scalar;
+	public:
+		using value_type = typename E::value_type;
+		static constexpr bool row_major = E::row_major;
+		static constexpr bool contiguous = E::contiguous;
+
+		Scalar(E expr, const value_type& scalar) : _expr(std::move(expr)), _scalar(scalar) {}
+
+		size_t rows() const noexcept { return this->_expr.rows(); }
+		size_t cols() const noexcept { return this->_expr.cols(); }
+		value_type operator[](size_t index) const {
+			return static_cast<value_type>(Op{}(this->_expr[index], this->_scalar));
+		}
+		value_type at(size_t line, size_t index) const {
+			return static_cast<value_type>(Op{}(this->_expr.at(line, index), this->_scalar));
+		}
+
+		template<typename M>
+		M* reusable(size_t rows, size_t cols) noexcept { return this->_expr.template reusable<M>(rows, cols); }
+	};
+
+	/**
+	 * @brief 式の各要素に関数を適用するノード
+	 * @tparam Func value_type(value_type) として呼び出せる関数オブジェクト
+	 */
+	template<typename E, typename Func>
+	class Map : public Base<Map<E, Func>> {
+	private:
+		E _expr;
+		Func _func;
+	public:
+		using value_type = typename E::value_type;
+		static constexpr bool row_major = E::row_major;
+		static constexpr bool contiguous = E::contiguous;
+
+		Map(E expr, Func func) : _expr(std::move(expr)), _func(std::move(func)) {}
+
+		size_t rows() const noexcept { return this->_expr.rows(); }
+		size_t cols() const noexcept { return this->_expr.cols(); }
+		value_type operator[](size_t index) const {
+			return static_cast<value_type>(this->_func(this->_expr[index]));
+		}
+		value_type at(size_t line, size_t index) const {
+			return static_cast<value_type>(this->_func(this->_expr.at(line, index)));
+		}
+
+		template<typename M>
+		M* reusable(size_t rows, size_t cols) noexcept { return this->_expr.template reusable<M>(rows, cols); }
+	};
+
+	/**
+	 * @brief 被演算子を式ノードに変換します。
+	 * @return lvalue の行列は Ref、rvalue の行列は Owned、式ノードはそのままのコピー
+	 */
+	template<Operand X>
+	inline auto to_node(X&& x) {
+		using D = std::remove_cvref_t<X>;
+		if constexpr (!is_matrix_v<D>)
+			return D(std::forward<X>(x));
+		else if constexpr (std::is_lvalue_reference_v<X>)
+			return Ref<typename is_matrix<D>::value_type, is_matrix<D>::row_major, is_matrix<D>::padded>(x);
+		else
+			return Owned<D>(std::move(x));
+	}
+
+	/**
+	 * @brief 行列を式ノードとして扱います。これを含む演算は結果の行列ではなく式ノードを返し、代入するまで評価されません。
+	 * @param x 行列または式
+	 * @return lvalue の行列は参照する式ノード、rvalue の行列は所有する式ノード、式はそのまま
+	 * @note 式ノードは lvalue の行列を参照で保持します。参照先の行列より長く保持したり、参照先を変更してから評価したりしないでください。
+	 */
+	template<Operand X>
+	inline auto lazy(X&& x) {
+		return to_node(std::forward<X>(x));
+	}
+
+	/**
+	 * @brief 演算子の戻り値を作ります。
+	 * @return 被演算子 L, R がどちらも行列の場合は node を評価した行列 (L と同じ型)、式を含む場合は node そのもの
+	 */
+	template<typename L, typename R = L, typename Node>
+	inline auto result(Node node) {
+		if constexpr (is_matrix_v<L> && is_matrix_v<R>)
+			return std::remove_cvref_t<L>(std::move(node));
+		else
+			return node;
+	}
+
+	/**
+	 * @brief 行列に0の要素が含まれていないか確認します。
+	 * @throws std::invalid_argument 0の要素が含まれている場合
+	 */
+	template<Operand X> requires is_matrix_v<X>
+	inline void check_divisor(const X& x) {
+		using value_type = typename is_matrix<std::remove_cvref_t<X>>::value_type;
+		const auto* data = x.data().data();
+		const size_t outer = operand_traits<X>::row_major ? x.rows() : x.cols();
+		const size_t inner = operand_traits<X>::row_major ? x.cols() : x.rows();
+
+		// パディング領域は確認しない
+		for (size_t line = 0; line < outer; line++) {
+			const auto* begin = data + line * x.ld();
+			if (std::find(begin, begin + inner, value_type(0)) != begin + inner)
+				throw std::invalid_argument("Division by zero in Hadamard division.");
+		}
+	}
+
+	/**
+	 * @brief 式の各要素に関数を遅延適用します。
+	 * @param x 行列または式
+	 * @param func 要素に適用する関数オブジェクト
+	 * @return 式ノード
+	 */
+	template<Operand X, typename Func>
+	inline auto map(X&& x, Func func) {
+		auto node = to_node(std::forward<X>(x));
+		return Map<decltype(node), Func>(std::move(node), std::move(func));
+	}
+}
+
+/**
+ * @brief 行列(または式)同士の加算を行います。
+ * @return 被演算子がすべて行列の場合は結果の行列、式を含む場合は遅延評価される式ノード
+ * @throws std::invalid_argument 行列の次元が一致しない場合
+ */
+template<MatrixExpr::Operand L, MatrixExpr::Operand R>
+inline auto operator+(L&& lhs, R&& rhs)
+{
+	auto l = MatrixExpr::to_node(std::forward<L>(lhs));
+	auto r = MatrixExpr::to_node(std::forward<R>(rhs));
+	return MatrixExpr::result<L, R>(MatrixExpr::Binary<std::plus<>, decltype(l), decltype(r)>(std::move(l), std::move(r), "Matrix dimensions must agree for addition."));
+}
+
+/**
+ * @brief 行列(または式)同士の減算を行います。
+ * @return 被演算子がすべて行列の場合は結果の行列、式を含む場合は遅延評価される式ノード
+ * @throws std::invalid_argument 行列の次元が一致しない場合
+ */
+template<MatrixExpr::Operand L, MatrixExpr::Operand R>
+inline auto operator-(L&& lhs, R&& rhs)
+{
+	auto l = MatrixExpr::to_node(std::forward<L>(lhs));
+	auto r = MatrixExpr::to_node(std::forward<R>(rhs));
+	return MatrixExpr::result<L, R>(MatrixExpr::Binary<std::minus<>, decltype(l), decltype(r)>(std::move(l), std::move(r), "Matrix dimensions must agree for subtraction."));
+}
+
+/**
+ * @brief 行列(または式)同士のアダマール積を行います。
+ * @return 被演算子がすべて行列の場合は結果の行列、式を含む場合は遅延評価される式ノード
+ * @throws std::invalid_argument 行列の次元が一致しない場合
+ * @note ^ は + や - より優先順位が低いため、他の演算子と組み合わせる場合は括弧で囲んでください。
+ */
+template<MatrixExpr::Operand L, MatrixExpr::Operand R>
+inline auto operator^(L&& lhs, R&& rhs)
+{
+	auto l = MatrixExpr::to_node(std::forward<L>(lhs));
+	auto r = MatrixExpr::to_node(std::forward<R>(rhs));
+	return MatrixExpr::result<L, R>(MatrixExpr::Binary<std::multiplies<>, decltype(l), decltype(r)>(std::move(l), std::move(r), "Matrix dimensions must agree for Hadamard multiplication."));
+}
+
+/**
+ * @brief 行列(または式)同士の要素ごとの除算を行います。
+ * @return 被演算子がすべて行列の場合は結果の行列、式を含む場合は遅延評価される式ノード
+ * @throws std::invalid_argument 行列の次元が一致しない場合、または除数に0が含まれる場合
+ * @note 除数が式の場合は、先に一時的な行列に評価して0を確認します。代入先に書き込む前に例外を送出するため、失敗しても代入先は変わりません。
+ */
+template<MatrixExpr::Operand L, MatrixExpr::Operand R>
+inline auto operator/(L&& lhs, R&& rhs)
+{
+	auto l = MatrixExpr::to_node(std::forward<L>(lhs));
+	if constexpr (MatrixExpr::is_matrix_v<R>) {
+		MatrixExpr::check_divisor(rhs);
+		auto r = MatrixExpr::to_node(std::forward<R>(rhs));
+		return MatrixExpr::result<L, R>(MatrixExpr::Binary<std::divides<>, decltype(l), decltype(r)>(std::move(l), std::move(r), "Matrix dimensions must agree for Hadamard division."));
+	}
+	else {
+		using traits = MatrixExpr::operand_traits<R>;
+		Matrix<typename traits::value_type, traits::row_major> divisor(std::forward<R>(rhs));
+		MatrixExpr::check_divisor(divisor);
+		auto r = MatrixExpr::to_node(std::move(divisor));
+		return MatrixExpr::result<L, R>(MatrixExpr::Binary<std::divides<>, decltype(l), decltype(r)>(std::move(l), std::move(r), "Matrix dimensions must agree for Hadamard division."));
+	}
+}
+
+/**
+ * @brief 行列(または式)の各要素にスカラーを加算します。
+ * @return 被演算子がすべて行列の場合は結果の行列、式を含む場合は遅延評価される式ノード
+ */
+template<MatrixExpr::Operand L>
+inline auto operator+(L&& lhs, const typename MatrixExpr::operand_traits<L>::value_type& scalar)
+{
+	auto l = MatrixExpr::to_node(std::forward<L>(lhs));
+	return MatrixExpr::result<L>(MatrixExpr::Scalar<std::plus<>, decltype(l)>(std::move(l), scalar));
+}
+
+/**
+ * @brief 行列(または式)の各要素からスカラーを減算します。
+ * @return 被演算子がすべて行列の場合は結果の行列、式を含む場合は遅延評価される式ノード
+ */
+template<MatrixExpr::Operand L>
+inline auto operator-(L&& lhs, const typename MatrixExpr::operand_traits<L>::value_type& scalar)
+{
+	auto l = MatrixExpr::to_node(std::forward<L>(lhs));
+	return MatrixExpr::result<L>(MatrixExpr::Scalar<std::minus<>, decltype(l)>(std::move(l), scalar));
+}
+
+/**
+ * @brief 行列(または式)の各要素にスカラーを乗算します。
+ * @return 被演算子がすべて行列の場合は結果の行列、式を含む場合は遅延評価される式ノード
+ * @note 行列同士の * は行列積(Matrix::operator*)です。
+ */
+template<MatrixExpr::Operand L>
+inline auto operator*(L&& lhs, const typename MatrixExpr::operand_traits<L>::value_type& scalar)
+{
+	auto l = MatrixExpr::to_node(std::forward<L>(lhs));
+	return MatrixExpr::result<L>(MatrixExpr::Scalar<std::multiplies<>, decltype(l)>(std::move(l), scalar));
+}
+
+/**
+ * @brief 行列(または式)の各要素をスカラーで除算します。
+ * @return 被演算子がすべて行列の場合は結果の行列、式を含む場合は遅延評価される式ノード
+ * @throws std::invalid_argument スカラーが0の場合
+ */
+template<MatrixExpr::Operand L>
+inline auto operator/(L&& lhs, const typename MatrixExpr::operand_traits<L>::value_type& scalar)
+{
+	using value_type = typename MatrixExpr::operand_traits<L>::value_type;
+	if (scalar == value_type(0))
+		throw std::invalid_argument("Scalar value cannot be zero for division.");
+
+	auto l = MatrixExpr::to_node(std::forward<L>(lhs));
+	return MatrixExpr::result<L>(MatrixExpr::Scalar<std::divides<>, decltype(l)>(std::move(l), scalar));
+}
+
+/**
+ * @brief 式を評価して出力ストリームに出力します。
+ * @param os 出力ストリーム
+ * @param expr 出力する式
+ * @return 出力ストリームへの参照
+ */
+template<typename Expr> requires MatrixExpression<Expr>
+std::ostream& operator<<(std::ostream& os, const Expr& expr)
+{
+	return os << expr.eval();
+}
+
+#endif // SANAE_NEURALNETWORK_MATRIX_EXPR
\ No newline at end of file
@@ -0,0 +1,366 @@
+﻿#ifndef SANAE_NEURALNETWORK_FIXEDMATRIX
+#define SANAE_NEURALNETWORK_FIXEDMATRIX
+
+#include "matrix.h"
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace FixedKernel {
+	/// 完全に展開するループの最大回数。これを超える場合は定数回のループにしてコンパイラの最適化に任せます。
+	inline constexpr size_t unroll_limit = 64;
+
+	/**
+	 * @brief f(0), f(1), ..., f(N - 1) を呼び出します。N が unroll_limit 以下の場合は完全に展開します。
+	 */
+	template<size_t N, typename Func>
+	constexpr void unroll(Func&& func) {
+		if constexpr (N <= unroll_limit) {
+			[&]<size_t... I>(std::index_sequence<I...>) {
+				(func(I), ...);
+			}(std::make_index_sequence<N>{});
+		}
+		else {
+			for (size_t i = 0; i < N; i++)
+				func(i);
+		}
+	}
+
+	template<typename A, typename T, size_t... I>
+	constexpr void axpy_unrolled(A* acc, A x, const T* b, std::index_sequence<I...>) {
+		((acc[I] += x * b[I]), ...);
+	}
+
+	/**
+	 * @brief acc[i] += x * b[i] (i = 0, ..., N - 1)
+	 * @tparam A 累積値の型 (16ビット浮動小数点数の場合は float)
+	 * @note 関数呼び出しを挟まない式の展開にして、入れ子になっても確実にインライン化されるようにしています。
+	 */
+	template<size_t N, typename A, typename T>
+	constexpr void axpy(A* acc, A x, const T* b) {
+		if constexpr (N <= unroll_limit) {
+			axpy_unrolled(acc, x, b, std::make_index_sequence<N>{});
+		}
+		else {
+			for (size_t i = 0; i < N; i++)
+				acc[i] += x * b[i];
+		}
+	}
+}
+
+/**
+ * @class FixedMatrix
+ * @brief 行数と列数がコンパイル時に決まる小さな行列
+ *
+ * 要素は std::array としてオブジェクト内に格納されるため、ヒープ確保やスレッドの起動を一切行いません。
+ * 形状はテンプレート引数で表されるため、加算や行列積の次元の不一致はコンパイルエラーになります。
+ * 要素演算は FixedKernel で展開され、行列積は形状に特化したSIMDカーネルで計算されるため、数十要素程度の行列を低レイテンシで計算できます。
+ * 多くの演算は constexpr で、定数式の中でも使用できます。
+ *
+ * @tparam T 要素型
+ * @tparam R 行数
+ * @tparam C 列数
+ * @tparam RowMajor 行優先か列優先か。デフォルトはtrue(行優先)。
+ */
+template<typename T, size_t R, size_t C, bool RowMajor = true>
+class FixedMatrix {
+private:
+	std::array<T, R * C> _data; ///< 要素 (パディングなし)
+
+	template<typename, size_t, size_t, bool> friend class FixedMatrix;
+
+	/// 全要素を書き込む演算の結果用に、0での初期化を省略して作成するためのタグ
+	struct _uninitialized_t {};
+	constexpr explicit FixedMatrix(_uninitialized_t) noexcept {}
+
+	static constexpr size_t _index(size_t row, size_t col) noexcept { return RowMajor ? row * C + col : col * R + row; }
+
+	template<typename Func>
+	constexpr FixedMatrix& _for_each(const FixedMatrix& other, Func func) {
+		FixedKernel::unroll<R * C>([&](size_t i) { _data[i] = func(_data[i], other._data[i]); });
+		return *this;
+	}
+
+	template<typename Func>
+	constexpr FixedMatrix& _for_each(Func func) {
+		FixedKernel::unroll<R * C>([&](size_t i) { _data[i] = func(_data[i]); });
+		return *this;
+	}
+
+	template<typename Func>
+	constexpr FixedMatrix _map(const FixedMatrix& other, Func func) const {
+		FixedMatrix result(_uninitialized_t{});
+		FixedKernel::unroll<R * C>([&](size_t i) { result._data[i] = func(_data[i], other._data[i]); });
+		return result;
+	}
+
+	template<typename Func>
+	constexpr FixedMatrix _map(Func func) const {
+		FixedMatrix result(_uninitialized_t{});
+		FixedKernel::unroll<R * C>([&](size_t i) { result._data[i] = func(_data[i]); });
+		return result;
+	}
+
+public:
+	using value_type = T;
+	static constexpr bool row_major = RowMajor;
+
+	/**
+	 * @brief 全要素を0で初期化するコンストラクタ
+	 */
+	constexpr FixedMatrix() : _data{} {}
+
+	/**
+	 * @brief 2次元配列で初期化するコンストラクタ。要素数が形状と異なる場合はコンパイルエラーになります。
+	 * @param init 行ごとの初期値 (例: FixedMatrix<float, 2, 2>({{1, 2}, {3, 4}}))
+	 */
+	constexpr FixedMatrix(const T(&init)[R][C]) {
+		for (size_t i = 0; i < R; i++)
+			for (size_t j = 0; j < C; j++)
+				_data[_index(i, j)] = init[i][j];
+	}
+
+	/**
+	 * @brief 初期化関数を指定して初期化するコンストラクタ
+	 * @param func 初期化関数 (引数なしで呼び出せる関数オブジェクト)。格納順に呼び出されます。
+	 */
+	template<typename InitFunc>
+	requires std::invocable<InitFunc> && std::convertible_to<std::invoke_result_t<InitFunc>, T>
+	constexpr explicit FixedMatrix(InitFunc func) {
+		for (T& x : _data)
+			x = static_cast<T>(func());
+	}
+
+	/**
+	 * @brief ビューの要素をコピーして初期化するコンストラクタ
+	 * @throws std::invalid_argument ビューの形状が R x C と異なる場合
+	 */
+	explicit FixedMatrix(MatrixView<const T, RowMajor> view) {
+		if (view.rows() != R || view.cols() != C)
+			throw std::invalid_argument("Matrix dimensions do not match the FixedMatrix shape.");
+
+		for (size_t i = 0; i < R; i++)
+			for (size_t j = 0; j < C; j++)
+				_data[_index(i, j)] = view(i, j);
+	}
+
+	/**
+	 * @brief 実行時サイズの行列の要素をコピーして初期化するコンストラクタ
+	 * @throws std::invalid_argument 行列の形状が R x C と異なる場合
+	 */
+	template<typename Container>
+	explicit FixedMatrix(const Matrix<T, RowMajor, Container>& mat) : FixedMatrix(mat.view()) {}
+
+	/**
+	 * @brief 実行時サイズの行列に変換します。
+	 */
+	Matrix<T, RowMajor> to_matrix() const {
+		Matrix<T, RowMajor> result(R, C);
+		for (size_t i = 0; i < R; i++)
+			for (size_t j = 0; j < C; j++)
+				result(i, j) = (*this)(i, j);
+		return result;
+	}
+
+	static constexpr size_t rows() noexcept { return R; }
+	static constexpr size_t cols() noexcept { return C; }
+	static constexpr size_t size() noexcept { return R * C; }
+
+	constexpr T* data() noexcept { return _data.data(); }
+	constexpr const T* data() const noexcept { return _data.data(); }
+
+	/**
+	 * @brief 要素にアクセスします。
+	 */
+	constexpr T& operator()(size_t row, size_t col) noexcept { return _data[_index(row, col)]; }
+	constexpr const T& operator()(size_t row, size_t col) const noexcept { return _data[_index(row, col)]; }
+
+	/**
+	 * @brief 要素を格納順の1次元インデックスでアクセスします。
+	 */
+	constexpr T& operator[](size_t index) noexcept { return _data[index]; }
+	constexpr const T& operator[](size_t index) const noexcept { return _data[index]; }
+
+	/**
+	 * @brief 行列全体のビューを取得します。gemm_into や matmul に実行時サイズの行列と混ぜて渡せます。
+	 */
+	MatrixView<T, RowMajor> view() noexcept { return MatrixView<T, RowMajor>(_data.data(), R, C); }
+	MatrixView<const T, RowMajor> view() const noexcept { return MatrixView<const T, RowMajor>(_data.data(), R, C); }
+
+	constexpr bool operator==(const FixedMatrix& other) const = default;
+
+	// 要素ごとの演算
+	constexpr FixedMatrix& add(const FixedMatrix& other) { return _for_each(other, [](T a, T b) { return a + b; }); }
+	constexpr FixedMatrix& sub(const FixedMatrix& other) { return _for_each(other, [](T a, T b) { return a - b; }); }
+	constexpr FixedMatrix& hadamard_mul(const FixedMatrix& other) { return _for_each(other, [](T a, T b) { return a * b; }); }
+	constexpr FixedMatrix& hadamard_div(const FixedMatrix& other) { return _for_each(other, [](T a, T b) { return a / b; }); }
+	constexpr FixedMatrix& scalar_mul(T scalar) { return _for_each([scalar](T a) { return a * scalar; }); }
+	constexpr FixedMatrix& scalar_div(T scalar) { return _for_each([scalar](T a) { return a / scalar; }); }
+
+	/**
+	 * @brief this = alpha * x + this
+	 */
+	constexpr FixedMatrix& axpy(T alpha, const FixedMatrix& x) { return _for_each(x, [alpha](T a, T b) { return alpha * b + a; }); }
+
+	/**
+	 * @brief this = a ⊙ b + this
+	 */
+	constexpr FixedMatrix& hadamard_fma(const FixedMatrix& a, const FixedMatrix& b) {
+		FixedKernel::unroll<R * C>([&](size_t i) { _data[i] += a._data[i] * b._data[i]; });
+		return *this;
+	}
+
+	// 自身をコピーしてから書き換えるのではなく、結果の行列に直接書き込む
+	constexpr FixedMatrix add_copy(const FixedMatrix& other) const { return _map(other, [](T a, T b) { return a + b; }); }
+	constexpr FixedMatrix sub_copy(const FixedMatrix& other) const { return _map(other, [](T a, T b) { return a - b; }); }
+	constexpr FixedMatrix hadamard_mul_copy(const FixedMatrix& other) const { return _map(other, [](T a, T b) { return a * b; }); }
+	constexpr FixedMatrix hadamard_div_copy(const FixedMatrix& other) const { return _map(other, [](T a, T b) { return a / b; }); }
+	constexpr FixedMatrix scalar_mul_copy(T scalar) const { return _map([scalar](T a) { return a * scalar; }); }
+	constexpr FixedMatrix scalar_div_copy(T scalar) const { return _map([scalar](T a) { return a / scalar; }); }
+
+	/**
+	 * @brief 各要素に関数を適用します。
+	 */
+	template<typename Func> requires std::invocable<Func, T> && std::convertible_to<std::invoke_result_t<Func, T>, T>
+	constexpr FixedMatrix& apply(Func func) { return _for_each([&](T a) { return static_cast<T>(func(a)); }); }
+
+	template<typename Func> requires std::invocable<Func, T> && std::convertible_to<std::invoke_result_t<Func, T>, T>
+	constexpr FixedMatrix apply_copy(Func func) const { return _map([&](T a) { return static_cast<T>(func(a)); }); }
+
+	/**
+	 * @brief 行列積 this * other を計算します。内側の次元が一致しない場合はコンパイルエラーになります。
+	 * @return R x N の新しい行列
+	 * @note float, double の場合は SimdKernel::gemm_fixed で出力の各行をレジスタに累積して計算します。
+	 *       それ以外の型や定数式の中では、出力の1行(列優先の場合は1列)を累積する最内ループを展開して計算します。
+	 *       16ビット浮動小数点数は float で累積します。
+	 */
+	template<size_t N>
+	constexpr FixedMatrix<T, R, N, RowMajor> matrix_mul_copy(const FixedMatrix<T, C, N, RowMajor>& other) const {
+		FixedMatrix<T, R, N, RowMajor> result(typename FixedMatrix<T, R, N, RowMajor>::_uninitialized_t{});
+
+		if constexpr (SimdKernel::supported_v<T>) {
+			if (!std::is_constant_evaluated()) {
+				// 列優先の場合は転置の関係 (A * B)^T = B^T * A^T を使って行優先のカーネルで計算する
+				if constexpr (RowMajor)
+					SimdKernel::gemm_fixed<R, C, N>(_data.data(), other.data(), result.data());
+				else
+					SimdKernel::gemm_fixed<N, C, R>(other.data(), _data.data(), result.data());
+				return result;
+			}
+		}
+
+		if constexpr (RowMajor) {
+			// result の i 行目 = Σ_k this(i, k) * other の k 行目 (1行分をレジスタに累積してから書き込む)
+			for (size_t i = 0; i < R; i++) {
+				accumulate_t<T> acc[N] = {};
+				for (size_t k = 0; k < C; k++)
+					FixedKernel::axpy<N>(acc, static_cast<accumulate_t<T>>(_data[i * C + k]), other.data() + k * N);
+				for (size_t j = 0; j < N; j++)
+					result[i * N + j] = acc[j];
+			}
+		}
+		else {
+			// result の j 列目 = Σ_k this の k 列目 * other(k, j)
+			for (size_t j = 0; j < N; j++) {
+				accumulate_t<T> acc[R] = {};
+				for (size_t k = 0; k < C; k++)
+					FixedKernel::axpy<R>(acc, static_cast<accumulate_t<T>>(other[j * C + k]), _data.data() + k * R);
+				for (size_t i = 0; i < R; i++)
+					result[j * R + i] = acc[i];
+			}
+		}
+		return result;
+	}
+
+	/**
+	 * @brief 正方行列 other との行列積で自身を置き換えます。(this = this * other)
+	 */
+	constexpr FixedMatrix& matrix_mul(const FixedMatrix<T, C, C, RowMajor>& other) {
+		*this = this->matrix_mul_copy(other);
+		return *this;
+	}
+
+	/**
+	 * @brief 転置行列を返します。
+	 */
+	constexpr FixedMatrix<T, C, R, RowMajor> transpose_copy() const {
+		FixedMatrix<T, C, R, RowMajor> result(typename FixedMatrix<T, C, R, RowMajor>::_uninitialized_t{});
+		for (size_t i = 0; i < R; i++)
+			for (size_t j = 0; j < C; j++)
+				result(j, i) = (*this)(i, j);
+		return result;
+	}
+
+	/**
+	 * @brief 正方行列をその場で転置します。
+	 */
+	constexpr FixedMatrix& transpose() requires (R == C) {
+		for (size_t i = 0; i < R; i++)
+			for (size_t j = i + 1; j < C; j++)
+				std::swap(_data[i * C + j], _data[j * C + i]);
+		return *this;
+	}
+
+	/**
+	 * @brief 各列の和を計算します。
+	 * @return 1 x C の行列
+	 */
+	constexpr FixedMatrix<T, 1, C, RowMajor> sum_rows() const {
+		FixedMatrix<T, 1, C, RowMajor> result;
+		for (size_t i = 0; i < R; i++)
+			FixedKernel::unroll<C>([&](size_t j) { result[j] += (*this)(i, j); });
+		return result;
+	}
+
+	/**
+	 * @brief 各行の和を計算します。
+	 * @return R x 1 の行列
+	 */
+	constexpr FixedMatrix<T, R, 1, RowMajor> sum_cols() const {
+		FixedMatrix<T, R, 1, RowMajor> result;
+		for (size_t j = 0; j < C; j++)
+			FixedKernel::unroll<R>([&](size_t i) { result[i] += (*this)(i, j); });
+		return result;
+	}
+
+	friend constexpr FixedMatrix operator+(const FixedMatrix& a, const FixedMatrix& b) { return a.add_copy(b); }
+	friend constexpr FixedMatrix operator-(const FixedMatrix& a, const FixedMatrix& b) { return a.sub_copy(b); }
+	friend constexpr FixedMatrix operator^(const FixedMatrix& a, const FixedMatrix& b) { return a.hadamard_mul_copy(b); }
+	friend constexpr FixedMatrix operator/(const FixedMatrix& a, const FixedMatrix& b) { return a.hadamard_div_copy(b); }
+	friend constexpr FixedMatrix operator*(const FixedMatrix& a, T s) { return a.scalar_mul_copy(s); }
+	friend constexpr FixedMatrix operator*(T s, const FixedMatrix& a) { return a.scalar_mul_copy(s); }
+	friend constexpr FixedMatrix operator/(const FixedMatrix& a, T s) { return a.scalar_div_copy(s); }
+
+	/**
+	 * @brief 行列積
+	 */
+	template<size_t N>
+	friend constexpr FixedMatrix<T, R, N, RowMajor> operator*(const FixedMatrix& a, const FixedMatrix<T, C, N, RowMajor>& b) { return a.matrix_mul_copy(b); }
+
+	friend std::ostream& operator<<(std::ostream& os, const FixedMatrix& mat) {
+		os << "{";
+		for (size_t i = 0; i < R; i++) {
+			os << "{";
+			for (size_t j = 0; j < C; j++)
+				os << mat(i, j) << (j + 1 != C ? "," : "");
+			os << "}" << (i + 1 != R ? "," : "");
+		}
+		return os << "}";
+	}
+};
+
+// gemm_into / matmul の入力として受け付ける
+template<typename T, size_t R, size_t C, bool RowMajor>
+struct matrix_operand_traits<FixedMatrix<T, R, C, RowMajor>> {
+	static constexpr bool value = true;
+	static constexpr bool row_major = RowMajor;
+	using value_type = T;
+	static MatrixView<const T, RowMajor> view(const FixedMatrix<T, R, C, RowMajor>& m) { return m.view(); }
+	static MatrixView<T, RowMajor> mutable_view(FixedMatrix<T, R, C, RowMajor>& m) { return m.view(); }
+};
+
+#endif // SANAE_NEURALNETWORK_FIXEDMATRIX
\ No newline at end of file
@@ -0,0 +1,140 @@
+﻿#ifndef SANAE_NEURALNETWORK_MATRIX_FLOAT16
+#define SANAE_NEURALNETWORK_MATRIX_FLOAT16
+
+#include <bit>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * @brief 16ビット浮動小数点数の形式
+ *
+ * 各形式は float との相互変換 from_float / to_float を持ちます。float からの変換は最近接偶数丸めです。
+ */
+namespace Float16Format {
+	/**
+	 * @brief bfloat16 (符号1, 指数8, 仮数7ビット)
+	 * @note float の上位16ビットと同じ形式のため、表現できる範囲は float と同じで精度は有効数字約3桁です。
+	 */
+	struct Brain {
+		static constexpr std::uint16_t from_float(float value) noexcept {
+			std::uint32_t x = std::bit_cast<std::uint32_t>(value);
+			// NaN は丸めで Inf にならないよう、静かなNaNにしてから上位16ビットを取り出す
+			if ((x & 0x7FFFFFFFu) > 0x7F800000u)
+				return static_cast<std::uint16_t>((x >> 16) | 0x0040u);
+
+			x += 0x7FFFu + ((x >> 16) & 1u);
+			return static_cast<std::uint16_t>(x >> 16);
+		}
+		static constexpr float to_float(std::uint16_t bits) noexcept {
+			return std::bit_cast<float>(static_cast<std::uint32_t>(bits) << 16);
+		}
+	};
+
+	/**
+	 * @brief IEEE 754 binary16 (符号1, 指数5, 仮数10ビット)
+	 * @note 絶対値が65520以上の値は Inf に、2^-14 未満の値は非正規化数に丸められます。
+	 *       変換結果は F16C 命令 (vcvtps2ph, vcvtph2ps) と一致します。
+	 */
+	struct Ieee {
+		static constexpr std::uint16_t from_float(float value) noexcept {
+			const std::uint32_t x = std::bit_cast<std::uint32_t>(value);
+			const std::uint32_t sign = (x >> 16) & 0x8000u;
+			std::uint32_t a = x & 0x7FFFFFFFu;
+
+			// 2^16 以上, Inf, NaN (NaN は静かなNaNにして仮数の上位ビットを残す)
+			if (a >= 0x47800000u)
+				return static_cast<std::uint16_t>(sign | (a > 0x7F800000u ? 0x7E00u | ((a >> 13) & 0x03FFu) : 0x7C00u));
+
+			// 2^-14 未満: 0.5 を足すと float の仮数の下位ビットに非正規化数の仮数が丸められて揃う
+			if (a < 0x38800000u) {
+				const float f = std::bit_cast<float>(a) + 0.5f;
+				return static_cast<std::uint16_t>(sign | (std::bit_cast<std::uint32_t>(f) - 0x3F000000u));
+			}
+
+			// 指数のバイアスを127から15に付け替え、仮数の下位13ビットを丸めて落とす (繰り上がりで Inf になる場合も含む)
+			a += 0xC8000FFFu + ((a >> 13) & 1u); // ((15 - 127) << 23) + 0xFFF + 奇数なら1
+			return static_cast<std::uint16_t>(sign | (a >> 13));
+		}
+		static constexpr float to_float(std::uint16_t bits) noexcept {
+			const std::uint32_t sign = static_cast<std::uint32_t>(bits & 0x8000u) << 16;
+			std::uint32_t x = static_cast<std::uint32_t>(bits & 0x7FFFu) << 13;
+			const std::uint32_t exp = x & 0x0F800000u;
+
+			x += (127u - 15u) << 23;
+			if (exp == 0x0F800000u) {
+				// Inf, NaN (NaN は静かなNaNにする)
+				x += (128u - 16u) << 23;
+				if ((bits & 0x03FFu) != 0)
+					x |= 0x00400000u;
+			}
+			else if (exp == 0) {
+				// 0, 非正規化数は float の演算で正規化する
+				x += 1u << 23;
+				x = std::bit_cast<std::uint32_t>(std::bit_cast<float>(x) - std::bit_cast<float>(113u << 23));
+			}
+			return std::bit_cast<float>(x | sign);
+		}
+	};
+}
+
+/**
+ * @brief 16ビット浮動小数点数の格納型
+ *
+ * 値の格納にだけ16ビットを使い、演算はすべて float に変換して行います。
+ * float との間は暗黙に変換できるため、Matrix などの要素型として float と同じように使えます。
+ * 演算子は複合代入だけを定義し、それ以外の演算の結果は float になります。
+ *
+ * @tparam Format 形式 (Float16Format::Brain, Float16Format::Ieee)
+ */
+template<typename Format>
+struct PackedFloat {
+	using format = Format;
+
+	/// ビット表現
+	std::uint16_t bits;
+
+	PackedFloat() = default;
+	constexpr PackedFloat(float value) noexcept : bits(Format::from_float(value)) {}
+
+	/**
+	 * @brief ビット表現から値を作ります。
+	 */
+	static constexpr PackedFloat from_bits(std::uint16_t bits) noexcept {
+		PackedFloat result;
+		result.bits = bits;
+		return result;
+	}
+
+	constexpr operator float() const noexcept { return Format::to_float(bits); }
+
+	constexpr PackedFloat& operator+=(float rhs) noexcept { return *this = static_cast<float>(*this) + rhs; }
+	constexpr PackedFloat& operator-=(float rhs) noexcept { return *this = static_cast<float>(*this) - rhs; }
+	constexpr PackedFloat& operator*=(float rhs) noexcept { return *this = static_cast<float>(*this) * rhs; }
+	constexpr PackedFloat& operator/=(float rhs) noexcept { return *this = static_cast<float>(*this) / rhs; }
+};
+
+using bfloat16 = PackedFloat<Float16Format::Brain>; ///< bfloat16
+using float16 = PackedFloat<Float16Format::Ieee>;   ///< IEEE 754 半精度
+
+static_assert(sizeof(bfloat16) == 2 && std::is_trivially_copyable_v<bfloat16>);
+static_assert(sizeof(float16) == 2 && std::is_trivially_copyable_v<float16>);
+
+/// 16ビット浮動小数点数の格納型かどうか
+template<typename T>
+inline constexpr bool is_float16_v = false;
+template<typename Format>
+inline constexpr bool is_float16_v<PackedFloat<Format>> = true;
+
+/**
+ * @brief 要素型 T の値を累積するときに使う型
+ * @note 16ビット浮動小数点数は float で累積し、それ以外は T のままです。
+ */
+template<typename T>
+struct accumulate_type { using type = T; };
+template<typename Format>
+struct accumulate_type<PackedFloat<Format>> { using type = float; };
+
+template<typename T>
+using accumulate_t = typename accumulate_type<T>::type;
+
+#endif // SANAE_NEURALNETWORK_MATRIX_FLOAT16
\ No newline at end of file
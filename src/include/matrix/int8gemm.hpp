@@ -0,0 +1,362 @@
+﻿#ifndef SANAE_NEURALNETWORK_MATRIX_INT8GEMM
+#define SANAE_NEURALNETWORK_MATRIX_INT8GEMM
+
+#include "simd.hpp"
+#include "../threadpool/threadpool.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * @brief int8 の行列積カーネル
+ *
+ * C (int32) = A (uint8) * B (int8) を計算します。量子化した活性化 (A) と重み (B) の積を想定しており、
+ * B はあらかじめ PackedB にパックしておき、何度も再利用します。
+ *
+ * 使用するカーネルは SimdKernel の命令セットに従い、パック時に選択します。
+ *   VNNI   : AVX-512 VNNI の vpdpbusd で4要素ずつ積和を計算します。
+ *   AVX2   : 16ビットに広げて vpmaddwd で積和を計算します (vpmaddubsw と異なり飽和しません)。
+ *   Scalar : それ以外の場合
+ * どのカーネルも結果は完全に一致します。
+ */
+namespace Int8Gemm {
+	/// カーネルの種類
+	enum class Kernel { Scalar, AVX2, VNNI };
+
+	/// int32 の累積があふれない内側の次元の上限 (255 * 128 * max_k < 2^31)
+	inline constexpr size_t max_k = 65536;
+
+	namespace detail {
+		/**
+		 * @brief CPUが AVX-512 VNNI と AVX-512 BW に対応しているかどうかを調べます。
+		 */
+		inline bool detect_vnni() noexcept {
+#if defined(SANAE_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512bw");
+#elif defined(SANAE_SIMD_X86) && defined(_MSC_VER)
+			int info[4];
+			__cpuidex(info, 7, 0);
+			return (info[2] & (1 << 11)) != 0 && (info[1] & (1 << 30)) != 0;
+#else
+			return false;
+#endif
+		}
+
+		/**
+		 * @brief カーネルごとのブロックサイズ
+		 * @note NR はパック済みBのパネルの列数、MR はマイクロカーネルが一度に計算する行数です。
+		 */
+		struct Blocking {
+			size_t MR;
+			size_t NR;
+		};
+		inline constexpr Blocking blocking(Kernel kernel) noexcept {
+			switch (kernel) {
+			case Kernel::VNNI: return { 6, 32 };
+			case Kernel::AVX2: return { 4, 8 };
+			default: return { 4, 8 };
+			}
+		}
+		inline constexpr size_t max_mr = 6;
+		inline constexpr size_t max_nr = 32;
+
+		/**
+		 * @brief パック済みのAとBのマイクロパネルの積を計算します。
+		 * @param k4 K方向の4要素の組の数
+		 * @param a 各組について mr 行分の4バイトを並べたAのパネル
+		 * @param b 各組について nr 列分の4バイトを並べたBのパネル
+		 * @param out out[i * max_nr + j] に結果を書き込む
+		 */
+		inline void kernel_scalar(size_t k4, size_t mr, size_t nr, const std::uint8_t* a, const std::int8_t* b, std::int32_t* out) {
+			for (size_t i = 0; i < mr; i++)
+				for (size_t j = 0; j < nr; j++)
+					out[i * max_nr + j] = 0;
+
+			for (size_t p = 0; p < k4; p++) {
+				for (size_t i = 0; i < mr; i++) {
+					const std::uint8_t* ap = a + (p * mr + i) * 4;
+					for (size_t j = 0; j < nr; j++) {
+						const std::int8_t* bp = b + (p * nr + j) * 4;
+						out[i * max_nr + j] += ap[0] * bp[0] + ap[1] * bp[1] + ap[2] * bp[2] + ap[3] * bp[3];
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief 現在の命令セットで使用するカーネルを返します。
+	 */
+	inline Kernel active_kernel() noexcept {
+		static const bool vnni = detail::detect_vnni();
+		switch (SimdKernel::active_isa()) {
+		case SimdKernel::Isa::AVX512: return vnni ? Kernel::VNNI : Kernel::AVX2;
+		case SimdKernel::Isa::AVX2: return Kernel::AVX2;
+		default: return Kernel::Scalar;
+		}
+	}
+
+#if defined(SANAE_SIMD_X86)
+	// ---- AVX2 ----
+#if defined(__clang__)
+	#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("avx2")
+#endif
+	namespace Avx2 {
+		/**
+		 * @brief 4 x 8 のマイクロカーネル
+		 * @note Bの4要素の組を16ビットに広げ、vpmaddwd で隣り合う2要素の積和を取ります。
+		 *       列の前半4列と後半4列を別々に累積し、最後に隣り合う要素を足して8列に揃えます。
+		 */
+		inline void kernel(size_t k4, const std::uint8_t* a, const std::int8_t* b, std::int32_t* out) {
+			__m256i lo[4], hi[4];
+			for (size_t i = 0; i < 4; i++)
+				lo[i] = hi[i] = _mm256_setzero_si256();
+
+			for (size_t p = 0; p < k4; p++) {
+				const __m256i bv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+				const __m256i b_lo = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(bv));
+				const __m256i b_hi = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(bv, 1));
+				for (size_t i = 0; i < 4; i++) {
+					std::int32_t a4;
+					std::memcpy(&a4, a + i * 4, 4);
+					const __m256i av = _mm256_broadcastq_epi64(_mm_cvtepu8_epi16(_mm_cvtsi32_si128(a4)));
+					lo[i] = _mm256_add_epi32(lo[i], _mm256_madd_epi16(b_lo, av));
+					hi[i] = _mm256_add_epi32(hi[i], _mm256_madd_epi16(b_hi, av));
+				}
+				a += 16;
+				b += 32;
+			}
+
+			for (size_t i = 0; i < 4; i++) {
+				// hadd の結果は列 0,1,4,5 | 2,3,6,7 の順になるため64ビット単位で並べ替える
+				const __m256i sum = _mm256_permute4x64_epi64(_mm256_hadd_epi32(lo[i], hi[i]), 0xD8);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * detail::max_nr), sum);
+			}
+		}
+	}
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC pop_options
+#endif
+
+	// ---- AVX-512 VNNI ----
+#if defined(__clang__)
+	#pragma clang attribute push(__attribute__((target("avx512f,avx512bw,avx512vnni"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("avx512f,avx512bw,avx512vnni")
+#endif
+	namespace Vnni {
+		/**
+		 * @brief 6 x 32 のマイクロカーネル
+		 * @note vpdpbusd はAの4バイト (符号なし) とBの4バイト (符号付き) の積和を32ビットの各要素に足し込みます。
+		 */
+		inline void kernel(size_t k4, const std::uint8_t* a, const std::int8_t* b, std::int32_t* out) {
+			__m512i acc[6][2];
+			for (size_t i = 0; i < 6; i++)
+				acc[i][0] = acc[i][1] = _mm512_setzero_si512();
+
+			for (size_t p = 0; p < k4; p++) {
+				const __m512i b0 = _mm512_loadu_si512(b);
+				const __m512i b1 = _mm512_loadu_si512(b + 64);
+				for (size_t i = 0; i < 6; i++) {
+					std::int32_t a4;
+					std::memcpy(&a4, a + i * 4, 4);
+					const __m512i av = _mm512_set1_epi32(a4);
+					acc[i][0] = _mm512_dpbusd_epi32(acc[i][0], av, b0);
+					acc[i][1] = _mm512_dpbusd_epi32(acc[i][1], av, b1);
+				}
+				a += 24;
+				b += 128;
+			}
+
+			for (size_t i = 0; i < 6; i++) {
+				_mm512_storeu_si512(out + i * detail::max_nr, acc[i][0]);
+				_mm512_storeu_si512(out + i * detail::max_nr + 16, acc[i][1]);
+			}
+		}
+	}
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC pop_options
+#endif
+#endif // SANAE_SIMD_X86
+
+	/**
+	 * @brief カーネルに合わせてパックした int8 の行列 (K x N)
+	 *
+	 * N 列を NR 列ずつのパネルに分け、各パネルの中は K 方向の4要素の組ごとに NR 列分の4バイトを並べます。
+	 * 端数の行・列は0で埋めます。列ごとの和 (ゼロ点の補正に使用) も保持します。
+	 */
+	class PackedB {
+	public:
+		PackedB() = default;
+
+		/**
+		 * @brief 行優先の int8 の行列 b (K x N) をパックします。
+		 * @param ldb b の行の格納間隔。0の場合は N とみなします。
+		 * @param kernel 使用するカーネル。省略した場合は active_kernel() になります。
+		 */
+		PackedB(const std::int8_t* b, size_t K, size_t N, size_t ldb = 0, Kernel kernel = active_kernel())
+			: _kernel(kernel), _k(K), _n(N), _col_sums(N, 0)
+		{
+			if (K > max_k)
+				throw std::invalid_argument("Inner dimension is too large for int8 GEMM.");
+			if (ldb == 0)
+				ldb = N;
+
+			const size_t NR = detail::blocking(kernel).NR;
+			const size_t k4 = k4_count();
+			_data.assign(panel_count() * k4 * NR * 4, 0);
+
+			for (size_t jp = 0; jp < N; jp += NR) {
+				std::int8_t* panel = _data.data() + (jp / NR) * k4 * NR * 4;
+				const size_t nr = std::min(NR, N - jp);
+				for (size_t k = 0; k < K; k++) {
+					const std::int8_t* row = b + k * ldb + jp;
+					for (size_t j = 0; j < nr; j++) {
+						panel[((k / 4) * NR + j) * 4 + k % 4] = row[j];
+						_col_sums[jp + j] += row[j];
+					}
+				}
+			}
+		}
+
+		size_t rows() const noexcept { return _k; }
+		size_t cols() const noexcept { return _n; }
+		Kernel kernel() const noexcept { return _kernel; }
+
+		/// 列ごとの要素の和 Σ_k b[k][j]
+		const std::vector<std::int32_t>& col_sums() const noexcept { return _col_sums; }
+
+		/// K方向の4要素の組の数
+		size_t k4_count() const noexcept { return (_k + 3) / 4; }
+		/// パネルの数
+		size_t panel_count() const noexcept { const size_t NR = detail::blocking(_kernel).NR; return (_n + NR - 1) / NR; }
+		/// p 番目のパネルの先頭
+		const std::int8_t* panel(size_t p) const noexcept { return _data.data() + p * k4_count() * detail::blocking(_kernel).NR * 4; }
+
+	private:
+		Kernel _kernel = Kernel::Scalar;
+		size_t _k = 0;
+		size_t _n = 0;
+		std::vector<std::int8_t> _data;
+		std::vector<std::int32_t> _col_sums;
+	};
+
+	/**
+	 * @brief C = A * B を計算し、出力のタイルごとに epilogue を呼び出します。
+	 * @param a 行優先の uint8 の行列 (M x K)
+	 * @param lda a の行の格納間隔
+	 * @param b パック済みの int8 の行列 (K x N)
+	 * @param epilogue epilogue(row, col, acc, n) の形で呼び出されます。acc は C の row 行目の col 列目から n 列分の int32 の値です。
+	 *                 逆量子化やバイアスの加算をここで行うと、int32 の中間結果をメモリに書き出さずに済みます。
+	 *                 並列に計算する場合は異なるタイルについて同時に呼び出されます。
+	 * @note 演算量が大きい場合は行方向に分割してスレッドプールで並列に計算します。
+	 */
+	template<typename Epilogue>
+	inline void multiply(const std::uint8_t* a, size_t M, size_t lda, const PackedB& b, Epilogue&& epilogue) {
+		const size_t N = b.cols();
+		const size_t K = b.rows();
+		if (M == 0 || N == 0)
+			return;
+
+		// パック時の命令セットが使えなくなっている場合は同じ並びのままスカラー実装で計算する
+		Kernel kernel = b.kernel();
+		if (static_cast<int>(active_kernel()) < static_cast<int>(kernel))
+			kernel = Kernel::Scalar;
+
+		const detail::Blocking bs = detail::blocking(b.kernel());
+		const size_t MR = bs.MR, NR = bs.NR;
+		const size_t k4 = b.k4_count();
+		// Bのパネルをキャッシュに載せたまま使い回す行数
+		const size_t MC = MR * 16;
+
+		auto run = [&](size_t row_begin, size_t row_end) {
+			thread_local std::vector<std::uint8_t> packed_a;
+			packed_a.resize(((MC + MR - 1) / MR) * k4 * MR * 4);
+			alignas(64) std::int32_t tile[detail::max_mr * detail::max_nr];
+
+			for (size_t ic = row_begin; ic < row_end; ic += MC) {
+				const size_t mc = std::min(MC, row_end - ic);
+
+				// Aのブロックを MR 行ずつ、K方向の4要素の組ごとに MR 行分の4バイトを並べてパックする (端数は0)
+				std::fill(packed_a.begin(), packed_a.end(), std::uint8_t(0));
+				for (size_t i = 0; i < mc; i++) {
+					const std::uint8_t* row = a + (ic + i) * lda;
+					std::uint8_t* dst = packed_a.data() + (i / MR) * k4 * MR * 4 + (i % MR) * 4;
+					for (size_t k = 0; k < K; k++)
+						dst[(k / 4) * MR * 4 + k % 4] = row[k];
+				}
+
+				for (size_t p = 0; p < b.panel_count(); p++) {
+					const size_t nr = std::min(NR, N - p * NR);
+					for (size_t ir = 0; ir < mc; ir += MR) {
+						const size_t mr = std::min(MR, mc - ir);
+						const std::uint8_t* a_panel = packed_a.data() + (ir / MR) * k4 * MR * 4;
+
+						switch (kernel) {
+#if defined(SANAE_SIMD_X86)
+						case Kernel::VNNI: Vnni::kernel(k4, a_panel, b.panel(p), tile); break;
+						case Kernel::AVX2: Avx2::kernel(k4, a_panel, b.panel(p), tile); break;
+#endif
+						default: detail::kernel_scalar(k4, MR, NR, a_panel, b.panel(p), tile); break;
+						}
+
+						for (size_t i = 0; i < mr; i++)
+							epilogue(ic + ir + i, p * NR, static_cast<const std::int32_t*>(tile + i * detail::max_nr), nr);
+					}
+				}
+			}
+		};
+
+		constexpr size_t parallel_threshold = 64 * 64 * 64;
+		if (M * N * K <= parallel_threshold) {
+			run(0, M);
+			return;
+		}
+
+		ThreadPool& pool = ThreadPool::instance();
+		const size_t blocks = (M + MR - 1) / MR;
+		const size_t grain = std::max<size_t>(blocks / (pool.num_threads() * 2), 1);
+		pool.parallel_for(0, blocks, grain, [&](size_t block_begin, size_t block_end) {
+			run(block_begin * MR, std::min(M, block_end * MR));
+		});
+	}
+
+	/**
+	 * @brief BlasGemm::MatMul に対応する int8 の行列積
+	 */
+	struct MatMul {
+		/**
+		 * @brief C = A * B を計算します。すべて行優先です。
+		 * @param A uint8 の行列 (M x K)
+		 * @param B int8 の行列 (K x N)。呼び出しごとにパックするため、同じBを繰り返し使う場合は PackedB を使ってください。
+		 * @param C 出力先の int32 の行列 (M x N)
+		 * @param lda, ldb, ldc 各行列の格納間隔。0の場合は詰めて格納されているものとみなします。
+		 */
+		static void multiply(
+			const std::uint8_t* A, const std::int8_t* B, std::int32_t* C,
+			size_t M, size_t N, size_t K,
+			size_t lda = 0, size_t ldb = 0, size_t ldc = 0
+		) {
+			const PackedB packed(B, K, N, ldb);
+			if (ldc == 0)
+				ldc = N;
+			Int8Gemm::multiply(A, M, lda != 0 ? lda : K, packed, [&](size_t row, size_t col, const std::int32_t* acc, size_t n) {
+				std::copy(acc, acc + n, C + row * ldc + col);
+			});
+		}
+	};
+}
+
+#endif // SANAE_NEURALNETWORK_MATRIX_INT8GEMM
\ No newline at end of file
@@ -2,10 +2,14 @@
 #define SANAE_NEURALNETWORK_MATRIX  
 
 #include "../view/view.h"
+#include "../view/matrixview.h"
+#include "allocator.hpp"
+#include "sharedvector.hpp"
 #include <array>  
 #include <execution>
 #include <initializer_list>
 #include <iosfwd>
+#include <span>
 #include <type_traits>  
 #include <vector>  
 #include <concepts>
@@ -14,10 +18,11 @@
 template<typename T>
 concept StdExecPolicy = std::is_execution_policy_v<std::remove_cvref_t<T>>;
 
-// std::vectorまたはstd::array判定用の型
+// std::vector, std::array または SharedVector 判定用の型
 template<typename T> struct is_vector_or_array : std::false_type {};
 template<typename T, typename Alloc> struct is_vector_or_array<std::vector<T, Alloc>> : std::true_type {};
 template<typename T, std::size_t N>  struct is_vector_or_array<std::array<T, N>>      : std::true_type {};
+template<typename T>                 struct is_vector_or_array<SharedVector<T>>        : std::true_type {};
 template<typename T> 
 concept VectorOrArray = is_vector_or_array<std::remove_cvref_t<T>>::value;
 
@@ -27,7 +32,8 @@ template<typename T, std::size_t N>  struct is_std_array<std::array<T, N>> : std
 template<typename T> 
 concept StdArray = is_std_array<std::remove_cvref_t<T>>::value;
 
-// BLAS使用判定用の型
+// BLAS使用判定用の型 (コンパイル時に有効にしたBLASが対応している要素型かどうか)
+// use_blas = true の演算が実際にどの実装で計算するかは、呼び出しごとに Backend::Registry が形状から選ぶ (backend.hpp)
 template<typename T> struct can_use_blas : std::false_type {};
 #if defined(USE_OPENBLAS)
 // OpenBlas
@@ -44,18 +50,64 @@ template<typename T> struct can_use_blas : std::false_type {};
 #endif
 template<typename T> concept CanUseBlas = can_use_blas<T>::value;
 
+/// 行列積のアルゴリズム (matrix_mul, matrix_mul_copy のテンプレート引数。BLASを使用しない場合のみ有効)
+enum class GemmAlgorithm {
+	Blocked,         ///< ブロック化した通常の行列積 (NativeGemm)
+	Strassen,        ///< 大きな行列では Strassen-Winograd 法で再帰し、カットオフ未満は Blocked で計算する (strassen.hpp)
+	StrassenChecked, ///< Strassen に加えて Freivalds 法で誤差の上限を確認し、超えた場合は Blocked で計算し直す
+};
+
+// 式テンプレートのノード判定用の型 (expr.hpp)
+struct MatrixExprTag {};
+template<typename T>
+concept MatrixExpression = std::is_base_of_v<MatrixExprTag, std::remove_cvref_t<T>>;
+
 /**
  * @brief 汎用的な行列クラスを提供します。
  * @tparam T 行列の要素型
  * @tparam RowMajor 行優先か列優先かを指定するブール値。デフォルトはtrue(行優先)。
- * @tparam Container 内部データコンテナの型。デフォルトはstd::vector<T>。VectorOrArrayコンセプトを満たす必要があります。
+ * @tparam Container 内部データコンテナの型。デフォルトはMatrixVector<T>(MatrixMemory::Scope で確保先を切り替えられるstd::vector)。VectorOrArrayコンセプトを満たす必要があります。
  */
-template<typename T, bool RowMajor = true, typename Container = std::vector<T>> requires VectorOrArray<Container>
+template<typename T, bool RowMajor = true, typename Container = MatrixVector<T>> requires VectorOrArray<Container>
 class Matrix {
 protected:
 	size_t _rows, _cols; /// 行数と列数
+	size_t _ld = 0; /// リーディングディメンション(行優先の場合は行の、列優先の場合は列の格納間隔)
 	Container _data; /// 内部データコンテナ
 
+	/// コンテナのパディング幅(バイト)。0の場合は行(列)を詰めて格納する
+	static constexpr size_t _padding = container_padding<Container>::value;
+
+	/**
+	 * @brief 内側の次元(行優先なら列数、列優先なら行数)からリーディングディメンションを求めます。
+	 * @param inner 内側の次元
+	 * @return リーディングディメンション
+	 */
+	static size_t _leading_dim(size_t inner);
+
+	/**
+	 * @brief 行数と列数を設定し、リーディングディメンションを含めた格納領域を確保します。
+	 * @param rows 行数
+	 * @param cols 列数
+	 * @throws std::invalid_argument std::arrayのサイズが足りない場合
+	 */
+	void _allocate(size_t rows, size_t cols);
+
+	/**
+	 * @brief 格納領域の要素数(パディングを含む)を取得します。
+	 * @return 外側の次元 * リーディングディメンション
+	 */
+	size_t _storage_size() const noexcept;
+
+	/**
+	 * @brief リーディングディメンションを含めて格納済みのデータをそのまま受け取るコンストラクタ(内部用)
+	 * @param rows 行数
+	 * @param cols 列数
+	 * @param ld リーディングディメンション
+	 * @param storage 格納済みのデータ
+	 */
+	Matrix(size_t rows, size_t cols, size_t ld, Container&& storage);
+
 	/**
 	 * @brief operationに従い二つの行列に対し演算を行います。
 	 * @tparam execType 実行ポリシー(parallel_policy,parallel_unsequenced_policy,sequenced_policyから選択可能)。StdExecPolicyコンセプトを満たす必要があります。
@@ -83,6 +135,38 @@ protected:
 	template<typename execType, typename calcType>
 	void _calc(Container& to, const T& other, execType execPolicy, calcType operation) const
 		requires StdExecPolicy<execType>;
+
+	/**
+	 * @brief 格納領域のうち要素が連続して格納されている区間ごとに関数を呼び出します。
+	 * @tparam execType 実行ポリシー。並列ポリシーの場合はスレッドプールで区間を分割して呼び出します。
+	 * @param func func(offset, length) として呼び出される関数。パディングがない場合は格納領域全体、ある場合は各行(列)が区間になります。
+	 */
+	template<typename execType, typename SpanFunc>
+	void _for_each_span(execType execPolicy, SpanFunc func) const
+		requires StdExecPolicy<execType>;
+
+	/**
+	 * @brief 0の要素が含まれているかどうかを返します。(パディング領域は確認しません)
+	 */
+	bool _has_zero() const;
+
+	/**
+	 * @brief outer 本の長さ inner の行(列)として格納された src を転置して dst に書き込みます。(dst[j * ldd + i] = src[i * lds + j])
+	 * @note 大きな行列の場合は書き込み先の行(列)の帯ごとにスレッドプールで分割して実行します。
+	 */
+	static void _transpose_lines(const T* src, size_t lds, T* dst, size_t ldd, size_t outer, size_t inner);
+
+	/**
+	 * @brief 正方行列を追加の格納領域を確保せずに転置します。
+	 * @note 対角を挟んだブロックの組ごとに、一方を作業領域に転置してから入れ替えます。
+	 */
+	void _transpose_square_inplace();
+
+	/**
+	 * @brief 集計結果を1行(AsRow = false の場合は1列)の行列にします。
+	 */
+	template<bool AsRow>
+	static Matrix _from_reduction(const MatrixVector<T>& values);
 public:
 	using Container2D = std::vector<std::vector<T>>;
 	using InitContainer2D = std::initializer_list<std::initializer_list<T>>;
@@ -105,6 +189,7 @@ public:
 	 * @param rows 行数
 	 * @param cols 列数
 	 * @param array 内部データコンテナの初期値を指定するコンテナ。少なくとも rows*cols 個の要素を保持している必要があります（std::array の場合は rows*cols が配列サイズ以下である必要があります）。
+	 * @note array はパディングなしで詰めて格納されている必要があります。パディングするコンテナの場合は内部でコピーし直します。
 	 */
 	Matrix(size_t rows, size_t cols, Container array);
 
@@ -134,6 +219,28 @@ public:
 	 */
 	Matrix(const InitContainer2D& data);
 
+	/**
+	 * @brief 式テンプレートを評価して初期化するコンストラクタ
+	 * @param expr 要素ごとの演算の式 (a + b * 2 など)
+	 */
+	template<typename Expr> requires MatrixExpression<Expr>
+	Matrix(const Expr& expr);
+
+	/**
+	 * @brief 一時的な式テンプレートを評価して初期化するコンストラクタ
+	 * @param expr 要素ごとの演算の式 (std::move(a) + b など)
+	 * @note 式が同じ型・形状の一時的な行列を保持している場合は、その格納領域に評価して受け取ります。(新しい格納領域を確保しません)
+	 */
+	template<typename Expr> requires MatrixExpression<Expr> && (!std::is_reference_v<Expr>) && (!std::is_const_v<Expr>)
+	Matrix(Expr&& expr);
+
+	/**
+	 * @brief ビューが参照している要素をコピーして初期化するコンストラクタ
+	 * @param view コピー元のビュー (MatrixView<T> も暗黙に変換されます)
+	 * @note 暗黙のコピーを避けるため explicit です。
+	 */
+	explicit Matrix(MatrixView<const T, RowMajor> view);
+
 	Matrix(const Matrix& other) = default;
 	Matrix(Matrix&& other) noexcept = default;
 	~Matrix() = default;
@@ -154,9 +261,16 @@ public:
 	/**
 	 * @brief 内部データコンテナへの定数参照を取得します。
 	 * @return 内部データコンテナへの定数参照
+	 * @note パディングするコンテナ(PaddedVector)の場合、各行(列)は ld() 要素ごとに格納されます。パディング領域の値は未規定です。
 	 */
 	const Container& data() const noexcept;
 
+	/**
+	 * @brief リーディングディメンション(行優先の場合は行の、列優先の場合は列の格納間隔)を取得します。
+	 * @return リーディングディメンション。パディングしないコンテナの場合は列数(列優先の場合は行数)と等しくなります。
+	 */
+	size_t ld() const noexcept;
+
 	/**
 	 * @brief 行列のメモリレイアウトを変換します。
 	 * @return メモリレイアウトが変換された新しい行列
@@ -223,6 +337,19 @@ public:
 	 */
 	const T* get_col_ptr(size_t col) const requires (!RowMajor);
 
+	/**
+	 * @brief 行列全体を参照するビューを取得します。
+	 * @return 書き込み可能なビュー。view().rows_range(begin, end) や view().block(...) でコピーせずに部分行列を参照できます。
+	 * @note 行列の次元を変える操作(再確保)を行うとビューは無効になります。
+	 */
+	MatrixView<T, RowMajor> view();
+
+	/**
+	 * @brief 行列全体を参照する読み取り専用のビューを取得します。(const版)
+	 * @return 読み取り専用のビュー
+	 */
+	MatrixView<const T, RowMajor> view() const;
+
 	/**
 	 * @brief BLASのGEMMを使用するかどうかを判定します。
 	 * @return 使用する場合はtrue、使用しない場合はfalse
@@ -249,6 +376,7 @@ public:
 	 * @param execPolicy 実行ポリシー。既定では逐次実行（sequenced）になり、並列ポリシーを指定した場合は
 	 *                   関数funcがスレッドセーフであり、要素の処理順序に依存しないことが要求されます。
 	 * @return 自身の参照
+	 * @note SimdKernel::Relu などの関数オブジェクトを渡した場合はSIMDカーネルで計算します。
 	 */
 	template<typename Func, typename ExecPolicy = std::execution::sequenced_policy>
 	Matrix& apply(Func func, ExecPolicy execPolicy = ExecPolicy{}) 
@@ -265,9 +393,17 @@ public:
 	 * @param execPolicy 実行ポリシー。既定では逐次実行（sequenced）になり、並列ポリシーを指定した場合は
 	 *                   関数funcがスレッドセーフであり、要素の処理順序に依存しないことが要求されます。
 	 * @return 新しい行列のコピー
+	 * @note SimdKernel::Relu などの関数オブジェクトを渡した場合はSIMDカーネルで計算します。
 	 */
 	template<typename Func, typename ExecPolicy = std::execution::sequenced_policy>
-	Matrix apply_copy(Func func, ExecPolicy execPolicy = ExecPolicy{}) const
+	Matrix apply_copy(Func func, ExecPolicy execPolicy = ExecPolicy{}) const&
+	requires
+		std::invocable<Func, T> &&
+		std::convertible_to<std::invoke_result_t<Func, T>, T> &&
+		StdExecPolicy<ExecPolicy>;
+	/// 一時オブジェクトの場合は新しい行列を確保せず、自身の格納領域で計算して返します。
+	template<typename Func, typename ExecPolicy = std::execution::sequenced_policy>
+	Matrix apply_copy(Func func, ExecPolicy execPolicy = ExecPolicy{}) &&
 	requires
 		std::invocable<Func, T> &&
 		std::convertible_to<std::invoke_result_t<Func, T>, T> &&
@@ -305,6 +441,67 @@ public:
 		&& std::invocable<CalcType, T, T>
 		&& std::convertible_to<std::invoke_result_t<CalcType, T, T>, T>;
 
+	/**
+	 * @brief 行列を [lo, hi) の一様乱数で埋めます。
+	 * @param seed 乱数の種
+	 * @param stream 同じ seed で独立した乱数列を使い分けるための番号
+	 * @param execPolicy 実行ポリシー。並列ポリシーの場合もスレッド数や分割に関わらず同じ値になります。
+	 * @return 自身の参照
+	 * @note カウンタベースの乱数 (Philox4x32-10) を使い、各要素の値は (seed, stream, 格納順の要素番号) だけで決まります。
+	 */
+	template<typename ExecPolicy = std::execution::sequenced_policy>
+	Matrix& fill_uniform(T lo, T hi, uint64_t seed, uint64_t stream = 0, ExecPolicy execPolicy = ExecPolicy{})
+		requires StdExecPolicy<ExecPolicy>;
+
+	/**
+	 * @brief 行列を平均 mean、標準偏差 stddev の正規乱数で埋めます。
+	 * @param seed 乱数の種
+	 * @param stream 同じ seed で独立した乱数列を使い分けるための番号
+	 * @param execPolicy 実行ポリシー。並列ポリシーの場合もスレッド数や分割に関わらず同じ値になります。
+	 * @return 自身の参照
+	 * @note fill_uniform と同じく、各要素の値は (seed, stream, 格納順の要素番号) だけで決まります。
+	 */
+	template<typename ExecPolicy = std::execution::sequenced_policy>
+	Matrix& fill_normal(T mean, T stddev, uint64_t seed, uint64_t stream = 0, ExecPolicy execPolicy = ExecPolicy{})
+		requires StdExecPolicy<ExecPolicy>;
+
+	/**
+	 * @brief 行列の各要素を確率 p で 1、それ以外は 0 にします。(Dropout のマスクなど)
+	 * @param seed 乱数の種
+	 * @param stream 同じ seed で独立した乱数列を使い分けるための番号
+	 * @param execPolicy 実行ポリシー。並列ポリシーの場合もスレッド数や分割に関わらず同じ値になります。
+	 * @return 自身の参照
+	 * @note fill_uniform と同じく、各要素の値は (seed, stream, 格納順の要素番号) だけで決まります。
+	 */
+	template<typename ExecPolicy = std::execution::sequenced_policy>
+	Matrix& fill_bernoulli(double p, uint64_t seed, uint64_t stream = 0, ExecPolicy execPolicy = ExecPolicy{})
+		requires StdExecPolicy<ExecPolicy>;
+
+	/**
+	 * @brief indices で指定した行を順に並べた行列を作成します。i 行目は indices[i] 行目になります。
+	 * @param indices 行のインデックスの配列。順不同や重複があっても構いません。(シャッフルしたミニバッチなど)
+	 * @param execPolicy 実行ポリシー。並列ポリシーの場合は行(列)単位でスレッドプールに分割します。
+	 * @return indices.size() 行 cols() 列の行列
+	 * @throws std::out_of_range インデックスが行数以上の場合
+	 * @note 結果の行列は MatrixMemory::current() のリソースから確保します。データセット全体をコピーせずにミニバッチを作れます。
+	 */
+	template<typename ExecPolicy = std::execution::sequenced_policy>
+	Matrix gather_rows(std::span<const size_t> indices, ExecPolicy execPolicy = ExecPolicy{}) const
+		requires StdExecPolicy<ExecPolicy>;
+
+	/**
+	 * @brief src の i 行目を indices[i] 行目に足し込みます。gather_rows の逆向きの操作です。
+	 * @param indices 行のインデックスの配列。重複したインデックスには該当する行がすべて足し込まれます。
+	 * @param src 足し込む行列。indices.size() 行 cols() 列である必要があります。
+	 * @param execPolicy 実行ポリシー。並列ポリシーの場合もインデックスの重複に関わらず結果は同じになります。
+	 * @return 自身の参照
+	 * @throws std::out_of_range インデックスが行数以上の場合
+	 * @throws std::invalid_argument src の形状が一致しない場合
+	 */
+	template<typename ExecPolicy = std::execution::sequenced_policy>
+	Matrix& scatter_add_rows(std::span<const size_t> indices, const Matrix& src, ExecPolicy execPolicy = ExecPolicy{})
+		requires StdExecPolicy<ExecPolicy>;
+
 	// ops.hpp
 	/**
 	 * @brief 行列の要素にアクセスするための演算子を定義します。
@@ -318,7 +515,7 @@ public:
 	 * @brief 行列の要素にアクセスするための演算子を定義します。
 	 * @param index 1次元インデックス
 	 * @return 指定された位置の要素への参照
-	 * @note 1次元インデックスは行優先または列優先のメモリレイアウトに基づいて解釈されます。
+	 * @note 1次元インデックスは行優先または列優先のメモリレイアウトに基づいて解釈されます。パディングするコンテナの場合は ld() を含めた格納位置になります。
 	 */
 	T& operator()(size_t index);
 
@@ -326,7 +523,7 @@ public:
 	 * @brief 行列の要素にアクセスするための演算子を定義します。
 	 * @param index 1次元インデックス
 	 * @return 指定された位置の要素への参照
-	 * @note 1次元インデックスは行優先または列優先のメモリレイアウトに基づいて解釈されます。
+	 * @note 1次元インデックスは行優先または列優先のメモリレイアウトに基づいて解釈されます。パディングするコンテナの場合は ld() を含めた格納位置になります。
 	 */
 	T& operator[](size_t index);
 
@@ -342,7 +539,7 @@ public:
 	 * @brief 行列の要素にアクセスするための定数演算子を定義します。
 	 * @param index 1次元インデックス
 	 * @return 指定された位置の要素への定数参照
-	 * @note 1次元インデックスは行優先または列優先のメモリレイアウトに基づいて解釈されます。
+	 * @note 1次元インデックスは行優先または列優先のメモリレイアウトに基づいて解釈されます。パディングするコンテナの場合は ld() を含めた格納位置になります。
 	 */
 	const T& operator()(size_t index) const;
 
@@ -350,7 +547,7 @@ public:
 	 * @brief 行列の要素にアクセスするための定数演算子を定義します。
 	 * @param index 1次元インデックス
 	 * @return 指定された位置の要素への定数参照
-	 * @note 1次元インデックスは行優先または列優先のメモリレイアウトに基づいて解釈されます。
+	 * @note 1次元インデックスは行優先または列優先のメモリレイアウトに基づいて解釈されます。パディングするコンテナの場合は ld() を含めた格納位置になります。
 	 */
 	const T& operator[](size_t index) const;
 
@@ -376,32 +573,31 @@ public:
 	Matrix& operator=(const Matrix& other) = default;
 
 	/**
-	 * @brief 他の行列を加算します。
-	 * @param other 加算する行列
-	 * @return 新しい行列のコピー
-	 */
-	Matrix operator+(const Matrix& other) const;
-
-	/**
-	 * @brief 他の行列を加算します。
-	 * @param scalar 加算するスカラー
-	 * @return 新しい行列のコピー
+	 * @brief 他の行列をムーブ代入します。
+	 * @param other 代入する行列
+	 * @return 自身の参照
 	 */
-	Matrix operator+(const T& scalar) const;
+	Matrix& operator=(Matrix&& other) noexcept = default;
 
 	/**
-	 * @brief 他の行列を減算します。
-	 * @param other 減算する行列
-	 * @return 新しい行列のコピー
+	 * @brief 式テンプレートを評価して代入します。
+	 * @param expr 要素ごとの演算の式 (a + b * 2 など)
+	 * @return 自身の参照
+	 * @note 式全体を1回のループで評価するため、中間の行列は確保されません。
 	 */
-	Matrix operator-(const Matrix& other) const;
+	template<typename Expr> requires MatrixExpression<Expr>
+	Matrix& operator=(const Expr& expr);
 
 	/**
-	 * @brief 他の行列を減算します。
-	 * @param scalar 減算するスカラー
-	 * @return 新しい行列のコピー
+	 * @brief 式テンプレートを実行ポリシーを指定して評価し、代入します。
+	 * @tparam execType 実行ポリシー(parallel_policy,parallel_unsequenced_policy,sequenced_policyから選択可能)
+	 * @param expr 要素ごとの演算の式
+	 * @param execPolicy 実行ポリシー
+	 * @return 自身の参照
 	 */
-	Matrix operator-(const T& scalar) const;
+	template<typename Expr, typename execType = std::execution::sequenced_policy>
+	Matrix& assign(const Expr& expr, execType execPolicy = execType{})
+		requires MatrixExpression<Expr> && StdExecPolicy<execType>;
 
 	/**
 	 * @brief 行列積を行います。
@@ -410,34 +606,6 @@ public:
 	 */
 	Matrix operator*(const Matrix& other) const;
 
-	/**
-	 * @brief 行列積を行います。
-	 * @param scalar 乗算するスカラー
-	 * @return 新しい行列のコピー
-	 */
-	Matrix operator*(const T& scalar) const;
-
-	/**
-	 * @brief アダマール積を行います。
-	 * @param other 乗算する行列
-	 * @return 新しい行列のコピー
-	 */
-	Matrix operator^(const Matrix& other) const;
-
-	/**
-	 * @brief 行列の要素ごとの除算を行います。
-	 * @param other 除算する行列
-	 * @return 新しい行列のコピー
-	 */
-	Matrix operator/(const Matrix& other) const;
-
-	/**
-	 * @brief 行列の要素ごとの除算を行います。
-	 * @param scalar 除算するスカラー
-	 * @return 新しい行列のコピー
-	 */
-	Matrix operator/(const T& scalar) const;
-
 	/**
 	 * @brief 他の行列との等価比較を行います。(メモリレイアウトが異なる場合)
 	 * @param other 比較する行列
@@ -486,7 +654,10 @@ public:
 	 * @throws std::invalid_argument 行列の次元が一致しない場合
 	 */
 	template<bool use_blas = false, typename execType = std::execution::sequenced_policy>
-	Matrix add_copy(const Matrix& other, execType execPolicy = execType()) const requires StdExecPolicy<execType>;
+	Matrix add_copy(const Matrix& other, execType execPolicy = execType()) const& requires StdExecPolicy<execType>;
+	/// 一時オブジェクトの場合は新しい行列を確保せず、自身の格納領域で計算して返します。
+	template<bool use_blas = false, typename execType = std::execution::sequenced_policy>
+	Matrix add_copy(const Matrix& other, execType execPolicy = execType()) && requires StdExecPolicy<execType>;
 
 	/**
 	 * @brief 他の行列との減算を行います。
@@ -510,7 +681,10 @@ public:
 	 * @throws std::invalid_argument 行列の次元が一致しない場合
 	 */
 	template<bool use_blas = false, typename execType = std::execution::sequenced_policy>
-	Matrix sub_copy(const Matrix& other, execType execPolicy = execType()) const requires StdExecPolicy<execType>;
+	Matrix sub_copy(const Matrix& other, execType execPolicy = execType()) const& requires StdExecPolicy<execType>;
+	/// 一時オブジェクトの場合は新しい行列を確保せず、自身の格納領域で計算して返します。
+	template<bool use_blas = false, typename execType = std::execution::sequenced_policy>
+	Matrix sub_copy(const Matrix& other, execType execPolicy = execType()) && requires StdExecPolicy<execType>;
 
 	/**
 	 * @brief 他の行列とのアダマール積を行います。
@@ -532,7 +706,10 @@ public:
 	 * @throws std::invalid_argument 行列の次元が一致しない場合
 	 */
 	template<typename execType = std::execution::sequenced_policy>
-	Matrix hadamard_mul_copy(const Matrix& other, execType execPolicy = execType()) const requires StdExecPolicy<execType>;
+	Matrix hadamard_mul_copy(const Matrix& other, execType execPolicy = execType()) const& requires StdExecPolicy<execType>;
+	/// 一時オブジェクトの場合は新しい行列を確保せず、自身の格納領域で計算して返します。
+	template<typename execType = std::execution::sequenced_policy>
+	Matrix hadamard_mul_copy(const Matrix& other, execType execPolicy = execType()) && requires StdExecPolicy<execType>;
 
 	/**
 	 * @brief スカラーとの乗算を行います。
@@ -554,7 +731,10 @@ public:
 	 * @return 新しい行列のコピー
 	 */
 	template<bool use_blas = false, typename execType = std::execution::sequenced_policy>
-	Matrix scalar_mul_copy(const T& scalar, execType execPolicy = execType()) const requires StdExecPolicy<execType>;
+	Matrix scalar_mul_copy(const T& scalar, execType execPolicy = execType()) const& requires StdExecPolicy<execType>;
+	/// 一時オブジェクトの場合は新しい行列を確保せず、自身の格納領域で計算して返します。
+	template<bool use_blas = false, typename execType = std::execution::sequenced_policy>
+	Matrix scalar_mul_copy(const T& scalar, execType execPolicy = execType()) && requires StdExecPolicy<execType>;
 
 	/**
 	 * @brief 他の行列とのアダマール除算を行います。
@@ -576,7 +756,10 @@ public:
 	 * @throws std::invalid_argument 行列の次元が一致しない場合、またはゼロ除算が発生した場合
 	 */
 	template<typename execType = std::execution::sequenced_policy>
-	Matrix hadamard_div_copy(const Matrix& other, execType execPolicy = execType()) const requires StdExecPolicy<execType>;
+	Matrix hadamard_div_copy(const Matrix& other, execType execPolicy = execType()) const& requires StdExecPolicy<execType>;
+	/// 一時オブジェクトの場合は新しい行列を確保せず、自身の格納領域で計算して返します。
+	template<typename execType = std::execution::sequenced_policy>
+	Matrix hadamard_div_copy(const Matrix& other, execType execPolicy = execType()) && requires StdExecPolicy<execType>;
 
 	/**
 	 * @brief スカラーとの除算を行います。
@@ -598,13 +781,42 @@ public:
 	 * @throws std::invalid_argument ゼロ除算が発生した場合
 	 */
 	template<typename execType = std::execution::sequenced_policy>
-	Matrix scalar_div_copy(const T& scalar, execType execPolicy = execType{}) const requires StdExecPolicy<execType>;
+	Matrix scalar_div_copy(const T& scalar, execType execPolicy = execType{}) const& requires StdExecPolicy<execType>;
+	/// 一時オブジェクトの場合は新しい行列を確保せず、自身の格納領域で計算して返します。
+	template<typename execType = std::execution::sequenced_policy>
+	Matrix scalar_div_copy(const T& scalar, execType execPolicy = execType{}) && requires StdExecPolicy<execType>;
+
+	/**
+	 * @brief 他の行列のスカラー倍を加算します。(this = this + alpha * x)
+	 * @tparam use_blas BLASを使用するかどうか(デフォルトはfalse)
+	 * @tparam execType 実行ポリシー(parallel_policy,parallel_unsequenced_policy,sequenced_policyから選択可能)デフォルトはstd::execution::sequenced_policy。StdExecPolicyコンセプトを満たす必要があります。
+	 * @param alpha スカラー
+	 * @param x 加算する行列
+	 * @param execPolicy 実行ポリシー(デフォルトはexecPolicy())
+	 * @return 自身の参照
+	 * @throws std::invalid_argument 行列の次元が一致しない場合
+	 */
+	template<bool use_blas = false, typename execType = std::execution::sequenced_policy>
+	Matrix& axpy(const T& alpha, const Matrix& x, execType execPolicy = execType()) requires StdExecPolicy<execType>;
+
+	/**
+	 * @brief 二つの行列のアダマール積を加算します。(this = this + a ⊙ b)
+	 * @tparam execType 実行ポリシー(parallel_policy,parallel_unsequenced_policy,sequenced_policyから選択可能)デフォルトはstd::execution::sequenced_policy。StdExecPolicyコンセプトを満たす必要があります。
+	 * @param a 乗算する行列
+	 * @param b 乗算する行列
+	 * @param execPolicy 実行ポリシー(デフォルトはexecPolicy())
+	 * @return 自身の参照
+	 * @throws std::invalid_argument 行列の次元が一致しない場合
+	 * @note float, double の場合は積和を1回の丸めで計算します。
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	Matrix& hadamard_fma(const Matrix& a, const Matrix& b, execType execPolicy = execType()) requires StdExecPolicy<execType>;
 
 	/**
 	 * @brief 各列の和を計算します。{{1,2,3},{4,5,6}} -> {{5,7,9}}
 	 * @return 新しい行列のコピー
 	 * @note 結果の行列は1行cols列の行列になります。
-	 * @note execPolicyは実行ポリシーを指定します。列優先レイアウトの場合のみ有効です。
+	 * @note execPolicyは実行ポリシーを指定します。並列ポリシーの場合は行(列)単位でスレッドプールに分割します。
 	 */
 	template<typename execType = std::execution::sequenced_policy>
 	Matrix sum_rows(execType execPolicy = execType{}) const requires StdExecPolicy<execType>;
@@ -612,36 +824,245 @@ public:
 	/**
 	 * @brief 列の和を計算します。{{1,2,3},{4,5,6}} -> {{6},{15}}
 	 * @return 新しい行列のコピー
-	 * @note execPolicyは実行ポリシーを指定します。列優先レイアウトの場合のみ有効です。
+	 * @note 結果の行列はrows行1列の行列になります。
 	 */
 	template<typename execType = std::execution::sequenced_policy>
 	Matrix sum_cols(execType execPolicy = execType{}) const requires StdExecPolicy<execType>;
 
+	/**
+	 * @brief 各列の最大値を計算します。{{1,5,3},{4,2,6}} -> {{4,5,6}}
+	 * @return 1行cols列の行列
+	 * @throws std::invalid_argument 行数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	Matrix max_rows(execType execPolicy = execType{}) const requires StdExecPolicy<execType>;
+
+	/**
+	 * @brief 各行の最大値を計算します。{{1,5,3},{4,2,6}} -> {{5},{6}}
+	 * @return rows行1列の行列
+	 * @throws std::invalid_argument 列数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	Matrix max_cols(execType execPolicy = execType{}) const requires StdExecPolicy<execType>;
+
+	/**
+	 * @brief 各列で最大値を持つ行のインデックスを計算します。最大値が複数ある場合は最も小さいインデックスを返します。
+	 * @return 長さcolsの配列
+	 * @throws std::invalid_argument 行数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	std::vector<size_t> argmax_rows(execType execPolicy = execType{}) const requires StdExecPolicy<execType>;
+
+	/**
+	 * @brief 各行で最大値を持つ列のインデックスを計算します。分類の予測ラベルの取得などに使用します。
+	 * @return 長さrowsの配列
+	 * @throws std::invalid_argument 列数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	std::vector<size_t> argmax_cols(execType execPolicy = execType{}) const requires StdExecPolicy<execType>;
+
+	/**
+	 * @brief 各列の平均を計算します。
+	 * @return 1行cols列の行列
+	 * @throws std::invalid_argument 行数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	Matrix mean_rows(execType execPolicy = execType{}) const requires StdExecPolicy<execType> && std::floating_point<T>;
+
+	/**
+	 * @brief 各行の平均を計算します。
+	 * @return rows行1列の行列
+	 * @throws std::invalid_argument 列数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	Matrix mean_cols(execType execPolicy = execType{}) const requires StdExecPolicy<execType> && std::floating_point<T>;
+
+	/**
+	 * @brief 各列の分散(標本数で割る母分散)をWelford法で計算します。
+	 * @return 1行cols列の行列
+	 * @throws std::invalid_argument 行数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	Matrix var_rows(execType execPolicy = execType{}) const requires StdExecPolicy<execType> && std::floating_point<T>;
+
+	/**
+	 * @brief 各行の分散(標本数で割る母分散)を計算します。
+	 * @return rows行1列の行列
+	 * @throws std::invalid_argument 列数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	Matrix var_cols(execType execPolicy = execType{}) const requires StdExecPolicy<execType> && std::floating_point<T>;
+
 	/**
 	 * @brief 他の行列との行列乗算を行います。
 	 * @tparam use_blas BLASを使用するかどうか(デフォルトはfalse)
+	 * @tparam TransThis 自身を転置して乗算するかどうか(デフォルトはfalse)。転置行列のコピーは作成しません。
+	 * @tparam TransOther 他の行列を転置して乗算するかどうか(デフォルトはfalse)。転置行列のコピーは作成しません。
+	 * @tparam Algorithm BLASを使用しない場合のアルゴリズム(デフォルトはBlocked)。Strassen は大きな行列で計算量を減らしますが、誤差が大きくなります。
 	 * @tparam OtherMajor 他の行列のメモリレイアウト
 	 * @tparam MCheck RowMajorがfalseかつOtherMajorがtrueである場合にコンパイルエラーとする(効率が非常に悪いため)
 	 * @param other 乗算する行列
 	 * @return 自身の参照
 	 * @throws std::invalid_argument 行列の次元が一致しない場合
 	 */
-	template<bool use_blas = false, bool OtherMajor, typename OtherContainer>
+	template<bool use_blas = false, bool TransThis = false, bool TransOther = false, GemmAlgorithm Algorithm = GemmAlgorithm::Blocked, bool OtherMajor, typename OtherContainer>
 	inline Matrix& matrix_mul(const Matrix<T, OtherMajor, OtherContainer>& other)
 	requires (!(RowMajor == false && OtherMajor == true));
 
 	/**
 	 * @brief 他の行列との行列乗算を行います。
 	 * @tparam use_blas BLASを使用するかどうか(デフォルトはfalse)
+	 * @tparam TransThis 自身を転置して乗算するかどうか(デフォルトはfalse)。転置行列のコピーは作成しません。
+	 * @tparam TransOther 他の行列を転置して乗算するかどうか(デフォルトはfalse)。転置行列のコピーは作成しません。
+	 * @tparam Algorithm BLASを使用しない場合のアルゴリズム(デフォルトはBlocked)。Strassen は大きな行列で計算量を減らしますが、誤差が大きくなります。
 	 * @tparam OtherMajor 他の行列のメモリレイアウト
 	 * @tparam MCheck RowMajorがfalseかつOtherMajorがtrueである場合にコンパイルエラーとする(効率が非常に悪いため)
 	 * @param other 乗算する行列
 	 * @return 新しい行列のコピー
 	 * @throws std::invalid_argument 行列の次元が一致しない場合
 	 */
-	template<bool use_blas = false, bool OtherMajor, typename OtherContainer>
+	template<bool use_blas = false, bool TransThis = false, bool TransOther = false, GemmAlgorithm Algorithm = GemmAlgorithm::Blocked, bool OtherMajor, typename OtherContainer>
 	inline Matrix matrix_mul_copy(const Matrix<T, OtherMajor, OtherContainer>& other) const
 	requires (!(RowMajor == false && OtherMajor == true));
 };
 
+/**
+ * @brief コピーで格納領域を共有し、書き込むときに複製する (コピーオンライト) 行列
+ * @note コピーを多く作り、ほとんど書き換えない行列に使います。確保先は MatrixMemory::Scope の影響を受けません (SharedVector を参照)。
+ */
+template<typename T, bool RowMajor = true>
+using SharedMatrix = Matrix<T, RowMajor, SharedVector<T>>;
+
+// 行列積の入力として受け付ける型 (Matrix または MatrixView)
+template<typename M> struct matrix_operand_traits { static constexpr bool value = false; };
+template<typename T, bool RowMajor, typename Container>
+struct matrix_operand_traits<Matrix<T, RowMajor, Container>> {
+	static constexpr bool value = true;
+	static constexpr bool row_major = RowMajor;
+	using value_type = T;
+	static MatrixView<const T, RowMajor> view(const Matrix<T, RowMajor, Container>& m) { return m.view(); }
+	static MatrixView<T, RowMajor> mutable_view(Matrix<T, RowMajor, Container>& m) { return m.view(); }
+};
+template<typename T, bool RowMajor>
+struct matrix_operand_traits<MatrixView<T, RowMajor>> {
+	static constexpr bool value = true;
+	static constexpr bool row_major = RowMajor;
+	using value_type = std::remove_const_t<T>;
+	static MatrixView<const value_type, RowMajor> view(const MatrixView<T, RowMajor>& v) { return v; }
+	static MatrixView<T, RowMajor> mutable_view(const MatrixView<T, RowMajor>& v) { return v; }
+};
+template<typename M>
+concept MatrixOperand = matrix_operand_traits<std::remove_cvref_t<M>>::value;
+template<typename M> requires MatrixOperand<M>
+using matrix_operand_value_t = typename matrix_operand_traits<std::remove_cvref_t<M>>::value_type;
+
+// calc.hpp
+/**
+ * @brief C = alpha * op(A) * op(B) + beta * C を計算し、既存の行列Cに書き込みます。(Cは再確保されません)
+ * @tparam use_blas BLASを使用するかどうか(デフォルトはfalse)。true の場合は Backend::Registry が (M, N, K) と要素型からプロバイダを選び、小さな積はネイティブの実装で計算します。
+ * @tparam TransA Aを転置して乗算するかどうか(デフォルトはfalse)
+ * @tparam TransB Bを転置して乗算するかどうか(デフォルトはfalse)
+ * @param C 出力先の行列またはビュー。op(A)の行数 x op(B)の列数である必要があります。メモリレイアウトはAと同じである必要があります。
+ * @param A 左側の行列またはビュー
+ * @param B 右側の行列またはビュー
+ * @param alpha 積に掛ける係数(デフォルトは1)
+ * @param beta Cの元の値に掛ける係数(デフォルトは0)。0の場合はCの元の値を読みません。
+ * @throws std::invalid_argument 行列の次元が一致しない場合、またはCの領域がAまたはBの領域と重なる場合
+ * @note beta = 1 とすると勾配の累積などに使用できます。
+ * @note ビューを渡すと、ミニバッチや部分行列をコピーせずにそのまま乗算・書き込みできます。
+ */
+template<bool use_blas = false, bool TransA = false, bool TransB = false,
+	typename CType, typename AType, typename BType>
+	requires MatrixOperand<CType> && MatrixOperand<AType> && MatrixOperand<BType>
+void gemm_into(
+	CType&& C,
+	const AType& A,
+	const BType& B,
+	matrix_operand_value_t<CType> alpha = matrix_operand_value_t<CType>(1),
+	matrix_operand_value_t<CType> beta = matrix_operand_value_t<CType>(0));
+
+/**
+ * @brief A の行を添字で選んだ行列 A_g (i 行目が A の rows[i] 行目) について C = alpha * op(A_g) * op(B) + beta * C を計算します。
+ * @tparam use_blas BLASを使用するかどうか(デフォルトはfalse)
+ * @tparam TransA A_g を転置して乗算するかどうか(デフォルトはfalse)
+ * @tparam TransB Bを転置して乗算するかどうか(デフォルトはfalse)
+ * @param C 出力先の行列またはビュー。メモリレイアウトはAと同じである必要があります。
+ * @param A 行を選ぶ元の行列またはビュー(データセット全体など)
+ * @param rows 行のインデックスの配列。順不同や重複があっても構いません。
+ * @param B 右側の行列またはビュー
+ * @param alpha 積に掛ける係数(デフォルトは1)
+ * @param beta Cの元の値に掛ける係数(デフォルトは0)
+ * @throws std::out_of_range インデックスがAの行数以上の場合
+ * @throws std::invalid_argument gemm_into と同じ条件を満たさない場合
+ * @note BLASを使用しない場合は A_g を作らず、パック時に添字で A を直接読みます。
+ *       BLASを使用する場合は A_g を MatrixMemory::current() のリソースにコピーしてから gemm_into を呼び出します。
+ */
+template<bool use_blas = false, bool TransA = false, bool TransB = false,
+	typename CType, typename AType, typename BType>
+	requires MatrixOperand<CType> && MatrixOperand<AType> && MatrixOperand<BType>
+void gemm_gathered_into(
+	CType&& C,
+	const AType& A,
+	std::span<const size_t> rows,
+	const BType& B,
+	matrix_operand_value_t<CType> alpha = matrix_operand_value_t<CType>(1),
+	matrix_operand_value_t<CType> beta = matrix_operand_value_t<CType>(0));
+
+/**
+ * @brief op(A) * op(B) を計算し、新しい行列として返します。
+ * @tparam use_blas BLASを使用するかどうか(デフォルトはfalse)
+ * @tparam TransA Aを転置して乗算するかどうか(デフォルトはfalse)
+ * @tparam TransB Bを転置して乗算するかどうか(デフォルトはfalse)
+ * @param A 左側の行列またはビュー
+ * @param B 右側の行列またはビュー
+ * @return Aと同じメモリレイアウトの新しい行列
+ * @throws std::invalid_argument 行列の次元が一致しない場合
+ */
+template<bool use_blas = false, bool TransA = false, bool TransB = false, typename AType, typename BType>
+	requires MatrixOperand<AType> && MatrixOperand<BType>
+Matrix<matrix_operand_value_t<AType>, matrix_operand_traits<std::remove_cvref_t<AType>>::row_major> matmul(const AType& A, const BType& B);
+
+/**
+ * @brief 行方向に batch 個積み重ねた行列どうしの積 C_i = alpha * op(A_i) * op(B_i) + beta * C_i (i = 0, ..., batch - 1) をまとめて計算します。
+ * @tparam use_blas BLASを使用するかどうか(デフォルトはfalse)。バックエンドにストライド指定のバッチ関数がある場合は1回の呼び出しで計算します。
+ * @tparam TransA 各 A_i を転置して乗算するかどうか(デフォルトはfalse)
+ * @tparam TransB 各 B_i を転置して乗算するかどうか(デフォルトはfalse)
+ * @param batch 行列積の数。A, B, C の行数は batch で割り切れる必要があり、i 番目の行列は [i * rows / batch, (i + 1) * rows / batch) 行の部分行列です。
+ * @param C 出力先の行列またはビュー。メモリレイアウトはAと同じである必要があります。
+ * @param A 左側の行列またはビュー
+ * @param B 右側の行列またはビュー
+ * @param alpha 積に掛ける係数(デフォルトは1)
+ * @param beta Cの元の値に掛ける係数(デフォルトは0)
+ * @throws std::invalid_argument 行数が batch で割り切れない場合、行列の次元が一致しない場合、またはCの領域がAまたはBの領域と重なる場合
+ * @note BLASを使用しない場合はバッチ方向にスレッドプールで分割し、小さな積をまとめて1つのタスクで計算します。
+ */
+template<bool use_blas = false, bool TransA = false, bool TransB = false,
+	typename CType, typename AType, typename BType>
+	requires MatrixOperand<CType> && MatrixOperand<AType> && MatrixOperand<BType>
+void gemm_batched(
+	size_t batch,
+	CType&& C,
+	const AType& A,
+	const BType& B,
+	matrix_operand_value_t<CType> alpha = matrix_operand_value_t<CType>(1),
+	matrix_operand_value_t<CType> beta = matrix_operand_value_t<CType>(0));
+
+/**
+ * @brief 行列(ビュー)の配列どうしの積 C[i] = alpha * op(A[i]) * op(B[i]) + beta * C[i] をまとめて計算します。
+ * @param C 出力先のビューの配列
+ * @param A 左側の行列またはビューの配列
+ * @param B 右側の行列またはビューの配列。C, A, B は同じ要素数で、積ごとに形状が異なっても構いません。
+ * @throws std::invalid_argument 配列の要素数が一致しない場合、または gemm_into と同じ条件を満たさない場合
+ * @note BLASを使用しない場合はバッチ方向にスレッドプールで分割します。BLASを使用する場合は順に gemm_into を呼び出します。
+ */
+template<bool use_blas = false, bool TransA = false, bool TransB = false,
+	typename T, bool RowMajor, typename AType, typename BType>
+	requires MatrixOperand<AType> && MatrixOperand<BType>
+void gemm_batched(
+	const std::vector<MatrixView<T, RowMajor>>& C,
+	const std::vector<AType>& A,
+	const std::vector<BType>& B,
+	std::type_identity_t<T> alpha = T(1),
+	std::type_identity_t<T> beta = T(0));
+
 #endif // SANAE_NEURALNETWORK_MATRIX
\ No newline at end of file
@@ -0,0 +1,336 @@
+﻿#ifndef SANAE_NEURALNETWORK_MATRIXFILE
+#define SANAE_NEURALNETWORK_MATRIXFILE
+
+#include "matrix.h"
+#include "float16.hpp"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+/**
+ * @brief 行列のバイナリファイル形式
+ *
+ * ファイルは64バイトのヘッダ (Header) と、data_offset バイト目から始まる要素の生データからなります。
+ * 数値はすべてリトルエンディアンで格納します。
+ *   magic       : "SNMATRIX"
+ *   version     : 形式のバージョン (現在は1)
+ *   dtype       : 要素型 (DType)
+ *   flags       : ビット0 が1なら行優先
+ *   rows, cols  : 行数と列数
+ *   ld          : リーディングディメンション (要素数)。外側の次元 * ld 個の要素が格納されます
+ *   data_offset : データの開始位置。alignment の倍数です
+ *   data_size   : データのバイト数
+ *   alignment   : データの開始位置の境界 (バイト)
+ *
+ * MappedMatrix はファイルをメモリマップし、コピーせずに MatrixView として参照します。
+ * 読み込みはページ単位で必要になったときに行われ、同じファイルを開いた複数のプロセスはページキャッシュを共有します。
+ */
+namespace MatrixFile {
+	/// 要素型の識別子
+	enum class DType : std::uint8_t {
+		Float32 = 1,
+		Float64 = 2,
+		BFloat16 = 3,
+		Float16 = 4,
+		Int8 = 5,
+		UInt8 = 6,
+		Int32 = 7,
+	};
+
+	/// 現在の形式のバージョン
+	inline constexpr std::uint32_t version = 1;
+	/// データの開始位置の境界 (バイト)。AVX-512 のロードとキャッシュラインに揃えます
+	inline constexpr std::uint32_t alignment = 64;
+	inline constexpr char magic[8] = { 'S', 'N', 'M', 'A', 'T', 'R', 'I', 'X' };
+
+	/// ファイル先頭のヘッダ
+	struct Header {
+		char magic[8];
+		std::uint32_t version;
+		std::uint16_t header_size;
+		std::uint8_t dtype;
+		std::uint8_t flags;
+		std::uint64_t rows;
+		std::uint64_t cols;
+		std::uint64_t ld;
+		std::uint64_t data_offset;
+		std::uint64_t data_size;
+		std::uint32_t alignment;
+		std::uint32_t reserved;
+
+		bool row_major() const noexcept { return (flags & 1) != 0; }
+	};
+	static_assert(sizeof(Header) == 64 && std::is_trivially_copyable_v<Header>, "MatrixFile::Header must be a 64-byte trivially copyable struct.");
+
+	template<typename T> struct dtype_of;
+	template<> struct dtype_of<float> { static constexpr DType value = DType::Float32; };
+	template<> struct dtype_of<double> { static constexpr DType value = DType::Float64; };
+	template<> struct dtype_of<bfloat16> { static constexpr DType value = DType::BFloat16; };
+	template<> struct dtype_of<float16> { static constexpr DType value = DType::Float16; };
+	template<> struct dtype_of<std::int8_t> { static constexpr DType value = DType::Int8; };
+	template<> struct dtype_of<std::uint8_t> { static constexpr DType value = DType::UInt8; };
+	template<> struct dtype_of<std::int32_t> { static constexpr DType value = DType::Int32; };
+	template<typename T>
+	inline constexpr DType dtype_of_v = dtype_of<T>::value;
+
+	namespace detail {
+		inline void check_endian() {
+			if constexpr (std::endian::native != std::endian::little)
+				throw std::runtime_error("MatrixFile supports only little-endian hosts.");
+		}
+
+		/**
+		 * @brief ヘッダを検証します。
+		 * @param file_size ファイルのバイト数
+		 * @throws std::runtime_error 形式が正しくない、または要素型・レイアウトが一致しない場合
+		 */
+		template<typename T, bool RowMajor>
+		inline void validate(const Header& header, std::uint64_t file_size) {
+			if (std::memcmp(header.magic, magic, sizeof(magic)) != 0)
+				throw std::runtime_error("Not a matrix file.");
+			if (header.version != version || header.header_size != sizeof(Header))
+				throw std::runtime_error("Unsupported matrix file version.");
+			if (header.dtype != static_cast<std::uint8_t>(dtype_of_v<T>))
+				throw std::runtime_error("Matrix file element type does not match.");
+			if (header.row_major() != RowMajor)
+				throw std::runtime_error("Matrix file layout does not match.");
+
+			const std::uint64_t outer = RowMajor ? header.rows : header.cols;
+			const std::uint64_t inner = RowMajor ? header.cols : header.rows;
+			if (header.ld < inner || header.alignment == 0 || header.data_offset % header.alignment != 0 || header.data_offset < sizeof(Header))
+				throw std::runtime_error("Corrupted matrix file header.");
+			if (outer != 0 && header.ld > (UINT64_MAX / sizeof(T)) / outer)
+				throw std::runtime_error("Corrupted matrix file header.");
+			if (header.data_size != outer * header.ld * sizeof(T) || file_size < header.data_offset || file_size - header.data_offset < header.data_size)
+				throw std::runtime_error("Matrix file is truncated.");
+		}
+	}
+
+	/**
+	 * @brief 行列をファイルに書き込みます。
+	 * @param path 書き込むファイルのパス
+	 * @param m Matrix, MatrixView, FixedMatrix など。パディングを除いて詰めて (ld = 内側の次元) 書き込みます
+	 * @throws std::runtime_error ファイルを書き込めない場合
+	 */
+	template<typename M> requires MatrixOperand<M>
+	inline void write(const std::string& path, const M& m) {
+		using T = matrix_operand_value_t<M>;
+		constexpr bool RowMajor = matrix_operand_traits<M>::row_major;
+		detail::check_endian();
+
+		const auto view = matrix_operand_traits<M>::view(m);
+		const size_t outer = RowMajor ? view.rows() : view.cols();
+		const size_t inner = RowMajor ? view.cols() : view.rows();
+
+		Header header{};
+		std::memcpy(header.magic, magic, sizeof(magic));
+		header.version = version;
+		header.header_size = sizeof(Header);
+		header.dtype = static_cast<std::uint8_t>(dtype_of_v<T>);
+		header.flags = RowMajor ? 1 : 0;
+		header.rows = view.rows();
+		header.cols = view.cols();
+		header.ld = inner;
+		header.data_offset = (sizeof(Header) + alignment - 1) / alignment * alignment;
+		header.data_size = outer * inner * sizeof(T);
+		header.alignment = alignment;
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file)
+			throw std::runtime_error("Failed to open matrix file for writing: " + path);
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		const std::vector<char> padding(header.data_offset - sizeof(Header), 0);
+		file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+		if (view.contiguous())
+			file.write(reinterpret_cast<const char*>(view.data()), static_cast<std::streamsize>(header.data_size));
+		else
+			for (size_t line = 0; line < outer; line++)
+				file.write(reinterpret_cast<const char*>(view.data() + line * view.ld()), static_cast<std::streamsize>(inner * sizeof(T)));
+
+		if (!file.flush())
+			throw std::runtime_error("Failed to write matrix file: " + path);
+	}
+
+	/**
+	 * @brief ファイルのヘッダだけを読み込みます。
+	 * @throws std::runtime_error ファイルを読み込めない場合
+	 */
+	inline Header read_header(const std::string& path) {
+		std::ifstream file(path, std::ios::binary);
+		Header header{};
+		if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+			throw std::runtime_error("Failed to read matrix file header: " + path);
+		return header;
+	}
+}
+
+/**
+ * @class MappedMatrix
+ * @brief MatrixFile 形式のファイルをメモリマップした読み取り専用の行列
+ *
+ * 要素はファイルのページをそのまま参照するため、開く処理はファイルの大きさによらず一定時間で終わります。
+ * view() で MatrixView として取得でき、gemm_into / matmul の入力にもそのまま指定できます。
+ * ムーブのみ可能で、破棄するとマップを解除します (取得したビューは無効になります)。
+ *
+ * @tparam T 要素型。ファイルの要素型と一致する必要があります
+ * @tparam RowMajor 行優先か列優先か。ファイルのレイアウトと一致する必要があります
+ */
+template<typename T, bool RowMajor = true>
+class MappedMatrix {
+private:
+	const unsigned char* _base = nullptr; ///< マップした領域の先頭
+	size_t _length = 0;                   ///< マップした領域のバイト数
+	MatrixView<const T, RowMajor> _view;
+
+	void _unmap() noexcept {
+		if (!_base)
+			return;
+#if defined(_WIN32)
+		UnmapViewOfFile(_base);
+#else
+		munmap(const_cast<unsigned char*>(_base), _length);
+#endif
+		_base = nullptr;
+		_length = 0;
+	}
+
+public:
+	/**
+	 * @brief ファイルを開いてメモリマップします。
+	 * @param path MatrixFile::write で書き込んだファイルのパス
+	 * @throws std::runtime_error ファイルを開けない、形式が正しくない、または要素型・レイアウトが一致しない場合
+	 */
+	explicit MappedMatrix(const std::string& path) {
+		MatrixFile::detail::check_endian();
+		std::uint64_t file_size = 0;
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("Failed to open matrix file: " + path);
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size)) {
+			CloseHandle(file);
+			throw std::runtime_error("Failed to stat matrix file: " + path);
+		}
+		file_size = static_cast<std::uint64_t>(size.QuadPart);
+		if (file_size < sizeof(MatrixFile::Header)) {
+			CloseHandle(file);
+			throw std::runtime_error("Not a matrix file.");
+		}
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (!mapping)
+			throw std::runtime_error("Failed to map matrix file: " + path);
+		void* base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		if (!base)
+			throw std::runtime_error("Failed to map matrix file: " + path);
+#else
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			throw std::runtime_error("Failed to open matrix file: " + path);
+		struct stat st {};
+		if (::fstat(fd, &st) != 0) {
+			::close(fd);
+			throw std::runtime_error("Failed to stat matrix file: " + path);
+		}
+		file_size = static_cast<std::uint64_t>(st.st_size);
+		if (file_size < sizeof(MatrixFile::Header)) {
+			::close(fd);
+			throw std::runtime_error("Not a matrix file.");
+		}
+		void* base = ::mmap(nullptr, static_cast<size_t>(file_size), PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd); // マップはファイル記述子を閉じても有効
+		if (base == MAP_FAILED)
+			throw std::runtime_error("Failed to map matrix file: " + path);
+#endif
+		_base = static_cast<const unsigned char*>(base);
+		_length = static_cast<size_t>(file_size);
+
+		MatrixFile::Header header;
+		std::memcpy(&header, _base, sizeof(header));
+		try {
+			MatrixFile::detail::validate<T, RowMajor>(header, file_size);
+		} catch (...) {
+			_unmap();
+			throw;
+		}
+		_view = MatrixView<const T, RowMajor>(reinterpret_cast<const T*>(_base + header.data_offset), header.rows, header.cols, header.ld);
+	}
+
+	MappedMatrix(const MappedMatrix&) = delete;
+	MappedMatrix& operator=(const MappedMatrix&) = delete;
+	MappedMatrix(MappedMatrix&& other) noexcept
+		: _base(std::exchange(other._base, nullptr)), _length(std::exchange(other._length, 0)), _view(std::exchange(other._view, {})) {}
+	MappedMatrix& operator=(MappedMatrix&& other) noexcept {
+		if (this != &other) {
+			_unmap();
+			_base = std::exchange(other._base, nullptr);
+			_length = std::exchange(other._length, 0);
+			_view = std::exchange(other._view, {});
+		}
+		return *this;
+	}
+	~MappedMatrix() { _unmap(); }
+
+	size_t rows() const noexcept { return _view.rows(); }
+	size_t cols() const noexcept { return _view.cols(); }
+	size_t ld() const noexcept { return _view.ld(); }
+	const T* data() const noexcept { return _view.data(); }
+	const T& operator()(size_t row, size_t col) const noexcept { return _view(row, col); }
+
+	/**
+	 * @brief マップした要素を参照するビューを取得します。ビューは MappedMatrix が破棄されるまで有効です。
+	 */
+	MatrixView<const T, RowMajor> view() const noexcept { return _view; }
+
+	/**
+	 * @brief 要素をコピーして書き換え可能な行列を作成します。
+	 */
+	Matrix<T, RowMajor> to_matrix() const { return Matrix<T, RowMajor>(_view); }
+};
+
+// gemm_into / matmul の入力として受け付ける
+template<typename T, bool RowMajor>
+struct matrix_operand_traits<MappedMatrix<T, RowMajor>> {
+	static constexpr bool value = true;
+	static constexpr bool row_major = RowMajor;
+	using value_type = T;
+	static MatrixView<const T, RowMajor> view(const MappedMatrix<T, RowMajor>& m) { return m.view(); }
+};
+
+namespace MatrixFile {
+	/**
+	 * @brief ファイルを読み込み、要素をコピーした行列を返します。
+	 * @throws std::runtime_error ファイルを開けない、形式が正しくない、または要素型・レイアウトが一致しない場合
+	 */
+	template<typename T, bool RowMajor = true>
+	inline Matrix<T, RowMajor> load(const std::string& path) {
+		return MappedMatrix<T, RowMajor>(path).to_matrix();
+	}
+}
+
+#endif // SANAE_NEURALNETWORK_MATRIXFILE
\ No newline at end of file
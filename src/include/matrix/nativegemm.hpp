@@ -0,0 +1,621 @@
+﻿#ifndef SANAE_NEURALNETWORK_NATIVE_GEMM
+#define SANAE_NEURALNETWORK_NATIVE_GEMM
+
+#include "../threadpool/threadpool.h"
+#include "float16.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+/**
+ * BLASを使用しない場合の行列積カーネル
+ *
+ * GotoBLAS/BLIS と同様の構成で、C += A * B を以下の5重ループで計算します。
+ *   jc : Bの列方向を NC 単位で分割 (L3キャッシュ)
+ *   pc : K方向を KC 単位で分割し、Bのブロック(KC x NC)をパック
+ *   ic : Aの行方向を MC 単位で分割し、Aのブロック(MC x KC)をパック (L2キャッシュ)
+ *   jr : パック済みBを NR 列ずつ (L1キャッシュ)
+ *   ir : パック済みAを MR 行ずつ処理するマイクロカーネル (レジスタ)
+ *
+ * 各行列は行ストライド・列ストライドで表現するため、行優先/列優先のどちらにも対応します。
+ * 16ビット浮動小数点数 (bfloat16, float16) はパック時に float に変換し、K方向全体を float で累積してから1回だけ丸めます。
+ */
+namespace NativeGemm {
+#if defined(__AVX512F__)
+	inline constexpr size_t vector_bytes = 64;
+#elif defined(__AVX__)
+	inline constexpr size_t vector_bytes = 32;
+#else
+	inline constexpr size_t vector_bytes = 16;
+#endif
+
+	/**
+	 * @brief ブロックサイズ
+	 * @tparam T 要素型
+	 * @note NRはSIMDレジスタ2本分の要素数、MR x NRの累積値がレジスタに収まるように設定しています。
+	 */
+	template<typename T>
+	struct BlockSize {
+		static constexpr size_t MR = 6;
+		static constexpr size_t NR = (2 * vector_bytes / sizeof(T)) < 4 ? 4 : 2 * vector_bytes / sizeof(T);
+		static constexpr size_t KC = 256;
+		static constexpr size_t MC = MR * 20;
+		static constexpr size_t NC = NR * 128;
+	};
+
+#if defined(__GNUC__)
+	/**
+	 * @brief マイクロカーネルで使用するSIMDベクタ型 (GCC/Clangのベクタ拡張)
+	 */
+	template<typename T>
+	struct VectorType {
+		typedef T type __attribute__((vector_size(vector_bytes)));
+		static constexpr size_t lanes = vector_bytes / sizeof(T);
+	};
+#endif
+
+	/**
+	 * @brief Aのブロック(mc x kc)をMR行ごとのマイクロパネルにパックします。
+	 * @note 端数の行は0で埋めます。パネル内は k, i の順に並びます。要素は累積に使う型 P に変換して格納します。
+	 *       rows (cols) を指定した場合は i 行目 (p 列目) として a の rows[i] 行目 (cols[p] 列目) を読みます。
+	 */
+	template<typename T, typename P>
+	inline void pack_a(size_t mc, size_t kc, const T* a, ptrdiff_t rs_a, ptrdiff_t cs_a, P* packed,
+		const size_t* rows = nullptr, const size_t* cols = nullptr)
+	{
+		constexpr size_t MR = BlockSize<P>::MR;
+
+		if (rows != nullptr || cols != nullptr) {
+			for (size_t ir = 0; ir < mc; ir += MR) {
+				const size_t mr = std::min(MR, mc - ir);
+
+				// パネルの各行の先頭を先に求めておく
+				const T* a_row[MR];
+				for (size_t i = 0; i < mr; i++)
+					a_row[i] = a + static_cast<ptrdiff_t>(rows != nullptr ? rows[ir + i] : ir + i) * rs_a;
+
+				for (size_t p = 0; p < kc; p++) {
+					const ptrdiff_t offset = static_cast<ptrdiff_t>(cols != nullptr ? cols[p] : p) * cs_a;
+					for (size_t i = 0; i < mr; i++)
+						packed[i] = static_cast<P>(a_row[i][offset]);
+					for (size_t i = mr; i < MR; i++)
+						packed[i] = P{};
+					packed += MR;
+				}
+			}
+			return;
+		}
+
+		for (size_t ir = 0; ir < mc; ir += MR) {
+			const size_t mr = std::min(MR, mc - ir);
+			const T* a_panel = a + static_cast<ptrdiff_t>(ir) * rs_a;
+
+			for (size_t p = 0; p < kc; p++) {
+				const T* a_col = a_panel + static_cast<ptrdiff_t>(p) * cs_a;
+				for (size_t i = 0; i < mr; i++)
+					packed[i] = static_cast<P>(a_col[static_cast<ptrdiff_t>(i) * rs_a]);
+				for (size_t i = mr; i < MR; i++)
+					packed[i] = P{};
+				packed += MR;
+			}
+		}
+	}
+
+	/**
+	 * @brief Bのブロック(kc x nc)をNR列ごとのマイクロパネルにパックします。
+	 * @note 端数の列は0で埋めます。パネル内は k, j の順に並びます。要素は累積に使う型 P に変換して格納します。
+	 */
+	template<typename T, typename P>
+	inline void pack_b(size_t kc, size_t nc, const T* b, ptrdiff_t rs_b, ptrdiff_t cs_b, P* packed)
+	{
+		constexpr size_t NR = BlockSize<P>::NR;
+
+		for (size_t jr = 0; jr < nc; jr += NR) {
+			const size_t nr = std::min(NR, nc - jr);
+			const T* b_panel = b + static_cast<ptrdiff_t>(jr) * cs_b;
+
+			for (size_t p = 0; p < kc; p++) {
+				const T* b_row = b_panel + static_cast<ptrdiff_t>(p) * rs_b;
+				if (cs_b == 1) {
+					std::copy(b_row, b_row + nr, packed);
+				}
+				else {
+					for (size_t j = 0; j < nr; j++)
+						packed[j] = static_cast<P>(b_row[static_cast<ptrdiff_t>(j) * cs_b]);
+				}
+				for (size_t j = nr; j < NR; j++)
+					packed[j] = P{};
+				packed += NR;
+			}
+		}
+	}
+
+	/**
+	 * @brief MR x NR のマイクロカーネル
+	 * @param kc K方向の長さ
+	 * @param a パック済みAのマイクロパネル
+	 * @param b パック済みBのマイクロパネル
+	 * @param c 出力先の左上要素
+	 * @param rs_c, cs_c 出力先の行ストライド・列ストライド
+	 * @param mr, nr 実際に書き込む行数・列数 (端数処理用)
+	 * @param alpha, beta c = alpha * (a * b) + beta * c として書き込む。betaが0の場合はcを読みません。
+	 * @note GCC/Clangではベクタ拡張を使用し、それ以外のコンパイラでは内側のNRループの自動ベクトル化に任せます。
+	 */
+	template<typename T>
+	inline void micro_kernel(size_t kc, const T* __restrict a, const T* __restrict b, T* c, ptrdiff_t rs_c, ptrdiff_t cs_c, size_t mr, size_t nr, T alpha, T beta)
+	{
+		constexpr size_t MR = BlockSize<T>::MR;
+		constexpr size_t NR = BlockSize<T>::NR;
+
+		T acc[MR][NR];
+#if defined(__GNUC__)
+		if constexpr (std::is_arithmetic_v<T> && NR % VectorType<T>::lanes == 0) {
+			using vec = typename VectorType<T>::type;
+			constexpr size_t NV = NR / VectorType<T>::lanes;
+
+			// 累積値をベクタ型で保持し、レジスタ上に載せる
+			vec vacc[MR][NV] = {};
+			for (size_t p = 0; p < kc; p++) {
+				vec bv[NV];
+				std::memcpy(bv, b, sizeof(bv));
+				for (size_t i = 0; i < MR; i++) {
+					const T av = a[i];
+					for (size_t v = 0; v < NV; v++)
+						vacc[i][v] += av * bv[v];
+				}
+				a += MR;
+				b += NR;
+			}
+			std::memcpy(acc, vacc, sizeof(acc));
+		}
+		else
+#endif
+		{
+			for (size_t i = 0; i < MR; i++)
+				for (size_t j = 0; j < NR; j++)
+					acc[i][j] = T{};
+
+			for (size_t p = 0; p < kc; p++) {
+				for (size_t i = 0; i < MR; i++) {
+					const T av = a[i];
+					for (size_t j = 0; j < NR; j++)
+						acc[i][j] += av * b[j];
+				}
+				a += MR;
+				b += NR;
+			}
+		}
+
+		for (size_t i = 0; i < mr; i++) {
+			T* c_row = c + static_cast<ptrdiff_t>(i) * rs_c;
+			if (beta == T(0)) {
+				for (size_t j = 0; j < nr; j++)
+					c_row[static_cast<ptrdiff_t>(j) * cs_c] = alpha * acc[i][j];
+			}
+			else if (beta == T(1)) {
+				for (size_t j = 0; j < nr; j++)
+					c_row[static_cast<ptrdiff_t>(j) * cs_c] += alpha * acc[i][j];
+			}
+			else {
+				for (size_t j = 0; j < nr; j++) {
+					T& cv = c_row[static_cast<ptrdiff_t>(j) * cs_c];
+					cv = alpha * acc[i][j] + beta * cv;
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief ストライド指定の行列積 C = alpha * A * B + beta * C を単一スレッドで計算します。
+	 * @param M, N, K 行列サイズ (A: M x K, B: K x N, C: M x N)
+	 * @param a, rs_a, cs_a Aの先頭ポインタと行・列ストライド
+	 * @param b, rs_b, cs_b Bの先頭ポインタと行・列ストライド
+	 * @param c, rs_c, cs_c Cの先頭ポインタと行・列ストライド
+	 * @param alpha, beta スケーリング係数。betaが0の場合はCの元の値を読みません。
+	 * @param a_rows, a_cols nullptr でない場合、Aの i 行目 (p 列目) として a の a_rows[i] 行目 (a_cols[p] 列目) を読みます。
+	 *                       データセットから添字で選んだ行をコピーせずに乗算するときに使用します。
+	 * @tparam T 入力の要素型
+	 * @tparam Acc 累積と出力の型。T と異なる場合はパック時に変換します。
+	 */
+	template<typename T, typename Acc = T>
+	inline void gemm(
+		size_t M, size_t N, size_t K,
+		const T* a, ptrdiff_t rs_a, ptrdiff_t cs_a,
+		const T* b, ptrdiff_t rs_b, ptrdiff_t cs_b,
+		Acc* c, ptrdiff_t rs_c, ptrdiff_t cs_c,
+		Acc alpha = Acc(1), Acc beta = Acc(0),
+		const size_t* a_rows = nullptr, const size_t* a_cols = nullptr)
+	{
+		using BS = BlockSize<Acc>;
+
+		if (M == 0 || N == 0)
+			return;
+
+		if (K == 0) {
+			for (size_t i = 0; i < M; i++) {
+				for (size_t j = 0; j < N; j++) {
+					Acc& cv = c[static_cast<ptrdiff_t>(i) * rs_c + static_cast<ptrdiff_t>(j) * cs_c];
+					cv = beta == Acc(0) ? Acc{} : beta * cv;
+				}
+			}
+			return;
+		}
+
+		// パック用バッファはスレッドごとに再利用する
+		thread_local std::vector<Acc> packed_a;
+		thread_local std::vector<Acc> packed_b;
+		packed_a.resize(BS::MC * BS::KC);
+		packed_b.resize(BS::KC * ((std::min(N, BS::NC) + BS::NR - 1) / BS::NR) * BS::NR);
+
+		for (size_t jc = 0; jc < N; jc += BS::NC) {
+			const size_t nc = std::min(BS::NC, N - jc);
+
+			for (size_t pc = 0; pc < K; pc += BS::KC) {
+				const size_t kc = std::min(BS::KC, K - pc);
+				// 最初のKブロックだけbetaを適用し、以降は累積する
+				const Acc block_beta = (pc == 0) ? beta : Acc(1);
+
+				pack_b(kc, nc,
+					b + static_cast<ptrdiff_t>(pc) * rs_b + static_cast<ptrdiff_t>(jc) * cs_b,
+					rs_b, cs_b, packed_b.data());
+
+				for (size_t ic = 0; ic < M; ic += BS::MC) {
+					const size_t mc = std::min(BS::MC, M - ic);
+
+					// 添字で選ぶ次元はポインタではなく添字の配列をずらす
+					pack_a(mc, kc,
+						a + static_cast<ptrdiff_t>(a_rows != nullptr ? 0 : ic) * rs_a + static_cast<ptrdiff_t>(a_cols != nullptr ? 0 : pc) * cs_a,
+						rs_a, cs_a, packed_a.data(),
+						a_rows != nullptr ? a_rows + ic : nullptr,
+						a_cols != nullptr ? a_cols + pc : nullptr);
+
+					for (size_t jr = 0; jr < nc; jr += BS::NR) {
+						const size_t nr = std::min(BS::NR, nc - jr);
+						const Acc* b_panel = packed_b.data() + jr * kc;
+
+						for (size_t ir = 0; ir < mc; ir += BS::MR) {
+							const size_t mr = std::min(BS::MR, mc - ir);
+							const Acc* a_panel = packed_a.data() + ir * kc;
+							Acc* c_tile = c
+								+ static_cast<ptrdiff_t>(ic + ir) * rs_c
+								+ static_cast<ptrdiff_t>(jc + jr) * cs_c;
+
+							micro_kernel(kc, a_panel, b_panel, c_tile, rs_c, cs_c, mr, nr, alpha, block_beta);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief 16ビット浮動小数点数の行列積 C = alpha * A * B + beta * C を単一スレッドで計算します。
+	 * @note float の作業領域 (M x N) に累積し、すべてのKブロックを足し終えてからCに丸めて書き込みます。
+	 *       引数は gemm と同じです。
+	 */
+	template<typename T>
+	inline void gemm_widened(
+		size_t M, size_t N, size_t K,
+		const T* a, ptrdiff_t rs_a, ptrdiff_t cs_a,
+		const T* b, ptrdiff_t rs_b, ptrdiff_t cs_b,
+		T* c, ptrdiff_t rs_c, ptrdiff_t cs_c,
+		T alpha = T(1), T beta = T(0),
+		const size_t* a_rows = nullptr, const size_t* a_cols = nullptr)
+	{
+		using Acc = accumulate_t<T>;
+		const Acc beta_acc = static_cast<Acc>(beta);
+
+		thread_local std::vector<Acc> work;
+		work.resize(M * N);
+		if (beta_acc != Acc(0)) {
+			for (size_t i = 0; i < M; i++)
+				for (size_t j = 0; j < N; j++)
+					work[i * N + j] = beta_acc * static_cast<Acc>(c[static_cast<ptrdiff_t>(i) * rs_c + static_cast<ptrdiff_t>(j) * cs_c]);
+		}
+
+		gemm<T, Acc>(M, N, K, a, rs_a, cs_a, b, rs_b, cs_b, work.data(), static_cast<ptrdiff_t>(N), 1,
+			static_cast<Acc>(alpha), beta_acc != Acc(0) ? Acc(1) : Acc(0), a_rows, a_cols);
+
+		for (size_t i = 0; i < M; i++)
+			for (size_t j = 0; j < N; j++)
+				c[static_cast<ptrdiff_t>(i) * rs_c + static_cast<ptrdiff_t>(j) * cs_c] = static_cast<T>(work[i * N + j]);
+	}
+
+	/**
+	 * @brief 連続した2つのベクトルの内積を計算します。
+	 * @note 4本のベクタレジスタに分けて累積し、加算の依存関係を短くします。
+	 */
+	template<typename T>
+	inline T dot(size_t n, const T* __restrict a, const T* __restrict b)
+	{
+		size_t i = 0;
+		T sum{};
+#if defined(__GNUC__)
+		if constexpr (std::is_arithmetic_v<T>) {
+			using vec = typename VectorType<T>::type;
+			constexpr size_t L = VectorType<T>::lanes;
+
+			vec acc[4] = {};
+			for (; i + 4 * L <= n; i += 4 * L) {
+				vec va[4], vb[4];
+				std::memcpy(va, a + i, sizeof(va));
+				std::memcpy(vb, b + i, sizeof(vb));
+				for (size_t u = 0; u < 4; u++)
+					acc[u] += va[u] * vb[u];
+			}
+			for (; i + L <= n; i += L) {
+				vec va, vb;
+				std::memcpy(&va, a + i, sizeof(va));
+				std::memcpy(&vb, b + i, sizeof(vb));
+				acc[0] += va * vb;
+			}
+
+			const vec total = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+			for (size_t l = 0; l < L; l++)
+				sum += total[l];
+		}
+#endif
+		for (; i < n; i++)
+			sum += a[i] * b[i];
+		return sum;
+	}
+
+	/**
+	 * @brief 連続した Cols 本の列の線形結合 out += a[0] * x[0] + ... + a[Cols - 1] * x[Cols - 1] を計算します。
+	 * @param n 列の長さ
+	 * @param a 先頭の列。以降の列は cs 要素ずつ離れています。
+	 */
+	template<size_t Cols, typename T>
+	inline void axpy_columns(size_t n, const T* a, ptrdiff_t cs, const T* x, T* __restrict out)
+	{
+		size_t i = 0;
+#if defined(__GNUC__)
+		if constexpr (std::is_arithmetic_v<T>) {
+			using vec = typename VectorType<T>::type;
+			constexpr size_t L = VectorType<T>::lanes;
+
+			vec vx[Cols];
+			for (size_t c = 0; c < Cols; c++)
+				vx[c] = vec{} + x[c];
+			for (; i + L <= n; i += L) {
+				vec o;
+				std::memcpy(&o, out + i, sizeof(o));
+				for (size_t c = 0; c < Cols; c++) {
+					vec va;
+					std::memcpy(&va, a + static_cast<ptrdiff_t>(c) * cs + i, sizeof(va));
+					o += va * vx[c];
+				}
+				std::memcpy(out + i, &o, sizeof(o));
+			}
+		}
+#endif
+		for (; i < n; i++)
+			for (size_t c = 0; c < Cols; c++)
+				out[i] += a[static_cast<ptrdiff_t>(c) * cs + i] * x[c];
+	}
+
+	/**
+	 * @brief 行列とベクトルの積 y = alpha * A * x + beta * y を単一スレッドで計算します。(M == 1 または N == 1 の行列積)
+	 * @param M, K Aの行数・列数
+	 * @param a, rs_a, cs_a Aの先頭ポインタと行・列ストライド
+	 * @param x, inc_x xの先頭ポインタと要素の間隔
+	 * @param y, inc_y yの先頭ポインタと要素の間隔
+	 * @param alpha, beta スケーリング係数。betaが0の場合はyの元の値を読みません。
+	 * @note Aの行が連続している場合は行ごとの内積、列が連続している場合は列ごとの axpy で計算します。パックは行いません。
+	 */
+	template<typename T>
+	inline void gemv(
+		size_t M, size_t K,
+		const T* a, ptrdiff_t rs_a, ptrdiff_t cs_a,
+		const T* x, ptrdiff_t inc_x,
+		T* y, ptrdiff_t inc_y,
+		T alpha = T(1), T beta = T(0))
+	{
+		auto store = [&](size_t i, T value) {
+			T& yv = y[static_cast<ptrdiff_t>(i) * inc_y];
+			yv = beta == T(0) ? alpha * value : alpha * value + beta * yv;
+		};
+
+		// xが連続していない場合は詰め直す
+		thread_local std::vector<T> packed_x;
+		if (inc_x != 1) {
+			packed_x.resize(K);
+			for (size_t k = 0; k < K; k++)
+				packed_x[k] = x[static_cast<ptrdiff_t>(k) * inc_x];
+			x = packed_x.data();
+		}
+
+		if (cs_a == 1 || rs_a != 1) {
+			for (size_t i = 0; i < M; i++) {
+				const T* a_row = a + static_cast<ptrdiff_t>(i) * rs_a;
+				if (cs_a == 1) {
+					store(i, dot(K, a_row, x));
+				}
+				else {
+					T sum{};
+					for (size_t k = 0; k < K; k++)
+						sum += a_row[static_cast<ptrdiff_t>(k) * cs_a] * x[k];
+					store(i, sum);
+				}
+			}
+			return;
+		}
+
+		// 列が連続している場合は、列を4本ずつ作業領域に累積する
+		thread_local std::vector<T> acc;
+		acc.assign(M, T{});
+		size_t k = 0;
+		for (; k + 4 <= K; k += 4)
+			axpy_columns<4>(M, a + static_cast<ptrdiff_t>(k) * cs_a, cs_a, x + k, acc.data());
+		for (; k < K; k++)
+			axpy_columns<1>(M, a + static_cast<ptrdiff_t>(k) * cs_a, cs_a, x + k, acc.data());
+		const T* out = acc.data();
+		for (size_t i = 0; i < M; i++)
+			store(i, out[i]);
+	}
+
+	/**
+	 * @brief BlasGemm::MatMul と同じインターフェースのネイティブ行列積
+	 * @tparam T 要素型
+	 */
+	template<typename T>
+	struct MatMul {
+		/// これ以下の演算量(M*N*K)の場合はスレッドを分けずに計算する
+		static constexpr size_t parallel_threshold = 64 * 64 * 64;
+
+		/**
+		 * @brief C = alpha * op(A) * op(B) + beta * C を計算します。
+		 * @param A 左側の行列 (op(A) が M x K)
+		 * @param B 右側の行列 (op(B) が K x N)
+		 * @param C 出力先 (M x N)。メモリレイアウトはAと同じになります。
+		 * @param AMajor Aが行優先かどうか
+		 * @param BMajor Bが行優先かどうか
+		 * @param TransA op(A) = A^T とするかどうか
+		 * @param TransB op(B) = B^T とするかどうか
+		 * @param alpha, beta スケーリング係数。betaが0の場合はCの元の値を読みません。
+		 * @param lda_, ldb_, ldc_ 各行列の格納間隔(リーディングディメンジョン)。0の場合は詰めて格納されているものとみなします。
+		 * @param rows_a nullptr でない場合、A (転置前) の i 行目として A の rows_a[i] 行目を読みます。
+		 *               A の行数は rows_a の要素数になり、lda_ には元の行列の格納間隔を指定する必要があります。
+		 */
+		static void multiply(
+			const T* A, const T* B, T* C,
+			size_t M, size_t N, size_t K,
+			bool AMajor, bool BMajor,
+			bool TransA = false, bool TransB = false,
+			T alpha = T(1), T beta = T(0),
+			size_t lda_ = 0, size_t ldb_ = 0, size_t ldc_ = 0,
+			const size_t* rows_a = nullptr
+		) {
+			// 格納されている行列のストライドを求め、転置の場合は行と列のストライドを入れ替える
+			const ptrdiff_t lda = static_cast<ptrdiff_t>(lda_ != 0 ? lda_ : (AMajor ? (TransA ? M : K) : (TransA ? K : M)));
+			const ptrdiff_t ldb = static_cast<ptrdiff_t>(ldb_ != 0 ? ldb_ : (BMajor ? (TransB ? K : N) : (TransB ? N : K)));
+			const ptrdiff_t ldc = static_cast<ptrdiff_t>(ldc_ != 0 ? ldc_ : (AMajor ? N : M));
+			const ptrdiff_t rs_a = (AMajor != TransA) ? lda : 1;
+			const ptrdiff_t cs_a = (AMajor != TransA) ? 1 : lda;
+			const ptrdiff_t rs_b = (BMajor != TransB) ? ldb : 1;
+			const ptrdiff_t cs_b = (BMajor != TransB) ? 1 : ldb;
+			const ptrdiff_t rs_c = AMajor ? ldc : 1;
+			const ptrdiff_t cs_c = AMajor ? 1 : ldc;
+
+			using BS = BlockSize<accumulate_t<T>>;
+			const size_t mr_blocks = (M + BS::MR - 1) / BS::MR;
+
+			// A の行を添字で選ぶ場合、転置しなければ op(A) の行 (M方向)、転置すれば op(A) の列 (K方向) を選ぶことになる
+			const size_t* const m_rows = TransA ? nullptr : rows_a;
+			const size_t* const k_rows = TransA ? rows_a : nullptr;
+
+			// 行の範囲ごとの計算。16ビット浮動小数点数は float で累積する
+			auto run = [&](size_t rows, const T* a, T* c, const size_t* a_rows) {
+				if constexpr (is_float16_v<T>)
+					gemm_widened(rows, N, K, a, rs_a, cs_a, B, rs_b, cs_b, c, rs_c, cs_c, alpha, beta, a_rows, k_rows);
+				else
+					gemm(rows, N, K, a, rs_a, cs_a, B, rs_b, cs_b, c, rs_c, cs_c, alpha, beta, a_rows, k_rows);
+			};
+
+			// 1行または1列の積は行列ベクトル積として計算する (パックとブロック分割を省く)
+			if constexpr (std::is_arithmetic_v<T>) {
+				if ((M == 1 || N == 1) && rows_a == nullptr) {
+					gemv_dispatch(M, N, K, A, rs_a, cs_a, B, rs_b, cs_b, C, rs_c, cs_c, alpha, beta);
+					return;
+				}
+			}
+
+			if (M * N * K <= parallel_threshold) {
+				run(M, A, C, m_rows);
+				return;
+			}
+
+			// Cの行方向をMR単位で分割し、スレッドプールの各タスクが独立に計算する
+			ThreadPool& pool = ThreadPool::instance();
+			const size_t grain = std::max<size_t>(mr_blocks / (pool.num_threads() * 2), 1);
+
+			pool.parallel_for(0, mr_blocks, grain, [&](size_t block_begin, size_t block_end) {
+				const size_t row_begin = block_begin * BS::MR;
+				const size_t row_end = std::min(M, block_end * BS::MR);
+
+				run(row_end - row_begin,
+					A + static_cast<ptrdiff_t>(m_rows != nullptr ? 0 : row_begin) * rs_a,
+					C + static_cast<ptrdiff_t>(row_begin) * rs_c,
+					m_rows != nullptr ? m_rows + row_begin : nullptr);
+			});
+		}
+
+	private:
+		/**
+		 * @brief M == 1 の場合は C^T = op(B)^T * A^T、N == 1 の場合は C = op(A) * B として gemv で計算します。
+		 * @note 演算量が parallel_threshold を超える場合は出力の要素を分割してスレッドプールで計算します。
+		 */
+		static void gemv_dispatch(
+			size_t M, size_t N, size_t K,
+			const T* A, ptrdiff_t rs_a, ptrdiff_t cs_a,
+			const T* B, ptrdiff_t rs_b, ptrdiff_t cs_b,
+			T* C, ptrdiff_t rs_c, ptrdiff_t cs_c,
+			T alpha, T beta)
+		{
+			const bool row = M == 1 && N != 1;
+			const size_t rows = row ? N : M;
+			const T* mat = row ? B : A;
+			const ptrdiff_t rs_m = row ? cs_b : rs_a;
+			const ptrdiff_t cs_m = row ? rs_b : cs_a;
+			const T* x = row ? A : B;
+			const ptrdiff_t inc_x = row ? cs_a : rs_b;
+			const ptrdiff_t inc_y = row ? cs_c : rs_c;
+
+			if (rows * K <= parallel_threshold) {
+				gemv(rows, K, mat, rs_m, cs_m, x, inc_x, C, inc_y, alpha, beta);
+				return;
+			}
+
+			const size_t grain = std::max<size_t>(parallel_threshold / std::max<size_t>(K, 1), 1);
+			ThreadPool::instance().parallel_for(0, rows, grain, [&](size_t begin, size_t end) {
+				gemv(end - begin, K,
+					mat + static_cast<ptrdiff_t>(begin) * rs_m, rs_m, cs_m,
+					x, inc_x,
+					C + static_cast<ptrdiff_t>(begin) * inc_y, inc_y,
+					alpha, beta);
+			});
+		}
+	};
+
+	/**
+	 * @brief 同じ形状の独立した行列積 C_i = alpha * op(A_i) * op(B_i) + beta * C_i (i = 0, ..., batch - 1) をまとめて計算します。
+	 * @note 小さな積はバッチ方向にスレッドプールで分割し、各積は1つのスレッドで計算します。大きな積は MatMul と同様に行方向にも分割されます。
+	 */
+	template<typename T>
+	struct BatchedMatMul {
+		/**
+		 * @param A, B, C 先頭の行列の先頭要素。他の引数は MatMul::multiply と同じです。
+		 * @param stride_a, stride_b, stride_c 隣り合う行列の先頭要素の間隔(要素数)。A, B は0にするとすべての積で同じ行列を使用します。
+		 * @param batch 行列積の数
+		 */
+		static void multiply(
+			const T* A, size_t stride_a,
+			const T* B, size_t stride_b,
+			T* C, size_t stride_c,
+			size_t batch,
+			size_t M, size_t N, size_t K,
+			bool AMajor, bool BMajor,
+			bool TransA = false, bool TransB = false,
+			T alpha = T(1), T beta = T(0),
+			size_t lda = 0, size_t ldb = 0, size_t ldc = 0
+		) {
+			if (batch == 0 || M == 0 || N == 0)
+				return;
+
+			// 1つのタスクが parallel_threshold 程度の演算量になるようにまとめる
+			const size_t work = std::max<size_t>(M * N * K, 1);
+			const size_t grain = std::max<size_t>(MatMul<T>::parallel_threshold / work, 1);
+			ThreadPool::instance().parallel_for(0, batch, grain, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					MatMul<T>::multiply(
+						A + i * stride_a, B + i * stride_b, C + i * stride_c,
+						M, N, K, AMajor, BMajor, TransA, TransB, alpha, beta, lda, ldb, ldc);
+				}
+			});
+		}
+	};
+}
+
+#endif
\ No newline at end of file
@@ -2,6 +2,9 @@
 #define SANAE_NEURALNETWORK_MATRIX_OPS  
 
 #include "matrix.h"  
+#include "expr.hpp"
+#include "../threadpool/threadpool.h"
+#include <execution>
 #include <iosfwd>
 #include <ostream>
 #include <stdexcept>
@@ -10,9 +13,9 @@ template<typename T, bool RowMajor, typename Container> requires VectorOrArray<C
 inline T& Matrix<T, RowMajor, Container>::operator()(size_t row, size_t col)
 {  
 	if constexpr (!RowMajor)
-		return this->_data[col * this->_rows + row];
+		return this->_data[col * this->_ld + row];
 
-	return this->_data[row * this->_cols + col];
+	return this->_data[row * this->_ld + col];
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline T& Matrix<T, RowMajor, Container>::operator()(size_t index)
@@ -28,9 +31,9 @@ template<typename T, bool RowMajor, typename Container> requires VectorOrArray<C
 inline const T& Matrix<T, RowMajor, Container>::operator()(size_t row, size_t col) const
 {
 	if constexpr (!RowMajor)
-		return this->_data[col * this->_rows + row];
+		return this->_data[col * this->_ld + row];
 
-	return this->_data[row * this->_cols + col];
+	return this->_data[row * this->_ld + col];
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline const T& Matrix<T, RowMajor, Container>::operator()(size_t index) const
@@ -48,6 +51,19 @@ inline bool Matrix<T, RowMajor, Container>::operator==(const Matrix& other) cons
 	if (this->cols() != other.cols() || this->rows() != other.rows())
 		return false;
 
+	if constexpr (_padding != 0) {
+		// パディング領域は比較しない
+		const size_t rows = this->rows();
+		const size_t cols = this->cols();
+		for (size_t i = 0; i < rows; ++i) {
+			for (size_t j = 0; j < cols; ++j) {
+				if (this->operator()(i, j) != other(i, j))
+					return false;
+			}
+		}
+		return true;
+	}
+
 	const size_t total_elements = this->rows() * this->cols();
 	for (size_t i = 0; i < total_elements; ++i) {
 		if (this->_data[i] != other._data[i])
@@ -57,30 +73,69 @@ inline bool Matrix<T, RowMajor, Container>::operator==(const Matrix& other) cons
 	return true;
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::operator+(const Matrix& other) const
-{
-	if (this->cols() != other.cols() || this->rows() != other.rows())
-		throw std::invalid_argument("Matrix dimensions must agree for addition.");
-
-	return this->add_copy(other);
-}
-template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::operator+(const T& scalar) const
+template<typename Expr> requires MatrixExpression<Expr>
+inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::operator=(const Expr& expr)
 {
-	return this->apply_copy([scalar](T x) { return x + scalar; });
+	return this->assign(expr, std::execution::seq);
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::operator-(const Matrix& other) const
+template<typename Expr, typename execType>
+inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::assign(const Expr& expr, [[maybe_unused]] execType execPolicy)
+	requires MatrixExpression<Expr> && StdExecPolicy<execType>
 {
-	if (this->cols() != other.cols() || this->rows() != other.rows())
-		throw std::invalid_argument("Matrix dimensions must agree for subtraction.");
+	static_assert(std::is_same_v<typename Expr::value_type, T>, "Matrix element types must agree.");
+	static_assert(Expr::row_major == RowMajor, "Matrix layouts must agree.");
 
-	return this->sub_copy(other);
-}
-template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::operator-(const T& scalar) const
-{
-	return this->apply_copy([scalar](T x) { return x - scalar; });
+	const size_t rows = expr.rows();
+	const size_t cols = expr.cols();
+	const size_t size = rows * cols;
+	const size_t outer = RowMajor ? rows : cols;
+	const size_t inner = RowMajor ? cols : rows;
+	const size_t ld = _leading_dim(inner);
+
+	// 式が自身を参照している場合は次元が一致するため、再確保は起こらない
+	if constexpr (is_std_array<Container>::value) {
+		if (size > std::tuple_size_v<Container>)
+			throw std::invalid_argument("Matrix dimensions do not match std::array size");
+	}
+	else if (this->_data.size() != outer * ld) {
+		this->_data.resize(outer * ld);
+	}
+	this->_rows = rows;
+	this->_cols = cols;
+	this->_ld = ld;
+
+	// 要素ごとに独立しているため、同じ行列を読み書きしても結果は変わらない
+	T* out = this->_data.data();
+	if constexpr (_padding == 0 && Expr::contiguous) {
+		if constexpr (is_parallel_policy_v<execType>) {
+			ThreadPool::instance().parallel_for(0, size, ThreadPool::default_grain, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++)
+					out[i] = expr[i];
+			});
+		}
+		else {
+			for (size_t i = 0; i < size; i++)
+				out[i] = expr[i];
+		}
+	}
+	else {
+		// パディング付きの行列を含む場合は行(列)ごとに評価する
+		auto lines = [&](size_t begin, size_t end) {
+			for (size_t line = begin; line < end; line++) {
+				T* dst = out + line * ld;
+				for (size_t i = 0; i < inner; i++)
+					dst[i] = expr.at(line, i);
+			}
+		};
+
+		if constexpr (is_parallel_policy_v<execType>)
+			ThreadPool::instance().parallel_for(0, outer, std::max<size_t>(ThreadPool::default_grain / std::max<size_t>(ld, 1), 1), lines);
+		else
+			lines(0, outer);
+	}
+
+	return *this;
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::operator*(const Matrix& other) const
@@ -91,35 +146,6 @@ inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::operator*(
 	return this->matrix_mul_copy(other);
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::operator*(const T& scalar) const
-{
-	return this->apply_copy([scalar](T x) { return x * scalar; });
-}
-template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::operator^(const Matrix& other) const
-{
-	if (this->cols() != other.cols() || this->rows() != other.rows())
-		throw std::invalid_argument("Matrix dimensions must agree for Hadamard multiplication.");
-
-	return this->hadamard_mul_copy(other);
-}
-template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::operator/(const Matrix& other) const
-{
-	if (this->cols() != other.cols() || this->rows() != other.rows())
-		throw std::invalid_argument("Matrix dimensions must agree for Hadamard division.");
-
-	return this->hadamard_div_copy(other);
-}
-template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
-inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::operator/(const T& scalar) const
-{
-	if (scalar == T(0))
-		throw std::invalid_argument("Scalar value cannot be zero for division.");
-
-	return this->apply_copy([scalar](T x) { return x / scalar; });
-}
-template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline bool Matrix<T, RowMajor, Container>::operator!=(const Matrix& other) const
 {
 	return !(*this == other);
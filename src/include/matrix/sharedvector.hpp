@@ -0,0 +1,239 @@
+﻿#ifndef SANAE_NEURALNETWORK_MATRIX_SHAREDVECTOR
+#define SANAE_NEURALNETWORK_MATRIX_SHAREDVECTOR
+
+#include "allocator.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief コピーで格納領域を共有し、書き込むときに複製する (コピーオンライト) 可変長配列
+ * @tparam T 要素型
+ * @note SharedMatrix のコンテナです。コピーは参照カウントを増やすだけで O(1) です。
+ *       非constの data(), begin(), end(), operator[] などは、他と共有している場合に先に複製してから返します。
+ *       そのたびに参照カウントを atomic に読むため、ループの中では呼び出さず、先に取得したポインタを使ってください。
+ * @note 共有を解除する前に取得したポインタやビューから書き込むと、共有しているすべてのコピーに反映されます。
+ *       書き込み用のポインタやビューは、コピーを作る前ではなく作った後に取得してください。
+ * @note 格納領域は MatrixMemory::current() ではなく、常に std::pmr::get_default_resource() から確保します。
+ *       コピーは MatrixMemory::Scope を抜けた後も残り得るため、MatrixArena から確保すると reset() の後に解放済みの領域を参照するためです。
+ * @note 参照カウントの操作はスレッドセーフです。共有中の同じオブジェクトに複数のスレッドから同時に非constでアクセスする場合は、
+ *       先に1つのスレッドで data() などを呼び出して共有を解除してください。
+ */
+template<typename T>
+class SharedVector {
+public:
+	using value_type = T;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+	using reference = T&;
+	using const_reference = const T&;
+	using pointer = T*;
+	using const_pointer = const T*;
+	using iterator = T*;
+	using const_iterator = const T*;
+	using allocator_type = MatrixAllocator<T>;
+
+private:
+	/// 格納領域の先頭に置く管理情報。要素は _header_size バイト後から格納する
+	struct Header {
+		std::atomic<std::size_t> refs;
+		std::size_t size;
+		std::size_t capacity;
+		std::pmr::memory_resource* resource; ///< 確保したリソース (解放に使う)
+	};
+
+	/// 管理情報の領域と格納領域の先頭を揃える境界 (キャッシュライン)
+	static constexpr std::size_t _alignment = std::max<std::size_t>({ 64, alignof(Header), alignof(T) });
+	static constexpr std::size_t _header_size = (sizeof(Header) + _alignment - 1) / _alignment * _alignment;
+
+	Header* _block = nullptr;
+	std::pmr::memory_resource* _resource; ///< 新しい格納領域の確保先
+
+	static T* _elements(Header* block) noexcept {
+		return std::launder(reinterpret_cast<T*>(reinterpret_cast<std::byte*>(block) + _header_size));
+	}
+
+	/**
+	 * @brief 要素を構築していない格納領域を確保します。
+	 * @param capacity 要素数
+	 * @return 参照カウント1、要素数0の領域
+	 */
+	Header* _allocate(size_type capacity) const {
+		if (capacity > (std::numeric_limits<size_type>::max() - _header_size) / sizeof(T))
+			throw std::bad_array_new_length();
+
+		void* memory = _resource->allocate(_header_size + capacity * sizeof(T), _alignment);
+		return ::new (memory) Header{ {1}, 0, capacity, _resource };
+	}
+
+	/// 参照カウントを減らし、最後の参照だった場合は要素を破棄して領域を解放します。
+	static void _release(Header* block) noexcept {
+		if (block && block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			std::destroy_n(_elements(block), block->size);
+			std::pmr::memory_resource* resource = block->resource;
+			const std::size_t bytes = _header_size + block->capacity * sizeof(T);
+			block->~Header();
+			resource->deallocate(block, bytes, _alignment);
+		}
+	}
+
+	/**
+	 * @brief first から count 個の要素をコピーした新しい格納領域を作ります。
+	 * @param capacity 確保する要素数 (count 以上)
+	 */
+	Header* _clone(const T* first, size_type count, size_type capacity) const {
+		Header* block = _allocate(capacity);
+		try {
+			std::uninitialized_copy_n(first, count, _elements(block));
+		}
+		catch (...) {
+			_resource->deallocate(block, _header_size + capacity * sizeof(T), _alignment);
+			throw;
+		}
+		block->size = count;
+		return block;
+	}
+
+	/// 他と共有している場合は複製して、このオブジェクトだけが参照する状態にします。
+	void _detach() {
+		if (_block && _block->refs.load(std::memory_order_acquire) != 1) {
+			Header* block = _clone(_elements(_block), _block->size, _block->size);
+			_release(_block);
+			_block = block;
+		}
+	}
+
+	/**
+	 * @brief 要素数を count にします。このオブジェクトだけが参照していて容量が足りる場合はそのまま使います。
+	 * @param count 新しい要素数
+	 * @param keep 残す先頭の要素数
+	 * @param fill 追加した要素の構築関数 (書き込み先のポインタと要素数を受け取る)
+	 */
+	template<typename Fill>
+	void _reshape(size_type count, size_type keep, Fill fill) {
+		if (_block && _block->refs.load(std::memory_order_acquire) == 1 && count <= _block->capacity) {
+			T* data = _elements(_block);
+			const size_type kept = std::min({ keep, _block->size, count });
+			std::destroy(data + kept, data + _block->size);
+			_block->size = kept;
+			fill(data + kept, count - kept);
+			_block->size = count;
+			return;
+		}
+
+		const size_type kept = _block ? std::min({ keep, _block->size, count }) : 0;
+		Header* block = count == 0 ? nullptr : _clone(_block ? _elements(_block) : nullptr, kept, count);
+		if (block) {
+			try {
+				fill(_elements(block) + kept, count - kept);
+			}
+			catch (...) {
+				block->size = kept;
+				_release(block);
+				throw;
+			}
+			block->size = count;
+		}
+		_release(_block);
+		_block = block;
+	}
+
+public:
+	SharedVector() noexcept : _resource(std::pmr::get_default_resource()) {}
+	explicit SharedVector(size_type count) : SharedVector() { resize(count); }
+	SharedVector(size_type count, const T& value) : SharedVector() { assign(count, value); }
+	template<std::input_iterator InputIt>
+	SharedVector(InputIt first, InputIt last) : SharedVector() {
+		if constexpr (std::forward_iterator<InputIt>) {
+			const size_type count = static_cast<size_type>(std::distance(first, last));
+			_reshape(count, 0, [&](T* out, size_type) { std::uninitialized_copy(first, last, out); });
+		}
+		else {
+			const std::vector<T> buffer(first, last);
+			_reshape(buffer.size(), 0, [&](T* out, size_type) { std::uninitialized_copy(buffer.begin(), buffer.end(), out); });
+		}
+	}
+	SharedVector(std::initializer_list<T> init) : SharedVector(init.begin(), init.end()) {}
+
+	/// 格納領域を共有します。
+	SharedVector(const SharedVector& other) noexcept : _block(other._block), _resource(std::pmr::get_default_resource()) {
+		if (_block)
+			_block->refs.fetch_add(1, std::memory_order_relaxed);
+	}
+	SharedVector(SharedVector&& other) noexcept : _block(std::exchange(other._block, nullptr)), _resource(other._resource) {}
+	~SharedVector() { _release(_block); }
+
+	/// 格納領域を共有します。
+	SharedVector& operator=(const SharedVector& other) noexcept {
+		if (other._block)
+			other._block->refs.fetch_add(1, std::memory_order_relaxed);
+		_release(_block);
+		_block = other._block;
+		return *this;
+	}
+	SharedVector& operator=(SharedVector&& other) noexcept {
+		if (this != &other) {
+			_release(_block);
+			_block = std::exchange(other._block, nullptr);
+		}
+		return *this;
+	}
+
+	size_type size() const noexcept { return _block ? _block->size : 0; }
+	size_type capacity() const noexcept { return _block ? _block->capacity : 0; }
+	bool empty() const noexcept { return size() == 0; }
+	/// 格納領域を参照しているオブジェクトの数 (空の場合は0)
+	size_type use_count() const noexcept { return _block ? _block->refs.load(std::memory_order_acquire) : 0; }
+	allocator_type get_allocator() const noexcept { return allocator_type(_resource); }
+
+	const T* data() const noexcept { return _block ? _elements(_block) : nullptr; }
+	T* data() {
+		_detach();
+		return _block ? _elements(_block) : nullptr;
+	}
+
+	const_iterator begin() const noexcept { return data(); }
+	const_iterator end() const noexcept { return data() + size(); }
+	const_iterator cbegin() const noexcept { return begin(); }
+	const_iterator cend() const noexcept { return end(); }
+	iterator begin() { return data(); }
+	iterator end() { return data() + size(); }
+
+	const T& operator[](size_type index) const noexcept { return _elements(_block)[index]; }
+	T& operator[](size_type index) {
+		_detach();
+		return _elements(_block)[index];
+	}
+
+	/**
+	 * @brief 要素数を変更します。追加した要素は値初期化します。
+	 * @note このオブジェクトだけが参照していて容量が足りる場合は、格納領域を確保し直しません。
+	 */
+	void resize(size_type count) {
+		if (count != size())
+			_reshape(count, count, [](T* out, size_type n) { std::uninitialized_value_construct_n(out, n); });
+	}
+	/// すべての要素を value にします。
+	void assign(size_type count, const T& value) {
+		_reshape(count, 0, [&](T* out, size_type n) { std::uninitialized_fill_n(out, n, value); });
+	}
+	void clear() noexcept {
+		_release(_block);
+		_block = nullptr;
+	}
+	void swap(SharedVector& other) noexcept {
+		std::swap(_block, other._block);
+		std::swap(_resource, other._resource);
+	}
+	friend void swap(SharedVector& a, SharedVector& b) noexcept { a.swap(b); }
+};
+
+#endif // SANAE_NEURALNETWORK_MATRIX_SHAREDVECTOR
\ No newline at end of file
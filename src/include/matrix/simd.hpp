@@ -0,0 +1,1158 @@
+﻿#ifndef SANAE_NEURALNETWORK_MATRIX_SIMD
+#define SANAE_NEURALNETWORK_MATRIX_SIMD
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <type_traits>
+#include "float16.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+	#define SANAE_SIMD_X86
+	#include <immintrin.h>
+	#if defined(_MSC_VER) && !defined(__clang__)
+		#include <intrin.h>
+	#endif
+#endif
+
+/**
+ * @brief 要素ごとの演算のSIMDカーネル
+ *
+ * 加減乗除・スカラー演算・axpy・fma・よく使う単項演算・総和や最大値などの集計・転置を AVX2 / AVX-512 で実装し、
+ * 実行時にCPUの対応命令を調べて使用する命令セットを選択します。x86以外や未対応のCPUではスカラー実装を使用します。
+ * 16ビット浮動小数点数 (bfloat16, float16) は float との変換カーネルで float に広げて計算し、結果を丸めて書き戻します。
+ * コンパイルオプションで -mavx2 などを指定する必要はありません。
+ *
+ * 使用する命令セットは次の優先順位で決まります。
+ *   1. set_isa() で指定された値
+ *   2. 環境変数 SANAE_SIMD (scalar, avx2, avx512)
+ *   3. CPUが対応している最も広い命令セット
+ * ただしCPUが対応していない命令セットは指定しても使用しません。
+ *
+ * 単項演算の Exp, Log, Tanh, Sigmoid, Softplus は多項式近似で計算し、精度の異なる2つのモードがあります。
+ *   - MathMode::Exact (既定) : float, double とも最大誤差は数ULP
+ *   - MathMode::Fast          : 多項式の次数を下げたもの。相対誤差は float で 3e-6、double で 4e-11 程度
+ * モードは set_math_mode() または環境変数 SANAE_MATH (exact, fast) で選択します。どちらのモードも無限大・NaN・
+ * 非正規化数の入出力は標準ライブラリと同じ値を返します。スカラー実装 (x86以外、Isa::Scalar) は常に標準ライブラリを使用します。
+ *
+ * 最大誤差 (ULP)。全域と [-1, 1] などを密に標本化し、long double の標準ライブラリの結果と比較した値です。AVX2, AVX-512 で同じです。
+ *                 float Exact  float Fast  double Exact  double Fast
+ *   Exp              0.9          40          0.9         6.1e4
+ *   Log              2.0          45          2.0         3.2e5
+ *   Tanh             1.4          15          1.4         2.2e4
+ *   Sigmoid          2.4          40          2.7         6.1e4
+ *   Softplus         3.3          47          3.3         3.2e5
+ *
+ * @note fma, axpy は積和を1回の丸めで計算するため、スカラー実装とは最下位ビットが異なる場合があります。
+ */
+namespace SimdKernel {
+	/// 命令セット
+	enum class Isa { Scalar = 0, AVX2 = 1, AVX512 = 2 };
+	/// 二項演算の種類
+	enum class Op { Add, Sub, Mul, Div, Max };
+	/// 単項演算の種類
+	enum class Unary { Relu, Step, Square, Sqrt, Abs, Neg, Exp, Log, Tanh, Sigmoid, Softplus };
+	/// 超越関数 (Exp, Log, Tanh, Sigmoid, Softplus) の精度
+	enum class MathMode { Exact = 0, Fast = 1 };
+
+	namespace detail {
+		/**
+		 * @brief CPUとOSが対応している最も広い命令セットを調べます。
+		 */
+		inline Isa detect_isa() noexcept {
+#if defined(SANAE_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+			// OSがレジスタの保存に対応しているかどうかも含めて判定される
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f"))
+				return Isa::AVX512;
+			if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+				return Isa::AVX2;
+#elif defined(SANAE_SIMD_X86) && defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			const int max_leaf = info[0];
+
+			__cpuid(info, 1);
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool fma = (info[2] & (1 << 12)) != 0;
+			const bool f16c = (info[2] & (1 << 29)) != 0;
+			if (!osxsave || max_leaf < 7)
+				return Isa::Scalar;
+
+			// XCR0 で YMM / ZMM レジスタの保存がOSに有効化されているか確認する
+			const unsigned long long xcr0 = _xgetbv(0);
+			const bool ymm = (xcr0 & 0x6) == 0x6;
+			const bool zmm = (xcr0 & 0xe6) == 0xe6;
+
+			__cpuidex(info, 7, 0);
+			const bool avx2 = (info[1] & (1 << 5)) != 0;
+			const bool avx512f = (info[1] & (1 << 16)) != 0;
+
+			if (avx512f && zmm)
+				return Isa::AVX512;
+			if (avx2 && fma && f16c && ymm)
+				return Isa::AVX2;
+#endif
+			return Isa::Scalar;
+		}
+
+		/**
+		 * @brief 環境変数 SANAE_SIMD を考慮した初期の命令セットを求めます。
+		 */
+		inline Isa initial_isa(Isa detected) noexcept {
+			const char* env = std::getenv("SANAE_SIMD");
+			if (env == nullptr)
+				return detected;
+
+			Isa requested = detected;
+			if (std::strcmp(env, "scalar") == 0)
+				requested = Isa::Scalar;
+			else if (std::strcmp(env, "avx2") == 0)
+				requested = Isa::AVX2;
+			else if (std::strcmp(env, "avx512") == 0)
+				requested = Isa::AVX512;
+
+			return requested < detected ? requested : detected;
+		}
+
+		inline std::atomic<Isa>& isa_state() noexcept {
+			static std::atomic<Isa> state(initial_isa(detect_isa()));
+			return state;
+		}
+
+		/**
+		 * @brief 環境変数 SANAE_MATH を考慮した初期の超越関数の精度を求めます。
+		 */
+		inline MathMode initial_math_mode() noexcept {
+			const char* env = std::getenv("SANAE_MATH");
+			return env != nullptr && std::strcmp(env, "fast") == 0 ? MathMode::Fast : MathMode::Exact;
+		}
+
+		inline std::atomic<MathMode>& math_mode_state() noexcept {
+			static std::atomic<MathMode> state(initial_math_mode());
+			return state;
+		}
+
+		/// 多項式近似で計算する単項演算かどうか
+		template<Unary op>
+		inline constexpr bool is_math_v = op == Unary::Exp || op == Unary::Log || op == Unary::Tanh || op == Unary::Sigmoid || op == Unary::Softplus;
+
+		/**
+		 * @brief 超越関数の多項式近似の定数
+		 *
+		 * exp(r) は |r| <= ln2 / 2 で次数 exp_degree のテイラー多項式、log(m) は sqrt(1/2) <= m < sqrt(2) で
+		 * s = (m - 1) / (m + 1) として 2 atanh(s) = 2s (1 + s^2/3 + s^4/5 + ...) の log_terms 項で近似します。
+		 * 打ち切り誤差は Exact では丸め誤差より十分小さく、Fast では exp の相対誤差が float で約 3e-6、double で約 6e-12 です。
+		 */
+		template<typename T, bool fast>
+		struct MathParams {
+			static constexpr bool is_double = std::is_same_v<T, double>;
+			static constexpr size_t exp_degree = is_double ? (fast ? 9 : 13) : (fast ? 5 : 7);
+			static constexpr size_t log_terms = is_double ? (fast ? 6 : 11) : (fast ? 3 : 5);
+
+			// ln2 = ln2_hi + ln2_lo (ln2_hi は下位ビットが0のため、整数倍が丸めなしで求まる)
+			static constexpr T ln2_hi = is_double ? T(6.93147180369123816490e-01) : T(0.693359375);
+			static constexpr T ln2_lo = is_double ? T(1.90821492927058770002e-10) : T(-2.12194440e-4);
+			static constexpr T log2e = T(1.44269504088896340736);
+			// exp の入力の範囲。これより外側は無限大または0になる
+			static constexpr T exp_lo = is_double ? T(-746) : T(-104);
+			static constexpr T exp_hi = is_double ? T(710) : T(89);
+			// 非正規化数を正規化数にするための倍率 2^tiny_bits
+			static constexpr T tiny_bits = is_double ? T(54) : T(24);
+			static constexpr T tiny_scale = is_double ? T(0x1p54) : T(0x1p24);
+
+			/// exp のテイラー多項式の係数 1 / k! (k = 0, ..., exp_degree)
+			static constexpr std::array<T, exp_degree + 1> exp_coefs = [] {
+				std::array<T, exp_degree + 1> c{};
+				double factorial = 1;
+				for (size_t k = 0; k <= exp_degree; k++) {
+					c[k] = static_cast<T>(1 / factorial);
+					factorial *= static_cast<double>(k + 1);
+				}
+				return c;
+			}();
+			/// atanh の級数の2項目以降の係数 1 / (2k + 1) (k = 1, ..., log_terms - 1)
+			static constexpr std::array<T, log_terms - 1> log_coefs = [] {
+				std::array<T, log_terms - 1> c{};
+				for (size_t k = 1; k < log_terms; k++)
+					c[k - 1] = static_cast<T>(1.0 / static_cast<double>(2 * k + 1));
+				return c;
+			}();
+		};
+
+		template<Op op, typename T>
+		inline T apply(T a, T b) {
+			if constexpr (op == Op::Add) return a + b;
+			else if constexpr (op == Op::Sub) return a - b;
+			else if constexpr (op == Op::Mul) return a * b;
+			else if constexpr (op == Op::Div) return a / b;
+			else return a < b ? b : a;
+		}
+
+		template<Unary op, typename T>
+		inline T apply(T x) {
+			if constexpr (op == Unary::Relu) return x > T(0) ? x : T(0);
+			else if constexpr (op == Unary::Step) return x > T(0) ? T(1) : T(0);
+			else if constexpr (op == Unary::Square) return x * x;
+			else if constexpr (op == Unary::Sqrt) return std::sqrt(x);
+			else if constexpr (op == Unary::Abs) return std::abs(x);
+			else if constexpr (op == Unary::Neg) return -x;
+			else {
+				// 16ビット浮動小数点数は float で計算する
+				using A = accumulate_t<T>;
+				const A a = static_cast<A>(x);
+				if constexpr (op == Unary::Exp) return static_cast<T>(std::exp(a));
+				else if constexpr (op == Unary::Log) return static_cast<T>(std::log(a));
+				else if constexpr (op == Unary::Tanh) return static_cast<T>(std::tanh(a));
+				else if constexpr (op == Unary::Sigmoid) return static_cast<T>(A(1) / (A(1) + std::exp(-a)));
+				else return static_cast<T>((a > A(0) ? a : A(0)) + std::log1p(std::exp(-std::abs(a))));
+			}
+		}
+
+		/**
+		 * @brief ni x nj のブロックを要素ごとに転置します。dst[j * ldd + i] = src[i * lds + j]
+		 */
+		template<typename T>
+		inline void transpose_scalar(const T* src, size_t lds, T* dst, size_t ldd, size_t ni, size_t nj) {
+			for (size_t i = 0; i < ni; i++)
+				for (size_t j = 0; j < nj; j++)
+					dst[j * ldd + i] = src[i * lds + j];
+		}
+	}
+
+	/**
+	 * @brief CPUが対応している最も広い命令セットを返します。
+	 */
+	inline Isa detected_isa() noexcept {
+		static const Isa isa = detail::detect_isa();
+		return isa;
+	}
+
+	/**
+	 * @brief 現在使用している命令セットを返します。
+	 */
+	inline Isa active_isa() noexcept {
+		return detail::isa_state().load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief 使用する命令セットを変更します。CPUが対応していない場合は対応している最も広い命令セットになります。
+	 * @param isa 使用する命令セット
+	 */
+	inline void set_isa(Isa isa) noexcept {
+		const Isa detected = detected_isa();
+		detail::isa_state().store(isa < detected ? isa : detected, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief 命令セットの名前を返します。
+	 */
+	inline const char* isa_name(Isa isa) noexcept {
+		switch (isa) {
+		case Isa::AVX512: return "AVX-512";
+		case Isa::AVX2: return "AVX2";
+		default: return "Scalar";
+		}
+	}
+
+	/**
+	 * @brief 現在の超越関数の精度を返します。
+	 */
+	inline MathMode active_math_mode() noexcept {
+		return detail::math_mode_state().load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief 超越関数 (Exp, Log, Tanh, Sigmoid, Softplus) の精度を変更します。
+	 */
+	inline void set_math_mode(MathMode mode) noexcept {
+		detail::math_mode_state().store(mode, std::memory_order_relaxed);
+	}
+
+#if defined(SANAE_SIMD_X86)
+	// ---- AVX2 ----
+#if defined(__clang__)
+	#pragma clang attribute push(__attribute__((target("avx2,fma,f16c"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("avx2,fma,f16c")
+#endif
+	namespace Avx2 {
+		template<typename T> struct Vec;
+
+		template<>
+		struct Vec<float> {
+			using value_type = float;
+			using reg = __m256;
+			static constexpr size_t width = 8;
+
+			static __m256i mask(size_t n) { return _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(n)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)); }
+			static reg load(const float* p) { return _mm256_loadu_ps(p); }
+			static void store(float* p, reg r) { _mm256_storeu_ps(p, r); }
+			static reg load_partial(const float* p, size_t n) { return _mm256_maskload_ps(p, mask(n)); }
+			static void store_partial(float* p, reg r, size_t n) { _mm256_maskstore_ps(p, mask(n), r); }
+			static reg set1(float x) { return _mm256_set1_ps(x); }
+			static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+			static float hsum(reg r) {
+				__m128 x = _mm_add_ps(_mm256_castps256_ps128(r), _mm256_extractf128_ps(r, 1));
+				x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+				return _mm_cvtss_f32(_mm_add_ss(x, _mm_movehdup_ps(x)));
+			}
+			static float hmax(reg r) {
+				__m128 x = _mm_max_ps(_mm256_castps256_ps128(r), _mm256_extractf128_ps(r, 1));
+				x = _mm_max_ps(x, _mm_movehl_ps(x, x));
+				return _mm_cvtss_f32(_mm_max_ss(x, _mm_movehdup_ps(x)));
+			}
+
+			template<Op op>
+			static reg binary(reg a, reg b) {
+				if constexpr (op == Op::Add) return _mm256_add_ps(a, b);
+				else if constexpr (op == Op::Sub) return _mm256_sub_ps(a, b);
+				else if constexpr (op == Op::Mul) return _mm256_mul_ps(a, b);
+				else if constexpr (op == Op::Div) return _mm256_div_ps(a, b);
+				else return _mm256_max_ps(a, b);
+			}
+			template<Unary op>
+			static reg unary(reg x) {
+				const reg zero = _mm256_setzero_ps();
+				if constexpr (op == Unary::Relu) return _mm256_max_ps(x, zero); // NaNの場合は0になる
+				else if constexpr (op == Unary::Step) return _mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GT_OQ), _mm256_set1_ps(1.0f));
+				else if constexpr (op == Unary::Square) return _mm256_mul_ps(x, x);
+				else if constexpr (op == Unary::Sqrt) return _mm256_sqrt_ps(x);
+				else if constexpr (op == Unary::Abs) return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x);
+				else return _mm256_xor_ps(x, _mm256_set1_ps(-0.0f));
+			}
+
+			// 超越関数 (simdmath.hpp) で使う操作
+			using mask_t = reg;
+			static reg min(reg a, reg b) { return _mm256_min_ps(a, b); }
+			template<int Pred>
+			static mask_t cmp(reg a, reg b) { return _mm256_cmp_ps(a, b, Pred); }
+			static reg select(mask_t m, reg a, reg b) { return _mm256_blendv_ps(b, a, m); }
+			static reg round(reg x) { return _mm256_round_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+			static reg copysign(reg mag, reg sign) {
+				const reg s = _mm256_set1_ps(-0.0f);
+				return _mm256_or_ps(_mm256_andnot_ps(s, mag), _mm256_and_ps(s, sign));
+			}
+			/// 2^n (n は [-126, 127] の整数値)
+			static reg pow2(reg n) { return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23)); }
+			/// x * 2^n (n は [-252, 254] の整数値)。2回に分けて掛けるため、結果が非正規化数や無限大になる場合も正しく丸めます。
+			static reg ldexp(reg x, reg n) {
+				const reg h = _mm256_round_ps(_mm256_mul_ps(n, _mm256_set1_ps(0.5f)), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+				return _mm256_mul_ps(_mm256_mul_ps(x, pow2(h)), pow2(_mm256_sub_ps(n, h)));
+			}
+			/// x = m * 2^e (0.5 <= m < 1) に分解します。(x は正の正規化数)
+			static reg frexp(reg x, reg& e) {
+				const __m256i bits = _mm256_castps_si256(x);
+				e = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(bits, 23)), _mm256_set1_ps(126.0f));
+				return _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F000000)));
+			}
+		};
+
+		template<>
+		struct Vec<double> {
+			using value_type = double;
+			using reg = __m256d;
+			static constexpr size_t width = 4;
+
+			static __m256i mask(size_t n) { return _mm256_cmpgt_epi64(_mm256_set1_epi64x(static_cast<long long>(n)), _mm256_setr_epi64x(0, 1, 2, 3)); }
+			static reg load(const double* p) { return _mm256_loadu_pd(p); }
+			static void store(double* p, reg r) { _mm256_storeu_pd(p, r); }
+			static reg load_partial(const double* p, size_t n) { return _mm256_maskload_pd(p, mask(n)); }
+			static void store_partial(double* p, reg r, size_t n) { _mm256_maskstore_pd(p, mask(n), r); }
+			static reg set1(double x) { return _mm256_set1_pd(x); }
+			static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+			static double hsum(reg r) {
+				const __m128d x = _mm_add_pd(_mm256_castpd256_pd128(r), _mm256_extractf128_pd(r, 1));
+				return _mm_cvtsd_f64(_mm_add_sd(x, _mm_unpackhi_pd(x, x)));
+			}
+			static double hmax(reg r) {
+				const __m128d x = _mm_max_pd(_mm256_castpd256_pd128(r), _mm256_extractf128_pd(r, 1));
+				return _mm_cvtsd_f64(_mm_max_sd(x, _mm_unpackhi_pd(x, x)));
+			}
+
+			template<Op op>
+			static reg binary(reg a, reg b) {
+				if constexpr (op == Op::Add) return _mm256_add_pd(a, b);
+				else if constexpr (op == Op::Sub) return _mm256_sub_pd(a, b);
+				else if constexpr (op == Op::Mul) return _mm256_mul_pd(a, b);
+				else if constexpr (op == Op::Div) return _mm256_div_pd(a, b);
+				else return _mm256_max_pd(a, b);
+			}
+			template<Unary op>
+			static reg unary(reg x) {
+				const reg zero = _mm256_setzero_pd();
+				if constexpr (op == Unary::Relu) return _mm256_max_pd(x, zero);
+				else if constexpr (op == Unary::Step) return _mm256_and_pd(_mm256_cmp_pd(x, zero, _CMP_GT_OQ), _mm256_set1_pd(1.0));
+				else if constexpr (op == Unary::Square) return _mm256_mul_pd(x, x);
+				else if constexpr (op == Unary::Sqrt) return _mm256_sqrt_pd(x);
+				else if constexpr (op == Unary::Abs) return _mm256_andnot_pd(_mm256_set1_pd(-0.0), x);
+				else return _mm256_xor_pd(x, _mm256_set1_pd(-0.0));
+			}
+
+			// 超越関数 (simdmath.hpp) で使う操作
+			using mask_t = reg;
+			static reg min(reg a, reg b) { return _mm256_min_pd(a, b); }
+			template<int Pred>
+			static mask_t cmp(reg a, reg b) { return _mm256_cmp_pd(a, b, Pred); }
+			static reg select(mask_t m, reg a, reg b) { return _mm256_blendv_pd(b, a, m); }
+			static reg round(reg x) { return _mm256_round_pd(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+			static reg copysign(reg mag, reg sign) {
+				const reg s = _mm256_set1_pd(-0.0);
+				return _mm256_or_pd(_mm256_andnot_pd(s, mag), _mm256_and_pd(s, sign));
+			}
+			/// 2^n (n は [-1022, 1023] の整数値)。2^52 を足して仮数部の下位ビットに n + 1023 を置き、指数部へシフトする
+			static reg pow2(reg n) { return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(_mm256_add_pd(n, _mm256_set1_pd(0x1p52 + 1023.0))), 52)); }
+			/// x * 2^n (n は [-2044, 2046] の整数値)。2回に分けて掛けるため、結果が非正規化数や無限大になる場合も正しく丸めます。
+			static reg ldexp(reg x, reg n) {
+				const reg h = _mm256_round_pd(_mm256_mul_pd(n, _mm256_set1_pd(0.5)), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+				return _mm256_mul_pd(_mm256_mul_pd(x, pow2(h)), pow2(_mm256_sub_pd(n, h)));
+			}
+			/// x = m * 2^e (0.5 <= m < 1) に分解します。(x は正の正規化数)
+			static reg frexp(reg x, reg& e) {
+				const __m256i bits = _mm256_castpd_si256(x);
+				// 指数部の整数を 2^52 の仮数部に置いて double に変換する
+				const __m256i biased = _mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_castpd_si256(_mm256_set1_pd(0x1p52)));
+				e = _mm256_sub_pd(_mm256_castsi256_pd(biased), _mm256_set1_pd(0x1p52 + 1022.0));
+				return _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFll)), _mm256_set1_epi64x(0x3FE0000000000000ll)));
+			}
+		};
+
+		/**
+		 * @brief 8x8 のタイルをレジスタ上で転置します。dst[j * ldd + i] = src[i * lds + j]
+		 */
+		inline void transpose_tile(const float* src, size_t lds, float* dst, size_t ldd) {
+			const __m256 r0 = _mm256_loadu_ps(src + 0 * lds), r1 = _mm256_loadu_ps(src + 1 * lds);
+			const __m256 r2 = _mm256_loadu_ps(src + 2 * lds), r3 = _mm256_loadu_ps(src + 3 * lds);
+			const __m256 r4 = _mm256_loadu_ps(src + 4 * lds), r5 = _mm256_loadu_ps(src + 5 * lds);
+			const __m256 r6 = _mm256_loadu_ps(src + 6 * lds), r7 = _mm256_loadu_ps(src + 7 * lds);
+
+			// 2行ずつ交互に並べる
+			const __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+			const __m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+			const __m256 t4 = _mm256_unpacklo_ps(r4, r5), t5 = _mm256_unpackhi_ps(r4, r5);
+			const __m256 t6 = _mm256_unpacklo_ps(r6, r7), t7 = _mm256_unpackhi_ps(r6, r7);
+
+			// 128ビットレーンごとに4行分の列を揃える
+			const __m256 u0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)), u1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+			const __m256 u2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)), u3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+			const __m256 u4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0)), u5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+			const __m256 u6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0)), u7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+			// 上位・下位のレーンを入れ替えて8行分を揃える
+			_mm256_storeu_ps(dst + 0 * ldd, _mm256_permute2f128_ps(u0, u4, 0x20));
+			_mm256_storeu_ps(dst + 1 * ldd, _mm256_permute2f128_ps(u1, u5, 0x20));
+			_mm256_storeu_ps(dst + 2 * ldd, _mm256_permute2f128_ps(u2, u6, 0x20));
+			_mm256_storeu_ps(dst + 3 * ldd, _mm256_permute2f128_ps(u3, u7, 0x20));
+			_mm256_storeu_ps(dst + 4 * ldd, _mm256_permute2f128_ps(u0, u4, 0x31));
+			_mm256_storeu_ps(dst + 5 * ldd, _mm256_permute2f128_ps(u1, u5, 0x31));
+			_mm256_storeu_ps(dst + 6 * ldd, _mm256_permute2f128_ps(u2, u6, 0x31));
+			_mm256_storeu_ps(dst + 7 * ldd, _mm256_permute2f128_ps(u3, u7, 0x31));
+		}
+
+		/**
+		 * @brief 4x4 のタイルをレジスタ上で転置します。dst[j * ldd + i] = src[i * lds + j]
+		 */
+		inline void transpose_tile(const double* src, size_t lds, double* dst, size_t ldd) {
+			const __m256d r0 = _mm256_loadu_pd(src + 0 * lds), r1 = _mm256_loadu_pd(src + 1 * lds);
+			const __m256d r2 = _mm256_loadu_pd(src + 2 * lds), r3 = _mm256_loadu_pd(src + 3 * lds);
+
+			const __m256d t0 = _mm256_unpacklo_pd(r0, r1), t1 = _mm256_unpackhi_pd(r0, r1);
+			const __m256d t2 = _mm256_unpacklo_pd(r2, r3), t3 = _mm256_unpackhi_pd(r2, r3);
+
+			_mm256_storeu_pd(dst + 0 * ldd, _mm256_permute2f128_pd(t0, t2, 0x20));
+			_mm256_storeu_pd(dst + 1 * ldd, _mm256_permute2f128_pd(t1, t3, 0x20));
+			_mm256_storeu_pd(dst + 2 * ldd, _mm256_permute2f128_pd(t0, t2, 0x31));
+			_mm256_storeu_pd(dst + 3 * ldd, _mm256_permute2f128_pd(t1, t3, 0x31));
+		}
+
+		/**
+		 * @brief 16ビット浮動小数点数を float に変換します。
+		 */
+		inline void widen(const bfloat16* in, float* out, size_t n) {
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8) {
+				const __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+				_mm256_storeu_ps(out + i, _mm256_castsi256_ps(_mm256_slli_epi32(x, 16)));
+			}
+			for (; i < n; i++)
+				out[i] = in[i];
+		}
+		inline void widen(const float16* in, float* out, size_t n) {
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+				_mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))));
+			for (; i < n; i++)
+				out[i] = in[i];
+		}
+
+		/**
+		 * @brief float を最近接偶数丸めで16ビット浮動小数点数に変換します。
+		 */
+		inline void narrow(const float* in, bfloat16* out, size_t n) {
+			const __m256i bias = _mm256_set1_epi32(0x7FFF), one = _mm256_set1_epi32(1), quiet = _mm256_set1_epi32(0x00400000);
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8) {
+				const __m256 v = _mm256_loadu_ps(in + i);
+				const __m256i x = _mm256_castps_si256(v);
+				const __m256i rounded = _mm256_add_epi32(x, _mm256_add_epi32(bias, _mm256_and_si256(_mm256_srli_epi32(x, 16), one)));
+				const __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+				const __m256i hi = _mm256_srli_epi32(_mm256_blendv_epi8(rounded, _mm256_or_si256(x, quiet), nan), 16);
+				// 16ビットへの詰め込みは128ビットレーンごとに行われるため、64ビット単位で並べ替えて下位128ビットに集める
+				const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(hi, hi), 0x08);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm256_castsi256_si128(packed));
+			}
+			for (; i < n; i++)
+				out[i] = in[i];
+		}
+		inline void narrow(const float* in, float16* out, size_t n) {
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+			for (; i < n; i++)
+				out[i] = in[i];
+		}
+
+		#include "simdmath.hpp"
+		#include "simdloops.hpp"
+	}
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC pop_options
+#endif
+
+	// ---- AVX-512 ----
+#if defined(__clang__)
+	#pragma clang attribute push(__attribute__((target("avx512f,avx2,fma,f16c"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("avx512f,avx2,fma,f16c")
+#endif
+	namespace Avx512 {
+		template<typename T> struct Vec;
+
+		template<>
+		struct Vec<float> {
+			using value_type = float;
+			using reg = __m512;
+			static constexpr size_t width = 16;
+
+			static __mmask16 mask(size_t n) { return static_cast<__mmask16>((1u << n) - 1); }
+			static reg load(const float* p) { return _mm512_loadu_ps(p); }
+			static void store(float* p, reg r) { _mm512_storeu_ps(p, r); }
+			static reg load_partial(const float* p, size_t n) { return _mm512_maskz_loadu_ps(mask(n), p); }
+			static void store_partial(float* p, reg r, size_t n) { _mm512_mask_storeu_ps(p, mask(n), r); }
+			static reg set1(float x) { return _mm512_set1_ps(x); }
+			static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+			// _mm512_reduce_add_ps や _mm512_castps512_ps256 は GCC 12 で誤った未初期化警告が出るため、マスク付きの命令で256ビットずつ取り出す
+			template<int I>
+			static __m256 half(reg r) { return _mm256_castpd_ps(_mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xF, _mm512_castps_pd(r), I)); }
+			static float hsum(reg r) {
+				const __m256 y = _mm256_add_ps(half<0>(r), half<1>(r));
+				__m128 x = _mm_add_ps(_mm256_castps256_ps128(y), _mm256_extractf128_ps(y, 1));
+				x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+				return _mm_cvtss_f32(_mm_add_ss(x, _mm_movehdup_ps(x)));
+			}
+			static float hmax(reg r) {
+				const __m256 y = _mm256_max_ps(half<0>(r), half<1>(r));
+				__m128 x = _mm_max_ps(_mm256_castps256_ps128(y), _mm256_extractf128_ps(y, 1));
+				x = _mm_max_ps(x, _mm_movehl_ps(x, x));
+				return _mm_cvtss_f32(_mm_max_ss(x, _mm_movehdup_ps(x)));
+			}
+
+			template<Op op>
+			static reg binary(reg a, reg b) {
+				if constexpr (op == Op::Add) return _mm512_add_ps(a, b);
+				else if constexpr (op == Op::Sub) return _mm512_sub_ps(a, b);
+				else if constexpr (op == Op::Mul) return _mm512_mul_ps(a, b);
+				else if constexpr (op == Op::Div) return _mm512_div_ps(a, b);
+				else return _mm512_mask_max_ps(a, 0xFFFF, a, b);
+			}
+			template<Unary op>
+			static reg unary(reg x) {
+				const reg zero = _mm512_setzero_ps();
+				if constexpr (op == Unary::Relu) return _mm512_mask_max_ps(zero, 0xFFFF, x, zero); // マスクなし版はGCC12で誤った未初期化警告が出るため全要素マスクで呼び出す
+				else if constexpr (op == Unary::Step) return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(x, zero, _CMP_GT_OQ), _mm512_set1_ps(1.0f));
+				else if constexpr (op == Unary::Square) return _mm512_mul_ps(x, x);
+				else if constexpr (op == Unary::Sqrt) return _mm512_mask_sqrt_ps(x, 0xFFFF, x);
+				else if constexpr (op == Unary::Abs) return _mm512_abs_ps(x);
+				else return _mm512_castsi512_ps(_mm512_xor_epi32(_mm512_castps_si512(x), _mm512_set1_epi32(static_cast<int>(0x80000000u))));
+			}
+
+			// 超越関数 (simdmath.hpp) で使う操作
+			using mask_t = __mmask16;
+			static reg min(reg a, reg b) { return _mm512_mask_min_ps(a, 0xFFFF, a, b); }
+			template<int Pred>
+			static mask_t cmp(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, Pred); }
+			static reg select(mask_t m, reg a, reg b) { return _mm512_mask_blend_ps(m, b, a); }
+			static reg round(reg x) { return _mm512_mask_roundscale_ps(x, 0xFFFF, x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+			static reg copysign(reg mag, reg sign) {
+				const __m512i s = _mm512_set1_epi32(static_cast<int>(0x80000000u));
+				return _mm512_castsi512_ps(_mm512_or_epi32(_mm512_maskz_andnot_epi32(0xFFFF, s, _mm512_castps_si512(mag)), _mm512_and_epi32(s, _mm512_castps_si512(sign))));
+			}
+			/// x * 2^n (n は整数値)。vscalefps は非正規化数や無限大になる場合も正しく丸めます。
+			static reg ldexp(reg x, reg n) { return _mm512_mask_scalef_ps(x, 0xFFFF, x, n); }
+			/// x = m * 2^e (0.5 <= m < 1) に分解します。(x は正の数)
+			static reg frexp(reg x, reg& e) {
+				e = _mm512_add_ps(_mm512_mask_getexp_ps(x, 0xFFFF, x), _mm512_set1_ps(1.0f));
+				return _mm512_mask_getmant_ps(x, 0xFFFF, x, _MM_MANT_NORM_p5_1, _MM_MANT_SIGN_src);
+			}
+		};
+
+		template<>
+		struct Vec<double> {
+			using value_type = double;
+			using reg = __m512d;
+			static constexpr size_t width = 8;
+
+			static __mmask8 mask(size_t n) { return static_cast<__mmask8>((1u << n) - 1); }
+			static reg load(const double* p) { return _mm512_loadu_pd(p); }
+			static void store(double* p, reg r) { _mm512_storeu_pd(p, r); }
+			static reg load_partial(const double* p, size_t n) { return _mm512_maskz_loadu_pd(mask(n), p); }
+			static void store_partial(double* p, reg r, size_t n) { _mm512_mask_storeu_pd(p, mask(n), r); }
+			static reg set1(double x) { return _mm512_set1_pd(x); }
+			static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_pd(a, b, c); }
+			static double hsum(reg r) {
+				const __m256d y = _mm256_add_pd(_mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xF, r, 0), _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xF, r, 1));
+				const __m128d x = _mm_add_pd(_mm256_castpd256_pd128(y), _mm256_extractf128_pd(y, 1));
+				return _mm_cvtsd_f64(_mm_add_sd(x, _mm_unpackhi_pd(x, x)));
+			}
+			static double hmax(reg r) {
+				const __m256d y = _mm256_max_pd(_mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xF, r, 0), _mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xF, r, 1));
+				const __m128d x = _mm_max_pd(_mm256_castpd256_pd128(y), _mm256_extractf128_pd(y, 1));
+				return _mm_cvtsd_f64(_mm_max_sd(x, _mm_unpackhi_pd(x, x)));
+			}
+
+			template<Op op>
+			static reg binary(reg a, reg b) {
+				if constexpr (op == Op::Add) return _mm512_add_pd(a, b);
+				else if constexpr (op == Op::Sub) return _mm512_sub_pd(a, b);
+				else if constexpr (op == Op::Mul) return _mm512_mul_pd(a, b);
+				else if constexpr (op == Op::Div) return _mm512_div_pd(a, b);
+				else return _mm512_mask_max_pd(a, 0xFF, a, b);
+			}
+			template<Unary op>
+			static reg unary(reg x) {
+				const reg zero = _mm512_setzero_pd();
+				if constexpr (op == Unary::Relu) return _mm512_mask_max_pd(zero, 0xFF, x, zero);
+				else if constexpr (op == Unary::Step) return _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(x, zero, _CMP_GT_OQ), _mm512_set1_pd(1.0));
+				else if constexpr (op == Unary::Square) return _mm512_mul_pd(x, x);
+				else if constexpr (op == Unary::Sqrt) return _mm512_mask_sqrt_pd(x, 0xFF, x);
+				else if constexpr (op == Unary::Abs) return _mm512_abs_pd(x);
+				else return _mm512_castsi512_pd(_mm512_xor_epi64(_mm512_castpd_si512(x), _mm512_set1_epi64(static_cast<long long>(0x8000000000000000ull))));
+			}
+
+			// 超越関数 (simdmath.hpp) で使う操作
+			using mask_t = __mmask8;
+			static reg min(reg a, reg b) { return _mm512_mask_min_pd(a, 0xFF, a, b); }
+			template<int Pred>
+			static mask_t cmp(reg a, reg b) { return _mm512_cmp_pd_mask(a, b, Pred); }
+			static reg select(mask_t m, reg a, reg b) { return _mm512_mask_blend_pd(m, b, a); }
+			static reg round(reg x) { return _mm512_mask_roundscale_pd(x, 0xFF, x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+			static reg copysign(reg mag, reg sign) {
+				const __m512i s = _mm512_set1_epi64(static_cast<long long>(0x8000000000000000ull));
+				return _mm512_castsi512_pd(_mm512_or_epi64(_mm512_maskz_andnot_epi64(0xFF, s, _mm512_castpd_si512(mag)), _mm512_and_epi64(s, _mm512_castpd_si512(sign))));
+			}
+			static reg ldexp(reg x, reg n) { return _mm512_mask_scalef_pd(x, 0xFF, x, n); }
+			static reg frexp(reg x, reg& e) {
+				e = _mm512_add_pd(_mm512_mask_getexp_pd(x, 0xFF, x), _mm512_set1_pd(1.0));
+				return _mm512_mask_getmant_pd(x, 0xFF, x, _MM_MANT_NORM_p5_1, _MM_MANT_SIGN_src);
+			}
+		};
+
+		// マスクなしの変換・シフト命令は GCC 12 で誤った未初期化警告が出るため、全要素マスクで呼び出す
+		inline void widen(const bfloat16* in, float* out, size_t n) {
+			size_t i = 0;
+			for (; i + 16 <= n; i += 16) {
+				const __m512i x = _mm512_maskz_cvtepu16_epi32(0xFFFF, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)));
+				_mm512_storeu_ps(out + i, _mm512_castsi512_ps(_mm512_maskz_slli_epi32(0xFFFF, x, 16)));
+			}
+			Avx2::widen(in + i, out + i, n - i);
+		}
+		inline void widen(const float16* in, float* out, size_t n) {
+			size_t i = 0;
+			for (; i + 16 <= n; i += 16)
+				_mm512_storeu_ps(out + i, _mm512_maskz_cvtph_ps(0xFFFF, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i))));
+			Avx2::widen(in + i, out + i, n - i);
+		}
+		inline void narrow(const float* in, bfloat16* out, size_t n) {
+			const __m512i bias = _mm512_set1_epi32(0x7FFF), one = _mm512_set1_epi32(1), quiet = _mm512_set1_epi32(0x00400000);
+			size_t i = 0;
+			for (; i + 16 <= n; i += 16) {
+				const __m512 v = _mm512_loadu_ps(in + i);
+				const __m512i x = _mm512_castps_si512(v);
+				const __m512i rounded = _mm512_add_epi32(x, _mm512_add_epi32(bias, _mm512_and_si512(_mm512_maskz_srli_epi32(0xFFFF, x, 16), one)));
+				const __m512i hi = _mm512_maskz_srli_epi32(0xFFFF, _mm512_mask_or_epi32(rounded, _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q), x, quiet), 16);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm512_maskz_cvtepi32_epi16(0xFFFF, hi));
+			}
+			Avx2::narrow(in + i, out + i, n - i);
+		}
+		inline void narrow(const float* in, float16* out, size_t n) {
+			size_t i = 0;
+			for (; i + 16 <= n; i += 16)
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm512_maskz_cvtps_ph(0xFFFF, _mm512_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+			Avx2::narrow(in + i, out + i, n - i);
+		}
+
+		#include "simdmath.hpp"
+		#include "simdloops.hpp"
+	}
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC pop_options
+#endif
+#endif // SANAE_SIMD_X86
+
+	/// SIMDカーネルが対応している要素型かどうか
+	template<typename T>
+	inline constexpr bool supported_v = std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+	/// 要素ごとの演算 (binary, binary_scalar, axpy, fma, unary) が対応している要素型かどうか。16ビット浮動小数点数を含みます。
+	template<typename T>
+	inline constexpr bool vectorizable_v = supported_v<T> || is_float16_v<T>;
+
+	namespace detail {
+		/// 16ビット浮動小数点数を float に広げて計算するときの1回あたりの要素数 (スタック上の作業領域の大きさ)
+		inline constexpr size_t widen_chunk = 256;
+	}
+
+	/**
+	 * @brief 16ビット浮動小数点数の配列を float に変換します。
+	 */
+	template<typename T>
+	inline void convert(const T* in, float* out, size_t n) {
+		static_assert(is_float16_v<T>, "Conversion kernels support only bfloat16 and float16.");
+#if defined(SANAE_SIMD_X86)
+		switch (active_isa()) {
+		case Isa::AVX512: Avx512::widen(in, out, n); return;
+		case Isa::AVX2: Avx2::widen(in, out, n); return;
+		default: break;
+		}
+#endif
+		for (size_t i = 0; i < n; i++)
+			out[i] = in[i];
+	}
+
+	/**
+	 * @brief float の配列を最近接偶数丸めで16ビット浮動小数点数に変換します。
+	 */
+	template<typename T>
+	inline void convert(const float* in, T* out, size_t n) {
+		static_assert(is_float16_v<T>, "Conversion kernels support only bfloat16 and float16.");
+#if defined(SANAE_SIMD_X86)
+		switch (active_isa()) {
+		case Isa::AVX512: Avx512::narrow(in, out, n); return;
+		case Isa::AVX2: Avx2::narrow(in, out, n); return;
+		default: break;
+		}
+#endif
+		for (size_t i = 0; i < n; i++)
+			out[i] = in[i];
+	}
+
+	/**
+	 * @brief out[i] = a[i] op b[i] を計算します。out は a または b と同じでも構いません。
+	 * @note 16ビット浮動小数点数は float で計算してから丸めます。加減乗除は float の精度が十分あるため、直接丸めた結果と一致します。
+	 */
+	template<Op op, typename T>
+	inline void binary(const T* a, const T* b, T* out, size_t n) {
+		static_assert(vectorizable_v<T>, "SIMD kernels support only float, double, bfloat16 and float16.");
+		if constexpr (is_float16_v<T>) {
+			float fa[detail::widen_chunk], fb[detail::widen_chunk];
+			for (size_t i = 0; i < n; i += detail::widen_chunk) {
+				const size_t m = std::min(detail::widen_chunk, n - i);
+				convert(a + i, fa, m);
+				convert(b + i, fb, m);
+				binary<op>(fa, fb, fa, m);
+				convert(fa, out + i, m);
+			}
+			return;
+		}
+#if defined(SANAE_SIMD_X86)
+		if constexpr (supported_v<T>) {
+			switch (active_isa()) {
+			case Isa::AVX512: Avx512::binary<Avx512::Vec<T>, op>(a, b, out, n); return;
+			case Isa::AVX2: Avx2::binary<Avx2::Vec<T>, op>(a, b, out, n); return;
+			default: break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < n; i++)
+			out[i] = detail::apply<op>(a[i], b[i]);
+	}
+
+	/**
+	 * @brief out[i] = a[i] op s を計算します。out は a と同じでも構いません。
+	 */
+	template<Op op, typename T>
+	inline void binary_scalar(const T* a, T s, T* out, size_t n) {
+		static_assert(vectorizable_v<T>, "SIMD kernels support only float, double, bfloat16 and float16.");
+		if constexpr (is_float16_v<T>) {
+			float fa[detail::widen_chunk];
+			for (size_t i = 0; i < n; i += detail::widen_chunk) {
+				const size_t m = std::min(detail::widen_chunk, n - i);
+				convert(a + i, fa, m);
+				binary_scalar<op>(fa, static_cast<float>(s), fa, m);
+				convert(fa, out + i, m);
+			}
+			return;
+		}
+#if defined(SANAE_SIMD_X86)
+		if constexpr (supported_v<T>) {
+			switch (active_isa()) {
+			case Isa::AVX512: Avx512::binary_scalar<Avx512::Vec<T>, op>(a, s, out, n); return;
+			case Isa::AVX2: Avx2::binary_scalar<Avx2::Vec<T>, op>(a, s, out, n); return;
+			default: break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < n; i++)
+			out[i] = detail::apply<op>(a[i], s);
+	}
+
+	/**
+	 * @brief y[i] = alpha * x[i] + y[i] を計算します。
+	 */
+	template<typename T>
+	inline void axpy(size_t n, T alpha, const T* x, T* y) {
+		static_assert(vectorizable_v<T>, "SIMD kernels support only float, double, bfloat16 and float16.");
+		if constexpr (is_float16_v<T>) {
+			float fx[detail::widen_chunk], fy[detail::widen_chunk];
+			for (size_t i = 0; i < n; i += detail::widen_chunk) {
+				const size_t m = std::min(detail::widen_chunk, n - i);
+				convert(x + i, fx, m);
+				convert(y + i, fy, m);
+				axpy(m, static_cast<float>(alpha), fx, fy);
+				convert(fy, y + i, m);
+			}
+			return;
+		}
+#if defined(SANAE_SIMD_X86)
+		if constexpr (supported_v<T>) {
+			switch (active_isa()) {
+			case Isa::AVX512: Avx512::axpy<Avx512::Vec<T>>(n, alpha, x, y); return;
+			case Isa::AVX2: Avx2::axpy<Avx2::Vec<T>>(n, alpha, x, y); return;
+			default: break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < n; i++)
+			y[i] = alpha * x[i] + y[i];
+	}
+
+	/**
+	 * @brief out[i] = a[i] * b[i] + c[i] を計算します。out は a, b, c のいずれかと同じでも構いません。
+	 */
+	template<typename T>
+	inline void fma(const T* a, const T* b, const T* c, T* out, size_t n) {
+		static_assert(vectorizable_v<T>, "SIMD kernels support only float, double, bfloat16 and float16.");
+		if constexpr (is_float16_v<T>) {
+			float fa[detail::widen_chunk], fb[detail::widen_chunk], fc[detail::widen_chunk];
+			for (size_t i = 0; i < n; i += detail::widen_chunk) {
+				const size_t m = std::min(detail::widen_chunk, n - i);
+				convert(a + i, fa, m);
+				convert(b + i, fb, m);
+				convert(c + i, fc, m);
+				fma(fa, fb, fc, fa, m);
+				convert(fa, out + i, m);
+			}
+			return;
+		}
+#if defined(SANAE_SIMD_X86)
+		if constexpr (supported_v<T>) {
+			switch (active_isa()) {
+			case Isa::AVX512: Avx512::fma<Avx512::Vec<T>>(a, b, c, out, n); return;
+			case Isa::AVX2: Avx2::fma<Avx2::Vec<T>>(a, b, c, out, n); return;
+			default: break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < n; i++)
+			out[i] = a[i] * b[i] + c[i];
+	}
+
+	/**
+	 * @brief out[i] = op(a[i]) を計算します。out は a と同じでも構いません。
+	 * @note Exp, Log, Tanh, Sigmoid, Softplus は active_math_mode() の精度で計算します。
+	 */
+	template<Unary op, typename T>
+	inline void unary(const T* a, T* out, size_t n) {
+		static_assert(vectorizable_v<T>, "SIMD kernels support only float, double, bfloat16 and float16.");
+		if constexpr (is_float16_v<T>) {
+			float fa[detail::widen_chunk];
+			for (size_t i = 0; i < n; i += detail::widen_chunk) {
+				const size_t m = std::min(detail::widen_chunk, n - i);
+				convert(a + i, fa, m);
+				unary<op>(fa, fa, m);
+				convert(fa, out + i, m);
+			}
+			return;
+		}
+#if defined(SANAE_SIMD_X86)
+		if constexpr (supported_v<T>) {
+			if constexpr (detail::is_math_v<op>) {
+				if (active_math_mode() == MathMode::Fast) {
+					switch (active_isa()) {
+					case Isa::AVX512: Avx512::unary<Avx512::Vec<T>, op, true>(a, out, n); return;
+					case Isa::AVX2: Avx2::unary<Avx2::Vec<T>, op, true>(a, out, n); return;
+					default: break;
+					}
+				}
+			}
+			switch (active_isa()) {
+			case Isa::AVX512: Avx512::unary<Avx512::Vec<T>, op>(a, out, n); return;
+			case Isa::AVX2: Avx2::unary<Avx2::Vec<T>, op>(a, out, n); return;
+			default: break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < n; i++)
+			out[i] = detail::apply<op>(a[i]);
+	}
+
+	/**
+	 * @brief コンパイル時に形状が決まる小さな行列の積 out = a * b を計算します。
+	 * @tparam M, K, N a は M x K、b は K x N、out は M x N で、すべて行優先で詰めて格納されている必要があります。
+	 * @note 出力の各行を最大4本のレジスタに累積するため、FixedMatrix のような数十要素程度の行列に向いています。
+	 */
+	template<size_t M, size_t K, size_t N, typename T>
+	inline void gemm_fixed(const T* a, const T* b, T* out) {
+		static_assert(supported_v<T>, "SIMD kernels support only float and double.");
+#if defined(SANAE_SIMD_X86)
+		// 出力の行がベクトル幅より短い場合は端数のマスク処理の方が高くつくため、幅の狭い命令セットに落とす
+		switch (active_isa()) {
+		case Isa::AVX512:
+			if constexpr (N >= Avx512::Vec<T>::width) {
+				Avx512::gemm_fixed<Avx512::Vec<T>, M, K, N>(a, b, out);
+				return;
+			}
+			[[fallthrough]];
+		case Isa::AVX2:
+			if constexpr (N >= Avx2::Vec<T>::width) {
+				Avx2::gemm_fixed<Avx2::Vec<T>, M, K, N>(a, b, out);
+				return;
+			}
+			break;
+		default: break;
+		}
+#endif
+		for (size_t i = 0; i < M; i++) {
+			for (size_t j = 0; j < N; j++)
+				out[i * N + j] = T(0);
+			for (size_t k = 0; k < K; k++)
+				for (size_t j = 0; j < N; j++)
+					out[i * N + j] += a[i * K + k] * b[k * N + j];
+		}
+	}
+
+	/**
+	 * @brief Σ a[i] を計算します。
+	 * @note float, double 以外の型はスカラー実装になります。SIMD実装は複数の部分和に分けて足すため、逐次の和とは丸め誤差が異なります。
+	 *       16ビット浮動小数点数は float で累積し、最後に1回だけ丸めます。
+	 */
+	template<typename T>
+	inline T reduce_sum(const T* a, size_t n) {
+		if constexpr (is_float16_v<T>) {
+			float fa[detail::widen_chunk];
+			float sum = 0.0f;
+			for (size_t i = 0; i < n; i += detail::widen_chunk) {
+				const size_t m = std::min(detail::widen_chunk, n - i);
+				convert(a + i, fa, m);
+				sum += reduce_sum(static_cast<const float*>(fa), m);
+			}
+			return T(sum);
+		}
+#if defined(SANAE_SIMD_X86)
+		if constexpr (supported_v<T>) {
+			switch (active_isa()) {
+			case Isa::AVX512: return Avx512::reduce_sum<Avx512::Vec<T>>(a, n);
+			case Isa::AVX2: return Avx2::reduce_sum<Avx2::Vec<T>>(a, n);
+			default: break;
+			}
+		}
+#endif
+		T sum = T(0);
+		for (size_t i = 0; i < n; i++)
+			sum += a[i];
+		return sum;
+	}
+
+	/**
+	 * @brief max a[i] を計算します。n は1以上である必要があります。
+	 * @note NaN を含む場合の結果は未規定です。
+	 */
+	template<typename T>
+	inline T reduce_max(const T* a, size_t n) {
+		if constexpr (is_float16_v<T>) {
+			float fa[detail::widen_chunk];
+			float result = a[0];
+			for (size_t i = 0; i < n; i += detail::widen_chunk) {
+				const size_t m = std::min(detail::widen_chunk, n - i);
+				convert(a + i, fa, m);
+				result = detail::apply<Op::Max>(result, reduce_max(static_cast<const float*>(fa), m));
+			}
+			return T(result);
+		}
+#if defined(SANAE_SIMD_X86)
+		if constexpr (supported_v<T>) {
+			switch (active_isa()) {
+			case Isa::AVX512: return Avx512::reduce_max<Avx512::Vec<T>>(a, n);
+			case Isa::AVX2: return Avx2::reduce_max<Avx2::Vec<T>>(a, n);
+			default: break;
+			}
+		}
+#endif
+		T result = a[0];
+		for (size_t i = 1; i < n; i++)
+			result = detail::apply<Op::Max>(result, a[i]);
+		return result;
+	}
+
+	/**
+	 * @brief Σ (a[i] - mean)^2 を計算します。
+	 */
+	template<typename T>
+	inline T reduce_sq_dev(const T* a, T mean, size_t n) {
+#if defined(SANAE_SIMD_X86)
+		if constexpr (supported_v<T>) {
+			switch (active_isa()) {
+			case Isa::AVX512: return Avx512::reduce_sq_dev<Avx512::Vec<T>>(a, mean, n);
+			case Isa::AVX2: return Avx2::reduce_sq_dev<Avx2::Vec<T>>(a, mean, n);
+			default: break;
+			}
+		}
+#endif
+		T sum = T(0);
+		for (size_t i = 0; i < n; i++)
+			sum += (a[i] - mean) * (a[i] - mean);
+		return sum;
+	}
+
+	/**
+	 * @brief Welford法で x を1標本として要素ごとの平均と偏差平方和を更新します。
+	 *        d = x[i] - mean[i]; mean[i] += d * inv_count; m2[i] += d * (x[i] - mean[i])
+	 * @param inv_count 更新後の標本数の逆数
+	 */
+	template<typename T>
+	inline void welford(const T* x, T* mean, T* m2, T inv_count, size_t n) {
+#if defined(SANAE_SIMD_X86)
+		if constexpr (supported_v<T>) {
+			switch (active_isa()) {
+			case Isa::AVX512: Avx512::welford<Avx512::Vec<T>>(x, mean, m2, inv_count, n); return;
+			case Isa::AVX2: Avx2::welford<Avx2::Vec<T>>(x, mean, m2, inv_count, n); return;
+			default: break;
+			}
+		}
+#endif
+		for (size_t i = 0; i < n; i++) {
+			const T d = x[i] - mean[i];
+			mean[i] += d * inv_count;
+			m2[i] += d * (x[i] - mean[i]);
+		}
+	}
+
+	/// 転置で書き込み先の行(列)をまとめて処理する本数
+	inline constexpr size_t transpose_block = 16;
+
+	/**
+	 * @brief outer 本の長さ inner の行(列)として格納された src を転置して dst に書き込みます。
+	 *        dst[j * ldd + i] = src[i * lds + j] (0 <= i < outer, 0 <= j < inner)
+	 * @param lds src の行(列)の格納間隔
+	 * @param ldd dst の行(列)の格納間隔
+	 * @note src と dst は重なってはいけません。
+	 * @note 書き込み先の transpose_block 本の行(列)を帯として、転置元を先頭から順に読み進めます。
+	 *       帯の書き込み先はキャッシュに載ったまま連続して埋まり、読み出しも各行(列)の連続した区間になるため、
+	 *       大きな行列でもキャッシュとTLBのミスが増えません。
+	 *       float, double でAVX2以上が使える場合、帯の中は 8x8 (double は 4x4) のタイルをレジスタ上で転置します。
+	 *       それ以外の型はスカラー実装になります。
+	 */
+	template<typename T>
+	inline void transpose(const T* src, size_t lds, T* dst, size_t ldd, size_t outer, size_t inner) {
+		constexpr size_t B = transpose_block;
+#if defined(SANAE_SIMD_X86)
+		if constexpr (supported_v<T>) {
+			if (active_isa() != Isa::Scalar) {
+				// AVX-512 でもタイルの転置はAVX2の命令で行う (メモリ帯域で律速されるため)
+				constexpr size_t W = 32 / sizeof(T);
+				const size_t outer_w = outer / W * W;
+				for (size_t j0 = 0; j0 < inner; j0 += B) {
+					const size_t nj = std::min(B, inner - j0);
+					const size_t nj_w = nj / W * W;
+					const T* s = src + j0;
+					T* d = dst + j0 * ldd;
+
+					for (size_t i = 0; i < outer_w; i += W)
+						for (size_t j = 0; j < nj_w; j += W)
+							Avx2::transpose_tile(s + i * lds + j, lds, d + j * ldd + i, ldd);
+
+					// タイルに収まらない端の部分
+					detail::transpose_scalar(s + nj_w, lds, d + nj_w * ldd, ldd, outer, nj - nj_w);
+					detail::transpose_scalar(s + outer_w * lds, lds, d + outer_w, ldd, outer - outer_w, nj_w);
+				}
+				return;
+			}
+		}
+#endif
+		for (size_t j0 = 0; j0 < inner; j0 += B)
+			detail::transpose_scalar(src + j0, lds, dst + j0 * ldd, ldd, outer, std::min(B, inner - j0));
+	}
+
+	/**
+	 * @brief 単項演算の関数オブジェクト
+	 *
+	 * Matrix::apply などに渡すとSIMDカーネルで計算されます。それ以外の場所では通常の関数オブジェクトとして使用できます。
+	 */
+	template<Unary Kind>
+	struct UnaryFunc {
+		static constexpr Unary op = Kind;
+
+		template<typename T>
+		T operator()(T x) const { return detail::apply<Kind>(x); }
+	};
+	using Relu = UnaryFunc<Unary::Relu>;     ///< max(x, 0)
+	using Step = UnaryFunc<Unary::Step>;     ///< x > 0 ? 1 : 0 (ReLUの導関数)
+	using Square = UnaryFunc<Unary::Square>; ///< x * x
+	using Sqrt = UnaryFunc<Unary::Sqrt>;     ///< sqrt(x)
+	using Abs = UnaryFunc<Unary::Abs>;       ///< |x|
+	using Neg = UnaryFunc<Unary::Neg>;       ///< -x
+	using Exp = UnaryFunc<Unary::Exp>;       ///< exp(x)
+	using Log = UnaryFunc<Unary::Log>;       ///< log(x)
+	using Tanh = UnaryFunc<Unary::Tanh>;     ///< tanh(x)
+	using Sigmoid = UnaryFunc<Unary::Sigmoid>;   ///< 1 / (1 + exp(-x))
+	using Softplus = UnaryFunc<Unary::Softplus>; ///< log(1 + exp(x))
+
+	// 二項演算の関数オブジェクトから演算の種類を取得する型
+	template<typename F> struct binary_op_of { static constexpr bool value = false; using argument_type = void; };
+	template<typename T> struct binary_op_of<std::plus<T>> { static constexpr bool value = true; static constexpr Op op = Op::Add; using argument_type = T; };
+	template<typename T> struct binary_op_of<std::minus<T>> { static constexpr bool value = true; static constexpr Op op = Op::Sub; using argument_type = T; };
+	template<typename T> struct binary_op_of<std::multiplies<T>> { static constexpr bool value = true; static constexpr Op op = Op::Mul; using argument_type = T; };
+	template<typename T> struct binary_op_of<std::divides<T>> { static constexpr bool value = true; static constexpr Op op = Op::Div; using argument_type = T; };
+
+	/// max(a, b) の関数オブジェクト
+	struct Max {
+		template<typename T>
+		T operator()(T a, T b) const { return detail::apply<Op::Max>(a, b); }
+	};
+	template<> struct binary_op_of<Max> { static constexpr bool value = true; static constexpr Op op = Op::Max; using argument_type = void; };
+
+	// 単項演算の関数オブジェクトから演算の種類を取得する型
+	template<typename F> struct unary_op_of { static constexpr bool value = false; };
+	template<Unary Kind> struct unary_op_of<UnaryFunc<Kind>> { static constexpr bool value = true; static constexpr Unary op = Kind; };
+
+	/// 要素型 T と関数オブジェクト F の組み合わせがSIMDカーネルで計算できるかどうか
+	template<typename T, typename F>
+	inline constexpr bool has_binary_v = vectorizable_v<T> && binary_op_of<std::remove_cvref_t<F>>::value &&
+		(std::is_void_v<typename binary_op_of<std::remove_cvref_t<F>>::argument_type> || std::is_same_v<typename binary_op_of<std::remove_cvref_t<F>>::argument_type, T>);
+	template<typename T, typename F>
+	inline constexpr bool has_unary_v = vectorizable_v<T> && unary_op_of<std::remove_cvref_t<F>>::value;
+}
+
+#endif // SANAE_NEURALNETWORK_MATRIX_SIMD
\ No newline at end of file
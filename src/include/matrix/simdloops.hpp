@@ -0,0 +1,248 @@
+﻿// 要素ごとの演算のSIMDループ本体
+//
+// このファイルは simd.hpp から ISA ごとに名前空間とターゲット指定を変えて複数回インクルードされるため、
+// インクルードガードを持ちません。単独でインクルードしないでください。
+//
+// V はベクトル型の操作をまとめた構造体で、次のメンバを持つ必要があります。
+//   value_type, reg, width
+//   load(p), store(p, r), load_partial(p, n), store_partial(p, r, n), set1(x)
+//   binary<op>(a, b), fmadd(a, b, c), unary<op>(x), hsum(r), hmax(r)
+// unary は超越関数のために simdmath.hpp の後にインクルードする必要があります。
+
+/**
+ * @brief out[i] = a[i] op b[i]
+ */
+template<typename V, Op op>
+inline void binary(const typename V::value_type* a, const typename V::value_type* b, typename V::value_type* out, size_t n)
+{
+	constexpr size_t W = V::width;
+	size_t i = 0;
+	for (; i + W <= n; i += W)
+		V::store(out + i, V::template binary<op>(V::load(a + i), V::load(b + i)));
+
+	// 端数はマスク付きのロード・ストアで処理する
+	if (i < n) {
+		const size_t rem = n - i;
+		V::store_partial(out + i, V::template binary<op>(V::load_partial(a + i, rem), V::load_partial(b + i, rem)), rem);
+	}
+}
+
+/**
+ * @brief out[i] = a[i] op s
+ */
+template<typename V, Op op>
+inline void binary_scalar(const typename V::value_type* a, typename V::value_type s, typename V::value_type* out, size_t n)
+{
+	constexpr size_t W = V::width;
+	const typename V::reg vs = V::set1(s);
+	size_t i = 0;
+	for (; i + W <= n; i += W)
+		V::store(out + i, V::template binary<op>(V::load(a + i), vs));
+
+	if (i < n) {
+		const size_t rem = n - i;
+		V::store_partial(out + i, V::template binary<op>(V::load_partial(a + i, rem), vs), rem);
+	}
+}
+
+/**
+ * @brief y[i] = alpha * x[i] + y[i]
+ */
+template<typename V>
+inline void axpy(size_t n, typename V::value_type alpha, const typename V::value_type* x, typename V::value_type* y)
+{
+	constexpr size_t W = V::width;
+	const typename V::reg va = V::set1(alpha);
+	size_t i = 0;
+	for (; i + W <= n; i += W)
+		V::store(y + i, V::fmadd(va, V::load(x + i), V::load(y + i)));
+
+	if (i < n) {
+		const size_t rem = n - i;
+		V::store_partial(y + i, V::fmadd(va, V::load_partial(x + i, rem), V::load_partial(y + i, rem)), rem);
+	}
+}
+
+/**
+ * @brief out[i] = a[i] * b[i] + c[i]
+ */
+template<typename V>
+inline void fma(const typename V::value_type* a, const typename V::value_type* b, const typename V::value_type* c, typename V::value_type* out, size_t n)
+{
+	constexpr size_t W = V::width;
+	size_t i = 0;
+	for (; i + W <= n; i += W)
+		V::store(out + i, V::fmadd(V::load(a + i), V::load(b + i), V::load(c + i)));
+
+	if (i < n) {
+		const size_t rem = n - i;
+		V::store_partial(out + i, V::fmadd(V::load_partial(a + i, rem), V::load_partial(b + i, rem), V::load_partial(c + i, rem)), rem);
+	}
+}
+
+/**
+ * @brief out[i] = op(a[i])
+ * @tparam fast 超越関数を MathMode::Fast の精度で計算するかどうか
+ */
+template<typename V, Unary op, bool fast = false>
+inline void unary(const typename V::value_type* a, typename V::value_type* out, size_t n)
+{
+	constexpr size_t W = V::width;
+	size_t i = 0;
+	for (; i + W <= n; i += W)
+		V::store(out + i, math::unary<V, op, fast>(V::load(a + i)));
+
+	if (i < n) {
+		const size_t rem = n - i;
+		V::store_partial(out + i, math::unary<V, op, fast>(V::load_partial(a + i, rem)), rem);
+	}
+}
+
+/**
+ * @brief Σ a[i]
+ */
+template<typename V>
+inline typename V::value_type reduce_sum(const typename V::value_type* a, size_t n)
+{
+	constexpr size_t W = V::width;
+	// 加算の依存関係を断つため2本のレジスタに交互に足し込む
+	typename V::reg acc0 = V::set1(0), acc1 = V::set1(0);
+	size_t i = 0;
+	for (; i + 2 * W <= n; i += 2 * W) {
+		acc0 = V::template binary<Op::Add>(acc0, V::load(a + i));
+		acc1 = V::template binary<Op::Add>(acc1, V::load(a + i + W));
+	}
+	for (; i + W <= n; i += W)
+		acc0 = V::template binary<Op::Add>(acc0, V::load(a + i));
+
+	// マスクされた要素は0として読み込まれる
+	if (i < n)
+		acc1 = V::template binary<Op::Add>(acc1, V::load_partial(a + i, n - i));
+
+	return V::hsum(V::template binary<Op::Add>(acc0, acc1));
+}
+
+/**
+ * @brief max a[i] (n >= 1)
+ */
+template<typename V>
+inline typename V::value_type reduce_max(const typename V::value_type* a, size_t n)
+{
+	constexpr size_t W = V::width;
+	if (n < W) {
+		typename V::value_type result = a[0];
+		for (size_t i = 1; i < n; i++)
+			result = result < a[i] ? a[i] : result;
+		return result;
+	}
+
+	typename V::reg acc = V::load(a);
+	size_t i = W;
+	for (; i + W <= n; i += W)
+		acc = V::template binary<Op::Max>(acc, V::load(a + i));
+
+	// 端数は末尾のW要素を読み直す (重複して読んでも最大値は変わらない)
+	if (i < n)
+		acc = V::template binary<Op::Max>(acc, V::load(a + n - W));
+
+	return V::hmax(acc);
+}
+
+/**
+ * @brief Σ (a[i] - mean)^2
+ */
+template<typename V>
+inline typename V::value_type reduce_sq_dev(const typename V::value_type* a, typename V::value_type mean, size_t n)
+{
+	constexpr size_t W = V::width;
+	const typename V::reg vm = V::set1(mean);
+	typename V::reg acc = V::set1(0);
+	size_t i = 0;
+	for (; i + W <= n; i += W) {
+		const typename V::reg d = V::template binary<Op::Sub>(V::load(a + i), vm);
+		acc = V::fmadd(d, d, acc);
+	}
+
+	typename V::value_type sum = V::hsum(acc);
+	for (; i < n; i++)
+		sum += (a[i] - mean) * (a[i] - mean);
+	return sum;
+}
+
+/**
+ * @brief d = x[i] - mean[i]; mean[i] += d * inv_count; m2[i] += d * (x[i] - mean[i])
+ */
+template<typename V>
+inline void welford(const typename V::value_type* x, typename V::value_type* mean, typename V::value_type* m2, typename V::value_type inv_count, size_t n)
+{
+	constexpr size_t W = V::width;
+	const typename V::reg vinv = V::set1(inv_count);
+	auto step = [&](typename V::reg vx, typename V::reg& vmean, typename V::reg& vm2) {
+		const typename V::reg d = V::template binary<Op::Sub>(vx, vmean);
+		vmean = V::fmadd(d, vinv, vmean);
+		vm2 = V::fmadd(d, V::template binary<Op::Sub>(vx, vmean), vm2);
+	};
+
+	size_t i = 0;
+	for (; i + W <= n; i += W) {
+		typename V::reg vmean = V::load(mean + i), vm2 = V::load(m2 + i);
+		step(V::load(x + i), vmean, vm2);
+		V::store(mean + i, vmean);
+		V::store(m2 + i, vm2);
+	}
+
+	if (i < n) {
+		const size_t rem = n - i;
+		typename V::reg vmean = V::load_partial(mean + i, rem), vm2 = V::load_partial(m2 + i, rem);
+		step(V::load_partial(x + i, rem), vmean, vm2);
+		V::store_partial(mean + i, vmean, rem);
+		V::store_partial(m2 + i, vm2, rem);
+	}
+}
+
+/**
+ * @brief 出力の1行のうち [J0, J0 + 4W) 列分をレジスタに累積し、残りの列は再帰的に処理します。
+ */
+template<typename V, size_t K, size_t N, size_t J0>
+inline void gemm_fixed_row(const typename V::value_type* arow, const typename V::value_type* b, typename V::value_type* orow)
+{
+	constexpr size_t W = V::width;
+	constexpr size_t NB = (N - J0 < 4 * W) ? N - J0 : 4 * W; // この回に計算する列数
+	constexpr size_t NR = (NB + W - 1) / W;                  // 使用するレジスタ数
+	constexpr size_t TAIL = NB - (NR - 1) * W;               // 最後のレジスタの要素数
+
+	typename V::reg acc[NR];
+	for (size_t r = 0; r < NR; r++)
+		acc[r] = V::set1(0);
+
+	for (size_t k = 0; k < K; k++) {
+		const typename V::reg x = V::set1(arow[k]);
+		const typename V::value_type* bk = b + k * N + J0;
+		for (size_t r = 0; r + 1 < NR; r++)
+			acc[r] = V::fmadd(x, V::load(bk + r * W), acc[r]);
+		if constexpr (TAIL == W)
+			acc[NR - 1] = V::fmadd(x, V::load(bk + (NR - 1) * W), acc[NR - 1]);
+		else
+			acc[NR - 1] = V::fmadd(x, V::load_partial(bk + (NR - 1) * W, TAIL), acc[NR - 1]);
+	}
+
+	for (size_t r = 0; r + 1 < NR; r++)
+		V::store(orow + J0 + r * W, acc[r]);
+	if constexpr (TAIL == W)
+		V::store(orow + J0 + (NR - 1) * W, acc[NR - 1]);
+	else
+		V::store_partial(orow + J0 + (NR - 1) * W, acc[NR - 1], TAIL);
+
+	if constexpr (J0 + NB < N)
+		gemm_fixed_row<V, K, N, J0 + NB>(arow, b, orow);
+}
+
+/**
+ * @brief out = a * b (a: M x K, b: K x N, out: M x N。すべて行優先で詰めて格納)
+ */
+template<typename V, size_t M, size_t K, size_t N>
+inline void gemm_fixed(const typename V::value_type* a, const typename V::value_type* b, typename V::value_type* out)
+{
+	for (size_t i = 0; i < M; i++)
+		gemm_fixed_row<V, K, N, 0>(a + i * K, b, out + i * N);
+}
\ No newline at end of file
@@ -0,0 +1,163 @@
+﻿// 超越関数のSIMD実装
+//
+// このファイルは simdloops.hpp と同様に simd.hpp から ISA ごとに名前空間とターゲット指定を変えて複数回インクルードされるため、
+// インクルードガードを持ちません。単独でインクルードしないでください。
+//
+// V は simdloops.hpp の要件に加えて次のメンバを持つ必要があります。
+//   mask_t, min(a, b), cmp<pred>(a, b), select(m, a, b), round(x), copysign(mag, sign), ldexp(x, n), frexp(x, e)
+// 係数と精度は detail::MathParams を参照してください。
+
+namespace math {
+	/**
+	 * @brief Horner法で c[0] + c[1] x + ... + c[N-1] x^(N-1) を計算します。
+	 */
+	template<typename V, size_t N>
+	inline typename V::reg poly(typename V::reg x, const std::array<typename V::value_type, N>& c)
+	{
+		typename V::reg p = V::set1(c[N - 1]);
+		for (size_t i = N - 1; i-- > 0;)
+			p = V::fmadd(p, x, V::set1(c[i]));
+		return p;
+	}
+
+	/**
+	 * @brief exp(x)
+	 * @note x = n ln2 + r (|r| <= ln2 / 2) に分解し、exp(r) の多項式に 2^n を掛けます。
+	 */
+	template<typename V, bool fast>
+	inline typename V::reg exp(typename V::reg x)
+	{
+		using T = typename V::value_type;
+		using P = detail::MathParams<T, fast>;
+		using reg = typename V::reg;
+
+		// 範囲外は無限大・0になる値に切り詰める (max, min は2番目の引数が NaN の場合にそれを返すため NaN は残る)
+		x = V::min(V::set1(P::exp_hi), V::template binary<Op::Max>(V::set1(P::exp_lo), x));
+
+		const reg n = V::round(V::template binary<Op::Mul>(x, V::set1(P::log2e)));
+		reg r = V::fmadd(n, V::set1(-P::ln2_hi), x);
+		r = V::fmadd(n, V::set1(-P::ln2_lo), r);
+		return V::ldexp(poly<V>(r, P::exp_coefs), n);
+	}
+
+	/**
+	 * @brief log(x)
+	 * @note x = m 2^e (sqrt(1/2) <= m < sqrt(2)) に分解し、log(m) = 2 atanh((m - 1) / (m + 1)) を級数で計算します。
+	 */
+	template<typename V, bool fast>
+	inline typename V::reg log(typename V::reg x)
+	{
+		using T = typename V::value_type;
+		using P = detail::MathParams<T, fast>;
+		using reg = typename V::reg;
+		const reg one = V::set1(T(1));
+
+		// 非正規化数は 2^tiny_bits 倍して正規化数にしてから分解する
+		const auto tiny = V::template cmp<_CMP_LT_OQ>(x, V::set1(std::numeric_limits<T>::min()));
+		reg e;
+		reg m = V::frexp(V::select(tiny, V::template binary<Op::Mul>(x, V::set1(P::tiny_scale)), x), e);
+		e = V::select(tiny, V::template binary<Op::Sub>(e, V::set1(P::tiny_bits)), e);
+
+		// [0.5, 1) を [sqrt(1/2), sqrt(2)) に移す
+		const auto below = V::template cmp<_CMP_LT_OQ>(m, V::set1(T(0.70710678118654752440)));
+		m = V::select(below, V::template binary<Op::Add>(m, m), m);
+		e = V::select(below, V::template binary<Op::Sub>(e, one), e);
+
+		const reg f = V::template binary<Op::Sub>(m, one);
+		const reg s = V::template binary<Op::Div>(f, V::template binary<Op::Add>(f, V::set1(T(2))));
+		const reg z = V::template binary<Op::Mul>(s, s);
+		const reg two_s = V::template binary<Op::Add>(s, s);
+		// 2s + 2s z (1/3 + z/5 + ...)
+		const reg log_m = V::fmadd(V::template binary<Op::Mul>(two_s, z), poly<V>(z, P::log_coefs), two_s);
+
+		reg result = V::fmadd(e, V::set1(P::ln2_lo), log_m);
+		result = V::fmadd(e, V::set1(P::ln2_hi), result);
+
+		// log(inf) = inf, log(0) = -inf, 負の数と NaN は NaN
+		const reg inf = V::set1(std::numeric_limits<T>::infinity());
+		result = V::select(V::template cmp<_CMP_EQ_OQ>(x, inf), inf, result);
+		result = V::select(V::template cmp<_CMP_EQ_OQ>(x, V::set1(T(0))), V::set1(-std::numeric_limits<T>::infinity()), result);
+		return V::select(V::template cmp<_CMP_NGE_UQ>(x, V::set1(T(0))), V::set1(std::numeric_limits<T>::quiet_NaN()), result);
+	}
+
+	/**
+	 * @brief tanh(x)
+	 * @note |x| < 0.625 では有理式 (float は多項式) 近似、それ以外は 1 - 2 / (exp(2|x|) + 1) で計算します。
+	 *       近似式の係数は Cephes Math Library (tanh.c, tanhf.c) のものです。
+	 */
+	template<typename V, bool fast>
+	inline typename V::reg tanh(typename V::reg x)
+	{
+		using T = typename V::value_type;
+		using reg = typename V::reg;
+		const reg one = V::set1(T(1));
+
+		const reg a = V::template unary<Unary::Abs>(x);
+		const reg e = exp<V, fast>(V::template binary<Op::Add>(a, a));
+		const reg large = V::template binary<Op::Sub>(one, V::template binary<Op::Div>(V::set1(T(2)), V::template binary<Op::Add>(e, one)));
+
+		// x + x z R(z) (z = x^2)
+		const reg z = V::template binary<Op::Mul>(x, x);
+		reg r;
+		if constexpr (std::is_same_v<T, double>) {
+			constexpr std::array<T, 3> p = { -1.61468768441708447952E3, -9.92877231001918586564E1, -9.64399179425052238628E-1 };
+			constexpr std::array<T, 4> q = { 4.84406305325125486048E3, 2.23548839060100448583E3, 1.12811678491632931402E2, 1.0 };
+			r = V::template binary<Op::Div>(poly<V>(z, p), poly<V>(z, q));
+		}
+		else {
+			constexpr std::array<T, 5> p = { -3.33332819422E-1f, 1.33314422036E-1f, -5.37397155531E-2f, 2.06390887954E-2f, -5.70498872745E-3f };
+			r = poly<V>(z, p);
+		}
+		const reg small = V::fmadd(V::template binary<Op::Mul>(x, z), r, x);
+
+		return V::select(V::template cmp<_CMP_LT_OQ>(a, V::set1(T(0.625))), small, V::copysign(large, x));
+	}
+
+	/**
+	 * @brief 1 / (1 + exp(-x))
+	 * @note x < 0 では exp(-x) が先に溢れないよう、e = exp(x) として e / (1 + e) で計算します。
+	 */
+	template<typename V, bool fast>
+	inline typename V::reg sigmoid(typename V::reg x)
+	{
+		using T = typename V::value_type;
+		using reg = typename V::reg;
+		const reg one = V::set1(T(1));
+
+		const reg e = exp<V, fast>(V::template unary<Unary::Neg>(V::template unary<Unary::Abs>(x)));
+		const reg r = V::template binary<Op::Div>(one, V::template binary<Op::Add>(one, e));
+		return V::select(V::template cmp<_CMP_LT_OQ>(x, V::set1(T(0))), V::template binary<Op::Mul>(e, r), r);
+	}
+
+	/**
+	 * @brief log(1 + exp(x)) = max(x, 0) + log1p(exp(-|x|))
+	 * @note log1p(u) は w = 1 + u の丸め誤差を log(w) - ((w - 1) - u) / w で補正して求めます。
+	 */
+	template<typename V, bool fast>
+	inline typename V::reg softplus(typename V::reg x)
+	{
+		using T = typename V::value_type;
+		using reg = typename V::reg;
+		const reg one = V::set1(T(1));
+
+		const reg u = exp<V, fast>(V::template unary<Unary::Neg>(V::template unary<Unary::Abs>(x)));
+		const reg w = V::template binary<Op::Add>(one, u);
+		const reg correction = V::template binary<Op::Div>(V::template binary<Op::Sub>(V::template binary<Op::Sub>(w, one), u), w);
+		const reg log1p = V::template binary<Op::Sub>(log<V, fast>(w), correction);
+		return V::template binary<Op::Add>(V::template binary<Op::Max>(V::set1(T(0)), x), log1p);
+	}
+
+	/**
+	 * @brief 単項演算 op を計算します。超越関数以外は V::unary をそのまま呼び出します。
+	 */
+	template<typename V, Unary op, bool fast>
+	inline typename V::reg unary(typename V::reg x)
+	{
+		if constexpr (op == Unary::Exp) return exp<V, fast>(x);
+		else if constexpr (op == Unary::Log) return log<V, fast>(x);
+		else if constexpr (op == Unary::Tanh) return tanh<V, fast>(x);
+		else if constexpr (op == Unary::Sigmoid) return sigmoid<V, fast>(x);
+		else if constexpr (op == Unary::Softplus) return softplus<V, fast>(x);
+		else return V::template unary<op>(x);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,307 @@
+﻿#ifndef SANAE_NEURALNETWORK_SPARSEMATRIX
+#define SANAE_NEURALNETWORK_SPARSEMATRIX
+
+#include "matrix.h"
+#include "simd.hpp"
+#include "../threadpool/threadpool.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @class SparseMatrix
+ * @brief CSR (Compressed Sparse Row) 形式の疎行列
+ *
+ * 非ゼロ要素だけを行ごとに列番号の昇順で格納します。
+ * 行 i の非ゼロ要素は [row_ptr()[i], row_ptr()[i + 1]) の範囲にあり、col_idx() が列番号、values() が値です。
+ *
+ * 密行列との積は spmm / spmm_into で計算します。非ゼロ要素ごとに密行列の1行を足し込むため、
+ * 計算量は (非ゼロ要素数) * (密行列の列数) になります。
+ *
+ * @tparam T 要素型
+ */
+template<typename T>
+class SparseMatrix {
+public:
+	/// 列番号の型。メモリ帯域を節約するため32ビットで格納します。
+	using index_type = std::uint32_t;
+
+private:
+	size_t _rows = 0, _cols = 0;
+	std::vector<size_t> _row_ptr{ 0 };  ///< 各行の先頭要素の位置 (要素数は行数 + 1)
+	std::vector<index_type> _col_idx;   ///< 各要素の列番号
+	std::vector<T> _values;             ///< 各要素の値
+
+	static void _check_cols(size_t cols) {
+		if (cols > std::numeric_limits<index_type>::max())
+			throw std::invalid_argument("SparseMatrix supports at most 2^32 - 1 columns.");
+	}
+
+public:
+	/**
+	 * @brief 0行0列の疎行列を作成します。
+	 */
+	SparseMatrix() = default;
+
+	/**
+	 * @brief すべての要素が0の疎行列を作成します。
+	 * @param rows 行数
+	 * @param cols 列数
+	 */
+	SparseMatrix(size_t rows, size_t cols)
+		: _rows(rows), _cols(cols), _row_ptr(rows + 1, 0)
+	{
+		_check_cols(cols);
+	}
+
+	/**
+	 * @brief CSR形式の配列から作成します。
+	 * @param rows 行数
+	 * @param cols 列数
+	 * @param row_ptr 各行の先頭要素の位置 (要素数は rows + 1、先頭は0、単調非減少)
+	 * @param col_idx 各要素の列番号 (行ごとに狭義単調増加)
+	 * @param values 各要素の値
+	 * @throws std::invalid_argument 配列がCSR形式として正しくない場合
+	 */
+	SparseMatrix(size_t rows, size_t cols, std::vector<size_t> row_ptr, std::vector<index_type> col_idx, std::vector<T> values)
+		: _rows(rows), _cols(cols), _row_ptr(std::move(row_ptr)), _col_idx(std::move(col_idx)), _values(std::move(values))
+	{
+		_check_cols(cols);
+		if (_row_ptr.size() != rows + 1 || _row_ptr.front() != 0 || _row_ptr.back() != _values.size() || _col_idx.size() != _values.size())
+			throw std::invalid_argument("Invalid CSR arrays in SparseMatrix.");
+		for (size_t i = 0; i < rows; i++) {
+			if (_row_ptr[i] > _row_ptr[i + 1])
+				throw std::invalid_argument("Row pointers must be non-decreasing in SparseMatrix.");
+			for (size_t p = _row_ptr[i]; p < _row_ptr[i + 1]; p++) {
+				if (_col_idx[p] >= cols || (p > _row_ptr[i] && _col_idx[p - 1] >= _col_idx[p]))
+					throw std::invalid_argument("Column indices must be in range and strictly increasing within a row in SparseMatrix.");
+			}
+		}
+	}
+
+	/**
+	 * @brief 密行列から0でない要素を取り出して作成します。
+	 * @param dense Matrix, MatrixView, FixedMatrix のいずれか
+	 */
+	template<typename Dense> requires MatrixOperand<Dense> && std::is_same_v<matrix_operand_value_t<Dense>, T>
+	explicit SparseMatrix(const Dense& dense) {
+		const auto view = matrix_operand_traits<Dense>::view(dense);
+		_rows = view.rows();
+		_cols = view.cols();
+		_check_cols(_cols);
+		_row_ptr.assign(1, 0);
+		_row_ptr.reserve(_rows + 1);
+		for (size_t i = 0; i < _rows; i++) {
+			for (size_t j = 0; j < _cols; j++) {
+				const T value = view(i, j);
+				if (value != T(0)) {
+					_col_idx.push_back(static_cast<index_type>(j));
+					_values.push_back(value);
+				}
+			}
+			_row_ptr.push_back(_values.size());
+		}
+	}
+
+	/**
+	 * @brief (行, 列, 値) の組の並びから作成します。
+	 * @param rows 行数
+	 * @param cols 列数
+	 * @param triplets 要素の並び。順序は任意で、同じ位置の要素は合計されます。
+	 * @throws std::out_of_range 位置が行列の範囲外の場合
+	 */
+	static SparseMatrix from_triplets(size_t rows, size_t cols, std::vector<std::tuple<size_t, size_t, T>> triplets) {
+		SparseMatrix result(rows, cols);
+		std::sort(triplets.begin(), triplets.end(), [](const auto& a, const auto& b) {
+			return std::get<0>(a) != std::get<0>(b) ? std::get<0>(a) < std::get<0>(b) : std::get<1>(a) < std::get<1>(b);
+		});
+
+		result._col_idx.reserve(triplets.size());
+		result._values.reserve(triplets.size());
+		for (size_t p = 0; p < triplets.size(); p++) {
+			const auto [row, col, value] = triplets[p];
+			if (row >= rows || col >= cols)
+				throw std::out_of_range("Element position is out of range in SparseMatrix::from_triplets");
+			if (p > 0 && std::get<0>(triplets[p - 1]) == row && std::get<1>(triplets[p - 1]) == col)
+				result._values.back() += value;
+			else {
+				result._col_idx.push_back(static_cast<index_type>(col));
+				result._values.push_back(value);
+				result._row_ptr[row + 1]++;
+			}
+		}
+		for (size_t i = 0; i < rows; i++)
+			result._row_ptr[i + 1] += result._row_ptr[i];
+		return result;
+	}
+
+	size_t rows() const noexcept { return _rows; }
+	size_t cols() const noexcept { return _cols; }
+	/// 格納している要素数
+	size_t nnz() const noexcept { return _values.size(); }
+	/// 格納している要素の割合
+	double density() const noexcept { return (_rows == 0 || _cols == 0) ? 0.0 : static_cast<double>(nnz()) / (static_cast<double>(_rows) * _cols); }
+
+	const std::vector<size_t>& row_ptr() const noexcept { return _row_ptr; }
+	const std::vector<index_type>& col_idx() const noexcept { return _col_idx; }
+	const std::vector<T>& values() const noexcept { return _values; }
+
+	/**
+	 * @brief [begin, end) 行を取り出した疎行列を作成します。ミニバッチの切り出しに使用します。
+	 * @throws std::out_of_range 範囲が不正な場合
+	 */
+	SparseMatrix rows_range(size_t begin, size_t end) const {
+		if (begin > end || end > _rows)
+			throw std::out_of_range("Invalid row range in SparseMatrix::rows_range");
+
+		SparseMatrix result(end - begin, _cols);
+		const size_t first = _row_ptr[begin], last = _row_ptr[end];
+		for (size_t i = begin; i < end; i++)
+			result._row_ptr[i - begin + 1] = _row_ptr[i + 1] - first;
+		result._col_idx.assign(_col_idx.begin() + first, _col_idx.begin() + last);
+		result._values.assign(_values.begin() + first, _values.begin() + last);
+		return result;
+	}
+
+	/**
+	 * @brief 密行列に変換します。
+	 */
+	Matrix<T> to_dense() const {
+		Matrix<T> result(_rows, _cols);
+		for (size_t i = 0; i < _rows; i++)
+			for (size_t p = _row_ptr[i]; p < _row_ptr[i + 1]; p++)
+				result(i, _col_idx[p]) = _values[p];
+		return result;
+	}
+};
+
+template<typename T>
+std::ostream& operator<<(std::ostream& os, const SparseMatrix<T>& mat) {
+	return os << mat.to_dense();
+}
+
+namespace SparseKernel {
+	/**
+	 * @brief y[j] += alpha * x[j] (j = 0, ..., n - 1)
+	 */
+	template<typename T>
+	inline void axpy(size_t n, T alpha, const T* x, T* y) {
+		if constexpr (SimdKernel::vectorizable_v<T>)
+			SimdKernel::axpy(n, alpha, x, y);
+		else
+			for (size_t j = 0; j < n; j++)
+				y[j] += alpha * x[j];
+	}
+
+	/**
+	 * @brief y[j] = beta * y[j] (beta = 0 の場合は元の値を読まずに0にします)
+	 */
+	template<typename T>
+	inline void scale(size_t n, T beta, T* y) {
+		if (beta == T(0))
+			std::fill(y, y + n, T(0));
+		else if (beta != T(1))
+			for (size_t j = 0; j < n; j++)
+				y[j] *= beta;
+	}
+}
+
+/**
+ * @brief C = alpha * op(A) * B + beta * C を計算し、既存の行列Cに書き込みます。(Cは再確保されません)
+ * @tparam TransA Aを転置して乗算するかどうか。true の場合は A^T * B を計算します (Affine の dW = X^T * dout)。
+ * @param C 出力先の行優先の行列またはビュー。op(A)の行数 x Bの列数である必要があります。
+ * @param A 左側の疎行列
+ * @param B 右側の行優先の行列またはビュー
+ * @param alpha 積に掛ける係数(デフォルトは1)
+ * @param beta Cの元の値に掛ける係数(デフォルトは0)。0の場合はCの元の値を読みません。
+ * @throws std::invalid_argument 行列の次元が一致しない場合、またはCの領域がBの領域と重なる場合
+ * @note 計算量は A.nnz() * Bの列数 です。
+ * @note TransA = false の場合は出力の行ごとに、true の場合は出力の列の帯ごとにスレッドプールで分割します。どちらも書き込み先が重ならないため結果は実行するスレッド数によりません。
+ */
+template<bool TransA = false, typename CType, typename BType>
+	requires MatrixOperand<CType> && MatrixOperand<BType>
+inline void spmm_into(
+	CType&& C_,
+	const SparseMatrix<matrix_operand_value_t<CType>>& A,
+	const BType& B_,
+	matrix_operand_value_t<CType> alpha = matrix_operand_value_t<CType>(1),
+	matrix_operand_value_t<CType> beta = matrix_operand_value_t<CType>(0))
+{
+	using CTraits = matrix_operand_traits<std::remove_cvref_t<CType>>;
+	using T = typename CTraits::value_type;
+	static_assert(std::is_same_v<matrix_operand_value_t<BType>, T>, "Matrix element types must agree.");
+	static_assert(CTraits::row_major && matrix_operand_traits<BType>::row_major, "Dense operands of a sparse product must be row-major.");
+
+	const MatrixView<T> C = CTraits::mutable_view(C_);
+	const MatrixView<const T> B = matrix_operand_traits<BType>::view(B_);
+
+	const size_t M = TransA ? A.cols() : A.rows();
+	const size_t N = B.cols();
+	if ((TransA ? A.rows() : A.cols()) != B.rows())
+		throw std::invalid_argument("Matrix dimensions must agree for matrix multiplication.");
+	if (C.rows() != M || C.cols() != N)
+		throw std::invalid_argument("Output matrix dimensions must agree for matrix multiplication.");
+	if (C.overlaps(B))
+		throw std::invalid_argument("Output matrix must not alias an input matrix.");
+
+	if (M == 0 || N == 0)
+		return;
+
+	const size_t* row_ptr = A.row_ptr().data();
+	const typename SparseMatrix<T>::index_type* col_idx = A.col_idx().data();
+	const T* values = A.values().data();
+	ThreadPool& pool = ThreadPool::instance();
+
+	if constexpr (!TransA) {
+		// C の行 i = Σ_p values[p] * B の行 col_idx[p]
+		const size_t work_per_row = std::max<size_t>((A.nnz() / std::max<size_t>(A.rows(), 1) + 1) * N, 1);
+		pool.parallel_for(0, M, std::max<size_t>(ThreadPool::default_grain / work_per_row, 1), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				T* crow = C.get_row_ptr(i);
+				SparseKernel::scale(N, beta, crow);
+				for (size_t p = row_ptr[i]; p < row_ptr[i + 1]; p++)
+					SparseKernel::axpy(N, alpha * values[p], B.get_row_ptr(col_idx[p]), crow);
+			}
+		});
+	}
+	else {
+		// C の行 col_idx[p] += values[p] * B の行 i
+		// 書き込み先の行が要素ごとに散らばるため、列の帯に分けて並列化する
+		constexpr size_t band = 64;
+		const size_t bands = (N + band - 1) / band;
+		const size_t work_per_band = std::max<size_t>((A.nnz() + M) * std::min(band, N), 1);
+		pool.parallel_for(0, bands, std::max<size_t>(ThreadPool::default_grain / work_per_band, 1), [&](size_t begin, size_t end) {
+			const size_t j0 = begin * band, j1 = std::min(end * band, N);
+			for (size_t k = 0; k < M; k++)
+				SparseKernel::scale(j1 - j0, beta, C.get_row_ptr(k) + j0);
+			for (size_t i = 0; i < A.rows(); i++) {
+				const T* brow = B.get_row_ptr(i) + j0;
+				for (size_t p = row_ptr[i]; p < row_ptr[i + 1]; p++)
+					SparseKernel::axpy(j1 - j0, alpha * values[p], brow, C.get_row_ptr(col_idx[p]) + j0);
+			}
+		});
+	}
+}
+
+/**
+ * @brief op(A) * B を計算し、新しい行列として返します。
+ * @tparam TransA Aを転置して乗算するかどうか
+ * @param A 左側の疎行列
+ * @param B 右側の行優先の行列またはビュー
+ * @throws std::invalid_argument 行列の次元が一致しない場合
+ */
+template<bool TransA = false, typename T, typename BType>
+	requires MatrixOperand<BType>
+inline Matrix<T> spmm(const SparseMatrix<T>& A, const BType& B) {
+	Matrix<T> result(TransA ? A.cols() : A.rows(), matrix_operand_traits<BType>::view(B).cols());
+	spmm_into<TransA>(result, A, B);
+	return result;
+}
+
+#endif // SANAE_NEURALNETWORK_SPARSEMATRIX
\ No newline at end of file
@@ -0,0 +1,271 @@
+﻿#ifndef SANAE_NEURALNETWORK_STRASSEN
+#define SANAE_NEURALNETWORK_STRASSEN
+
+#include "matrix.h"
+#include "nativegemm.hpp"
+#include "simd.hpp"
+#include "../threadpool/threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Strassen-Winograd 法による行列積 (BLASを使用しない場合)
+ *
+ * C = A * B を4つの部分行列に分け、7回の部分行列の積と15回の加減算で計算します (計算量 O(n^2.81))。
+ * 部分行列の積は再帰的に計算し、いずれかの次元がカットオフ未満になったら NativeGemm で計算します。
+ * 作業領域は Douglas らの順序で C の部分行列を使い回し、各段で (M/2) x max(K/2, N/2) と (K/2) x (N/2) の2つだけ確保します。
+ * 奇数の次元は末尾の1行 (1列) を切り離し、NativeGemm で計算します。
+ *
+ * @note 通常の行列積と比べて誤差が大きくなります (要素ごとではなく行列のノルムに対してのみ上限があります)。
+ *       check() は誤差の上限を Freivalds 法で確認します。
+ */
+namespace Strassen {
+	/// 既定のカットオフ。いずれかの次元がこれ未満になったら NativeGemm で計算します
+	inline constexpr size_t default_cutoff = 512;
+
+	namespace detail {
+		inline std::atomic<size_t>& cutoff_state() {
+			static std::atomic<size_t> cutoff{ default_cutoff };
+			return cutoff;
+		}
+	}
+
+	/**
+	 * @brief 現在のカットオフを返します。
+	 */
+	inline size_t cutoff() noexcept {
+		return detail::cutoff_state().load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief カットオフを変更します。2未満の値は2とみなします。
+	 */
+	inline void set_cutoff(size_t cutoff) noexcept {
+		detail::cutoff_state().store(std::max<size_t>(cutoff, 2), std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief M x N x K の積で再帰する段数を返します。
+	 */
+	inline size_t levels(size_t M, size_t N, size_t K, size_t cutoff = Strassen::cutoff()) noexcept {
+		cutoff = std::max<size_t>(cutoff, 2);
+		size_t depth = 0;
+		while (std::min({ M, N, K }) >= cutoff) {
+			M /= 2; N /= 2; K /= 2;
+			depth++;
+		}
+		return depth;
+	}
+
+	namespace detail {
+		/**
+		 * @brief out = a op b (rows x cols の部分行列。すべて行優先)
+		 */
+		template<SimdKernel::Op op, typename T>
+		inline void combine(size_t rows, size_t cols, const T* a, size_t lda, const T* b, size_t ldb, T* out, size_t ldo) {
+			const size_t grain = std::max<size_t>(ThreadPool::default_grain / std::max<size_t>(cols, 1), 1);
+			ThreadPool::instance().parallel_for(0, rows, grain, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					if constexpr (SimdKernel::vectorizable_v<T>)
+						SimdKernel::binary<op>(a + i * lda, b + i * ldb, out + i * ldo, cols);
+					else
+						for (size_t j = 0; j < cols; j++)
+							out[i * ldo + j] = op == SimdKernel::Op::Add ? a[i * lda + j] + b[i * ldb + j] : a[i * lda + j] - b[i * ldb + j];
+				}
+			});
+		}
+
+		/**
+		 * @brief C = A * B + beta * C を NativeGemm で計算します。
+		 */
+		template<typename T>
+		inline void base(size_t M, size_t N, size_t K, const T* A, size_t lda, const T* B, size_t ldb, T* C, size_t ldc, T beta = T(0)) {
+			if (M == 0 || N == 0)
+				return;
+			NativeGemm::MatMul<T>::multiply(A, B, C, M, N, K, true, true, false, false, T(1), beta, lda, ldb, ldc);
+		}
+
+		/**
+		 * @brief C = A * B (すべて行優先)
+		 */
+		template<typename T>
+		inline void recurse(size_t M, size_t N, size_t K, const T* A, size_t lda, const T* B, size_t ldb, T* C, size_t ldc, size_t cutoff) {
+			if (std::min({ M, N, K }) < cutoff) {
+				base(M, N, K, A, lda, B, ldb, C, ldc);
+				return;
+			}
+
+			using SimdKernel::Op;
+			const size_t m = M / 2, n = N / 2, k = K / 2;
+			const T* A11 = A;           const T* A12 = A + k;
+			const T* A21 = A + m * lda; const T* A22 = A21 + k;
+			const T* B11 = B;           const T* B12 = B + n;
+			const T* B21 = B + k * ldb; const T* B22 = B21 + n;
+			T* C11 = C;           T* C12 = C + n;
+			T* C21 = C + m * ldc; T* C22 = C21 + n;
+
+			// X は m x k (S) と m x n (P1) に、Y は k x n (T) に使う
+			std::vector<T> x_buf(m * std::max(k, n)), y_buf(k * n);
+			T* X = x_buf.data();
+			T* Y = y_buf.data();
+			auto product = [&](const T* a, size_t la, const T* b, size_t lb, T* c) {
+				recurse(m, n, k, a, la, b, lb, c, ldc, cutoff);
+			};
+
+			combine<Op::Sub>(m, k, A11, lda, A21, lda, X, k);       // S3 = A11 - A21
+			combine<Op::Sub>(k, n, B22, ldb, B12, ldb, Y, n);       // T3 = B22 - B12
+			product(X, k, Y, n, C21);                               // P7 = S3 * T3
+			combine<Op::Add>(m, k, A21, lda, A22, lda, X, k);       // S1 = A21 + A22
+			combine<Op::Sub>(k, n, B12, ldb, B11, ldb, Y, n);       // T1 = B12 - B11
+			product(X, k, Y, n, C22);                               // P5 = S1 * T1
+			combine<Op::Sub>(m, k, X, k, A11, lda, X, k);           // S2 = S1 - A11
+			combine<Op::Sub>(k, n, B22, ldb, Y, n, Y, n);           // T2 = B22 - T1
+			product(X, k, Y, n, C12);                               // P6 = S2 * T2
+			combine<Op::Sub>(m, k, A12, lda, X, k, X, k);           // S4 = A12 - S2
+			product(X, k, B22, ldb, C11);                           // P3 = S4 * B22
+			recurse(m, n, k, A11, lda, B11, ldb, X, n, cutoff);     // P1 = A11 * B11
+			combine<Op::Add>(m, n, X, n, C12, ldc, C12, ldc);       // U2 = P1 + P6
+			combine<Op::Add>(m, n, C12, ldc, C21, ldc, C21, ldc);   // U3 = U2 + P7
+			combine<Op::Add>(m, n, C12, ldc, C22, ldc, C12, ldc);   // U4 = U2 + P5
+			combine<Op::Add>(m, n, C21, ldc, C22, ldc, C22, ldc);   // C22 = U3 + P5
+			combine<Op::Add>(m, n, C12, ldc, C11, ldc, C12, ldc);   // C12 = U4 + P3
+			combine<Op::Sub>(k, n, Y, n, B21, ldb, Y, n);           // T4 = T2 - B21
+			product(A22, lda, Y, n, C11);                           // P4 = A22 * T4
+			combine<Op::Sub>(m, n, C21, ldc, C11, ldc, C21, ldc);   // C21 = U3 - P4
+			product(A12, lda, B21, ldb, C11);                       // P2 = A12 * B21
+			combine<Op::Add>(m, n, X, n, C11, ldc, C11, ldc);       // C11 = P1 + P2
+
+			// 奇数の次元で切り離した部分
+			if (K % 2 != 0)
+				base(2 * m, 2 * n, 1, A + (K - 1), lda, B + (K - 1) * ldb, ldb, C, ldc, T(1));
+			if (N % 2 != 0)
+				base(M, 1, K, A, lda, B + (N - 1), ldb, C + (N - 1), ldc);
+			if (M % 2 != 0)
+				base(1, 2 * n, K, A + (M - 1) * lda, lda, B, ldb, C + (M - 1) * ldc, ldc);
+		}
+	}
+
+	/**
+	 * @brief C = A * B を Strassen-Winograd 法で計算します。(すべて行優先)
+	 * @param A 左側の行列 (M x K)
+	 * @param B 右側の行列 (K x N)
+	 * @param C 出力先 (M x N)。元の値は読みません。
+	 * @param lda, ldb, ldc 各行列の格納間隔。0の場合は詰めて格納されているものとみなします。
+	 * @param cutoff いずれかの次元がこれ未満になったら NativeGemm で計算します。
+	 */
+	template<typename T>
+	inline void multiply(const T* A, const T* B, T* C, size_t M, size_t N, size_t K,
+		size_t lda = 0, size_t ldb = 0, size_t ldc = 0, size_t cutoff = Strassen::cutoff())
+	{
+		detail::recurse(M, N, K, A, lda != 0 ? lda : K, B, ldb != 0 ? ldb : N, C, ldc != 0 ? ldc : N, std::max<size_t>(cutoff, 2));
+	}
+
+	/// check() の結果
+	struct CheckResult {
+		double residual; ///< max_i |(C x - A (B x))_i|
+		double bound;    ///< residual の上限
+		bool ok() const noexcept { return residual <= bound; } // NaN の場合は false
+	};
+
+	/**
+	 * @brief C = A * B の誤差が Strassen-Winograd 法の誤差の上限以内かどうかを Freivalds 法で確認します。(すべて行優先)
+	 *
+	 * 要素が [-1, 1] の乱数ベクトル x について C x と A (B x) を高い精度で計算し、差を比べます (計算量 O(MK + KN + MN))。
+	 * 上限には Higham の誤差解析 (Accuracy and Stability of Numerical Algorithms, 23.2) による Winograd 法の一次の上限
+	 *   |C - AB|_max <= ((K / n0)^log2(18) * (n0^2 + 6 n0) - 6 K) u |A|_max |B|_max
+	 * (n0 は再帰の末端の K、u は T の単位丸め誤差) を使い、これに N |x|_max を掛けた値と比べます。
+	 * 通常の丸め誤差では超えないため、超えた場合は計算の誤りかオーバーフローを示します。
+	 *
+	 * @param levels 再帰した段数 (levels() の値)
+	 * @param seed 乱数ベクトルのシード
+	 */
+	template<typename T>
+	inline CheckResult check(const T* A, const T* B, const T* C, size_t M, size_t N, size_t K,
+		size_t lda, size_t ldb, size_t ldc, size_t levels, unsigned seed = 0x5EED)
+	{
+		using Acc = std::conditional_t<(sizeof(T) < sizeof(double)), double, long double>;
+		lda = lda != 0 ? lda : K;
+		ldb = ldb != 0 ? ldb : N;
+		ldc = ldc != 0 ? ldc : N;
+
+		std::mt19937 engine(seed);
+		std::uniform_real_distribution<double> dist(-1.0, 1.0);
+		std::vector<Acc> x(N), bx(K, Acc(0));
+		for (Acc& v : x)
+			v = static_cast<Acc>(dist(engine));
+
+		Acc a_max = 0, b_max = 0;
+		for (size_t p = 0; p < K; p++) {
+			for (size_t j = 0; j < N; j++) {
+				const Acc b = static_cast<Acc>(B[p * ldb + j]);
+				bx[p] += b * x[j];
+				b_max = std::max<Acc>(b_max, std::abs(b));
+			}
+		}
+
+		Acc residual = 0;
+		for (size_t i = 0; i < M; i++) {
+			Acc abx = 0, cx = 0;
+			for (size_t p = 0; p < K; p++) {
+				const Acc a = static_cast<Acc>(A[i * lda + p]);
+				abx += a * bx[p];
+				a_max = std::max<Acc>(a_max, std::abs(a));
+			}
+			for (size_t j = 0; j < N; j++)
+				cx += static_cast<Acc>(C[i * ldc + j]) * x[j];
+			const Acc diff = std::abs(cx - abx);
+			residual = (diff > residual || std::isnan(static_cast<double>(diff))) ? diff : residual;
+		}
+
+		const double u = std::numeric_limits<T>::epsilon() / 2;
+		const double k = static_cast<double>(K);
+		const double n0 = std::max(1.0, k / std::ldexp(1.0, static_cast<int>(levels)));
+		const double growth = std::pow(k / n0, std::log2(18.0)) * (n0 * n0 + 6 * n0) - 6 * k;
+		// 確認自体の丸め誤差 (Acc で K + N 項を足す) も加える
+		const double check_error = static_cast<double>(std::numeric_limits<Acc>::epsilon()) * (k + static_cast<double>(N)) * 2;
+		const double bound = (std::max(growth, k) * u + check_error) * static_cast<double>(a_max * b_max) * static_cast<double>(N);
+		return { static_cast<double>(residual), bound };
+	}
+
+	/**
+	 * @brief BLASを使用しない場合の C = op(A) * op(B) を Algorithm に従って計算します。(引数は NativeGemm::MatMul::multiply と同じ)
+	 * @note Strassen-Winograd 法は float, double の転置なしで A と B のレイアウトが同じ場合だけ使用し、それ以外は NativeGemm で計算します。
+	 *       列優先の場合は C^T = B^T * A^T として行優先で計算します。
+	 */
+	template<GemmAlgorithm Algorithm, typename T>
+	inline void gemm(const T* A, const T* B, T* C, size_t M, size_t N, size_t K,
+		bool AMajor, bool BMajor, bool TransA, bool TransB,
+		size_t lda = 0, size_t ldb = 0, size_t ldc = 0)
+	{
+		if constexpr (Algorithm != GemmAlgorithm::Blocked && std::is_floating_point_v<T>) {
+			const size_t depth = levels(M, N, K);
+			if (!TransA && !TransB && AMajor == BMajor && depth > 0) {
+				if (AMajor)
+					multiply(A, B, C, M, N, K, lda, ldb, ldc);
+				else
+					multiply(B, A, C, N, M, K, ldb, lda, ldc);
+
+				if constexpr (Algorithm == GemmAlgorithm::StrassenChecked) {
+					const CheckResult result = AMajor
+						? check(A, B, C, M, N, K, lda, ldb, ldc, depth)
+						: check(B, A, C, N, M, K, ldb, lda, ldc, depth);
+					if (result.ok())
+						return;
+					// 上限を超えた場合は通常の行列積で計算し直す
+				}
+				else {
+					return;
+				}
+			}
+		}
+		NativeGemm::MatMul<T>::multiply(A, B, C, M, N, K, AMajor, BMajor, TransA, TransB, T(1), T(0), lda, ldb, ldc);
+	}
+}
+
+#endif // SANAE_NEURALNETWORK_STRASSEN
\ No newline at end of file
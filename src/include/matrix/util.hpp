@@ -1,8 +1,11 @@
 ﻿#ifndef SANAE_NEURALNETWORK_MATRIX_UTIL
 #define SANAE_NEURALNETWORK_MATRIX_UTIL
 
+#include "../threadpool/threadpool.h"
 #include "../view/view.h"
 #include "matrix.h"
+#include "philox.hpp"
+#include "simd.hpp"
 #include <algorithm>
 
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
@@ -21,25 +24,19 @@ inline const Container& Matrix<T, RowMajor, Container>::data() const noexcept
 	return this->_data;
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+inline size_t Matrix<T, RowMajor, Container>::ld() const noexcept
+{
+	return this->_ld;
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline Matrix<T, !RowMajor> Matrix<T, RowMajor, Container>::convertLayout() const
 {
 	Matrix<T, !RowMajor> result(this->rows(), this->cols());
-	
-	const size_t rows = this->rows();
-	const size_t cols = this->cols();
-	for (size_t i = 0; i < rows; i++) {
-		const size_t offset = i * cols;
-		for (size_t j = 0; j < cols; j++) {
-			if constexpr (RowMajor) {
-				// 行優先 → 列優先: before[i,j] = before[i*cols + j] → after[i,j] = after[j*rows + i]
-				result[j * rows + i] = this->_data[offset + j];
-			}
-			else {
-				// 列優先 → 行優先: before[i,j] = before[j*rows + i] → after[i,j] = after[i*cols + j]
-				result[offset + j] = this->_data[j * rows + i];
-			}
-		}
-	}
+
+	// 行優先 → 列優先: before[i*ld + j] → after[j*ld' + i] (列優先 → 行優先も同じ形の転置になる)
+	const size_t outer = RowMajor ? this->rows() : this->cols();
+	const size_t inner = RowMajor ? this->cols() : this->rows();
+	_transpose_lines(this->_data.data(), this->_ld, result.view().data(), result.ld(), outer, inner);
 
 	return result;
 }
@@ -47,12 +44,12 @@ template<typename T, bool RowMajor, typename Container> requires VectorOrArray<C
 inline View<T> Matrix<T, RowMajor, Container>::get_row(size_t row)
 {
 	if constexpr (RowMajor) {
-		View<T> view(&this->_data[row * this->cols()], this->cols());
+		View<T> view(&this->_data[row * this->_ld], this->cols());
 		return view;
 	}
 	else
 	{
-		View<T> view(&this->_data[row], this->cols(), this->rows());
+		View<T> view(&this->_data[row], this->cols(), this->_ld);
 		return view;
 	}
 }
@@ -60,35 +57,35 @@ template<typename T, bool RowMajor, typename Container> requires VectorOrArray<C
 inline View<T> Matrix<T, RowMajor, Container>::get_col(size_t col)
 {
 	if constexpr (!RowMajor) {
-		View<T> view(&this->_data[col * this->rows()], this->rows());
+		View<T> view(&this->_data[col * this->_ld], this->rows());
 		return view;
 	}
 	else
 	{
-		View<T> view(&this->_data[col], this->rows(), this->cols());
+		View<T> view(&this->_data[col], this->rows(), this->_ld);
 		return view;
 	}
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline T* Matrix<T, RowMajor, Container>::get_row_ptr(size_t row) requires RowMajor
 {
-	return &this->_data[row * this->cols()];
+	return &this->_data[row * this->_ld];
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline T* Matrix<T, RowMajor, Container>::get_col_ptr(size_t col) requires (!RowMajor)
 {
-	return &this->_data[col * this->rows()];
+	return &this->_data[col * this->_ld];
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline View<const T> Matrix<T, RowMajor, Container>::get_row(size_t row) const
 {
 	if constexpr (RowMajor) {
-		View<const T> view(&this->_data[row * this->cols()], this->cols());
+		View<const T> view(&this->_data[row * this->_ld], this->cols());
 		return view;
 	}
 	else
 	{
-		View<const T> view(&this->_data[row], this->cols(), this->rows());
+		View<const T> view(&this->_data[row], this->cols(), this->_ld);
 		return view;
 	}
 }
@@ -96,24 +93,34 @@ template<typename T, bool RowMajor, typename Container> requires VectorOrArray<C
 inline View<const T> Matrix<T, RowMajor, Container>::get_col(size_t col) const
 {
 	if constexpr (!RowMajor) {
-		View<const T> view(&this->_data[col * this->rows()], this->rows());
+		View<const T> view(&this->_data[col * this->_ld], this->rows());
 		return view;
 	}
 	else
 	{
-		View<const T> view(&this->_data[col], this->rows(), this->cols());
+		View<const T> view(&this->_data[col], this->rows(), this->_ld);
 		return view;
 	}
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline const T* Matrix<T, RowMajor, Container>::get_row_ptr(size_t row) const requires RowMajor
 {
-	return &this->_data[row * this->cols()];
+	return &this->_data[row * this->_ld];
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline const T* Matrix<T, RowMajor, Container>::get_col_ptr(size_t col) const requires (!RowMajor)
 {
-	return &this->_data[col * this->rows()];
+	return &this->_data[col * this->_ld];
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+inline MatrixView<T, RowMajor> Matrix<T, RowMajor, Container>::view()
+{
+	return MatrixView<T, RowMajor>(this->_data.data(), this->_rows, this->_cols, this->_ld);
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+inline MatrixView<const T, RowMajor> Matrix<T, RowMajor, Container>::view() const
+{
+	return MatrixView<const T, RowMajor>(this->_data.data(), this->_rows, this->_cols, this->_ld);
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline bool Matrix<T, RowMajor, Container>::is_blas_enabled() const
@@ -123,57 +130,90 @@ inline bool Matrix<T, RowMajor, Container>::is_blas_enabled() const
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::transpose()
 {
-	Container result{};
-	if constexpr (requires(Container& c) { c.resize(this->_data.size()); }) {
-		result.resize(this->_data.size());
+	// 正方行列は次元もリーディングディメンションも変わらないため、その場で転置する
+	if (this->_rows == this->_cols) {
+		this->_transpose_square_inplace();
+		return *this;
 	}
-	const size_t rows = this->rows();
-	const size_t cols = this->cols();
 
-	for (size_t i = 0; i < rows; i++) {
-		const size_t offset = i * cols;
-		for (size_t j = 0; j < cols; j++) {
-			if constexpr (RowMajor) {
-				// 転置: before[i,j] → after[j,i] (同じ行優先レイアウト)
-				result[j * rows + i] = this->_data[offset + j];
-			}
-			else {
-				// 転置: before[i,j] → after[j,i] (同じ列優先レイアウト)
-				result[offset + j] = this->_data[j * rows + i];
-			}
-		}
-	}
+	Matrix<T, RowMajor, Container> result = this->transpose_copy();
 
-	this->_rows = cols;
-	this->_cols = rows;
-	this->_data = std::move(result);
+	this->_rows = result._rows;
+	this->_cols = result._cols;
+	this->_ld = result._ld;
+	this->_data = std::move(result._data);
 	return *this;
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 inline Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::transpose_copy() const
 {
-	Container result{};
-	if constexpr (requires(Container& c) { c.resize(this->_data.size()); }) {
-		result.resize(this->_data.size());
-	}
 	const size_t rows = this->rows();
 	const size_t cols = this->cols();
+	Matrix<T, RowMajor, Container> result(cols, rows);
 
-	for (size_t i = 0; i < rows; i++) {
-		const size_t offset = i * cols;
-		for (size_t j = 0; j < cols; j++) {
-			if constexpr (RowMajor) {
-				// 転置: before[i,j] → after[j,i] (同じ行優先レイアウト)
-				result[j * rows + i] = this->_data[offset + j];
-			}
-			else {
-				// 転置: before[i,j] → after[j,i] (同じ列優先レイアウト)
-				result[offset + j] = this->_data[j * rows + i];
+	// 転置: before[i,j] → after[j,i] (同じメモリレイアウト)
+	const size_t outer = RowMajor ? rows : cols;
+	const size_t inner = RowMajor ? cols : rows;
+	_transpose_lines(this->_data.data(), this->_ld, result._data.data(), result._ld, outer, inner);
+
+	return result;
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+inline void Matrix<T, RowMajor, Container>::_transpose_lines(const T* src, size_t lds, T* dst, size_t ldd, size_t outer, size_t inner)
+{
+	constexpr size_t B = SimdKernel::transpose_block;
+	const size_t size = outer * inner;
+	if (size < ThreadPool::default_grain * 4) {
+		SimdKernel::transpose(src, lds, dst, ldd, outer, inner);
+		return;
+	}
+
+	// 書き込み先の行(列)の帯ごとに分割すると、各スレッドの書き込み先が重ならない
+	const size_t blocks = (inner + B - 1) / B;
+	const size_t grain = std::max<size_t>(ThreadPool::default_grain / (B * outer), 1);
+	ThreadPool::instance().parallel_for(0, blocks, grain, [&](size_t begin, size_t end) {
+		const size_t j0 = begin * B;
+		const size_t j1 = std::min(end * B, inner);
+		SimdKernel::transpose(src + j0, lds, dst + j0 * ldd, ldd, outer, j1 - j0);
+	});
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+inline void Matrix<T, RowMajor, Container>::_transpose_square_inplace()
+{
+	constexpr size_t B = SimdKernel::transpose_block;
+	const size_t n = this->_rows;
+	const size_t ld = this->_ld;
+	const size_t blocks = (n + B - 1) / B;
+	T* data = this->_data.data();
+
+	// ブロック行 bi について、対角ブロックと右側のブロック(およびその対称位置)を転置する
+	auto block_rows = [&](size_t begin, size_t end) {
+		std::vector<T> tmp(B * B);
+		for (size_t bi = begin; bi < end; bi++) {
+			const size_t i0 = bi * B;
+			const size_t ni = std::min(B, n - i0);
+			for (size_t bj = bi; bj < blocks; bj++) {
+				const size_t j0 = bj * B;
+				const size_t nj = std::min(B, n - j0);
+				T* upper = data + i0 * ld + j0; // (bi, bj)
+				T* lower = data + j0 * ld + i0; // (bj, bi)
+
+				// tmp = upper^T (nj x ni)
+				SimdKernel::transpose<T>(upper, ld, tmp.data(), B, ni, nj);
+				// upper = lower^T (対角ブロックの場合は upper と lower が同じため不要)
+				if (bi != bj)
+					SimdKernel::transpose<T>(lower, ld, upper, ld, nj, ni);
+				// lower = tmp
+				for (size_t j = 0; j < nj; j++)
+					std::copy(tmp.data() + j * B, tmp.data() + j * B + ni, lower + j * ld);
 			}
 		}
-	}
+	};
 
-	return Matrix<T, RowMajor, Container>(cols, rows, std::move(result));
+	if (n * n < ThreadPool::default_grain * 4)
+		block_rows(0, blocks);
+	else
+		ThreadPool::instance().parallel_for(0, blocks, 1, block_rows);
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<typename Func, typename ExecPolicy>
@@ -183,12 +223,19 @@ requires
     std::convertible_to<std::invoke_result_t<Func, T>, T> &&
     StdExecPolicy<ExecPolicy>
 {
-	std::transform(execPolicy, this->_data.begin(), this->_data.end(), this->_data.begin(), func);
+	T* const data = this->_data.data(); // 格納領域の共有の解除はスレッドに分割する前に行う
+	this->_for_each_span(execPolicy, [&](size_t offset, size_t length) {
+		T* ptr = data + offset;
+		if constexpr (SimdKernel::has_unary_v<T, Func>)
+			SimdKernel::unary<SimdKernel::unary_op_of<Func>::op>(ptr, ptr, length);
+		else
+			std::transform(ptr, ptr + length, ptr, func);
+	});
 	return *this;
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<typename Func, typename ExecPolicy>
-Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::apply_copy(Func func, ExecPolicy execPolicy) const
+Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::apply_copy(Func func, ExecPolicy execPolicy) const&
 requires
     std::invocable<Func, T> &&
     std::convertible_to<std::invoke_result_t<Func, T>, T> &&
@@ -198,8 +245,87 @@ requires
 	if constexpr (requires(Container& c) { c.resize(this->_data.size()); }) {
 		result.resize(this->_data.size());
 	}
-	std::transform(execPolicy, this->_data.begin(), this->_data.end(), result.begin(), func);
-	return Matrix<T, RowMajor, Container>(this->rows(), this->cols(), std::move(result));
+	this->_for_each_span(execPolicy, [&](size_t offset, size_t length) {
+		const T* ptr = this->_data.data() + offset;
+		T* out = result.data() + offset;
+		if constexpr (SimdKernel::has_unary_v<T, Func>)
+			SimdKernel::unary<SimdKernel::unary_op_of<Func>::op>(ptr, out, length);
+		else
+			std::transform(ptr, ptr + length, out, func);
+	});
+	return Matrix<T, RowMajor, Container>(this->rows(), this->cols(), this->_ld, std::move(result));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename Func, typename ExecPolicy>
+Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::apply_copy(Func func, ExecPolicy execPolicy) &&
+requires
+    std::invocable<Func, T> &&
+    std::convertible_to<std::invoke_result_t<Func, T>, T> &&
+    StdExecPolicy<ExecPolicy>
+{
+	return std::move(this->apply(func, execPolicy));
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename ExecPolicy>
+Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::fill_uniform(T lo, T hi, uint64_t seed, uint64_t stream, ExecPolicy execPolicy)
+	requires StdExecPolicy<ExecPolicy>
+{
+	using R = Philox::real_t<T>;
+	const size_t inner = RowMajor ? this->cols() : this->rows();
+	const size_t ld = std::max<size_t>(this->_ld, 1);
+	T* const data = this->_data.data(); // 格納領域の共有の解除はスレッドに分割する前に行う
+	this->_for_each_span(execPolicy, [&](size_t offset, size_t length) {
+		// 乱数の番号はパディングを除いた格納順の要素番号にする
+		const size_t index = (offset / ld) * inner + offset % ld;
+		Philox::uniform(data + offset, length, seed, stream, index, static_cast<R>(lo), static_cast<R>(hi));
+	});
+	return *this;
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename ExecPolicy>
+Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::fill_normal(T mean, T stddev, uint64_t seed, uint64_t stream, ExecPolicy execPolicy)
+	requires StdExecPolicy<ExecPolicy>
+{
+	using R = Philox::real_t<T>;
+	const size_t inner = RowMajor ? this->cols() : this->rows();
+	const size_t ld = std::max<size_t>(this->_ld, 1);
+	T* const data = this->_data.data();
+	this->_for_each_span(execPolicy, [&](size_t offset, size_t length) {
+		const size_t index = (offset / ld) * inner + offset % ld;
+		Philox::normal(data + offset, length, seed, stream, index, static_cast<R>(mean), static_cast<R>(stddev));
+	});
+	return *this;
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename ExecPolicy>
+Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::fill_bernoulli(double p, uint64_t seed, uint64_t stream, ExecPolicy execPolicy)
+	requires StdExecPolicy<ExecPolicy>
+{
+	const size_t inner = RowMajor ? this->cols() : this->rows();
+	const size_t ld = std::max<size_t>(this->_ld, 1);
+	T* const data = this->_data.data();
+	this->_for_each_span(execPolicy, [&](size_t offset, size_t length) {
+		const size_t index = (offset / ld) * inner + offset % ld;
+		Philox::bernoulli(data + offset, length, seed, stream, index, p);
+	});
+	return *this;
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename ExecPolicy>
+Matrix<T, RowMajor, Container> Matrix<T, RowMajor, Container>::gather_rows(std::span<const size_t> indices, ExecPolicy execPolicy) const
+	requires StdExecPolicy<ExecPolicy>
+{
+	Matrix<T, RowMajor, Container> result(indices.size(), this->cols());
+	this->view().gather_rows_into(indices, result.view(), execPolicy);
+	return result;
+}
+template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
+template<typename ExecPolicy>
+Matrix<T, RowMajor, Container>& Matrix<T, RowMajor, Container>::scatter_add_rows(std::span<const size_t> indices, const Matrix& src, ExecPolicy execPolicy)
+	requires StdExecPolicy<ExecPolicy>
+{
+	this->view().scatter_add_rows(indices, src.view(), execPolicy);
+	return *this;
 }
 template<typename T, bool RowMajor, typename Container> requires VectorOrArray<Container>
 template<typename CalcType, typename ExecPolicy>
@@ -212,7 +338,26 @@ requires
     const size_t rowCount = this->rows();
     const size_t colCount = this->cols();
 
-	if constexpr (RowMajor){
+	if constexpr (is_parallel_policy_v<ExecPolicy>) {
+		// 並列ポリシーの場合は行(列優先の場合は列)単位でスレッドプールに分割する
+		const size_t lineCount = RowMajor ? rowCount : colCount;
+		const size_t lineLength = RowMajor ? colCount : rowCount;
+		const size_t grain = std::max<size_t>(ThreadPool::default_grain / std::max<size_t>(lineLength, 1), 1);
+
+		T* const base = this->_data.data(); // 格納領域の共有の解除はスレッドに分割する前に行う
+		ThreadPool::instance().parallel_for(0, lineCount, grain, [&](size_t begin, size_t end) {
+			for (size_t line = begin; line < end; line++) {
+				T* linePtr = base + line * this->_ld;
+				for (size_t i = 0; i < lineLength; i++) {
+					if constexpr (RowMajor)
+						linePtr[i] = operation(linePtr[i], data[i]);
+					else
+						linePtr[i] = operation(linePtr[i], data[line]);
+				}
+			}
+		});
+	}
+	else if constexpr (RowMajor){
 		for (size_t r = 0; r < rowCount; r++) {
 			T* rowPtr = this->get_row_ptr(r); // 行優先のみ
 			
@@ -246,24 +391,43 @@ requires
 	const size_t rowCount = this->rows();
 	const size_t colCount = this->cols();
 
+	// 並列ポリシーの場合は行(列優先の場合は列)単位でスレッドプールに分割する
+	if constexpr (is_parallel_policy_v<ExecPolicy>) {
+		const size_t lineCount = RowMajor ? rowCount : colCount;
+		const size_t lineLength = RowMajor ? colCount : rowCount;
+		const size_t grain = std::max<size_t>(ThreadPool::default_grain / std::max<size_t>(lineLength, 1), 1);
+
+		ThreadPool::instance().parallel_for(0, lineCount, grain, [&](size_t begin, size_t end) {
+			for (size_t line = begin; line < end; line++) {
+				const T* linePtr = &this->_data[line * this->_ld];
+				T* outPtr = &result[line * this->_ld];
+				for (size_t i = 0; i < lineLength; i++) {
+					if constexpr (RowMajor)
+						outPtr[i] = operation(linePtr[i], data[i]);
+					else
+						outPtr[i] = operation(linePtr[i], data[line]);
+				}
+			}
+		});
+	}
 	// 行優先
-	if constexpr (RowMajor) {
+	else if constexpr (RowMajor) {
 		for (size_t r = 0; r < rowCount; r++) {
 			const T* rowPtr = this->get_row_ptr(r); // 行優先のみ
-			std::transform(execPolicy, rowPtr, rowPtr + colCount, data.begin(), &result[r * colCount], operation);
+			std::transform(execPolicy, rowPtr, rowPtr + colCount, data.begin(), &result[r * this->_ld], operation);
 		}
 	}
 	// 列優先
 	else {
 		for (size_t c = 0; c < colCount; c++) {
 			const T* colPtr = this->get_col_ptr(c);
-			T* outPtr = &result[c * rowCount];
+			T* outPtr = &result[c * this->_ld];
 
 			std::transform(execPolicy, colPtr, colPtr + rowCount, outPtr, [&](const T& a){ return operation(a, data[c]); });
 		}
 	}
 
-	return Matrix<T, RowMajor, Container>(this->rows(), this->cols(), std::move(result));
+	return Matrix<T, RowMajor, Container>(this->rows(), this->cols(), this->_ld, std::move(result));
 }
 
 #endif // SANAE_NEURALNETWORK_MATRIX_UTIL
\ No newline at end of file
@@ -4,11 +4,15 @@
 #include "layerbase.hpp"
 #include "../../matrix/matrix"
 #include "optimizer.hpp"
+#include "quantizedaffine.hpp"
 #include <execution>
 #include <iostream>
 #include <math.h>
 #include <random>
 #include <functional>
+#include <memory>
+#include <span>
+#include <utility>
 
 class StandardDeviation {
 public:
@@ -34,9 +38,15 @@ template<typename ty, bool use_blas = true, typename ExecType = std::execution::
 requires DerivedOptimizer<OptimizerType, ty> && StdExecPolicy<ExecType> && StdDeviation<DeviationType>
 class Affine : public LayerBase<ty> {
 private:
-    Matrix<ty> _in; // (batch, in_dim)
+    Matrix<ty> _in; // (batch, in_dim) forward(const Matrix&) で受け取った入力のコピー
+    MatrixView<const ty> _in_view; // backward で使用する入力。_in または forward(MatrixView) で受け取ったビューを参照する
+    std::span<const size_t> _in_rows; // forward(const GatheredRows&) で受け取った行の添字。_in_view はデータセット全体を参照する
+    bool _gathered_input = false; // 直前の forward の入力が添字で選んだ行かどうか
+    SparseMatrix<ty> _sparse_in; // forward(const SparseMatrix&) で受け取った入力のコピー
+    bool _sparse_input = false; // 直前の forward の入力が疎行列かどうか
     Matrix<ty> _w;  // (in_dim, out_dim)
     Matrix<ty> _b;  // (1, out_dim)
+    Matrix<ty> _dw; // (in_dim, out_dim) 勾配用のバッファ。毎回確保せずに再利用する
 
 public:
     static constexpr bool is_affine = true;
@@ -47,22 +57,29 @@ public:
     Affine(size_t input_size, size_t output_size, ty lr = 0.01f, uint32_t seed = std::random_device{}(), DeviationType dev = DeviationType{})
         : _w(input_size, output_size),
           _b(1, output_size),
+          _dw(input_size, output_size),
           optimizer(_w, _b, lr)
     {
-        std::default_random_engine engine(seed);
-        std::normal_distribution<ty> dist(0, dev(input_size));
-
-        _w = Matrix<ty>(input_size, output_size, [&](){ return dist(engine); });
-        _b = Matrix<ty>(1, output_size, [&](){ return dist(engine); });
+        // カウンタベースの乱数で初期化するため、並列に生成しても seed が同じなら同じ値になる
+        // (16ビット浮動小数点数の場合は float で乱数を生成してから丸める)
+        const ty stddev = static_cast<ty>(dev(input_size));
+        _w.fill_normal(ty(0), stddev, seed, 0, ExecType{});
+        _b.fill_normal(ty(0), stddev, seed, 1, ExecType{});
     }
 
     Matrix<ty> forward(const Matrix<ty>& in) override {
         _in = in; // (batch, in_dim)
-
-        Matrix<ty> out = in;
+        return this->forward(_in.view());
+    }
+    Matrix<ty> forward(MatrixView<const ty> in) override {
+        _in_view = in; // ミニバッチなどのビューはコピーせずに保持する
+        _sparse_input = false;
+        _gathered_input = false;
 
         try{
-            out.template matrix_mul<use_blas>(_w);
+            // 入力をコピーせずに出力へ直接書き込む
+            Matrix<ty> out(in.rows(), _w.cols());
+            gemm_into<use_blas>(out, in, _w);
             out.apply_row(_b.data(), std::plus<ty>(), ExecType{}); // 各行にバイアスを加算
 
             return out; // (batch, out_dim)
@@ -71,21 +88,79 @@ public:
             throw;
         }
     }
+    /**
+     * @brief 疎行列の入力を密行列に変換せずに順伝播を行います。
+     * @note 計算量は (入力の非ゼロ要素数) * out_dim です。backward の dW も疎行列のまま計算します。
+     */
+    Matrix<ty> forward(const SparseMatrix<ty>& in) override {
+        _sparse_in = in;
+        _sparse_input = true;
+        _gathered_input = false;
+
+        Matrix<ty> out(in.rows(), _w.cols());
+        spmm_into(out, _sparse_in, _w);
+        out.apply_row(_b.data(), std::plus<ty>(), ExecType{});
+        return out; // (batch, out_dim)
+    }
+    /**
+     * @brief データセットから添字で選んだ行を、ミニバッチの行列にコピーせずに順伝播します。
+     * @note ネイティブのGEMMはパック時に添字で行を読みます。backward の dW も同じ添字で計算します。
+     */
+    Matrix<ty> forward(const GatheredRows<ty>& in) override {
+        _in_view = in.source;
+        _in_rows = in.indices;
+        _sparse_input = false;
+        _gathered_input = true;
+
+        Matrix<ty> out(in.rows(), _w.cols());
+        gemm_gathered_into<use_blas>(out, in.source, in.indices, _w);
+        out.apply_row(_b.data(), std::plus<ty>(), ExecType{});
+        return out; // (batch, out_dim)
+    }
+
+    /// 重み (in_dim, out_dim)
+    const Matrix<ty>& weight() const noexcept { return _w; }
+    /// バイアス (1, out_dim)
+    const Matrix<ty>& bias() const noexcept { return _b; }
+
+    std::unique_ptr<LayerBase<ty>> quantize(MatrixView<const ty> calibration) const override {
+        return std::make_unique<QuantizedAffine<ty>>(_w, _b, calibration);
+    }
+
+    /**
+     * @note 入力が疎行列だった場合はネットワークの入力層なので dx を計算せず、0行0列の行列を返します。
+     */
     Matrix<ty> backward(const Matrix<ty>& dout) override {
-        // dx = dout * W^T
-        Matrix<ty> wt = _w.transpose_copy();
-        Matrix<ty> dx = dout.template matrix_mul_copy<use_blas>(wt);
+        Matrix<ty> dx;
+        if (_sparse_input) {
+            // dW = X^T * dout (疎行列の非ゼロ要素だけを使う)
+            spmm_into<true>(_dw, _sparse_in, dout);
+        } else {
+            // dx = dout * W^T (転置行列は作らずにGEMMの転置フラグで計算する)
+            dx = dout.template matrix_mul_copy<use_blas, false, true>(_w);
 
-        // dW = X^T * dout
-        Matrix<ty> in_t = _in.transpose_copy();
-        Matrix<ty> dw = in_t.template matrix_mul_copy<use_blas>(dout);
+            // dW = X^T * dout (確保済みのバッファに書き込む)
+            if (_gathered_input)
+                gemm_gathered_into<use_blas, true, false>(_dw, _in_view, _in_rows, dout);
+            else
+                gemm_into<use_blas, true, false>(_dw, _in_view, dout);
+        }
 
         // db = sum(dout, axis=0)
-        Matrix<ty> db = dout.sum_rows(); // (1, out_dim)
+        Matrix<ty> db = dout.sum_rows(ExecType{}); // (1, out_dim)
 
-        optimizer.optimize(dw, db);
+        optimizer.optimize(_dw, db);
         return dx;
     }
+
+    void clear_cache() override {
+        _in = Matrix<ty>();
+        _in_view = {};
+        _in_rows = {};
+        _gathered_input = false;
+        _sparse_in = SparseMatrix<ty>();
+        _sparse_input = false;
+    }
 };
 
 #endif //SANAE_NEURALNETWORK_AFFINE_HPP
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <execution>
 #include <cmath>
 #include <stdexcept>
+#include <tuple>
 #include <vector>
 #include "layerbase.hpp"
 #include "../../matrix/matrix" // MatrixクラスとStdExecPolicyコンセプト
@@ -19,15 +20,17 @@ private:
     std::vector<ty> running_mean; // 推論用
     std::vector<ty> running_var;  // 推論用
 
-    std::vector<ty> muB;      // 学習時のバッチ平均
-    std::vector<ty> sigma2B;  // 学習時のバッチ分散
-    std::vector<ty> inv;      // 1/sqrt(var+eps)
+    MatrixVector<ty> muB;      // 学習時のバッチ平均
+    MatrixVector<ty> sigma2B;  // 学習時のバッチ分散
+    MatrixVector<ty> inv;      // 1/sqrt(var+eps)
 
     Matrix<ty> xhat;          // 学習時のみ保持
     ty eps = static_cast<ty>(1e-7);
     ty momentum = static_cast<ty>(0.9);
 
 public:
+    using LayerBase<ty>::forward;
+
     ty lr = static_cast<ty>(0.01);
 
     /**
@@ -57,11 +60,8 @@ public:
 
         // 学習
         if (this->training) {
-            muB = in.sum_rows().data();
-            for (auto& v : muB) v /= rows;
-
-            sigma2B = in.apply_row_copy(muB, [](ty a, ty b){ return (a - b)*(a - b); }).sum_rows().data();
-            for (auto& v : sigma2B) v /= rows;
+            // バッチ平均と分散を1回の走査で求める
+            std::tie(muB, sigma2B) = in.view().mean_var_rows(ExecPolicy{});
 
             // running update
             for (size_t j = 0; j < cols; j++) {
@@ -74,13 +74,17 @@ public:
             for (size_t j = 0; j < cols; j++)
                 inv[j] = static_cast<ty>(1) / std::sqrt(sigma2B[j] + eps);
 
-            xhat = in.apply_row_copy(muB, [](ty a, ty b){ return a - b; });
-            xhat.apply_row(inv, [](ty a, ty b){ return a * b; });
-
             // y = γ[j] * xhat + β[j]
-            for (size_t i = 0; i < rows; i++)
-                for (size_t j = 0; j < cols; j++)
-                    out(i,j) = gamma[j] * xhat(i,j) + beta[j];
+            xhat = Matrix<ty>(rows, cols);
+            for (size_t i = 0; i < rows; i++) {
+                const ty* x = in.get_row_ptr(i);
+                ty* xh = xhat.get_row_ptr(i);
+                ty* y = out.get_row_ptr(i);
+                for (size_t j = 0; j < cols; j++) {
+                    xh[j] = (x[j] - muB[j]) * inv[j];
+                    y[j] = gamma[j] * xh[j] + beta[j];
+                }
+            }
 
         } else {
             inv.resize(cols);
@@ -92,11 +96,12 @@ public:
             for (size_t j = 0; j < cols; j++)
                 inv[j] = static_cast<ty>(1) / std::sqrt(running_var[j] + eps);
 
-            for (size_t i = 0; i < rows; i++)
-                for (size_t j = 0; j < cols; j++) {
-                    ty xhat_ij = (in(i,j) - running_mean[j]) * inv[j];
-                    out(i,j) = gamma[j] * xhat_ij + beta[j];
-                }
+            for (size_t i = 0; i < rows; i++) {
+                const ty* x = in.get_row_ptr(i);
+                ty* y = out.get_row_ptr(i);
+                for (size_t j = 0; j < cols; j++)
+                    y[j] = gamma[j] * ((x[j] - running_mean[j]) * inv[j]) + beta[j];
+            }
         }
 
         return out;
@@ -119,43 +124,34 @@ public:
         const size_t cols = dout.cols();
         Matrix<ty> dx(rows, cols);
 
-        // dγ[j], dβ[j]
-        std::vector<ty> dgamma(cols, 0), dbeta(cols, 0);
-
-        for (size_t j = 0; j < cols; j++) {
-            for (size_t i = 0; i < rows; i++) {
-                dgamma[j] += dout(i,j) * xhat(i,j);
-                dbeta[j]  += dout(i,j);
-            }
-        }
+        // dγ[j], dβ[j] (dx の計算に使う Σdout, Σdout*xhat と同じ値)
+        const Matrix<ty> dgamma = dout.hadamard_mul_copy(xhat, ExecPolicy{}).sum_rows(ExecPolicy{});
+        const Matrix<ty> dbeta = dout.sum_rows(ExecPolicy{});
 
         // update γ, β
         for (size_t j = 0; j < cols; j++) {
-            gamma[j] -= lr * dgamma[j];
-            beta[j]  -= lr * dbeta[j];
+            gamma[j] -= lr * dgamma(0,j);
+            beta[j]  -= lr * dbeta(0,j);
         }
 
         // dx
-        for (size_t j = 0; j < cols; j++) {
-            ty inv_std = inv[j];
-
-            ty sum_dout = 0;
-            ty sum_dout_xhat = 0;
-
-            for (size_t i = 0; i < rows; i++) {
-                sum_dout += dout(i,j);
-                sum_dout_xhat += dout(i,j) * xhat(i,j);
-            }
-
-            for (size_t i = 0; i < rows; i++) {
-                dx(i,j) =
-                    gamma[j] * (1.0 / rows) * inv_std *
-                    (rows * dout(i,j) - sum_dout - xhat(i,j) * sum_dout_xhat);
-            }
+        MatrixVector<ty> scale(cols);
+        for (size_t j = 0; j < cols; j++)
+            scale[j] = gamma[j] * (static_cast<ty>(1) / rows) * inv[j];
+
+        const ty n = static_cast<ty>(rows);
+        for (size_t i = 0; i < rows; i++) {
+            const ty* d = dout.get_row_ptr(i);
+            const ty* xh = xhat.get_row_ptr(i);
+            ty* out = dx.get_row_ptr(i);
+            for (size_t j = 0; j < cols; j++)
+                out[j] = scale[j] * (n * d[j] - dbeta(0,j) - xh[j] * dgamma(0,j));
         }
 
         return dx;
     }
+
+    void clear_cache() override { xhat = Matrix<ty>(); }
 };
 
 #endif //SANAE_NEURALNETWORK_BATCHNORMALIZATION_HPP
\ No newline at end of file
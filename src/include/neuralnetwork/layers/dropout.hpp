@@ -17,11 +17,11 @@ private:
     Matrix<ty> _mask; // ドロップアウトマスク
     uint32_t _seed; // 乱数シード
     ty _dropout_ratio;
-
-    std::default_random_engine _engine;
-    std::bernoulli_distribution _dist;
+    uint64_t _step = 0; // マスクを生成した回数 (乱数の stream 番号に使う)
 
 public:
+    using LayerBase<ty>::forward;
+
     static constexpr std::string_view name() { return "Dropout"; }
     
     Dropout(ty dropout_ratio = 0.5f, uint32_t seed = std::random_device{}()) {
@@ -31,9 +31,6 @@ public:
 
         this->_dropout_ratio = dropout_ratio;
         this->_seed = seed;
-
-        this->_engine = std::default_random_engine(this->_seed);
-        this->_dist = std::bernoulli_distribution(1.0 - this->_dropout_ratio);
     }
     
     /**
@@ -41,11 +38,13 @@ public:
      * @param in 入力
      * @return 出力
      * @note out = in ⊙ mask (学習時), out = in * (1 - dropout_ratio) (推論時)  
+     * @note マスクは (seed, 呼び出し回数, 要素番号) から生成するため、並列に生成しても seed が同じなら同じになります。
      */
     Matrix<ty> forward(const Matrix<ty>& in) override{
         try{
             if(this->training){
-               _mask = Matrix<ty>(in.rows(), in.cols(), [&](){ return _dist(_engine) ? static_cast<ty>(1) : static_cast<ty>(0); });
+                _mask = Matrix<ty>(in.rows(), in.cols());
+                _mask.fill_bernoulli(1.0 - this->_dropout_ratio, this->_seed, this->_step++, ExecPolicy{});
                 return in.hadamard_mul_copy(_mask, ExecPolicy{});
             }else{
                 return in.template scalar_mul_copy<true>(1.0f - this->_dropout_ratio, ExecPolicy{});
@@ -74,6 +73,8 @@ public:
             throw;
         }
     }
+
+    void clear_cache() override { _mask = Matrix<ty>(); }
 };
 
 #endif //SANAE_NEURALNETWORK_DROPOUT_HPP
\ No newline at end of file
@@ -17,6 +17,8 @@ private:
     Matrix<ty> _out; // 出力の保存用
 
 public:
+    using LayerBase<ty>::forward;
+
     static constexpr std::string_view name() { return "IdentityWithLoss"; }
     static constexpr bool has_loss = true; // loss関数を所有
 
@@ -80,6 +82,8 @@ public:
             throw;
         }
     }
+
+    void clear_cache() override { this->_out = Matrix<ty>(); }
 };
 
 #endif //SANAE_NEURALNETWORK_IDENTITYWITHLOSS_HPP
\ No newline at end of file
@@ -2,9 +2,33 @@
 #define NEURALNETWORK_LAYERBASE_HPP
 
 #include "../../matrix/matrix"
+#include <execution>
+#include <memory>
+#include <span>
 #include <string>
 #include <string_view>
 
+/**
+ * @brief データセットの行を添字で選んだミニバッチ。i 行目は source の indices[i] 行目を表します。
+ * @note 行をコピーせずに保持します。先頭の Affine レイヤは乗算時に source を添字で直接読みます。
+ * @note source と indices の参照先は対応する backward の呼び出しが終わるまで有効である必要があります。
+ */
+template<typename ty>
+struct GatheredRows {
+    MatrixView<const ty> source;
+    std::span<const size_t> indices;
+
+    size_t rows() const noexcept { return indices.size(); }
+    size_t cols() const noexcept { return source.cols(); }
+
+    /// 選んだ行を並べた行列を作成します。
+    Matrix<ty> to_dense() const {
+        Matrix<ty> result(rows(), cols());
+        source.gather_rows_into(indices, result.view(), std::execution::par);
+        return result;
+    }
+};
+
 // ベースレイヤー
 template<typename ty>
 class LayerBase {
@@ -18,6 +42,38 @@ public:
     virtual ~LayerBase() = default;
     virtual Matrix<ty> forward(const Matrix<ty>&) = 0;
     virtual Matrix<ty> backward(const Matrix<ty>&) = 0;
+
+    /**
+     * @brief 行列のビューを入力として順伝播を行います。
+     * @note 既定では入力をコピーして forward(const Matrix&) を呼び出します。コピーせずに扱えるレイヤはオーバーライドします。
+     * @note in の参照先は対応する backward の呼び出しが終わるまで有効である必要があります。
+     */
+    virtual Matrix<ty> forward(MatrixView<const ty> in) { return this->forward(Matrix<ty>(in)); }
+
+    /**
+     * @brief 疎行列を入力として順伝播を行います。
+     * @note 既定では密行列に変換して forward(const Matrix&) を呼び出します。疎行列のまま計算できるレイヤはオーバーライドします。
+     */
+    virtual Matrix<ty> forward(const SparseMatrix<ty>& in) { return this->forward(in.to_dense()); }
+
+    /**
+     * @brief データセットから添字で選んだ行を入力として順伝播を行います。
+     * @note 既定では選んだ行を並べた行列を作って forward(const Matrix&) を呼び出します。添字のまま計算できるレイヤはオーバーライドします。
+     */
+    virtual Matrix<ty> forward(const GatheredRows<ty>& in) { return this->forward(in.to_dense()); }
+
+    /**
+     * @brief int8 で推論するように量子化したレイヤを作ります。
+     * @param calibration このレイヤに入る代表的な入力。行数が0の場合は推論時に入力ごとに量子化します。
+     * @return 量子化したレイヤ。量子化に対応していないレイヤは nullptr を返します。
+     */
+    virtual std::unique_ptr<LayerBase<ty>> quantize([[maybe_unused]] MatrixView<const ty> calibration) const { return nullptr; }
+
+    /**
+     * @brief 逆伝播のために保存している行列を破棄します。
+     * @note 保存した行列はステップごとに確保し直さないように保持し続けます。学習を終えてメモリを解放したい場合に呼び出します。
+     */
+    virtual void clear_cache() {}
 };
 
 #endif //NEURALNETWORK_LAYERBASE_HPP
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <math.h>
 #include <concepts>
+#include <stdexcept>
 
 template<typename ty>
 class Optimizer {
@@ -21,6 +22,27 @@ public:
 
     virtual ~Optimizer() = default;
     virtual void optimize(Matrix<ty>&, Matrix<ty>&) = 0;
+
+protected:
+    /**
+     * @brief パラメータの要素ごとの更新 func(begin, end) を実行します。
+     * @tparam execPolicy 並列の実行ポリシーの場合は範囲に分けてスレッドプールで実行します。
+     * @param param 更新するパラメータ (要素数とパラメータの形状の確認に使います)
+     * @param grad パラメータの勾配
+     * @throws std::invalid_argument 勾配とパラメータの次元が一致しない場合
+     * @note パラメータ・勾配・状態の行列は詰めて格納されている (Matrix<ty> の既定のコンテナ) ものとして、同じ添字の要素を更新します。
+     */
+    template<typename execPolicy, typename Func>
+    static void _update(const Matrix<ty>& param, const Matrix<ty>& grad, Func&& func) {
+        if (param.rows() != grad.rows() || param.cols() != grad.cols())
+            throw std::invalid_argument("Gradient dimensions must agree with the parameters.");
+
+        const size_t size = param.rows() * param.cols();
+        if constexpr (is_parallel_policy_v<execPolicy>)
+            ThreadPool::instance().parallel_for(0, size, ThreadPool::default_grain, func);
+        else
+            func(size_t(0), size);
+    }
 };
 
 template<typename T, typename ty>
@@ -41,9 +63,9 @@ public:
 
     inline void optimize(Matrix<ty>& dw, Matrix<ty>& db) override {
         try{
-            // パラメータの更新
-            this->_w = this->_w - dw.template scalar_mul_copy<use_blas>(this->_learning_rate, execPolicy{}); // w1 = w0 - dL/dw = w0 - in^T * dout * η
-            this->_b = this->_b - db.template scalar_mul_copy<use_blas>(this->_learning_rate, execPolicy{}); // b1 = b0 - dL/db = b0 - dout * η
+            // パラメータの更新 (axpyカーネルで1回のループで計算する)
+            this->_w.template axpy<use_blas>(-this->_learning_rate, dw, execPolicy{}); // w1 = w0 - dL/dw = w0 - in^T * dout * η
+            this->_b.template axpy<use_blas>(-this->_learning_rate, db, execPolicy{}); // b1 = b0 - dL/db = b0 - dout * η
         }
         catch(const std::exception& e){
             std::cerr << "Error in SGD::optimize: " << e.what() << std::endl;
@@ -75,13 +97,24 @@ public:
     }
 
     inline void optimize(Matrix<ty>& dw, Matrix<ty>& db) override {
-        // vW = momentum * vW - lr * dW
-        _vW = _vW.template scalar_mul_copy<use_blas>(this->_momentum, execPolicy{}) - dw.template scalar_mul_copy<use_blas>(this->_learning_rate, execPolicy{});
-        _w  = _w + _vW;
+        this->_step(_w, _vW, dw);
+        this->_step(_b, _vB, db);
+    }
 
-        // vB = momentum * vB - lr * dB
-        _vB = _vB.template scalar_mul_copy<use_blas>(this->_momentum, execPolicy{}) - db.template scalar_mul_copy<use_blas>(this->_learning_rate, execPolicy{});
-        _b  = _b + _vB;
+private:
+    // v = momentum * v - lr * d, p = p + v を要素ごとに1回の走査で計算する
+    void _step(Matrix<ty>& param, Matrix<ty>& velocity, const Matrix<ty>& grad) {
+        ty* p = param.view().data();
+        ty* v = velocity.view().data();
+        const ty* g = grad.data().data();
+        const ty momentum = this->_momentum, lr = this->_learning_rate;
+
+        Optimizer<ty>::template _update<execPolicy>(param, grad, [=](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                v[i] = v[i] * momentum - g[i] * lr;
+                p[i] = p[i] + v[i];
+            }
+        });
     }
 };
 template<typename ty, bool use_blas = false, typename execPolicy = std::execution::sequenced_policy>
@@ -102,36 +135,31 @@ public:
 
     inline void optimize(Matrix<ty>& dw, Matrix<ty>& db) override {
         try{
-            // W更新
-            // hw = hw + dw ⊙ dw
-            this->_hw = this->_hw + dw.hadamard_mul_copy(dw, execPolicy{});
-
-            // scale = 1 / sqrt(hw + ε)
-            Matrix<ty> scale = this->_hw.apply_copy([](ty d){ return static_cast<ty>(1)/std::sqrt(d + 1e-8);}, execPolicy{});
-
-            // update = scale ⊙ dw * η
-            Matrix<ty> updateW = scale.hadamard_mul_copy(dw, execPolicy{}).template scalar_mul<use_blas>(this->_learning_rate, execPolicy{});
-
-            // W更新
-            // w = w - update
-            this->_w = this->_w - updateW;
-
-            // hb = hb + db ⊙ db
-            this->_hb = this->_hb + db.hadamard_mul_copy(db, execPolicy{});
-
-            // scale = 1 / sqrt(hb + ε)
-            scale = this->_hb.apply_copy([](ty d){ return static_cast<ty>(1)/std::sqrt(d + 1e-8);}, execPolicy{});
-
-            // update = scale ⊙ db * η
-            Matrix<ty> updateB = scale.hadamard_mul_copy(db, execPolicy{}).template scalar_mul<use_blas>(this->_learning_rate, execPolicy{});
-
-            this->_b = this->_b - updateB;
+            this->_step(this->_w, this->_hw, dw);
+            this->_step(this->_b, this->_hb, db);
         }
         catch(const std::exception& e){
             std::cerr << "Error in AdaGrad optimize: " << e.what() << std::endl;
             throw;
         }
     }
+
+private:
+    // h = h + d ⊙ d, p = p - (1 / sqrt(h + ε)) ⊙ d * η を要素ごとに1回の走査で計算する
+    void _step(Matrix<ty>& param, Matrix<ty>& h, const Matrix<ty>& grad) {
+        ty* p = param.view().data();
+        ty* hp = h.view().data();
+        const ty* g = grad.data().data();
+        const ty lr = this->_learning_rate;
+
+        Optimizer<ty>::template _update<execPolicy>(param, grad, [=](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                hp[i] = hp[i] + g[i] * g[i];
+                const ty scale = static_cast<ty>(static_cast<ty>(1) / std::sqrt(hp[i] + 1e-8));
+                p[i] = p[i] - (scale * g[i]) * lr;
+            }
+        });
+    }
 };
 template<typename ty, bool use_blas = false, typename execPolicy = std::execution::sequenced_policy>
 requires StdExecPolicy<execPolicy>
@@ -170,102 +198,41 @@ public:
         try{
             this->_time += 1;
 
-            // ---- W ----
-            // m = β1*m + (1-β1)*dw
-            {
-                Matrix<ty> tmp_m = this->_wm;
-                tmp_m.template scalar_mul<use_blas>(this->_momentum, execPolicy{}); // β1*m
-
-                Matrix<ty> tmp_dw = dw;
-                tmp_dw.template scalar_mul<use_blas>((1 - this->_momentum), execPolicy{}); // (1-β1)*dw
-
-                this->_wm = tmp_m + tmp_dw;
-            }
-
-            // v = β2*v + (1-β2)*(dw ⊙ dw)
-            {
-                Matrix<ty> tmp_v = this->_wv;
-                tmp_v.template scalar_mul<use_blas>(this->_rms, execPolicy{}); // β2*v
-
-                Matrix<ty> dw_sq = dw;                          // copy
-                dw_sq.hadamard_mul(dw, execPolicy{});           // dw ⊙ dw
-                dw_sq.template scalar_mul<use_blas>((1 - this->_rms), execPolicy{}); // (1-β2)*(dw^2)
-
-                this->_wv = tmp_v + dw_sq;
-            }
-
-            // m_hat = m / (1 - β1^t)
-            Matrix<ty> m_hat = _wm;
-            m_hat.template scalar_mul<use_blas>(1.0 / (1 - std::pow(this->_momentum, this->_time)), execPolicy{});
-
-            // v_hat = v / (1 - β2^t)
-            Matrix<ty> v_hat = _wv;
-            v_hat.template scalar_mul<use_blas>(1.0 / (1 - std::pow(this->_rms, this->_time)), execPolicy{});
-
-            // update = m_hat / (sqrt(v_hat) + ε)
-            Matrix<ty> updateW = m_hat; // start from m_hat; will be scaled by 1 / (sqrt(v_hat) + ε)
-
-            // divide by sqrt(v_hat) + ε
-            {
-                Matrix<ty> denom = v_hat;
-                denom.apply([this](ty x){ return static_cast<ty>(1) / (std::sqrt(x) + 1e-8); }, execPolicy{});
-                updateW.hadamard_mul(denom, execPolicy{});
-            }
-
-            updateW.template scalar_mul<use_blas>(this->_learning_rate, execPolicy{});
-            _w.template sub<use_blas>(updateW, execPolicy{});
-
-            // ---- B ----
-
-            // m = β1*m + (1-β1)*db
-            {
-                Matrix<ty> tmp_m = this->_bm;
-                tmp_m.template scalar_mul<use_blas>(this->_momentum, execPolicy{}); // β1*m
-
-                Matrix<ty> tmp_db = db;
-                tmp_db.template scalar_mul<use_blas>((1 - this->_momentum), execPolicy{}); // (1-β1)*db
-
-                this->_bm = tmp_m + tmp_db;
-            }
-
-            // v = β2*v + (1-β2)*(db ⊙ db)
-            {
-                Matrix<ty> tmp_v = this->_bv;
-                tmp_v.template scalar_mul<use_blas>(this->_rms, execPolicy{}); // β2*v
+            // バイアス補正の係数
+            const ty m_scale = static_cast<ty>(1.0 / (1 - std::pow(this->_momentum, this->_time))); // m_hat = m / (1 - β1^t)
+            const ty v_scale = static_cast<ty>(1.0 / (1 - std::pow(this->_rms, this->_time)));      // v_hat = v / (1 - β2^t)
 
-                Matrix<ty> db_sq = db;                          // copy
-                db_sq.hadamard_mul(db, execPolicy{});           // db ⊙ db
-                db_sq.template scalar_mul<use_blas>((1 - this->_rms), execPolicy{}); // (1-β2)*(db^2)
-
-                this->_bv = tmp_v + db_sq;
-            }
-
-            // m_hat = m / (1 - β1^t)
-            Matrix<ty> m_hat_b = _bm;
-            m_hat_b.template scalar_mul<use_blas>(1.0 / (1 - std::pow(this->_momentum, this->_time)), execPolicy{});
-
-            // v_hat = v / (1 - β2^t)
-            Matrix<ty> v_hat_b = _bv;
-            v_hat_b.template scalar_mul<use_blas>(1.0 / (1 - std::pow(this->_rms, this->_time)), execPolicy{});
-
-            // update = m_hat / (sqrt(v_hat) + ε)
-            Matrix<ty> updateB = m_hat_b;
-
-            // divide by sqrt(v_hat) + ε
-            {
-                Matrix<ty> denom = v_hat_b;
-                denom.apply([this](ty x){ return static_cast<ty>(1) / (std::sqrt(x) + 1e-8); }, execPolicy{});
-                updateB.hadamard_mul(denom, execPolicy{});
-            }
-
-            updateB.template scalar_mul<use_blas>(this->_learning_rate, execPolicy{});
-            _b.template sub<use_blas>(updateB, execPolicy{});
+            this->_step(this->_w, this->_wm, this->_wv, dw, m_scale, v_scale);
+            this->_step(this->_b, this->_bm, this->_bv, db, m_scale, v_scale);
         }
         catch(const std::exception& e){
             std::cerr << "Error in Adam::optimize: " << e.what() << std::endl;
             throw;
         }
     } 
+
+private:
+    // m, v, パラメータを要素ごとに1回の走査で更新する
+    void _step(Matrix<ty>& param, Matrix<ty>& m, Matrix<ty>& v, const Matrix<ty>& grad, ty m_scale, ty v_scale) {
+        ty* p = param.view().data();
+        ty* mp = m.view().data();
+        ty* vp = v.view().data();
+        const ty* g = grad.data().data();
+        const ty beta1 = this->_momentum, beta2 = this->_rms;
+        const ty step = this->_learning_rate * m_scale;
+
+        Optimizer<ty>::template _update<execPolicy>(param, grad, [=](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                // m = β1*m + (1-β1)*d
+                mp[i] = mp[i] * beta1 + g[i] * (1 - beta1);
+                // v = β2*v + (1-β2)*(d ⊙ d)
+                vp[i] = vp[i] * beta2 + (g[i] * g[i]) * (1 - beta2);
+                // p = p - η * m_hat / (sqrt(v_hat) + ε)
+                const ty inv_denom = static_cast<ty>(static_cast<ty>(1) / (std::sqrt(vp[i] * v_scale) + 1e-8));
+                p[i] = p[i] - (mp[i] * inv_denom) * step;
+            }
+        });
+    }
 };
 
 #endif
\ No newline at end of file
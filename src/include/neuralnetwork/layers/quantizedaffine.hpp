@@ -0,0 +1,179 @@
+#ifndef SANAE_NEURALNETWORK_QUANTIZEDAFFINE_HPP
+#define SANAE_NEURALNETWORK_QUANTIZEDAFFINE_HPP
+
+#include "layerbase.hpp"
+#include "../../matrix/matrix"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief 量子化パラメータ。実数値 = scale * (量子化値 - zero_point)
+ */
+struct QuantParams {
+    float scale = 1.0f;
+    int32_t zero_point = 0;
+
+    /**
+     * @brief 実数の範囲 [lo, hi] を整数の範囲 [qmin, qmax] に割り当てるパラメータを求めます。
+     * @note 0 が誤差なく表現できるよう、範囲は0を含むように広げます。
+     */
+    static QuantParams from_range(float lo, float hi, int32_t qmin, int32_t qmax) {
+        lo = std::min(lo, 0.0f);
+        hi = std::max(hi, 0.0f);
+
+        QuantParams p;
+        if (hi > lo)
+            p.scale = (hi - lo) / static_cast<float>(qmax - qmin);
+        p.zero_point = std::clamp(static_cast<int32_t>(std::lround(qmin - lo / p.scale)), qmin, qmax);
+        return p;
+    }
+
+    /**
+     * @brief x を量子化して [qmin, qmax] に収めます。
+     */
+    int32_t quantize(float x, int32_t qmin, int32_t qmax) const {
+        return std::clamp(static_cast<int32_t>(std::lround(x / scale)) + zero_point, qmin, qmax);
+    }
+};
+
+/**
+ * @brief int8 で推論する全結合レイヤ
+ *
+ * 学習済みの Affine の重みを出力チャネル(列)ごとのスケールとゼロ点で int8 に量子化し、入力を uint8 に量子化して
+ * Int8Gemm で積を計算します。逆量子化とバイアスの加算は行列積のエピローグで行い、int32 の中間結果は書き出しません。
+ *   y[i][j] = sx * sw[j] * Σ_k (xq[i][k] - zx) * (wq[k][j] - zw[j]) + b[j]
+ * Σ の展開に必要な重みの列ごとの和は量子化時に、入力の行ごとの和は順伝播時に求めます。
+ *
+ * 推論専用のため backward は例外を送出します。通常は NeuralNetwork::quantize で Affine から置き換えて使用します。
+ */
+template<typename ty>
+class QuantizedAffine : public LayerBase<ty> {
+private:
+    Int8Gemm::PackedB _w;             // (in_dim, out_dim) 量子化してパックした重み
+    std::vector<float> _w_scale;      // 出力チャネルごとのスケール
+    std::vector<int32_t> _w_zero;     // 出力チャネルごとのゼロ点
+    std::vector<float> _b;            // (out_dim) バイアス
+    bool _dynamic = true;             // 入力の範囲を順伝播のたびに行ごとに求めるかどうか
+    QuantParams _x;                   // 静的量子化の場合の入力の量子化パラメータ
+
+    std::vector<uint8_t> _xq;         // (batch, in_dim) 量子化した入力のバッファ
+    std::vector<QuantParams> _x_rows; // 行ごとの入力の量子化パラメータ
+    std::vector<int32_t> _x_sums;     // 行ごとの量子化した入力の和
+
+public:
+    using LayerBase<ty>::forward;
+
+    static constexpr bool is_affine = true;
+    static constexpr std::string_view name() { return "QuantizedAffine"; }
+
+    /**
+     * @param w 学習済みの重み (in_dim, out_dim)
+     * @param b 学習済みのバイアス (1, out_dim)
+     * @param calibration このレイヤに入る代表的な入力 (batch, in_dim)。全要素の範囲から入力の量子化パラメータを決めます。
+     *                    行数が0の場合は順伝播のたびに入力の各行の範囲から求めます (動的量子化)。
+     */
+    QuantizedAffine(const Matrix<ty>& w, const Matrix<ty>& b, MatrixView<const ty> calibration = {})
+        : _w_scale(w.cols()), _w_zero(w.cols()), _b(w.cols())
+    {
+        const size_t in_dim = w.rows(), out_dim = w.cols();
+        if (b.rows() != 1 || b.cols() != out_dim)
+            throw std::invalid_argument("Bias dimensions must agree with the weight matrix.");
+        if (calibration.rows() != 0 && calibration.cols() != in_dim)
+            throw std::invalid_argument("Calibration data dimensions must agree with the weight matrix.");
+
+        // 重みは出力チャネルごとに [-128, 127] へ量子化する
+        std::vector<int8_t> wq(in_dim * out_dim);
+        for (size_t j = 0; j < out_dim; j++) {
+            float lo = 0.0f, hi = 0.0f;
+            for (size_t k = 0; k < in_dim; k++) {
+                lo = std::min(lo, static_cast<float>(w(k, j)));
+                hi = std::max(hi, static_cast<float>(w(k, j)));
+            }
+            const QuantParams p = QuantParams::from_range(lo, hi, -128, 127);
+            _w_scale[j] = p.scale;
+            _w_zero[j] = p.zero_point;
+            for (size_t k = 0; k < in_dim; k++)
+                wq[k * out_dim + j] = static_cast<int8_t>(p.quantize(static_cast<float>(w(k, j)), -128, 127));
+            _b[j] = static_cast<float>(b(0, j));
+        }
+        _w = Int8Gemm::PackedB(wq.data(), in_dim, out_dim);
+
+        if (calibration.rows() != 0) {
+            float lo = 0.0f, hi = 0.0f;
+            for (size_t i = 0; i < calibration.rows(); i++) {
+                for (size_t k = 0; k < in_dim; k++) {
+                    lo = std::min(lo, static_cast<float>(calibration(i, k)));
+                    hi = std::max(hi, static_cast<float>(calibration(i, k)));
+                }
+            }
+            _x = QuantParams::from_range(lo, hi, 0, 255);
+            _dynamic = false;
+        }
+    }
+
+    /// 入力を順伝播のたびに量子化するかどうか
+    bool is_dynamic() const noexcept { return _dynamic; }
+    /// 静的量子化の場合の入力の量子化パラメータ
+    const QuantParams& input_params() const noexcept { return _x; }
+
+    Matrix<ty> forward(const Matrix<ty>& in) override {
+        return this->forward(in.view());
+    }
+    Matrix<ty> forward(MatrixView<const ty> in) override {
+        const size_t batch = in.rows(), in_dim = _w.rows(), out_dim = _w.cols();
+        if (in.cols() != in_dim)
+            throw std::invalid_argument("Input dimensions must agree with the weight matrix.");
+
+        // 入力を行ごとに uint8 へ量子化し、ゼロ点の補正に使う行ごとの和も求める
+        _xq.resize(batch * in_dim);
+        _x_rows.resize(batch);
+        _x_sums.resize(batch);
+        for (size_t i = 0; i < batch; i++) {
+            QuantParams p = _x;
+            if (_dynamic) {
+                float lo = 0.0f, hi = 0.0f;
+                for (size_t k = 0; k < in_dim; k++) {
+                    lo = std::min(lo, static_cast<float>(in(i, k)));
+                    hi = std::max(hi, static_cast<float>(in(i, k)));
+                }
+                p = QuantParams::from_range(lo, hi, 0, 255);
+            }
+
+            uint8_t* row = _xq.data() + i * in_dim;
+            int32_t sum = 0;
+            for (size_t k = 0; k < in_dim; k++) {
+                row[k] = static_cast<uint8_t>(p.quantize(static_cast<float>(in(i, k)), 0, 255));
+                sum += row[k];
+            }
+            _x_rows[i] = p;
+            _x_sums[i] = sum;
+        }
+
+        Matrix<ty> out(batch, out_dim);
+        const std::vector<int32_t>& w_sums = _w.col_sums();
+        const int64_t K = static_cast<int64_t>(in_dim);
+
+        // エピローグで逆量子化とバイアスの加算を行う
+        Int8Gemm::multiply(_xq.data(), batch, in_dim, _w, [&](size_t row, size_t col, const int32_t* acc, size_t n) {
+            const QuantParams& p = _x_rows[row];
+            const int64_t zx = p.zero_point;
+            const int64_t x_sum = _x_sums[row];
+            for (size_t t = 0; t < n; t++) {
+                const size_t j = col + t;
+                const int64_t zw = _w_zero[j];
+                const int64_t v = acc[t] - zx * w_sums[j] - zw * x_sum + K * zx * zw;
+                out(row, j) = static_cast<ty>(p.scale * _w_scale[j] * static_cast<float>(v) + _b[j]);
+            }
+        });
+        return out;
+    }
+    Matrix<ty> backward(const Matrix<ty>&) override {
+        throw std::runtime_error("QuantizedAffine supports inference only.");
+    }
+};
+
+#endif //SANAE_NEURALNETWORK_QUANTIZEDAFFINE_HPP
\ No newline at end of file
@@ -16,6 +16,8 @@ private:
     Matrix<ty> _out; // 出力の保存用（ReLU適用後）
 
 public:
+    using LayerBase<ty>::forward;
+
     static constexpr std::string_view name() { return "ReLU"; }
 
     /**
@@ -25,12 +27,8 @@ public:
      * @note out = max(0, in)
      */
     Matrix<ty> forward(const Matrix<ty>& in) override{
-        Matrix<ty> out = in;
-
-        out.apply([](ty x) { 
-            return x > 0 ? x : 0; 
-        }, ExecPolicy{});
-        _out = out; 
+        Matrix<ty> out = in.apply_copy(SimdKernel::Relu{}, ExecPolicy{});
+        _out = out;
 
         return out;
     }
@@ -41,19 +39,14 @@ public:
      * @note dx = dout ⊙ (in > 0 ? 1 : 0)
      */
     Matrix<ty> backward(const Matrix<ty>& dout) override{
-        Matrix<ty> dx = dout;
-        Matrix<ty> out = this->_out; // ReLUの出力を保存しておいた_outから取得
-
-        dx.hadamard_mul(
-            out.apply(
-                [](ty x){ return x > 0 ? 1 : 0; }, 
-                ExecPolicy{}
-            ),
-            ExecPolicy{}
-        );
+        // ReLUの出力を保存しておいた_outから取得
+        Matrix<ty> dx = this->_out.apply_copy(SimdKernel::Step{}, ExecPolicy{});
+        dx.hadamard_mul(dout, ExecPolicy{});
 
         return dx;
     }
+
+    void clear_cache() override { _out = Matrix<ty>(); }
 };
 
 #endif //SANAE_NEURALNETWORK_RELU_HPP
\ No newline at end of file
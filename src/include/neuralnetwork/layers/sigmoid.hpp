@@ -16,19 +16,20 @@ private:
     Matrix<ty> _out; // 出力の保存用
 
 public:
+    using LayerBase<ty>::forward;
+
     static constexpr std::string_view name() { return "Sigmoid"; }
     
     /**
      * 前向き伝播
      * @param in 入力
      * @return 出力
-     * @note out = 1 / (1 + exp(-in))
+     * @note out = 1 / (1 + exp(-in))。SIMDカーネルの多項式近似で計算します。(精度は SimdKernel::set_math_mode で選択)
      */
     Matrix<ty> forward(const Matrix<ty>& in) override{
         try{
-            Matrix<ty> out = in;
-            out.apply([](ty x) { return 1 / (1 + exp(-x)); }, ExecPolicy{});
-            
+            Matrix<ty> out = in.apply_copy(SimdKernel::Sigmoid{}, ExecPolicy{});
+
             this->_out = out; // 出力を保存
             return out;
         }
@@ -45,11 +46,9 @@ public:
      */
     Matrix<ty> backward(const Matrix<ty>& dout) override{
         try{
-            // 保存しておいた出力 _out からシグモイドの導関数 out * (1 - out) を要素ごとに計算
-            Matrix<ty> dx = this->_out;
-            dx.apply([](ty y) { return y * (static_cast<ty>(1) - y); }, ExecPolicy{});
-            // dx: out ⊙ (1 - out) に dout を要素ごとに掛ける
-            dx.hadamard_mul(dout, ExecPolicy{});
+            // 保存しておいた出力 _out からシグモイドの導関数 out * (1 - out) を計算し、dout を要素ごとに掛ける
+            Matrix<ty> dx;
+            dx.assign(MatrixExpr::map(this->_out, [](ty y) { return y * (static_cast<ty>(1) - y); }) ^ dout, ExecPolicy{});
             return dx;
         }
         catch(const std::exception& e){
@@ -57,6 +56,8 @@ public:
             throw;
         }
     }
+
+    void clear_cache() override { this->_out = Matrix<ty>(); }
 };
 
 #endif //SANAE_NEURALNETWORK_SIGMOID_HPP
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include <iostream>
 #include "layerbase.hpp"
 #include <stdexcept>
+#include <vector>
 #include "../../matrix/matrix" // MatrixクラスとStdExecPolicyコンセプト
 
 // ソフトマックス with ロスレイヤー
@@ -18,6 +19,8 @@ private:
     Matrix<ty> _out; // 出力の保存用
 
 public:
+    using LayerBase<ty>::forward;
+
     static constexpr std::string_view name() { return "SoftmaxWithLoss"; }
     static constexpr bool has_loss = true; // loss関数を所有
 
@@ -29,28 +32,38 @@ public:
      */
     Matrix<ty> forward(const Matrix<ty>& in) override {
         // in: (batch, classes)
-        Matrix<ty> out = in;
-        if (out.rows() == 0 || out.cols() == 0) {
+        if (in.rows() == 0 || in.cols() == 0) {
             throw std::runtime_error("Error in SoftmaxWithLoss forward: input matrix is empty.");
         }
 
         const ExecPolicy policy = ExecPolicy{};
+        Matrix<ty> out(in.rows(), in.cols());
 
-        // 行ごとに softmax を適用
+        // 行ごとの最大値を引いてから指数をとる
+        const MatrixVector<ty> max_val = in.view().max_cols(policy);
         for (size_t i = 0; i < out.rows(); ++i) {
-            ty* row = out.get_row_ptr(i);
-
-            ty max_val = *std::max_element(policy, row, row + out.cols());
-            std::transform(policy, row, row + out.cols(), row,
-                           [max_val](ty x) { return std::exp(x - max_val); });
+            const ty* x = in.get_row_ptr(i);
+            ty* y = out.get_row_ptr(i);
+            const ty m = max_val[i];
+            if constexpr (SimdKernel::vectorizable_v<ty>) {
+                SimdKernel::binary_scalar<SimdKernel::Op::Sub>(x, m, y, in.cols());
+                SimdKernel::unary<SimdKernel::Unary::Exp>(y, y, in.cols());
+            }
+            else {
+                std::transform(x, x + in.cols(), y, [m](ty v) { return std::exp(v - m); });
+            }
+        }
 
-            ty sum = std::reduce(policy, row, row + out.cols(), static_cast<ty>(0));
-            if(sum <= 0){
+        // 行ごとの和で正規化する
+        const MatrixVector<ty> sum = out.view().sum_cols(policy);
+        for (size_t i = 0; i < out.rows(); ++i) {
+            if(sum[i] <= 0){
                 throw std::runtime_error("Error in SoftmaxWithLoss forward: sum of exponentials is non-positive.");
             }
 
-            std::transform(policy, row, row + out.cols(), row,
-                           [sum](ty x) { return x / sum; });
+            ty* row = out.get_row_ptr(i);
+            const ty s = sum[i];
+            std::transform(row, row + out.cols(), row, [s](ty x) { return x / s; });
         }
 
         _out = out;
@@ -86,25 +99,37 @@ public:
     /**
     * @param t 教師データ
     * @return ロス値
-    * @note loss = -Σ(t_i * log(out_i + ε))
+    * @note loss = -Σ(t_i * log(max(out_i, ε)))。log は行ごとにSIMDカーネルで計算します。
     */
     double loss(const Matrix<ty>& t) {
-        ty epsilon = static_cast<ty>(1e-7);
+        if(_out.rows() == 0){
+            throw std::runtime_error("Error in SoftmaxWithLoss loss calculation: batch size is zero.");
+        }
+
+        const ty epsilon = static_cast<ty>(1e-7);
+        const Matrix<ty>& out = _out; // 格納領域の共有を解除しないよう const で読む
+        MatrixVector<ty> log_y(out.cols());
         ty total = 0;
 
-        for (size_t i = 0; i < _out.rows(); ++i) {
-            for (size_t j = 0; j < _out.cols(); ++j) {
-                ty y = std::max(_out(i, j), epsilon);
-                total -= t(i, j) * std::log(y);
+        for (size_t i = 0; i < out.rows(); ++i) {
+            const ty* y = out.get_row_ptr(i);
+            const ty* ti = t.get_row_ptr(i);
+            if constexpr (SimdKernel::vectorizable_v<ty>) {
+                SimdKernel::binary_scalar<SimdKernel::Op::Max>(y, epsilon, log_y.data(), out.cols());
+                SimdKernel::unary<SimdKernel::Unary::Log>(log_y.data(), log_y.data(), out.cols());
+            }
+            else {
+                std::transform(y, y + out.cols(), log_y.begin(), [epsilon](ty v) { return std::log(std::max(v, epsilon)); });
             }
-        }
 
-        if(_out.rows() == 0){
-            throw std::runtime_error("Error in SoftmaxWithLoss loss calculation: batch size is zero.");
+            for (size_t j = 0; j < out.cols(); ++j)
+                total -= ti[j] * log_y[j];
         }
 
         return static_cast<double>(total / _out.rows()); // バッチ平均
     }
+
+    void clear_cache() override { _out = Matrix<ty>(); }
 };
 
 #endif //SANAE_NEURALNETWORK_SOFTMAXWITHLOSS_HPP
\ No newline at end of file
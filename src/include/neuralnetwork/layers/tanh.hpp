@@ -16,18 +16,19 @@ private:
     Matrix<ty> _out; // 出力の保存用
 
 public:
+    using LayerBase<ty>::forward;
+
     static constexpr std::string_view name() { return "Tanh"; }
     
     /**
      * 前向き伝播
      * @param in 入力
      * @return 出力
-     * @note out = tanh(x)
+     * @note out = tanh(x)。SIMDカーネルの多項式近似で計算します。(精度は SimdKernel::set_math_mode で選択)
      */
     Matrix<ty> forward(const Matrix<ty>& in) override{
         try{
-            this->_out = in;
-            this->_out.apply([](ty x) { return std::tanh(x); }, ExecPolicy{});
+            this->_out = in.apply_copy(SimdKernel::Tanh{}, ExecPolicy{});
 
             return this->_out;
         }
@@ -44,9 +45,8 @@ public:
      */
     Matrix<ty> backward(const Matrix<ty>& dout) override{
         try{
-            Matrix<ty> dx = this->_out;
-            dx.apply([](ty y) { return static_cast<ty>(1) - (y * y); }, ExecPolicy{});
-            dx.hadamard_mul(dout, ExecPolicy{});
+            Matrix<ty> dx;
+            dx.assign(MatrixExpr::map(this->_out, [](ty y) { return static_cast<ty>(1) - (y * y); }) ^ dout, ExecPolicy{});
 
             return dx;
         }
@@ -55,6 +55,8 @@ public:
             throw;
         }
     }
+
+    void clear_cache() override { this->_out = Matrix<ty>(); }
 };
 
 #endif //SANAE_NEURALNETWORK_TANH_HPP
\ No newline at end of file
@@ -7,6 +7,8 @@
 #include "layers/batchnormalization.hpp"
 
 #include <memory>
+#include <span>
+#include <utility>
 #include <vector>
 #include <concepts>
 #include <stdexcept>
@@ -55,6 +57,7 @@ class NeuralNetwork<ty, LayerPack<Layers...>>
 {
     protected:
     std::vector<std::unique_ptr<LayerBase<ty>>> _layers;
+    MatrixArena _arena; // learn / predict の1回ごとの一時的な行列の確保先。呼び出しの先頭で reset する
 
     /**
      * @brief レイヤを追加するための再帰的な関数
@@ -106,29 +109,30 @@ class NeuralNetwork<ty, LayerPack<Layers...>>
         this->_add_layer<size, count+1, LayerTail...>(in_size, hidden_size, out_size, learning_rate, seed+count);
     }
 
-public:
-    NeuralNetwork() = delete;
-    NeuralNetwork(size_t in_size, size_t hidden_size, size_t out_size, ty learning_rate = 0.01f, uint32_t seed = std::random_device{}())
-    {
-        this->_add_layer<sizeof...(Layers), 0, Layers...>(in_size, hidden_size, out_size, learning_rate, seed);
-    }
+    /// 教師データをアリーナ上の行列にする
+    static Matrix<ty> _to_target(MatrixView<const ty> t) { return Matrix<ty>(t); }
+    static Matrix<ty> _to_target(const GatheredRows<ty>& t) { return t.to_dense(); }
 
-    /*
-     * @brief 学習を行う関数
-     * @tparam use_loss ロス値を計算するかどうか。デフォルトはtrue。falseの場合、ロス値は常に0を返す。
-     * @param in 入力データ
-     * @param t 教師データ
-     * @return ロス値（use_lossがtrueの場合）。use_lossがfalseの場合は常に0を返す。
-    */
-    template<bool use_loss = true>
-    double learn(const Matrix<ty>& in, const Matrix<ty>& t){
-        Matrix<ty> out = in;
+    /**
+     * @brief 学習の本体。先頭のレイヤには in をそのまま渡す。
+     * @tparam InputType MatrixView<const ty>、SparseMatrix<ty> または GatheredRows<ty>
+     * @tparam TargetType MatrixView<const ty> または GatheredRows<ty>
+     */
+    template<bool use_loss, typename InputType, typename TargetType>
+    double _learn(const InputType& in, const TargetType& t){
+        // 前回の呼び出しの一時的な行列はすべて破棄済みなので、アリーナを先頭から再利用する
+        _arena.reset();
+        MatrixMemory::Scope scope(&_arena);
+
+        Matrix<ty> out;
         for(size_t i = 0; i < this->_layers.size(); i++){
             this->_layers.at(i)->training = true;
-            out = _layers.at(i)->forward(out);
+            // 先頭のレイヤには入力をそのまま渡す
+            out = (i == 0) ? _layers.at(i)->forward(in) : _layers.at(i)->forward(out);
         }
 
-        out = t;
+        const Matrix<ty> target = _to_target(t);
+        out = target;
         for(size_t i = this->_layers.size(); i-- > 0; ){
             out = _layers.at(i)->backward(out);
         }
@@ -141,24 +145,154 @@ public:
                 throw std::runtime_error("Last layer type mismatch");
             }
 
-            return last->loss(t);
+            return last->loss(target);
         }else{
             return 0;
         }
     }
 
+    /**
+     * @brief 推論の本体。先頭のレイヤには in をそのまま渡す。
+     * @tparam InputType MatrixView<const ty>、SparseMatrix<ty> または GatheredRows<ty>
+     */
+    template<typename InputType>
+    Matrix<ty> _predict(const InputType& in){
+        Matrix<ty> result; // 呼び出し元に返すため、アリーナの外で確保する
+        {
+            _arena.reset();
+            MatrixMemory::Scope scope(&_arena);
+
+            Matrix<ty> out;
+            for(size_t i = 0; i < this->_layers.size(); i++){
+                _layers.at(i)->training = false;
+                out = (i == 0) ? _layers.at(i)->forward(in) : _layers.at(i)->forward(out);
+            }
+            result = out;
+        }
+        return result;
+    }
+
+public:
+    NeuralNetwork() = delete;
+    NeuralNetwork(size_t in_size, size_t hidden_size, size_t out_size, ty learning_rate = 0.01f, uint32_t seed = std::random_device{}())
+    {
+        this->_add_layer<sizeof...(Layers), 0, Layers...>(in_size, hidden_size, out_size, learning_rate, seed);
+    }
+
+    /*
+     * @brief 学習を行う関数
+     * @tparam use_loss ロス値を計算するかどうか。デフォルトはtrue。falseの場合、ロス値は常に0を返す。
+     * @param in 入力データ
+     * @param t 教師データ
+     * @return ロス値（use_lossがtrueの場合）。use_lossがfalseの場合は常に0を返す。
+    */
+    template<bool use_loss = true>
+    double learn(const Matrix<ty>& in, const Matrix<ty>& t){
+        return this->learn<use_loss>(in.view(), t.view());
+    }
+
+    /*
+     * @brief 行列のビューを入力として学習を行う関数
+     * @tparam use_loss ロス値を計算するかどうか。デフォルトはtrue。falseの場合、ロス値は常に0を返す。
+     * @param in 入力データのビュー。データセットの行列から rows_range で切り出したミニバッチなどをコピーせずに渡せる。
+     * @param t 教師データのビュー
+     * @return ロス値（use_lossがtrueの場合）。use_lossがfalseの場合は常に0を返す。
+    */
+    template<bool use_loss = true>
+    double learn(MatrixView<const ty> in, MatrixView<const ty> t){
+        return this->_learn<use_loss>(in, t);
+    }
+
+    /*
+     * @brief 疎行列を入力として学習を行う関数
+     * @tparam use_loss ロス値を計算するかどうか。デフォルトはtrue。falseの場合、ロス値は常に0を返す。
+     * @param in 入力データ。先頭の Affine レイヤが密行列に変換せずに計算する。
+     * @param t 教師データ
+     * @return ロス値（use_lossがtrueの場合）。use_lossがfalseの場合は常に0を返す。
+    */
+    template<bool use_loss = true>
+    double learn(const SparseMatrix<ty>& in, MatrixView<const ty> t){
+        return this->_learn<use_loss>(in, t);
+    }
+    template<bool use_loss = true>
+    double learn(const SparseMatrix<ty>& in, const Matrix<ty>& t){
+        return this->_learn<use_loss>(in, t.view());
+    }
+
+    /*
+     * @brief データセットから添字で選んだ行をミニバッチとして学習を行う関数
+     * @tparam use_loss ロス値を計算するかどうか。デフォルトはtrue。falseの場合、ロス値は常に0を返す。
+     * @param in 入力データセット全体のビュー。先頭の Affine レイヤは選んだ行をコピーせずに添字で直接読む。
+     * @param indices ミニバッチに使う行のインデックス。エポックごとにシャッフルした添字の配列を区切って渡せる。
+     * @param t 教師データセット全体のビュー。in と同じ indices で行を選ぶ。
+     * @return ロス値（use_lossがtrueの場合）。use_lossがfalseの場合は常に0を返す。
+     * @throws std::out_of_range インデックスが in または t の行数以上の場合
+    */
+    template<bool use_loss = true>
+    double learn(MatrixView<const ty> in, std::span<const size_t> indices, MatrixView<const ty> t){
+        return this->_learn<use_loss>(GatheredRows<ty>{in, indices}, GatheredRows<ty>{t, indices});
+    }
+
     /**
      * @brief 推論を行う関数
      * @param in 入力データ
      * @return 推論結果
      */
     Matrix<ty> predict(const Matrix<ty>& in){
-        Matrix<ty> out = in;
+        return this->predict(in.view());
+    }
+
+    /**
+     * @brief 行列のビューを入力として推論を行う関数
+     * @param in 入力データのビュー
+     * @return 推論結果
+     */
+    Matrix<ty> predict(MatrixView<const ty> in){
+        return this->_predict(in);
+    }
+
+    /**
+     * @brief 疎行列を入力として推論を行う関数
+     * @param in 入力データ
+     * @return 推論結果
+     */
+    Matrix<ty> predict(const SparseMatrix<ty>& in){
+        return this->_predict(in);
+    }
+
+    /**
+     * @brief データセットから添字で選んだ行を入力として推論を行う関数
+     * @param in 入力データセット全体のビュー
+     * @param indices 推論する行のインデックス
+     * @return 推論結果。i 行目は in の indices[i] 行目に対応する。
+     */
+    Matrix<ty> predict(MatrixView<const ty> in, std::span<const size_t> indices){
+        return this->_predict(GatheredRows<ty>{in, indices});
+    }
+
+    /**
+     * @brief 学習済みの Affine レイヤを int8 で推論する QuantizedAffine に置き換えます。
+     * @param calibration 代表的な入力データ。量子化前のネットワークで順に伝播させ、各 Affine レイヤに入る値の範囲から入力の量子化パラメータを決めます。
+     *                    省略した場合 (行数が0の場合) は推論のたびに入力の各行の範囲を求めます。
+     * @note 置き換えた後は predict だけが使えます。learn を呼ぶと例外になります。
+     */
+    void quantize(MatrixView<const ty> calibration = {}){
+        const bool calibrate = calibration.rows() != 0;
+        Matrix<ty> out;
         for(size_t i = 0; i < this->_layers.size(); i++){
-            _layers.at(i)->training = false;
-            out = _layers.at(i)->forward(out);
+            std::unique_ptr<LayerBase<ty>> quantized = _layers.at(i)->quantize(
+                (calibrate && i != 0) ? out.view() : calibration);
+
+            if(calibrate){
+                _layers.at(i)->training = false;
+                out = (i == 0) ? _layers.at(i)->forward(calibration) : _layers.at(i)->forward(out);
+            }
+            if(quantized)
+                _layers.at(i) = std::move(quantized);
         }
-        return out;
+    }
+    void quantize(const Matrix<ty>& calibration){
+        this->quantize(calibration.view());
     }
 };
 
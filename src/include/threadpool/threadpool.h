@@ -0,0 +1,311 @@
+﻿#ifndef SANAE_NEURALNETWORK_THREADPOOL
+#define SANAE_NEURALNETWORK_THREADPOOL
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <execution>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// 並列実行ポリシー判定用の型
+template<typename T>
+inline constexpr bool is_parallel_policy_v =
+	std::is_same_v<std::remove_cvref_t<T>, std::execution::parallel_policy> ||
+	std::is_same_v<std::remove_cvref_t<T>, std::execution::parallel_unsequenced_policy>;
+
+/**
+ * @class ThreadPool
+ * @brief プロセス全体で共有するワークスティーリング型のスレッドプール
+ *
+ * 初回の instance() 呼び出し時にワーカースレッドを起動し、以降は使い回します。
+ * 各ワーカーは自身のタスクキューを持ち、空になった場合は他のワーカーのキューからタスクを盗みます。
+ * parallel_for を呼び出したスレッドも完了待ちの間タスクを実行するため、入れ子の呼び出しでもデッドロックしません。
+ *
+ * スレッド数は次の優先順位で決まります。
+ *   1. set_num_threads() で指定された値
+ *   2. 環境変数 SANAE_NUM_THREADS
+ *   3. std::thread::hardware_concurrency()
+ */
+class ThreadPool {
+private:
+	/**
+	 * @brief parallel_for 1回分の共有状態
+	 */
+	struct Job {
+		void (*invoke)(const void* func, size_t begin, size_t end); ///< 型消去した範囲関数の呼び出し
+		const void* func;                                         ///< 範囲関数へのポインタ
+		std::atomic<size_t> remaining;                             ///< 未完了のタスク数
+		std::atomic<bool> failed{ false };                         ///< 例外が発生したかどうか
+		std::exception_ptr exception;                              ///< 最初に発生した例外
+	};
+
+	/**
+	 * @brief キューに積む範囲タスク
+	 */
+	struct Task {
+		Job* job;
+		size_t begin;
+		size_t end;
+	};
+
+	/**
+	 * @brief ワーカーごとのタスクキュー
+	 */
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> _queues; ///< ワーカーごとのキュー (呼び出し元スレッド用を含む)
+	std::vector<std::thread> _workers;           ///< ワーカースレッド
+	std::atomic<size_t> _pending{ 0 };           ///< キューに積まれている未取得のタスク数
+	std::atomic<bool> _stop{ false };
+	std::mutex _sleep_mutex;
+	std::condition_variable _sleep_cv;
+	size_t _num_threads = 1;
+
+	/// 次に起動するプールのスレッド数 (0の場合は自動)
+	static size_t& _requested_threads() {
+		static size_t requested = 0;
+		return requested;
+	}
+
+	/// 現在のスレッドが使用するキューのインデックス (ワーカー以外は0)
+	static size_t& _thread_index() {
+		thread_local size_t index = 0;
+		return index;
+	}
+
+	static size_t _default_threads() {
+		if (const char* env = std::getenv("SANAE_NUM_THREADS")) {
+			const long value = std::strtol(env, nullptr, 10);
+			if (value > 0)
+				return static_cast<size_t>(value);
+		}
+		return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	}
+
+	explicit ThreadPool(size_t num_threads) {
+		this->_start(num_threads);
+	}
+
+	void _start(size_t num_threads) {
+		this->_num_threads = std::max<size_t>(num_threads, 1);
+		this->_stop = false;
+
+		// インデックス0は呼び出し元スレッド用のキュー
+		this->_queues.clear();
+		for (size_t i = 0; i < this->_num_threads; i++)
+			this->_queues.emplace_back(std::make_unique<Queue>());
+
+		for (size_t i = 1; i < this->_num_threads; i++)
+			this->_workers.emplace_back([this, i]() { this->_worker_loop(i); });
+	}
+
+	void _shutdown() {
+		{
+			std::lock_guard<std::mutex> lock(this->_sleep_mutex);
+			this->_stop = true;
+		}
+		this->_sleep_cv.notify_all();
+
+		for (auto& worker : this->_workers)
+			worker.join();
+		this->_workers.clear();
+	}
+
+	bool _pop(size_t index, Task& task) {
+		Queue& queue = *this->_queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			return false;
+
+		task = queue.tasks.back();
+		queue.tasks.pop_back();
+		this->_pending.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool _steal(size_t thief, Task& task) {
+		const size_t count = this->_queues.size();
+		for (size_t offset = 1; offset < count; offset++) {
+			Queue& queue = *this->_queues[(thief + offset) % count];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty())
+				continue;
+
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+			this->_pending.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	bool _find_task(size_t index, Task& task) {
+		return this->_pop(index, task) || this->_steal(index, task);
+	}
+
+	static void _run(const Task& task) {
+		Job& job = *task.job;
+		if (!job.failed.load(std::memory_order_relaxed)) {
+			try {
+				job.invoke(job.func, task.begin, task.end);
+			}
+			catch (...) {
+				if (!job.failed.exchange(true))
+					job.exception = std::current_exception();
+			}
+		}
+		job.remaining.fetch_sub(1, std::memory_order_acq_rel);
+	}
+
+	void _worker_loop(size_t index) {
+		_thread_index() = index;
+
+		Task task;
+		while (true) {
+			if (this->_find_task(index, task)) {
+				_run(task);
+				continue;
+			}
+
+			// 短い間はスピンして次のタスクを待ち、来なければ眠る
+			bool found = false;
+			for (int spin = 0; spin < 256 && !found; spin++) {
+				if (this->_pending.load(std::memory_order_relaxed) > 0)
+					found = true;
+				else
+					std::this_thread::yield();
+			}
+			if (found)
+				continue;
+
+			std::unique_lock<std::mutex> lock(this->_sleep_mutex);
+			this->_sleep_cv.wait(lock, [this]() {
+				return this->_stop.load() || this->_pending.load() > 0;
+			});
+			if (this->_stop.load())
+				return;
+		}
+	}
+
+public:
+	/// parallel_for の既定の最小分割サイズ(要素数)
+	static constexpr size_t default_grain = 1 << 15;
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	~ThreadPool() {
+		this->_shutdown();
+	}
+
+	/**
+	 * @brief プロセス全体で共有するスレッドプールを取得します。初回呼び出し時に起動します。
+	 * @return スレッドプールへの参照
+	 */
+	static ThreadPool& instance() {
+		static ThreadPool pool(_requested_threads() != 0 ? _requested_threads() : _default_threads());
+		return pool;
+	}
+
+	/**
+	 * @brief スレッド数を設定します。(呼び出し元スレッドを含む)
+	 * @param num_threads スレッド数。0の場合は既定値(環境変数またはハードウェアのスレッド数)に戻します。
+	 * @note 既にプールが起動している場合はワーカーを作り直します。parallel_for の実行中に呼び出してはいけません。
+	 */
+	static void set_num_threads(size_t num_threads) {
+		_requested_threads() = num_threads;
+
+		ThreadPool& pool = instance();
+		const size_t target = num_threads != 0 ? num_threads : _default_threads();
+		if (pool._num_threads == target)
+			return;
+
+		pool._shutdown();
+		pool._start(target);
+	}
+
+	/**
+	 * @brief スレッド数を取得します。(呼び出し元スレッドを含む)
+	 * @return スレッド数
+	 */
+	size_t num_threads() const noexcept {
+		return this->_num_threads;
+	}
+
+	/**
+	 * @brief [begin, end) を分割し、func(chunk_begin, chunk_end) を並列に実行します。
+	 * @tparam Func void(size_t, size_t) として呼び出せる関数オブジェクト
+	 * @param begin 範囲の先頭
+	 * @param end 範囲の終端
+	 * @param grain 1タスクあたりの最小の範囲長。範囲がこれ以下の場合は呼び出し元スレッドでそのまま実行します。
+	 * @param func 範囲関数
+	 * @throws func が送出した最初の例外を、全タスクの完了後に再送出します。
+	 */
+	template<typename Func>
+	void parallel_for(size_t begin, size_t end, size_t grain, Func&& func) {
+		if (end <= begin)
+			return;
+
+		const size_t length = end - begin;
+		grain = std::max<size_t>(grain, 1);
+
+		// 分割しても得をしない場合はスレッドを使わない
+		if (this->_num_threads <= 1 || length <= grain) {
+			func(begin, end);
+			return;
+		}
+
+		// スレッド数の4倍程度に分割し、偏りはスティールで吸収する
+		const size_t max_tasks = this->_num_threads * 4;
+		const size_t task_count = std::min((length + grain - 1) / grain, max_tasks);
+		const size_t chunk = (length + task_count - 1) / task_count;
+
+		using FuncType = std::remove_reference_t<Func>;
+		Job job;
+		job.func = static_cast<const void*>(std::addressof(func));
+		job.invoke = [](const void* f, size_t b, size_t e) {
+			(*static_cast<FuncType*>(const_cast<void*>(f)))(b, e);
+		};
+
+		const size_t pushed = (length + chunk - 1) / chunk;
+		job.remaining.store(pushed, std::memory_order_relaxed);
+		{
+			std::lock_guard<std::mutex> lock(this->_sleep_mutex);
+			this->_pending.fetch_add(pushed, std::memory_order_release);
+		}
+
+		// タスクを各キューに均等に配る
+		const size_t self = _thread_index();
+		size_t index = self;
+		for (size_t b = begin; b < end; b += chunk, index++) {
+			Queue& queue = *this->_queues[index % this->_queues.size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back(Task{ &job, b, std::min(end, b + chunk) });
+		}
+		this->_sleep_cv.notify_all();
+
+		// 完了までは呼び出し元もタスクを処理する
+		Task task;
+		while (job.remaining.load(std::memory_order_acquire) > 0) {
+			if (this->_find_task(self, task))
+				_run(task);
+			else
+				std::this_thread::yield();
+		}
+
+		if (job.exception)
+			std::rethrow_exception(job.exception);
+	}
+};
+
+#endif
\ No newline at end of file
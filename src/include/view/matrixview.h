@@ -0,0 +1,732 @@
+﻿#ifndef SANAE_NEURALNETWORK_MATRIXVIEW
+#define SANAE_NEURALNETWORK_MATRIXVIEW
+
+#include "view.h"
+#include "../matrix/allocator.hpp"
+#include "../matrix/simd.hpp"
+#include "../threadpool/threadpool.h"
+#include <algorithm>
+#include <concepts>
+#include <execution>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @class MatrixView
+ * @brief 他の行列やバッファの一部を所有せずに参照する2次元ビュー
+ *
+ * (ポインタ, 行数, 列数, リーディングディメンション) の組で行列を表します。
+ * Matrix::view() や block() / rows_range() を使うと、ミニバッチや学習・検証データの分割、
+ * GEMM の部分行列などをコピーせずに参照できます。
+ *
+ * ビューは参照先の寿命を管理しません。参照先の行列が破棄・再確保された後にビューを使用してはいけません。
+ * const T を指定すると読み取り専用のビューになります。MatrixView<T> は MatrixView<const T> に暗黙に変換できます。
+ * sum_rows などの集計結果は Matrix と同じく MatrixVector で返し、MatrixMemory::current() のリソースから確保します。
+ *
+ * @tparam T 要素型 (読み取り専用の場合は const T)
+ * @tparam RowMajor 行優先か列優先か。デフォルトはtrue(行優先)。
+ */
+template<typename T, bool RowMajor = true>
+class MatrixView {
+private:
+	T* _data = nullptr; ///< 先頭要素へのポインタ
+	size_t _rows = 0, _cols = 0; ///< 行数と列数
+	size_t _ld = 0; ///< リーディングディメンション(行優先の場合は行の、列優先の場合は列の格納間隔)
+
+	size_t _outer() const noexcept { return RowMajor ? _rows : _cols; }
+	size_t _inner() const noexcept { return RowMajor ? _cols : _rows; }
+
+	/**
+	 * @brief 行(列優先の場合は列)ごとに func(line, ptr) を呼び出します。
+	 */
+	template<typename execType, typename LineFunc>
+	void _for_each_line([[maybe_unused]] execType execPolicy, LineFunc func) const {
+		auto lines = [&](size_t begin, size_t end) {
+			for (size_t line = begin; line < end; line++)
+				func(line, _data + line * _ld);
+		};
+
+		if constexpr (is_parallel_policy_v<execType>)
+			ThreadPool::instance().parallel_for(0, _outer(), std::max<size_t>(ThreadPool::default_grain / std::max<size_t>(_inner(), 1), 1), lines);
+		else
+			lines(0, _outer());
+	}
+
+public:
+	using value_type = std::remove_const_t<T>;
+	static constexpr bool row_major = RowMajor;
+
+	/**
+	 * @brief 空のビューを作成するコンストラクタ
+	 */
+	MatrixView() noexcept = default;
+
+	/**
+	 * @brief 詰めて格納されたデータに対するビューを作成するコンストラクタ
+	 * @param data 先頭要素へのポインタ
+	 * @param rows 行数
+	 * @param cols 列数
+	 */
+	MatrixView(T* data, size_t rows, size_t cols) noexcept
+		: _data(data), _rows(rows), _cols(cols), _ld(RowMajor ? cols : rows) {}
+
+	/**
+	 * @brief リーディングディメンションを指定してビューを作成するコンストラクタ
+	 * @param data 先頭要素へのポインタ
+	 * @param rows 行数
+	 * @param cols 列数
+	 * @param ld リーディングディメンション。内側の次元(行優先なら列数、列優先なら行数)以上である必要があります。
+	 * @throws std::invalid_argument ld が内側の次元より小さい場合
+	 */
+	MatrixView(T* data, size_t rows, size_t cols, size_t ld)
+		: _data(data), _rows(rows), _cols(cols), _ld(ld)
+	{
+		if (ld < _inner())
+			throw std::invalid_argument("Leading dimension must not be smaller than the inner dimension.");
+	}
+
+	/**
+	 * @brief 書き込み可能なビューから読み取り専用のビューへ変換するコンストラクタ
+	 */
+	template<typename U> requires (std::is_same_v<const U, T> && !std::is_same_v<U, T>)
+	MatrixView(const MatrixView<U, RowMajor>& other) noexcept
+		: _data(other.data()), _rows(other.rows()), _cols(other.cols()), _ld(other.ld()) {}
+
+	/**
+	 * @brief 行数を取得します。
+	 */
+	size_t rows() const noexcept { return _rows; }
+
+	/**
+	 * @brief 列数を取得します。
+	 */
+	size_t cols() const noexcept { return _cols; }
+
+	/**
+	 * @brief リーディングディメンションを取得します。
+	 */
+	size_t ld() const noexcept { return _ld; }
+
+	/**
+	 * @brief 先頭要素へのポインタを取得します。
+	 */
+	T* data() const noexcept { return _data; }
+
+	/**
+	 * @brief 要素を持たないかどうかを返します。
+	 */
+	bool empty() const noexcept { return _rows == 0 || _cols == 0; }
+
+	/**
+	 * @brief 要素が隙間なく連続して格納されているかどうかを返します。
+	 */
+	bool contiguous() const noexcept { return _ld == _inner() || _outer() <= 1; }
+
+	/**
+	 * @brief 要素にアクセスします。
+	 * @param row 行のインデックス
+	 * @param col 列のインデックス
+	 * @return 要素への参照
+	 */
+	T& operator()(size_t row, size_t col) const noexcept {
+		if constexpr (RowMajor)
+			return _data[row * _ld + col];
+		else
+			return _data[col * _ld + row];
+	}
+
+	/**
+	 * @brief 指定された行のビューを取得します。
+	 */
+	View<T> get_row(size_t row) const {
+		if constexpr (RowMajor)
+			return View<T>(_data + row * _ld, _cols);
+		else
+			return View<T>(_data + row, _cols, _ld);
+	}
+
+	/**
+	 * @brief 指定された列のビューを取得します。
+	 */
+	View<T> get_col(size_t col) const {
+		if constexpr (RowMajor)
+			return View<T>(_data + col, _rows, _ld);
+		else
+			return View<T>(_data + col * _ld, _rows);
+	}
+
+	/**
+	 * @brief 指定された行のポインタを取得します。(行優先のみ)
+	 */
+	T* get_row_ptr(size_t row) const noexcept requires RowMajor { return _data + row * _ld; }
+
+	/**
+	 * @brief 指定された列のポインタを取得します。(列優先のみ)
+	 */
+	T* get_col_ptr(size_t col) const noexcept requires (!RowMajor) { return _data + col * _ld; }
+
+	/**
+	 * @brief 部分行列のビューを取得します。
+	 * @param row 先頭の行
+	 * @param col 先頭の列
+	 * @param rows 行数
+	 * @param cols 列数
+	 * @return 同じリーディングディメンションを持つ部分行列のビュー
+	 * @throws std::out_of_range 範囲がビューの外に出る場合
+	 */
+	MatrixView block(size_t row, size_t col, size_t rows, size_t cols) const {
+		if (row > _rows || col > _cols || rows > _rows - row || cols > _cols - col)
+			throw std::out_of_range("Block is out of range in MatrixView::block");
+
+		MatrixView result;
+		result._data = (rows == 0 || cols == 0) ? _data : &(*this)(row, col);
+		result._rows = rows;
+		result._cols = cols;
+		result._ld = _ld;
+		return result;
+	}
+
+	/**
+	 * @brief [begin, end) 行のビューを取得します。ミニバッチの切り出しなどに使用します。
+	 * @throws std::out_of_range 範囲がビューの外に出る場合
+	 */
+	MatrixView rows_range(size_t begin, size_t end) const {
+		if (begin > end)
+			throw std::out_of_range("Invalid row range in MatrixView::rows_range");
+		return block(begin, 0, end - begin, _cols);
+	}
+
+	/**
+	 * @brief [begin, end) 列のビューを取得します。
+	 * @throws std::out_of_range 範囲がビューの外に出る場合
+	 */
+	MatrixView cols_range(size_t begin, size_t end) const {
+		if (begin > end)
+			throw std::out_of_range("Invalid column range in MatrixView::cols_range");
+		return block(0, begin, _rows, end - begin);
+	}
+
+	/**
+	 * @brief 参照している領域が他のビューの領域と重なる可能性があるかどうかを返します。
+	 * @note 先頭要素から最後の要素までのアドレス範囲で判定するため、互いに重ならない部分行列でも true になる場合があります。
+	 */
+	template<typename U, bool OtherMajor>
+	bool overlaps(const MatrixView<U, OtherMajor>& other) const noexcept {
+		if (empty() || other.empty())
+			return false;
+
+		const auto* a_begin = reinterpret_cast<const unsigned char*>(_data);
+		const auto* a_end = reinterpret_cast<const unsigned char*>(_data + (_outer() - 1) * _ld + _inner());
+		const size_t other_outer = OtherMajor ? other.rows() : other.cols();
+		const size_t other_inner = OtherMajor ? other.cols() : other.rows();
+		const auto* b_begin = reinterpret_cast<const unsigned char*>(other.data());
+		const auto* b_end = reinterpret_cast<const unsigned char*>(other.data() + (other_outer - 1) * other.ld() + other_inner);
+		return std::less<const unsigned char*>{}(a_begin, b_end) && std::less<const unsigned char*>{}(b_begin, a_end);
+	}
+
+	/**
+	 * @brief 参照先の各要素に関数を適用します。(書き込み可能なビューのみ)
+	 * @param func 関数オブジェクト。SimdKernel の関数オブジェクト(SimdKernel::Relu など)を渡すとSIMD命令で計算します。
+	 * @param execPolicy 実行ポリシー。並列ポリシーの場合は行(列)単位でスレッドプールに分割します。
+	 * @return 自身の参照
+	 */
+	template<typename Func, typename execType = std::execution::sequenced_policy>
+	const MatrixView& apply(Func func, execType execPolicy = execType{}) const
+	requires
+		(!std::is_const_v<T>) &&
+		std::invocable<Func, T> &&
+		std::convertible_to<std::invoke_result_t<Func, T>, T> &&
+		std::is_execution_policy_v<std::remove_cvref_t<execType>>
+	{
+		const size_t inner = _inner();
+		_for_each_line(execPolicy, [&](size_t, T* ptr) {
+			if constexpr (SimdKernel::has_unary_v<T, Func>)
+				SimdKernel::unary<SimdKernel::unary_op_of<Func>::op>(ptr, ptr, inner);
+			else
+				std::transform(ptr, ptr + inner, ptr, func);
+		});
+		return *this;
+	}
+
+	/**
+	 * @brief indices で指定した行を順に dst へコピーします。dst の i 行目は indices[i] 行目になります。
+	 * @param indices 行のインデックスの配列。順不同や重複があっても構いません。
+	 * @param dst コピー先。indices.size() 行 cols() 列で、このビューと重なってはいけません。
+	 * @param execPolicy 実行ポリシー。並列ポリシーの場合は dst の行(列)単位でスレッドプールに分割します。
+	 * @throws std::out_of_range インデックスが行数以上の場合
+	 * @throws std::invalid_argument dst の形状が一致しない場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	void gather_rows_into(std::span<const size_t> indices, const MatrixView<value_type, RowMajor>& dst, [[maybe_unused]] execType execPolicy = execType{}) const
+	requires std::is_execution_policy_v<std::remove_cvref_t<execType>>
+	{
+		_check_indices(indices);
+		if (dst.rows() != indices.size() || dst.cols() != _cols)
+			throw std::invalid_argument("Destination shape does not match in MatrixView::gather_rows_into");
+
+		const size_t count = indices.size();
+		value_type* const out = dst.data();
+		const size_t out_ld = dst.ld();
+		if constexpr (RowMajor) {
+			// 行ごとに連続した領域をそのままコピーする
+			auto rows = [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++)
+					std::copy_n(_data + indices[i] * _ld, _cols, out + i * out_ld);
+			};
+			if constexpr (is_parallel_policy_v<execType>)
+				ThreadPool::instance().parallel_for(0, count, std::max<size_t>(ThreadPool::default_grain / std::max<size_t>(_cols, 1), 1), rows);
+			else
+				rows(0, count);
+		}
+		else {
+			// 列ごとに添字で読み出す
+			auto cols = [&](size_t begin, size_t end) {
+				for (size_t col = begin; col < end; col++) {
+					const T* src = _data + col * _ld;
+					value_type* col_out = out + col * out_ld;
+					for (size_t i = 0; i < count; i++)
+						col_out[i] = src[indices[i]];
+				}
+			};
+			if constexpr (is_parallel_policy_v<execType>)
+				ThreadPool::instance().parallel_for(0, _cols, std::max<size_t>(ThreadPool::default_grain / std::max<size_t>(count, 1), 1), cols);
+			else
+				cols(0, _cols);
+		}
+	}
+
+	/**
+	 * @brief src の i 行目を indices[i] 行目に足し込みます。(書き込み可能なビューのみ)
+	 *        gather_rows_into の逆向きの操作で、埋め込み層の勾配の集計などに使用します。
+	 * @param indices 行のインデックスの配列。重複したインデックスには該当する行がすべて足し込まれます。
+	 * @param src 足し込む行列。indices.size() 行 cols() 列である必要があります。
+	 * @param execPolicy 実行ポリシー。並列ポリシーの場合は列の範囲でスレッドプールに分割します。
+	 * @return 自身の参照
+	 * @throws std::out_of_range インデックスが行数以上の場合
+	 * @throws std::invalid_argument src の形状が一致しない場合
+	 * @note 列の範囲で分割するため、インデックスが重複していても書き込みは競合せず、足し込む順序は常に indices の順になります。
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	const MatrixView& scatter_add_rows(std::span<const size_t> indices, const MatrixView<const value_type, RowMajor>& src, [[maybe_unused]] execType execPolicy = execType{}) const
+	requires (!std::is_const_v<T>) && std::is_execution_policy_v<std::remove_cvref_t<execType>>
+	{
+		_check_indices(indices);
+		if (src.rows() != indices.size() || src.cols() != _cols)
+			throw std::invalid_argument("Source shape does not match in MatrixView::scatter_add_rows");
+
+		const size_t count = indices.size();
+		const value_type* const in = src.data();
+		const size_t in_ld = src.ld();
+		auto cols = [&](size_t begin, size_t end) {
+			if constexpr (RowMajor) {
+				for (size_t i = 0; i < count; i++)
+					_combine<SimdKernel::Op::Add>(_data + indices[i] * _ld + begin, in + i * in_ld + begin, end - begin);
+			}
+			else {
+				for (size_t col = begin; col < end; col++) {
+					T* dst = _data + col * _ld;
+					const value_type* col_in = in + col * in_ld;
+					for (size_t i = 0; i < count; i++)
+						dst[indices[i]] += col_in[i];
+				}
+			}
+		};
+
+		if constexpr (is_parallel_policy_v<execType>) {
+			// 行優先では1スレッドあたりの列の範囲が短すぎるとSIMD命令が生きないため、最低でも64列ずつ割り当てる
+			const size_t grain = std::max<size_t>(ThreadPool::default_grain / std::max<size_t>(count, 1), RowMajor ? 64 : 1);
+			ThreadPool::instance().parallel_for(0, _cols, grain, cols);
+		}
+		else {
+			cols(0, _cols);
+		}
+		return *this;
+	}
+
+	/**
+	 * @brief 各列の和を計算します。{{1,2,3},{4,5,6}} -> {5,7,9}
+	 * @param execPolicy 実行ポリシー。並列ポリシーの場合は行(列)単位でスレッドプールに分割します。
+	 * @return 長さ cols() の配列
+	 * @note 並列ポリシーでは部分和を足し合わせる順序が実行ごとに変わるため、浮動小数点数の丸め誤差が一致しない場合があります。
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	MatrixVector<value_type> sum_rows(execType execPolicy = execType{}) const requires std::is_execution_policy_v<std::remove_cvref_t<execType>> {
+		return _sum<RowMajor>(execPolicy);
+	}
+
+	/**
+	 * @brief 各行の和を計算します。{{1,2,3},{4,5,6}} -> {6,15}
+	 * @param execPolicy 実行ポリシー。並列ポリシーの場合は行(列)単位でスレッドプールに分割します。
+	 * @return 長さ rows() の配列
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	MatrixVector<value_type> sum_cols(execType execPolicy = execType{}) const requires std::is_execution_policy_v<std::remove_cvref_t<execType>> {
+		return _sum<!RowMajor>(execPolicy);
+	}
+
+	/**
+	 * @brief 各列の最大値を計算します。{{1,5,3},{4,2,6}} -> {4,5,6}
+	 * @return 長さ cols() の配列
+	 * @throws std::invalid_argument 行数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	MatrixVector<value_type> max_rows(execType execPolicy = execType{}) const requires std::is_execution_policy_v<std::remove_cvref_t<execType>> {
+		if (_rows == 0)
+			throw std::invalid_argument("Cannot take the maximum over zero rows.");
+		return _max<RowMajor>(execPolicy);
+	}
+
+	/**
+	 * @brief 各行の最大値を計算します。{{1,5,3},{4,2,6}} -> {5,6}
+	 * @return 長さ rows() の配列
+	 * @throws std::invalid_argument 列数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	MatrixVector<value_type> max_cols(execType execPolicy = execType{}) const requires std::is_execution_policy_v<std::remove_cvref_t<execType>> {
+		if (_cols == 0)
+			throw std::invalid_argument("Cannot take the maximum over zero columns.");
+		return _max<!RowMajor>(execPolicy);
+	}
+
+	/**
+	 * @brief 各列で最大値を持つ行のインデックスを計算します。最大値が複数ある場合は最も小さいインデックスを返します。
+	 * @return 長さ cols() の配列
+	 * @throws std::invalid_argument 行数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	std::vector<size_t> argmax_rows(execType execPolicy = execType{}) const requires std::is_execution_policy_v<std::remove_cvref_t<execType>> {
+		if (_rows == 0)
+			throw std::invalid_argument("Cannot take the argmax over zero rows.");
+		return _argmax<RowMajor>(execPolicy);
+	}
+
+	/**
+	 * @brief 各行で最大値を持つ列のインデックスを計算します。分類の予測ラベルの取得などに使用します。
+	 * @return 長さ rows() の配列
+	 * @throws std::invalid_argument 列数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	std::vector<size_t> argmax_cols(execType execPolicy = execType{}) const requires std::is_execution_policy_v<std::remove_cvref_t<execType>> {
+		if (_cols == 0)
+			throw std::invalid_argument("Cannot take the argmax over zero columns.");
+		return _argmax<!RowMajor>(execPolicy);
+	}
+
+	/**
+	 * @brief 各列の平均を計算します。
+	 * @return 長さ cols() の配列
+	 * @throws std::invalid_argument 行数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	MatrixVector<value_type> mean_rows(execType execPolicy = execType{}) const
+	requires std::floating_point<value_type> && std::is_execution_policy_v<std::remove_cvref_t<execType>>
+	{
+		if (_rows == 0)
+			throw std::invalid_argument("Cannot take the mean over zero rows.");
+		return _mean<RowMajor>(execPolicy);
+	}
+
+	/**
+	 * @brief 各行の平均を計算します。
+	 * @return 長さ rows() の配列
+	 * @throws std::invalid_argument 列数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	MatrixVector<value_type> mean_cols(execType execPolicy = execType{}) const
+	requires std::floating_point<value_type> && std::is_execution_policy_v<std::remove_cvref_t<execType>>
+	{
+		if (_cols == 0)
+			throw std::invalid_argument("Cannot take the mean over zero columns.");
+		return _mean<!RowMajor>(execPolicy);
+	}
+
+	/**
+	 * @brief 各列の平均と分散(標本数で割る母分散)を1回の走査で計算します。
+	 * @return {平均, 分散} それぞれ長さ cols() の配列
+	 * @throws std::invalid_argument 行数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	std::pair<MatrixVector<value_type>, MatrixVector<value_type>> mean_var_rows(execType execPolicy = execType{}) const
+	requires std::floating_point<value_type> && std::is_execution_policy_v<std::remove_cvref_t<execType>>
+	{
+		if (_rows == 0)
+			throw std::invalid_argument("Cannot take the variance over zero rows.");
+		return _mean_var<RowMajor>(execPolicy);
+	}
+
+	/**
+	 * @brief 各行の平均と分散(標本数で割る母分散)を計算します。
+	 * @return {平均, 分散} それぞれ長さ rows() の配列
+	 * @throws std::invalid_argument 列数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	std::pair<MatrixVector<value_type>, MatrixVector<value_type>> mean_var_cols(execType execPolicy = execType{}) const
+	requires std::floating_point<value_type> && std::is_execution_policy_v<std::remove_cvref_t<execType>>
+	{
+		if (_cols == 0)
+			throw std::invalid_argument("Cannot take the variance over zero columns.");
+		return _mean_var<!RowMajor>(execPolicy);
+	}
+
+	/**
+	 * @brief 各列の分散(母分散)を計算します。
+	 * @return 長さ cols() の配列
+	 * @throws std::invalid_argument 行数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	MatrixVector<value_type> var_rows(execType execPolicy = execType{}) const
+	requires std::floating_point<value_type> && std::is_execution_policy_v<std::remove_cvref_t<execType>>
+	{
+		return mean_var_rows(execPolicy).second;
+	}
+
+	/**
+	 * @brief 各行の分散(母分散)を計算します。
+	 * @return 長さ rows() の配列
+	 * @throws std::invalid_argument 列数が0の場合
+	 */
+	template<typename execType = std::execution::sequenced_policy>
+	MatrixVector<value_type> var_cols(execType execPolicy = execType{}) const
+	requires std::floating_point<value_type> && std::is_execution_policy_v<std::remove_cvref_t<execType>>
+	{
+		return mean_var_cols(execPolicy).second;
+	}
+
+private:
+	// 集計の実装
+	//
+	// Across = true  : 格納上の行(列)をまたいで集計する。結果の長さは _inner()。
+	//                  各行(列)を先頭から順に読み、要素ごとの累積値にSIMD命令で足し込む。
+	//                  並列ポリシーの場合は行(列)の範囲ごとに部分的な累積値を作り、最後にまとめる。
+	// Across = false : 各行(列)の中で集計する。結果の長さは _outer()。
+	//                  行(列)ごとにSIMD命令で水平に集計し、並列ポリシーの場合は行(列)単位で分割する。
+
+	/**
+	 * @brief 行のインデックスがすべて範囲内かどうかを確認します。
+	 * @throws std::out_of_range インデックスが行数以上の場合
+	 */
+	void _check_indices(std::span<const size_t> indices) const {
+		for (size_t index : indices)
+			if (index >= _rows)
+				throw std::out_of_range("Row index is out of range in MatrixView");
+	}
+
+	/**
+	 * @brief acc[i] = acc[i] op src[i]
+	 */
+	template<SimdKernel::Op op>
+	static void _combine(value_type* acc, const value_type* src, size_t n) {
+		if constexpr (SimdKernel::vectorizable_v<value_type>)
+			SimdKernel::binary<op>(static_cast<const value_type*>(acc), src, acc, n);
+		else
+			std::transform(acc, acc + n, src, acc, [](value_type a, value_type b) { return SimdKernel::detail::apply<op>(a, b); });
+	}
+
+	/**
+	 * @brief 行(列)の範囲 [begin, end) ごとに chunk(begin, end) で部分的な結果を作り、merge(result, part) でまとめます。
+	 *        _outer() は1以上である必要があります。
+	 */
+	template<typename execType, typename Chunk, typename Merge>
+	auto _reduce_lines([[maybe_unused]] execType execPolicy, Chunk chunk, [[maybe_unused]] Merge merge) const {
+		using Acc = std::invoke_result_t<Chunk, size_t, size_t>;
+		if constexpr (is_parallel_policy_v<execType>) {
+			std::optional<Acc> result;
+			std::mutex mutex;
+			ThreadPool::instance().parallel_for(0, _outer(), std::max<size_t>(ThreadPool::default_grain / std::max<size_t>(_inner(), 1), 1), [&](size_t begin, size_t end) {
+				Acc part = chunk(begin, end);
+				std::lock_guard<std::mutex> lock(mutex);
+				if (result)
+					merge(*result, part);
+				else
+					result.emplace(std::move(part));
+			});
+			return std::move(*result);
+		}
+		else {
+			return chunk(0, _outer());
+		}
+	}
+
+	template<bool Across, typename execType>
+	MatrixVector<value_type> _sum(execType execPolicy) const {
+		const size_t inner = _inner();
+		if constexpr (Across) {
+			if (_outer() == 0)
+				return MatrixVector<value_type>(inner, value_type(0));
+
+			if constexpr (is_float16_v<value_type>) {
+				// 16ビット浮動小数点数は float で累積し、最後に1回だけ丸める
+				const MatrixVector<float> sum = _reduce_lines(execPolicy,
+					[&](size_t begin, size_t end) {
+						MatrixVector<float> acc(inner, 0.0f), line_buf(inner);
+						for (size_t line = begin; line < end; line++) {
+							SimdKernel::convert(_data + line * _ld, line_buf.data(), inner);
+							SimdKernel::binary<SimdKernel::Op::Add>(static_cast<const float*>(acc.data()), line_buf.data(), acc.data(), inner);
+						}
+						return acc;
+					},
+					[&](MatrixVector<float>& acc, const MatrixVector<float>& part) {
+						SimdKernel::binary<SimdKernel::Op::Add>(static_cast<const float*>(acc.data()), part.data(), acc.data(), inner);
+					});
+				MatrixVector<value_type> result(inner);
+				SimdKernel::convert(sum.data(), result.data(), inner);
+				return result;
+			}
+			return _reduce_lines(execPolicy,
+				[&](size_t begin, size_t end) {
+					MatrixVector<value_type> acc(_data + begin * _ld, _data + begin * _ld + inner);
+					for (size_t line = begin + 1; line < end; line++)
+						_combine<SimdKernel::Op::Add>(acc.data(), _data + line * _ld, inner);
+					return acc;
+				},
+				[&](MatrixVector<value_type>& acc, const MatrixVector<value_type>& part) {
+					_combine<SimdKernel::Op::Add>(acc.data(), part.data(), inner);
+				});
+		}
+		else {
+			MatrixVector<value_type> result(_outer());
+			_for_each_line(execPolicy, [&](size_t line, const T* ptr) {
+				result[line] = SimdKernel::reduce_sum(ptr, inner);
+			});
+			return result;
+		}
+	}
+
+	template<bool Across, typename execType>
+	MatrixVector<value_type> _max(execType execPolicy) const {
+		const size_t inner = _inner();
+		if constexpr (Across) {
+			return _reduce_lines(execPolicy,
+				[&](size_t begin, size_t end) {
+					MatrixVector<value_type> acc(_data + begin * _ld, _data + begin * _ld + inner);
+					for (size_t line = begin + 1; line < end; line++)
+						_combine<SimdKernel::Op::Max>(acc.data(), _data + line * _ld, inner);
+					return acc;
+				},
+				[&](MatrixVector<value_type>& acc, const MatrixVector<value_type>& part) {
+					_combine<SimdKernel::Op::Max>(acc.data(), part.data(), inner);
+				});
+		}
+		else {
+			MatrixVector<value_type> result(_outer());
+			_for_each_line(execPolicy, [&](size_t line, const T* ptr) {
+				result[line] = SimdKernel::reduce_max(ptr, inner);
+			});
+			return result;
+		}
+	}
+
+	template<bool Across, typename execType>
+	std::vector<size_t> _argmax(execType execPolicy) const {
+		const size_t inner = _inner();
+		if constexpr (Across) {
+			using Acc = std::pair<MatrixVector<value_type>, std::vector<size_t>>;
+			Acc result = _reduce_lines(execPolicy,
+				[&](size_t begin, size_t end) {
+					Acc acc(MatrixVector<value_type>(_data + begin * _ld, _data + begin * _ld + inner), std::vector<size_t>(inner, begin));
+					value_type* best = acc.first.data();
+					size_t* index = acc.second.data();
+					for (size_t line = begin + 1; line < end; line++) {
+						const T* ptr = _data + line * _ld;
+						for (size_t i = 0; i < inner; i++) {
+							if (best[i] < ptr[i]) {
+								best[i] = ptr[i];
+								index[i] = line;
+							}
+						}
+					}
+					return acc;
+				},
+				[&](Acc& acc, const Acc& part) {
+					for (size_t i = 0; i < inner; i++) {
+						if (acc.first[i] < part.first[i] || (!(part.first[i] < acc.first[i]) && part.second[i] < acc.second[i])) {
+							acc.first[i] = part.first[i];
+							acc.second[i] = part.second[i];
+						}
+					}
+				});
+			return std::move(result.second);
+		}
+		else {
+			std::vector<size_t> result(_outer());
+			_for_each_line(execPolicy, [&](size_t line, const T* ptr) {
+				// 最大値を求めてから最初に一致する位置を探す (行(列)はキャッシュに載っているため2回目の走査は安価)
+				const value_type max = SimdKernel::reduce_max(ptr, inner);
+				size_t index = static_cast<size_t>(std::find(ptr, ptr + inner, max) - ptr);
+				// NaN を含む場合は一致する要素がないことがあるため、軸方向の argmax と同じ比較で走査し直す
+				if (index == inner) {
+					index = 0;
+					for (size_t i = 1; i < inner; i++) {
+						if (ptr[index] < ptr[i])
+							index = i;
+					}
+				}
+				result[line] = index;
+			});
+			return result;
+		}
+	}
+
+	template<bool Across, typename execType>
+	MatrixVector<value_type> _mean(execType execPolicy) const {
+		MatrixVector<value_type> result = _sum<Across>(execPolicy);
+		const value_type count = static_cast<value_type>(Across ? _outer() : _inner());
+		for (value_type& x : result)
+			x /= count;
+		return result;
+	}
+
+	template<bool Across, typename execType>
+	std::pair<MatrixVector<value_type>, MatrixVector<value_type>> _mean_var(execType execPolicy) const {
+		const size_t inner = _inner();
+		if constexpr (Across) {
+			// Welford法で平均と偏差平方和を1回の走査で更新し、部分的な結果は Chan らの式でまとめる
+			struct Acc {
+				size_t count = 0;
+				MatrixVector<value_type> mean, m2;
+			};
+			Acc result = _reduce_lines(execPolicy,
+				[&](size_t begin, size_t end) {
+					Acc acc{ 0, MatrixVector<value_type>(inner, value_type(0)), MatrixVector<value_type>(inner, value_type(0)) };
+					for (size_t line = begin; line < end; line++) {
+						acc.count++;
+						SimdKernel::welford(_data + line * _ld, acc.mean.data(), acc.m2.data(), value_type(1) / static_cast<value_type>(acc.count), inner);
+					}
+					return acc;
+				},
+				[&](Acc& acc, const Acc& part) {
+					const value_type na = static_cast<value_type>(acc.count), nb = static_cast<value_type>(part.count);
+					const value_type n = na + nb;
+					for (size_t i = 0; i < inner; i++) {
+						const value_type delta = part.mean[i] - acc.mean[i];
+						acc.mean[i] += delta * nb / n;
+						acc.m2[i] += part.m2[i] + delta * delta * na * nb / n;
+					}
+					acc.count += part.count;
+				});
+
+			const value_type count = static_cast<value_type>(result.count);
+			for (value_type& x : result.m2)
+				x /= count;
+			return { std::move(result.mean), std::move(result.m2) };
+		}
+		else {
+			// 行(列)はキャッシュに載っているため、平均を求めてから偏差平方和を計算する2パス法で精度を保つ
+			MatrixVector<value_type> mean(_outer()), var(_outer());
+			const value_type count = static_cast<value_type>(inner);
+			_for_each_line(execPolicy, [&](size_t line, const T* ptr) {
+				mean[line] = SimdKernel::reduce_sum(ptr, inner) / count;
+				var[line] = SimdKernel::reduce_sq_dev(ptr, mean[line], inner) / count;
+			});
+			return { std::move(mean), std::move(var) };
+		}
+	}
+};
+
+#endif // SANAE_NEURALNETWORK_MATRIXVIEW
\ No newline at end of file
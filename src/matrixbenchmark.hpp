@@ -9,12 +9,19 @@
 #endif
 
 template<typename func>
-void benchmark(const std::string& testName, func f) {
+double benchmark(const std::string& testName, func f) {
 	auto start = std::chrono::high_resolution_clock::now();
 	f();
 	auto end = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double, std::milli> duration = end - start;
 	std::cout << testName << " took " << duration.count() << " ms\n";
+	return duration.count();
+}
+
+// 行列積の演算性能(GFLOP/s)を表示
+static void print_gflops(double ms, size_t m, size_t n, size_t k) {
+	const double flops = 2.0 * static_cast<double>(m) * static_cast<double>(n) * static_cast<double>(k);
+	std::cout << "  -> " << flops / (ms * 1e6) << " GFLOP/s\n";
 }
 
 constexpr size_t MATRIX_SIZE = 1000;
@@ -53,7 +60,7 @@ static void run_benchmarks() {
 	}
 #endif
 
-	std::cout << "BLAS disabled tests." << std::endl;
+	std::cout << "BLAS disabled tests. (SIMD: " << SimdKernel::isa_name(SimdKernel::active_isa()) << ")" << std::endl;
 	// 加算
 	benchmark("Addition", [&]() {
 		matA.add(matB);
@@ -78,15 +85,75 @@ static void run_benchmarks() {
 	benchmark("Hadamard Division", [&]() {
 		matA.hadamard_div(matB);
 		});
+
+	// スカラー倍の加算
+	benchmark("AXPY", [&]() {
+		matA.axpy(0.5f, matB);
+		});
 	// スカラー除算
 	benchmark("Scalar Division", [&]() {
 		matA.scalar_div(2.0);
 		});
 
+	// 転置
+	benchmark("Transpose (in-place)", [&]() {
+		matA.transpose();
+		});
+	benchmark("Layout Conversion", [&]() {
+		auto converted = matA.convertLayout();
+		});
+
+	// 集計
+	benchmark("Sum Rows", [&]() {
+		auto summed = matA.sum_rows();
+		});
+	benchmark("Sum Cols", [&]() {
+		auto summed = matA.sum_cols();
+		});
+	benchmark("Var Rows (Welford)", [&]() {
+		auto var = matA.var_rows();
+		});
+
+	// 超越関数 (標準ライブラリとSIMDカーネルの多項式近似)
+	benchmark("Exp (std::exp)", [&]() {
+		auto result = matA.apply_copy([](Type x) { return std::exp(x); });
+		});
+	benchmark("Exp (SIMD)", [&]() {
+		auto result = matA.apply_copy(SimdKernel::Exp{});
+		});
+	benchmark("Tanh (SIMD)", [&]() {
+		auto result = matA.apply_copy(SimdKernel::Tanh{});
+		});
+	SimdKernel::set_math_mode(SimdKernel::MathMode::Fast);
+	benchmark("Exp (SIMD, fast)", [&]() {
+		auto result = matA.apply_copy(SimdKernel::Exp{});
+		});
+	benchmark("Tanh (SIMD, fast)", [&]() {
+		auto result = matA.apply_copy(SimdKernel::Tanh{});
+		});
+	SimdKernel::set_math_mode(SimdKernel::MathMode::Exact);
+
 	// 行列積
-	benchmark("Matrix Multiplication", [&]() {
+	print_gflops(benchmark("Matrix Multiplication", [&]() {
 		matA.matrix_mul(matB);
-		});
+		}), MATRIX_SIZE, MATRIX_SIZE, MATRIX_SIZE);
+
+	// Strassen-Winograd 法 (GFLOPS は通常の行列積の演算量で換算)
+	print_gflops(benchmark("Matrix Multiplication (Strassen)", [&]() {
+		auto product = matA.template matrix_mul_copy<false, false, false, GemmAlgorithm::Strassen>(matB);
+		}), MATRIX_SIZE, MATRIX_SIZE, MATRIX_SIZE);
+
+	// 16ビット浮動小数点数 (float で累積)
+	{
+		Matrix<bfloat16, false> halfA(MATRIX_SIZE, MATRIX_SIZE, [&]() { return bfloat16(static_cast<float>(dist(engine))); });
+		Matrix<bfloat16, false> halfB(MATRIX_SIZE, MATRIX_SIZE, [&]() { return bfloat16(static_cast<float>(dist(engine))); });
+		benchmark("Addition (bfloat16)", [&]() {
+			halfA.add(halfB);
+			});
+		print_gflops(benchmark("Matrix Multiplication (bfloat16)", [&]() {
+			auto product = halfA.matrix_mul_copy(halfB);
+			}), MATRIX_SIZE, MATRIX_SIZE, MATRIX_SIZE);
+	}
 		
 	// BLAS使用版
 	if constexpr (can_use_blas<Type>::value) {
@@ -100,8 +167,8 @@ static void run_benchmarks() {
 		benchmark("Scalar Multiplication with BLAS", [&]() {
 			matA.scalar_mul<true>(2.0);
 			});
-		benchmark("Matrix Multiplication with BLAS", [&]() {
+		print_gflops(benchmark("Matrix Multiplication with BLAS", [&]() {
 			matA.matrix_mul<true>(matB);
-			});
+			}), MATRIX_SIZE, MATRIX_SIZE, MATRIX_SIZE);
 	}
 }
\ No newline at end of file
@@ -2,7 +2,14 @@
 #define MATRIXTEST_HPP
 
 #include "include/matrix/matrix"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
 #include <iostream>
+#include <limits>
+#include <type_traits>
+#include <vector>
 
 void run_matrix_tests() {
 #ifdef USE_OPENBLAS
@@ -154,6 +161,78 @@ void run_matrix_tests() {
         std::cout << "Scalar division performed.\n" << std::endl;
     }
 
+    // 式テンプレート
+    {
+        std::cout << "Testing expression templates...\n";
+        MatrixType mat1(data1);
+        MatrixType mat2(data2);
+        MatrixType result = mat1 - mat2 * 0.5f + 1.0f;
+
+        std::cout << mat1 << " - " << mat2 << " * 0.5 + 1 = " << result << std::endl;
+        std::cout << "(mat1 ^ mat2) / 2 = " << (mat1 ^ mat2) / 2.0f << std::endl;
+        std::cout << "mat1 / mat2 = " << mat1 / mat2 << std::endl;
+
+        MatrixType quotient(data2);
+        try {
+            quotient = mat1 / (mat2 - mat2);
+        } catch (const std::invalid_argument& e) {
+            std::cout << "Caught expected exception: " << e.what() << std::endl;
+        }
+        std::cout << "unchanged after failed division: " << (quotient == MatrixType(data2)) << std::endl; // 1
+
+        // 行列同士の演算は評価した行列を返すため、auto で受けても被演算子を参照しない
+        auto sum = mat1 + mat2;
+        static_assert(std::is_same_v<decltype(sum), MatrixType>);
+        MatrixType fused = MatrixExpr::lazy(mat1) - mat2 * 0.5f + 1.0f; // 式ノードを含む式は1回のループで評価する
+        mat2 = mat2 * 0.0f;
+        std::cout << "auto sum = mat1 + mat2 (mat2 cleared afterwards): " << sum << std::endl;
+        std::cout << "lazy(mat1) - mat2 * 0.5 + 1 == result: " << (fused == result) << std::endl; // 1
+
+        mat1 = mat1 + mat1 * 2.0f;
+        std::cout << "mat1 = mat1 + mat1 * 2: " << mat1 << std::endl;
+        std::cout << "Expression templates tested.\n" << std::endl;
+    }
+
+    // スレッドプール (入れ子の parallel_for、例外の伝播、スレッド数の変更)
+    {
+        std::cout << "Testing thread pool...\n";
+        ThreadPool::set_num_threads(4);
+        ThreadPool& pool = ThreadPool::instance();
+        std::cout << "num_threads = " << pool.num_threads() << std::endl; // 4
+
+        std::atomic<size_t> total = 0;
+        pool.parallel_for(0, 8, 1, [&](size_t begin, size_t end) {
+            for (size_t outer = begin; outer < end; outer++) {
+                pool.parallel_for(0, 1000, 10, [&](size_t b, size_t e) {
+                    size_t local = 0;
+                    for (size_t i = b; i < e; i++)
+                        local += i;
+                    total += local;
+                });
+            }
+        });
+        std::cout << "nested sum = " << total << std::endl; // 8 * 499500 = 3996000
+
+        try {
+            pool.parallel_for(0, 100, 1, [](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    if (i == 42)
+                        throw std::runtime_error("task 42 failed");
+                }
+            });
+        } catch (const std::runtime_error& e) {
+            std::cout << "Caught expected exception: " << e.what() << std::endl;
+        }
+
+        ThreadPool::set_num_threads(2);
+        std::atomic<size_t> count = 0;
+        pool.parallel_for(0, 1000, 1, [&](size_t begin, size_t end) { count += end - begin; });
+        std::cout << "after set_num_threads(2): num_threads = " << pool.num_threads() << ", count = " << count << std::endl; // 2, 1000
+
+        ThreadPool::set_num_threads(0); // 既定のスレッド数に戻す
+        std::cout << "Thread pool tested.\n" << std::endl;
+    }
+
     // 行列積
     {
         std::cout << "Testing matrix multiplication...\n";
@@ -164,6 +243,239 @@ void run_matrix_tests() {
         std::cout << "Matrix multiplication performed.\n" << std::endl;
     }
 
+    // ネイティブの行列積を素朴な3重ループと比較する (端のタイル、転置、列優先、リーディングディメンジョンのパディング)
+    {
+        std::cout << "Testing GEMM against a reference...\n";
+        struct Shape { size_t m, n, k; };
+        const std::vector<Shape> shapes = { {67, 131, 53}, {1, 131, 53}, {67, 1, 53} }; // 1行・1列は行列ベクトル積の経路
+        constexpr size_t pad = 5;
+
+        auto check = [&]<typename T>(const char* name, double tolerance, auto multiply) {
+            double worst = 0;
+            bool padding_kept = true;
+            for (const Shape& s : shapes) {
+                for (int layout = 0; layout < 4; layout++) {
+                    for (int trans = 0; trans < 4; trans++) {
+                        const bool am = layout & 1, bm = layout & 2, ta = trans & 1, tb = trans & 2;
+                        // 格納されている行列の行数・列数と、要素の位置
+                        const size_t ar = ta ? s.k : s.m, ac = ta ? s.m : s.k;
+                        const size_t br = tb ? s.n : s.k, bc = tb ? s.k : s.n;
+                        const size_t lda = (am ? ac : ar) + pad, ldb = (bm ? bc : br) + pad, ldc = (am ? s.n : s.m) + pad;
+                        auto at = [](bool major, size_t ld, size_t r, size_t c) { return major ? r * ld + c : c * ld + r; };
+
+                        uint32_t state = 12345;
+                        auto next = [&]() { state = state * 1664525u + 1013904223u; return static_cast<float>((state >> 24) % 17) / 8.0f - 1.0f; };
+                        std::vector<T> a((am ? ar : ac) * lda), b((bm ? br : bc) * ldb), c((am ? s.m : s.n) * ldc, T(7.0f));
+                        for (auto& x : a) x = T(next());
+                        for (auto& x : b) x = T(next());
+                        for (size_t i = 0; i < s.m; i++)
+                            for (size_t j = 0; j < s.n; j++)
+                                c[at(am, ldc, i, j)] = T(next());
+                        const std::vector<T> c0 = c;
+
+                        const T alpha = T(1.5f), beta = T(0.5f);
+                        multiply(a.data(), b.data(), c.data(), s.m, s.n, s.k, am, bm, ta, tb, alpha, beta, lda, ldb, ldc);
+
+                        for (size_t i = 0; i < s.m; i++) {
+                            for (size_t j = 0; j < s.n; j++) {
+                                double sum = 0, scale = 0;
+                                for (size_t p = 0; p < s.k; p++) {
+                                    const double x = static_cast<float>(a[ta ? at(am, lda, p, i) : at(am, lda, i, p)]);
+                                    const double y = static_cast<float>(b[tb ? at(bm, ldb, j, p) : at(bm, ldb, p, j)]);
+                                    sum += x * y;
+                                    scale += std::abs(x * y);
+                                }
+                                const double old = static_cast<float>(c0[at(am, ldc, i, j)]);
+                                const double ref = 1.5 * sum + 0.5 * old;
+                                const double err = std::abs(static_cast<float>(c[at(am, ldc, i, j)]) - ref) / (1.5 * scale + 0.5 * std::abs(old) + 1);
+                                worst = std::max(worst, err);
+                            }
+                        }
+                        // パディング領域は書き換えない
+                        for (size_t line = 0; line < (am ? s.m : s.n); line++)
+                            for (size_t i = (am ? s.n : s.m); i < ldc; i++)
+                                padding_kept &= static_cast<float>(c[line * ldc + i]) == 7.0f;
+                    }
+                }
+            }
+            std::cout << name << ": max relative error " << worst << (worst <= tolerance && padding_kept ? " (ok)" : " (FAILED)") << std::endl;
+        };
+        auto native = [](const auto* A, const auto* B, auto* C, auto... args) {
+            NativeGemm::MatMul<std::remove_pointer_t<decltype(C)>>::multiply(A, B, C, args...);
+        };
+        check.operator()<float>("float", 1e-6, native);
+        check.operator()<double>("double", 1e-12, native);
+        check.operator()<bfloat16>("bfloat16", 1.0 / 256, native);
+        check.operator()<float16>("float16", 1.0 / 2048, native);
+#if defined(USE_OPENBLAS)
+        auto blas = [](const auto* A, const auto* B, auto* C, auto... args) {
+            BlasGemm::MatMul<std::remove_pointer_t<decltype(C)>>::multiply(A, B, C, args...);
+        };
+        check.operator()<float>("OpenBLAS float", 1e-6, blas);
+        check.operator()<double>("OpenBLAS double", 1e-12, blas);
+#endif
+        std::cout << "GEMM tested.\n" << std::endl;
+    }
+
+    // Strassen-Winograd 法 (小さな行列でも再帰するようにカットオフを下げる)
+    {
+        std::cout << "Testing Strassen multiplication...\n";
+        Matrix<double> mat1(5, 5, [n = 0]() mutable { return static_cast<double>(n++ % 7); });
+        Matrix<double> mat2(5, 5, [n = 0]() mutable { return static_cast<double>(n++ % 5) - 2; });
+
+        Strassen::set_cutoff(2);
+        const auto strassen = mat1.matrix_mul_copy<false, false, false, GemmAlgorithm::StrassenChecked>(mat2);
+        Strassen::set_cutoff(Strassen::default_cutoff);
+        std::cout << "levels = " << Strassen::levels(5, 5, 5, 2) << std::endl; // 2
+        std::cout << "strassen == blocked: " << (strassen == mat1.matrix_mul_copy(mat2) ? "true" : "false") << std::endl; // true (整数値のため丸め誤差なし)
+        std::cout << "Strassen multiplication tested.\n" << std::endl;
+    }
+
+    // 既存の行列への行列積の書き込み・累積
+    {
+        std::cout << "Testing gemm_into...\n";
+        MatrixType mat1(data1);
+        MatrixType mat2(data2);
+        MatrixType out(3, 3, []() { return 1.0f; });
+
+        gemm_into(out, mat1, mat2, 1.0f, 1.0f);
+        std::cout << "mat1 * mat2 + 1 = " << out << std::endl;
+        gemm_into<false, true, false>(out, mat1, mat2, 0.5f);
+        std::cout << "0.5 * mat1^T * mat2 = " << out << std::endl;
+        std::cout << "gemm_into tested.\n" << std::endl;
+    }
+
+    // 小さな行列積のバッチ計算 (行方向に積み重ねた行列と、ビューの配列)
+    {
+        std::cout << "Testing batched GEMM...\n";
+        Matrix<float> a({ {1, 2}, {3, 4}, {1, 0}, {0, 1} }); // 2x2 を2個
+        Matrix<float> b({ {1, 1}, {0, 1}, {2, 3}, {4, 5} });
+        Matrix<float> c(4, 2);
+
+        gemm_batched(2, c, a, b);
+        std::cout << "stacked = " << c << std::endl; // {{1,3},{3,7},{2,3},{4,5}}
+
+        std::vector<MatrixView<float>> outs = { c.view().rows_range(0, 2), c.view().rows_range(2, 4) };
+        std::vector<MatrixView<const float>> lhs = { a.view().rows_range(2, 4), a.view().rows_range(0, 2) };
+        std::vector<MatrixView<const float>> rhs = { b.view().rows_range(0, 2), b.view().rows_range(2, 4) };
+        gemm_batched(outs, lhs, rhs);
+        std::cout << "array = " << c << std::endl; // {{1,1},{0,1},{10,13},{22,29}}
+        std::cout << "Batched GEMM tested.\n" << std::endl;
+    }
+
+    // 1行・1列の行列積 (行列ベクトル積として計算される)
+    {
+        std::cout << "Testing matrix-vector products...\n";
+        Matrix<float> row({ {1, 2, 3} });
+        Matrix<float> col({ {1}, {0}, {-1} });
+        Matrix<float> mat({ {1, 2}, {3, 4}, {5, 6} });
+
+        std::cout << "row * mat = " << matmul(row, mat) << std::endl; // {{22,28}}
+        std::cout << "mat^T * col = " << matmul<false, true, false>(mat, col) << std::endl; // {{-4},{-4}}
+        std::cout << "Matrix-vector products tested.\n" << std::endl;
+    }
+
+    // ビューによるコピーなしの部分行列参照
+    {
+        std::cout << "Testing MatrixView...\n";
+        Matrix<float> dataset({ {1, 2, 3}, {4, 5, 6}, {7, 8, 9}, {10, 11, 12} });
+        Matrix<float> weight({ {1, 0}, {0, 1}, {1, 1} });
+
+        auto batch = dataset.view().rows_range(1, 3); // 2行目と3行目をコピーせずに参照する
+        std::cout << "batch = " << Matrix<float>(batch) << std::endl;
+        std::cout << "batch * weight = " << matmul(batch, weight) << std::endl;
+
+        auto sums = batch.sum_rows();
+        std::cout << "batch.sum_rows() = {" << sums[0] << "," << sums[1] << "," << sums[2] << "}" << std::endl;
+
+        dataset.view().block(0, 1, 2, 2).apply(SimdKernel::Neg{});
+        std::cout << "dataset (block negated) = " << dataset << std::endl;
+        std::cout << "MatrixView tested.\n" << std::endl;
+    }
+
+    // コンパイル時に形状が決まる行列
+    {
+        std::cout << "Testing FixedMatrix...\n";
+        FixedMatrix<float, 2, 3> a({ {1, 2, 3}, {4, 5, 6} });
+        FixedMatrix<float, 3, 2> b({ {1, 0}, {0, 1}, {1, 1} });
+
+        std::cout << "a * b = " << a * b << std::endl; // 2x3 * 3x2 -> 2x2 (次元の不一致はコンパイルエラー)
+        std::cout << "a + a * 2 = " << a + a * 2.0f << std::endl;
+        std::cout << "a^T = " << a.transpose_copy() << std::endl;
+        std::cout << "a.sum_rows() = " << a.sum_rows() << std::endl;
+        std::cout << "a.to_matrix() * b = " << matmul(a.to_matrix(), b) << std::endl;
+        std::cout << "FixedMatrix tested.\n" << std::endl;
+    }
+
+    // 16ビット浮動小数点数
+    {
+        std::cout << "Testing bfloat16 / float16...\n";
+        Matrix<bfloat16> a({ {1.0f, 2.0f, 3.0f}, {4.0f, 5.0f, 6.0f} });
+        Matrix<bfloat16> b({ {1.0f, 0.0f}, {0.0f, 1.0f}, {1.0f, 1.0f} });
+        Matrix<float16> h({ {0.1f, 65504.0f}, {1e-7f, -2.5f} });
+
+        std::cout << "bfloat16(1.00390625f) = " << bfloat16(1.00390625f) << std::endl; // 偶数への丸めで1になる
+        std::cout << "a * b = " << a * b << std::endl; // float で累積する
+        std::cout << "a + a = " << Matrix<bfloat16>(a + a) << std::endl;
+        std::cout << "a.sum_rows() = " << a.sum_rows() << std::endl;
+        std::cout << "float16 = " << h << std::endl;
+        std::cout << "bfloat16 / float16 tested.\n" << std::endl;
+    }
+
+    // int8 の行列積
+    {
+        std::cout << "Testing int8 GEMM...\n";
+        const uint8_t a[2 * 5] = { 1, 2, 3, 4, 5, 255, 0, 128, 7, 1 };
+        const int8_t b[5 * 3] = { 1, -1, 0, 2, 0, -128, 3, 1, 1, 4, -2, 127, 5, 0, 1 };
+        int32_t c[2 * 3] = {};
+
+        Int8Gemm::MatMul::multiply(a, b, c, 2, 3, 5);
+        std::cout << "kernel = " << static_cast<int>(Int8Gemm::active_kernel()) << std::endl;
+        std::cout << "a * b = {{" << c[0] << "," << c[1] << "," << c[2] << "},{" << c[3] << "," << c[4] << "," << c[5] << "}}" << std::endl; // {{55,-6,260},{672,-141,1018}}
+        std::cout << "int8 GEMM tested.\n" << std::endl;
+    }
+
+    // 疎行列
+    {
+        std::cout << "Testing sparse matrix...\n";
+        SparseMatrix<float> sparse(Matrix<float>({ {0, 2, 0}, {0, 0, 0}, {1, 0, 3} }));
+        Matrix<float> dense({ {1, 2}, {3, 4}, {5, 6} });
+
+        std::cout << "nnz = " << sparse.nnz() << std::endl; // 3
+        std::cout << "sparse * dense = " << spmm(sparse, dense) << std::endl; // {{6,8},{0,0},{16,20}}
+        std::cout << "sparse^T * dense = " << spmm<true>(sparse, dense) << std::endl; // {{5,6},{2,4},{15,18}}
+        std::cout << "Sparse matrix tested.\n" << std::endl;
+    }
+
+    // バイナリ形式での保存とメモリマップでの読み込み
+    {
+        std::cout << "Testing matrix file...\n";
+        const std::string path = (std::filesystem::temp_directory_path() / "sanae_matrixtest.mat").string();
+        MatrixType mat(data1);
+        MatrixFile::write(path, mat);
+        {
+            MappedMatrix<float> mapped(path);
+            std::cout << "mapped = " << Matrix<float>(mapped.view()) << std::endl; // data1
+            std::cout << "mapped * mat = " << matmul(mapped, mat) << std::endl;
+        }
+        std::filesystem::remove(path);
+        std::cout << "Matrix file tested.\n" << std::endl;
+    }
+
+    // パディング付きの格納領域
+    {
+        std::cout << "Testing padded storage...\n";
+        using PaddedMatrix = Matrix<float, true, PaddedVector<float>>;
+        PaddedMatrix mat1({ {1, 2, 3}, {4, 5, 6}, {7, 8, 9} });
+        PaddedMatrix mat2({ {9, 8, 7}, {6, 5, 4}, {3, 2, 1} });
+
+        std::cout << "ld = " << mat1.ld() << std::endl;
+        std::cout << "mat1 + mat2 = " << PaddedMatrix(mat1 + mat2) << std::endl;
+        std::cout << "mat1 * mat2 = " << mat1 * mat2 << std::endl;
+        std::cout << "mat1^T = " << mat1.transpose_copy() << std::endl;
+        std::cout << "Padded storage tested.\n" << std::endl;
+    }
+
     // 転置
     {
         std::cout << "Testing transpose methods...\n";
@@ -187,6 +499,51 @@ void run_matrix_tests() {
         std::cout << "Apply methods tested.\n" << std::endl;
     }
 
+    // SIMDカーネル
+    {
+        std::cout << "Testing SIMD kernels (" << SimdKernel::isa_name(SimdKernel::active_isa()) << ")...\n";
+        MatrixType mat({ {1, -2, 3}, {-4, 5, -6}, {7, -8, 9} });
+        MatrixType ones(3, 3, []() { return 1.0f; });
+
+        std::cout << "relu: " << mat.apply_copy(SimdKernel::Relu{}) << std::endl;
+        std::cout << "step: " << mat.apply_copy(SimdKernel::Step{}) << std::endl;
+        std::cout << "|mat| + 2 * ones = " << mat.apply_copy(SimdKernel::Abs{}).axpy(2.0f, ones) << std::endl;
+        std::cout << "ones + mat ⊙ mat = " << ones.hadamard_fma(mat, mat) << std::endl;
+        std::cout << "SIMD kernels tested.\n" << std::endl;
+    }
+
+    // 超越関数のSIMDカーネル
+    {
+        std::cout << "Testing transcendental kernels...\n";
+        Matrix<float> x(1, 1001);
+        for (size_t j = 0; j < x.cols(); j++)
+            x(0, j) = -10.0f + 0.02f * static_cast<float>(j);
+
+        auto max_rel_error = [&](auto func, auto reference) {
+            const Matrix<float> y = x.apply_copy(func);
+            double worst = 0;
+            for (size_t j = 0; j < x.cols(); j++) {
+                const double want = reference(static_cast<double>(x(0, j)));
+                worst = std::max(worst, std::abs(static_cast<double>(y(0, j)) - want) / std::max(std::abs(want), 1e-30));
+            }
+            return worst;
+        };
+        for (SimdKernel::MathMode mode : { SimdKernel::MathMode::Exact, SimdKernel::MathMode::Fast }) {
+            SimdKernel::set_math_mode(mode);
+            std::cout << (mode == SimdKernel::MathMode::Exact ? "exact" : "fast") << " max relative error:"
+                << " exp " << max_rel_error(SimdKernel::Exp{}, [](double v) { return std::exp(v); })
+                << " log " << max_rel_error(SimdKernel::Log{}, [](double v) { return std::log(v); })
+                << " tanh " << max_rel_error(SimdKernel::Tanh{}, [](double v) { return std::tanh(v); })
+                << " sigmoid " << max_rel_error(SimdKernel::Sigmoid{}, [](double v) { return 1 / (1 + std::exp(-v)); })
+                << " softplus " << max_rel_error(SimdKernel::Softplus{}, [](double v) { return std::log1p(std::exp(v)); }) << std::endl;
+        }
+        SimdKernel::set_math_mode(SimdKernel::MathMode::Exact);
+
+        Matrix<float> special({ { 0.0f, -1.0f, std::numeric_limits<float>::infinity() } });
+        std::cout << "log(0, -1, inf): " << special.apply_copy(SimdKernel::Log{}) << std::endl;
+        std::cout << "Transcendental kernels tested.\n" << std::endl;
+    }
+
     // 行ごとの演算適用
     {
         std::cout << "Testing apply_row and apply_row_copy...\n";
@@ -210,6 +567,225 @@ void run_matrix_tests() {
         std::cout << "sum_rows result:\n" << summed << std::endl;
         std::cout << "sum_rows tested.\n" << std::endl;
     }
+
+    // 行・列方向の集計
+    {
+        std::cout << "Testing reductions...\n";
+        Matrix<float> mat({ {1, 5, 3}, {4, 2, 6} });
+        auto argmax = mat.argmax_cols();
+
+        std::cout << "sum_cols: " << mat.sum_cols() << std::endl;
+        std::cout << "max_rows: " << mat.max_rows() << std::endl;
+        std::cout << "max_cols: " << mat.max_cols(std::execution::par) << std::endl;
+        std::cout << "argmax_cols: {" << argmax[0] << "," << argmax[1] << "}" << std::endl;
+        std::cout << "mean_rows: " << mat.mean_rows() << std::endl;
+        std::cout << "var_rows: " << mat.var_rows() << std::endl;
+        std::cout << "var_cols: " << mat.var_cols() << std::endl;
+
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        Matrix<float> with_nan({ {1, nan, 3}, {nan, nan, nan} });
+        auto nan_argmax = with_nan.argmax_cols();
+        std::cout << "argmax_cols with NaN: {" << nan_argmax[0] << "," << nan_argmax[1] << "}" << std::endl;
+        std::cout << "Reductions tested.\n" << std::endl;
+    }
+
+    // アリーナからの確保
+    {
+        std::cout << "Testing matrix arena...\n";
+        MatrixArena arena;
+        {
+            MatrixMemory::Scope scope(&arena);
+            Matrix<float> a({ {1, 2}, {3, 4} });
+            Matrix<float> b = a + a;
+            std::cout << "allocated from arena: " << (b.data().get_allocator().resource() == &arena) << std::endl;
+            std::cout << "used > 0: " << (arena.used() > 0) << std::endl;
+            std::cout << "a + a:\n" << b << std::endl;
+        }
+        const size_t upstream = arena.upstream_allocations();
+        arena.reset();
+        {
+            MatrixMemory::Scope scope(&arena);
+            Matrix<float> c({ {5, 6}, {7, 8} });
+            std::cout << "reused after reset: " << (arena.upstream_allocations() == upstream) << std::endl;
+        }
+        std::cout << "default resource restored: " << (MatrixMemory::current() == std::pmr::get_default_resource()) << std::endl;
+        std::cout << "Matrix arena tested.\n" << std::endl;
+    }
+
+    // コピーオンライト
+    {
+        std::cout << "Testing copy-on-write storage...\n";
+        SharedMatrix<float> a({ {1, 2}, {3, 4} });
+        SharedMatrix<float> b = a;
+        std::cout << "shared after copy: " << (a.data().data() == b.data().data()) << " (use_count " << a.data().use_count() << ")" << std::endl;
+
+        b(0, 0) = 10;
+        std::cout << "detached on write: " << (a.data().data() != b.data().data()) << std::endl;
+        std::cout << "a:\n" << a << "\nb:\n" << b << std::endl;
+
+        // スコープの中で作ったコピーはアリーナではなく既定のリソースから確保するため、reset() の後も使える
+        MatrixArena arena;
+        SharedMatrix<float> kept;
+        {
+            MatrixMemory::Scope scope(&arena);
+            SharedMatrix<float> c = a.add_copy(a);
+            kept = c;
+            std::cout << "not in arena: " << (arena.used() == 0) << std::endl;
+        }
+        arena.reset();
+        {
+            MatrixMemory::Scope scope(&arena);
+            Matrix<float> overwrite({ {-1, -1}, {-1, -1} });
+        }
+        std::cout << "copy survives reset:\n" << kept << std::endl;
+        std::cout << "Copy-on-write storage tested.\n" << std::endl;
+    }
+
+    // 一時オブジェクトの格納領域の再利用
+    {
+        std::cout << "Testing rvalue operators...\n";
+        Matrix<float> a({ {1, 2}, {3, 4} });
+        Matrix<float> b({ {10, 20}, {30, 40} });
+
+        Matrix<float> t = a.add_copy(b);
+        const float* storage = t.data().data();
+        Matrix<float> r = std::move(t) - b * 2.0f;
+        std::cout << "std::move(a + b) - b * 2:\n" << r << std::endl;
+        std::cout << "storage reused: " << (r.data().data() == storage) << std::endl;
+
+        Matrix<float> s = std::move(r).scalar_mul_copy(-1.0f);
+        std::cout << "storage reused by scalar_mul_copy &&: " << (s.data().data() == storage) << std::endl;
+        std::cout << "Rvalue operators tested.\n" << std::endl;
+    }
+
+    // カウンタベースの乱数
+    {
+        std::cout << "Testing counter-based RNG...\n";
+        Matrix<float> seq(300, 300), par(300, 300);
+        seq.fill_normal(0.0f, 1.0f, 42, 0);
+        par.fill_normal(0.0f, 1.0f, 42, 0, std::execution::par);
+        std::cout << "seq == par: " << (seq == par) << std::endl;
+
+        const double n = static_cast<double>(seq.rows() * seq.cols());
+        double sum = 0, sq = 0;
+        for (float x : std::as_const(seq).data()) { sum += x; sq += double(x) * x; }
+        const double mean = sum / n;
+        std::cout << "normal(0, 1) mean: " << mean << " variance: " << sq / n - mean * mean << std::endl;
+
+        Matrix<float> other(300, 300);
+        other.fill_normal(0.0f, 1.0f, 42, 1);
+        std::cout << "other stream differs: " << (other != seq) << std::endl;
+
+        Matrix<float> mask(300, 300);
+        mask.fill_bernoulli(0.25, 7, 0, std::execution::par);
+        double ones = 0;
+        for (float x : std::as_const(mask).data()) ones += x;
+        std::cout << "bernoulli(0.25) ratio: " << ones / n << std::endl;
+
+        Matrix<float> u(2, 4);
+        u.fill_uniform(-1.0f, 1.0f, 1);
+        std::cout << "uniform(-1, 1):\n" << u << std::endl;
+        std::cout << "Counter-based RNG tested.\n" << std::endl;
+    }
+
+    // 添字による行の収集と足し込み
+    {
+        std::cout << "Testing gather/scatter rows...\n";
+        Matrix<float> data({ {1, 2, 3}, {4, 5, 6}, {7, 8, 9}, {10, 11, 12} });
+        const std::vector<size_t> indices = { 3, 0, 3 };
+        Matrix<float> batch = data.gather_rows(indices, std::execution::par);
+        std::cout << "gather_rows {3, 0, 3}:\n" << batch << std::endl;
+
+        Matrix<float, false> col_data(data.rows(), data.cols());
+        for (size_t i = 0; i < data.rows(); i++)
+            for (size_t j = 0; j < data.cols(); j++)
+                col_data(i, j) = data(i, j);
+        std::cout << "column-major gather matches: " << (col_data.gather_rows(indices) == batch) << std::endl;
+
+        Matrix<float> acc(4, 3);
+        acc.scatter_add_rows(indices, batch, std::execution::par);
+        std::cout << "scatter_add_rows {3, 0, 3}:\n" << acc << std::endl;
+
+        // 添字で読むGEMMとコピーしてからのGEMMの比較
+        auto max_diff = [](const Matrix<float>& a, const Matrix<float>& b) {
+            float diff = 0;
+            for (size_t i = 0; i < a.rows(); i++)
+                for (size_t j = 0; j < a.cols(); j++)
+                    diff = std::max(diff, std::abs(a(i, j) - b(i, j)));
+            return diff;
+        };
+        Matrix<float> big(200, 70), w(70, 30);
+        big.fill_uniform(-1.0f, 1.0f, 3);
+        w.fill_uniform(-1.0f, 1.0f, 4);
+        std::vector<size_t> perm(big.rows());
+        for (size_t i = 0; i < perm.size(); i++)
+            perm[i] = (i * 37) % perm.size();
+        Matrix<float> fused(perm.size(), w.cols()), copied(perm.size(), w.cols());
+        gemm_gathered_into(fused, big, perm, w);
+        gemm_into(copied, big.gather_rows(perm), w);
+        std::cout << "gathered GEMM max diff: " << max_diff(fused, copied) << std::endl;
+
+        Matrix<float> dout(perm.size(), w.cols()), dw_fused(70, 30), dw_copied(70, 30);
+        dout.fill_uniform(-1.0f, 1.0f, 5);
+        gemm_gathered_into<false, true, false>(dw_fused, big, perm, dout);
+        gemm_into<false, true, false>(dw_copied, big.gather_rows(perm), dout);
+        std::cout << "gathered GEMM (transposed) max diff: " << max_diff(dw_fused, dw_copied) << std::endl;
+
+        try {
+            const std::vector<size_t> bad = { 4 };
+            data.gather_rows(bad);
+        } catch (const std::out_of_range& e) {
+            std::cout << "Caught expected exception: " << e.what() << std::endl;
+        }
+        std::cout << "Gather/scatter rows tested.\n" << std::endl;
+    }
+
+    // 行列演算のプロバイダの実行時の選択
+    {
+        std::cout << "Testing backend registry...\n";
+        auto& registry = Backend::Registry<float>::instance();
+        std::cout << "providers:";
+        for (const auto& provider : registry.providers())
+            std::cout << " " << provider.name;
+        std::cout << " (override: " << Backend::active_provider() << ")" << std::endl;
+
+        // 固定費が大きくスループットの高いプロバイダは大きな積だけで選ばれる
+        static size_t calls = 0;
+        Backend::Provider<float> counting;
+        counting.name = "counting";
+        counting.gemm = [](const float* A, const float* B, float* C, size_t M, size_t N, size_t K, bool AMajor, bool BMajor, bool TransA, bool TransB, float alpha, float beta, size_t lda, size_t ldb, size_t ldc) {
+            calls++;
+            NativeGemm::MatMul<float>::multiply(A, B, C, M, N, K, AMajor, BMajor, TransA, TransB, alpha, beta, lda, ldb, ldc);
+        };
+        counting.gemm_cost = { 1e6, 1e4, 0 };
+        registry.add(counting);
+        std::cout << "4x4x4 -> " << registry.select(Backend::Routine::Gemm, 4, 4, 4).name
+            << ", 512x512x512 -> " << registry.select(Backend::Routine::Gemm, 512, 512, 512).name
+            << ", axpy -> " << registry.select(Backend::Routine::Axpy, 1 << 20).name << std::endl;
+
+        Matrix<float> small_a(4, 4), small_b(4, 4), large_a(256, 256), large_b(256, 256);
+        small_a.fill_uniform(-1.0f, 1.0f, 1);
+        small_b.fill_uniform(-1.0f, 1.0f, 2);
+        large_a.fill_uniform(-1.0f, 1.0f, 3);
+        large_b.fill_uniform(-1.0f, 1.0f, 4);
+        Matrix<float> small_c = matmul<true>(small_a, small_b);
+        Matrix<float> large_c = matmul<true>(large_a, large_b);
+        std::cout << "calls after small and large products: " << calls << std::endl;
+        std::cout << "results match native: " << (small_c == matmul(small_a, small_b) && large_c == matmul(large_a, large_b)) << std::endl;
+
+        Backend::set_provider("native");
+        matmul<true>(large_a, large_b);
+        std::cout << "calls with override \"native\": " << calls << std::endl;
+        Backend::set_provider("auto");
+        std::cout << "removed: " << registry.remove("counting") << std::endl;
+
+        // axpy と scal はそれぞれ測った係数に置き換わる
+        registry.calibrate();
+        const auto& native = *std::find_if(registry.providers().begin(), registry.providers().end(), [](const auto& p) { return p.native; });
+        std::cout << "calibrated: axpy " << (native.vector_cost.flops_per_ns > 0) << ", scal " << (native.scal_cost.flops_per_ns > 0)
+            << " (separate models: " << (native.scal_cost.flops_per_ns != native.vector_cost.flops_per_ns) << ")" << std::endl;
+        std::cout << "Backend registry tested.\n" << std::endl;
+    }
 }
 
 #endif // MATRIXTEST_HPP
\ No newline at end of file
@@ -84,6 +84,14 @@ void run_nntest() {
         Matrix<float> output = a.predict(x);
         std::cout << "Predicted probabilities: " << d1 << " XOR " << d2 << " = " << (output.data()[0] < output.data()[1] ? "true" : "false") << std::endl;
     }
+
+    // int8 推論: 入力の全パターンで量子化の範囲を決めて Affine レイヤを置き換える
+    Matrix<float> calibration({ {0, 0}, {0, 1}, {1, 0}, {1, 1} });
+    Matrix<float> before = a.predict(calibration);
+    a.quantize(calibration);
+    Matrix<float> after = a.predict(calibration);
+    std::cout << "float predictions: " << before << std::endl;
+    std::cout << "int8 predictions:  " << after << std::endl;
 }
 
 #endif // SANAE_NNTEST_HPP
\ No newline at end of file